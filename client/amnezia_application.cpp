@@ -13,6 +13,7 @@
 #include <QLocalSocket>
 #include <QLocalServer>
 
+#include "core/keyPool.h"
 #include "logger.h"
 #include "ui/models/installedAppsModel.h"
 #include "version.h"
@@ -32,6 +33,7 @@
 
 AmneziaApplication::AmneziaApplication(int &argc, char *argv[]) : AMNEZIA_BASE_CLASS(argc, argv)
 {
+    m_startupTimer.start();
     setQuitOnLastWindowClosed(false);
 
     // Fix config file permissions
@@ -51,7 +53,10 @@ AmneziaApplication::AmneziaApplication(int &argc, char *argv[]) : AMNEZIA_BASE_C
 #endif
 
     m_settings = std::shared_ptr<Settings>(new Settings);
+    KeyPool::instance().setWatermark(m_settings->openVpnKeyPoolSize());
     m_nam = new QNetworkAccessManager(this);
+
+    logStartupPhase("settings");
 }
 
 AmneziaApplication::~AmneziaApplication()
@@ -86,7 +91,9 @@ void AmneziaApplication::init()
 
     initModels();
     loadTranslator();
+    logStartupPhase("models");
     initControllers();
+    logStartupPhase("controllers");
 
 #ifdef Q_OS_ANDROID
     if (!AndroidController::initLogging()) {
@@ -157,6 +164,7 @@ void AmneziaApplication::init()
     m_engine->addImportPath("qrc:/ui/qml/Modules/");
     m_engine->load(url);
     m_systemController->setQmlRoot(m_engine->rootObjects().value(0));
+    logStartupPhase("qml");
 
     bool enabled = m_settings->isSaveLogs();
 #ifndef Q_OS_ANDROID
@@ -299,6 +307,13 @@ void AmneziaApplication::startLocalServer() {
 }
 #endif
 
+void AmneziaApplication::logStartupPhase(const QString &phase)
+{
+    const qint64 elapsedMs = m_startupTimer.elapsed();
+    qDebug().noquote() << QString("Startup phase %1 took %2 ms, %3 ms since start").arg(phase).arg(elapsedMs - m_lastStartupPhaseMs).arg(elapsedMs);
+    m_lastStartupPhaseMs = elapsedMs;
+}
+
 QQmlApplicationEngine *AmneziaApplication::qmlEngine() const
 {
     return m_engine;
@@ -317,7 +332,9 @@ void AmneziaApplication::initModels()
     connect(m_serversModel.get(), &ServersModel::containersUpdated, m_containersModel.get(), &ContainersModel::updateModel);
     connect(m_serversModel.get(), &ServersModel::defaultServerContainersUpdated, m_defaultServerContainersModel.get(),
             &ContainersModel::updateModel);
-    m_serversModel->resetModel();
+    // key material is fetched and servers are decrypted on a worker, the qml shell doesn't wait for it
+    connect(m_serversModel.get(), &ServersModel::serversLoaded, this, [this]() { logStartupPhase("servers"); });
+    m_serversModel->resetModelAsync();
 
     m_languageModel.reset(new LanguageModel(m_settings, this));
     m_engine->rootContext()->setContextProperty("LanguageModel", m_languageModel.get());
@@ -447,6 +464,8 @@ void AmneziaApplication::initControllers()
     m_settingsController.reset(
             new SettingsController(m_serversModel, m_containersModel, m_languageModel, m_sitesModel, m_appSplitTunnelingModel, m_settings));
     m_engine->rootContext()->setContextProperty("SettingsController", m_settingsController.get());
+    // openConnection() takes the default server through ServersModel::getServerConfig(), which decrypts it
+    // if the startup worker hasn't got to it yet
     if (m_settingsController->isAutoConnectEnabled() && m_serversModel->getDefaultServerIndex() >= 0) {
         QTimer::singleShot(1000, this, [this]() { m_connectionController->openConnection(); });
     }
@@ -2,6 +2,7 @@
 #define AMNEZIA_APPLICATION_H
 
 #include <QCommandLineParser>
+#include <QElapsedTimer>
 #include <QNetworkAccessManager>
 #include <QQmlApplicationEngine>
 #include <QQmlContext>
@@ -84,7 +85,12 @@ private:
     void initModels();
     void initControllers();
 
+    void logStartupPhase(const QString &phase);
+
     QQmlApplicationEngine *m_engine {};
+
+    QElapsedTimer m_startupTimer;
+    qint64 m_lastStartupPhaseMs = 0;
     std::shared_ptr<Settings> m_settings;
 
     QSharedPointer<ContainerProps> m_containerProps;
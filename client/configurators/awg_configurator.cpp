@@ -8,11 +8,18 @@ AwgConfigurator::AwgConfigurator(std::shared_ptr<Settings> settings, const QShar
 {
 }
 
-QString AwgConfigurator::createConfig(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &containerConfig,
-                                      ErrorCode &errorCode)
+QStringList AwgConfigurator::createConfigs(const ServerCredentials &credentials, DockerContainer container,
+                                           const QJsonObject &containerConfig, int count, ErrorCode &errorCode)
 {
-    QString config = WireguardConfigurator::createConfig(credentials, container, containerConfig, errorCode);
+    QStringList configs = WireguardConfigurator::createConfigs(credentials, container, containerConfig, count, errorCode);
+    for (auto &config : configs) {
+        config = processAwgConfig(config, containerConfig);
+    }
+    return configs;
+}
 
+QString AwgConfigurator::processAwgConfig(const QString &config, const QJsonObject &containerConfig)
+{
     QJsonObject jsonConfig = QJsonDocument::fromJson(config.toUtf8()).object();
     QString awgConfig = jsonConfig.value(config_key::config).toString();
 
@@ -11,8 +11,11 @@ class AwgConfigurator : public WireguardConfigurator
 public:
     AwgConfigurator(std::shared_ptr<Settings> settings, const QSharedPointer<ServerController> &serverController, QObject *parent = nullptr);
 
-    QString createConfig(const ServerCredentials &credentials, DockerContainer container,
-                         const QJsonObject &containerConfig, ErrorCode &errorCode);
+    QStringList createConfigs(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &containerConfig,
+                              int count, ErrorCode &errorCode) override;
+
+private:
+    QString processAwgConfig(const QString &config, const QJsonObject &containerConfig);
 };
 
 #endif // AWGCONFIGURATOR_H
@@ -1,5 +1,6 @@
 #include "openvpn_configurator.h"
 
+#include <QDateTime>
 #include <QDebug>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -7,6 +8,7 @@
 #include <QString>
 #include <QTemporaryDir>
 #include <QTemporaryFile>
+#include <QtConcurrent>
 #if defined(Q_OS_ANDROID) || defined(Q_OS_IOS)
     #include <QGuiApplication>
 #else
@@ -20,52 +22,126 @@
 #include "settings.h"
 #include "utilities.h"
 
+#include <cstring>
+
 #include <openssl/pem.h>
 #include <openssl/rsa.h>
 #include <openssl/x509.h>
 
-OpenVpnConfigurator::OpenVpnConfigurator(std::shared_ptr<Settings> settings, const QSharedPointer<ServerController> &serverController,
-                                         QObject *parent)
-    : ConfiguratorBase(settings, serverController, parent)
+namespace
 {
-}
+    constexpr int tarBlockSize = 512;
+
+    // just enough of ustar to move a batch of small regular files in and out of a container in one stream
+    void appendTarEntry(QByteArray &archive, const QString &fileName, const QByteArray &data)
+    {
+        QByteArray header(tarBlockSize, '\0');
+        auto writeField = [&header](int offset, const QByteArray &value) {
+            std::memcpy(header.data() + offset, value.constData(), value.size());
+        };
+
+        writeField(0, fileName.toUtf8().left(99));
+        writeField(100, "0000644");
+        writeField(108, "0000000");
+        writeField(116, "0000000");
+        writeField(124, QByteArray::number(data.size(), 8).rightJustified(11, '0'));
+        writeField(136, QByteArray::number(QDateTime::currentSecsSinceEpoch(), 8).rightJustified(11, '0'));
+        header[156] = '0';
+        writeField(257, "ustar");
+        writeField(263, "00");
+
+        // the checksum is calculated with the checksum field itself filled with spaces
+        std::memset(header.data() + 148, ' ', 8);
+        unsigned int checksum = 0;
+        for (char c : std::as_const(header)) {
+            checksum += static_cast<unsigned char>(c);
+        }
+        writeField(148, QByteArray::number(checksum, 8).rightJustified(6, '0'));
+        header[154] = '\0';
 
-OpenVpnConfigurator::ConnectionData OpenVpnConfigurator::prepareOpenVpnConfig(const ServerCredentials &credentials,
-                                                                              DockerContainer container, ErrorCode &errorCode)
-{
-    OpenVpnConfigurator::ConnectionData connData = OpenVpnConfigurator::createCertRequest();
-    connData.host = credentials.hostName;
+        archive.append(header);
+        archive.append(data);
+        archive.append(QByteArray((tarBlockSize - data.size() % tarBlockSize) % tarBlockSize, '\0'));
+    }
 
-    if (connData.privKey.isEmpty() || connData.request.isEmpty()) {
-        errorCode = ErrorCode::OpenSslFailed;
-        return connData;
+    void finishTarArchive(QByteArray &archive)
+    {
+        archive.append(QByteArray(tarBlockSize * 2, '\0'));
     }
 
-    QString reqFileName = QString("%1/%2.req").arg(amnezia::protocols::openvpn::clientsDirPath).arg(connData.clientId);
+    QMap<QString, QByteArray> readTarArchive(const QByteArray &archive)
+    {
+        QMap<QString, QByteArray> files;
+
+        qsizetype offset = 0;
+        while (offset + tarBlockSize <= archive.size()) {
+            const char *header = archive.constData() + offset;
+            if (header[0] == '\0') {
+                break;
+            }
+
+            QString name = QString::fromUtf8(header, qstrnlen(header, 100));
+            const QString prefix = QString::fromUtf8(header + 345, qstrnlen(header + 345, 155));
+            if (!prefix.isEmpty()) {
+                name = prefix + "/" + name;
+            }
+            if (name.startsWith("./")) {
+                name.remove(0, 2);
+            }
+
+            bool ok = false;
+            const qsizetype size = QByteArray(header + 124, qstrnlen(header + 124, 12)).trimmed().toLongLong(&ok, 8);
+            offset += tarBlockSize;
+            if (!ok || offset + size > archive.size()) {
+                break;
+            }
+
+            const char type = header[156];
+            if (type == '0' || type == '\0') {
+                files.insert(name, archive.mid(offset, size));
+            }
+            offset += (size + tarBlockSize - 1) / tarBlockSize * tarBlockSize;
+        }
 
-    errorCode = m_serverController->uploadTextFileToContainer(container, credentials, connData.request, reqFileName);
-    if (errorCode != ErrorCode::NoError) {
-        return connData;
+        return files;
     }
+}
 
-    errorCode = signCert(container, credentials, connData.clientId);
-    if (errorCode != ErrorCode::NoError) {
-        return connData;
-    }
+OpenVpnConfigurator::OpenVpnConfigurator(std::shared_ptr<Settings> settings, const QSharedPointer<ServerController> &serverController,
+                                         QObject *parent)
+    : ConfiguratorBase(settings, serverController, parent)
+{
+}
 
-    connData.caCert =
-            m_serverController->getTextFileFromContainer(container, credentials, amnezia::protocols::openvpn::caCertPath, errorCode);
-    connData.clientCert = m_serverController->getTextFileFromContainer(
-            container, credentials, QString("%1/%2.crt").arg(amnezia::protocols::openvpn::clientCertPath).arg(connData.clientId), errorCode);
+void OpenVpnConfigurator::warmUpKeyPool(const Settings &settings)
+{
+    KeyPool::instance().warmUp(keyType(settings));
+}
 
-    if (errorCode != ErrorCode::NoError) {
-        return connData;
-    }
+KeyPool::KeyType OpenVpnConfigurator::keyType(const Settings &settings)
+{
+    return settings.isOpenVpnEcKeysEnabled() ? KeyPool::KeyType::EcP256 : KeyPool::KeyType::Rsa2048;
+}
 
-    connData.taKey = m_serverController->getTextFileFromContainer(container, credentials, amnezia::protocols::openvpn::taKeyPath, errorCode);
+QList<OpenVpnConfigurator::ConnectionData> OpenVpnConfigurator::prepareOpenVpnConfigs(const ServerCredentials &credentials,
+                                                                                     DockerContainer container, int count,
+                                                                                     ErrorCode &errorCode)
+{
+    QList<ConnectionData> connData(count);
+    const KeyPool::KeyType type = keyType(*m_settings);
+    QtConcurrent::blockingMap(connData, [type](ConnectionData &data) { data = createCertRequest(type); });
+
+    for (auto &data : connData) {
+        data.host = credentials.hostName;
+        if (data.privKey.isEmpty() || data.request.isEmpty()) {
+            errorCode = ErrorCode::OpenSslFailed;
+            return {};
+        }
+    }
 
-    if (connData.caCert.isEmpty() || connData.clientCert.isEmpty() || connData.taKey.isEmpty()) {
-        errorCode = ErrorCode::SshScpFailureError;
+    errorCode = signCerts(container, credentials, connData);
+    if (errorCode != ErrorCode::NoError) {
+        return {};
     }
 
     return connData;
@@ -73,36 +149,48 @@ OpenVpnConfigurator::ConnectionData OpenVpnConfigurator::prepareOpenVpnConfig(co
 
 QString OpenVpnConfigurator::createConfig(const ServerCredentials &credentials, DockerContainer container,
                                           const QJsonObject &containerConfig, ErrorCode &errorCode)
+{
+    return createConfigs(credentials, container, containerConfig, 1, errorCode).value(0);
+}
+
+QStringList OpenVpnConfigurator::createConfigs(const ServerCredentials &credentials, DockerContainer container,
+                                               const QJsonObject &containerConfig, int count, ErrorCode &errorCode)
 {
     QString config = m_serverController->replaceVars(amnezia::scriptData(ProtocolScriptType::openvpn_template, container),
                                                      m_serverController->genVarsForScript(credentials, container, containerConfig));
 
-    ConnectionData connData = prepareOpenVpnConfig(credentials, container, errorCode);
+    const QList<ConnectionData> connData = prepareOpenVpnConfigs(credentials, container, count, errorCode);
     if (errorCode != ErrorCode::NoError) {
-        return "";
+        return {};
     }
 
-    config.replace("$OPENVPN_CA_CERT", connData.caCert);
-    config.replace("$OPENVPN_CLIENT_CERT", connData.clientCert);
-    config.replace("$OPENVPN_PRIV_KEY", connData.privKey);
-
-    if (config.contains("$OPENVPN_TA_KEY")) {
-        config.replace("$OPENVPN_TA_KEY", connData.taKey);
-    } else {
-        config.replace("<tls-auth>", "");
-        config.replace("</tls-auth>", "");
-    }
+    QStringList configs;
+    for (const auto &data : connData) {
+        QString clientConfig = config;
+        clientConfig.replace("$OPENVPN_CA_CERT", data.caCert);
+        clientConfig.replace("$OPENVPN_CLIENT_CERT", data.clientCert);
+        clientConfig.replace("$OPENVPN_PRIV_KEY", data.privKey);
+
+        if (clientConfig.contains("$OPENVPN_TA_KEY")) {
+            clientConfig.replace("$OPENVPN_TA_KEY", data.taKey);
+        } else {
+            clientConfig.replace("<tls-auth>", "");
+            clientConfig.replace("</tls-auth>", "");
+        }
 
 #ifndef MZ_WINDOWS
-    config.replace("block-outside-dns", "");
+        clientConfig.replace("block-outside-dns", "");
 #endif
 
-    QJsonObject jConfig;
-    jConfig[config_key::config] = config;
+        QJsonObject jConfig;
+        jConfig[config_key::config] = clientConfig;
+
+        jConfig[config_key::clientId] = data.clientId;
 
-    jConfig[config_key::clientId] = connData.clientId;
+        configs.append(QJsonDocument(jConfig).toJson());
+    }
 
-    return QJsonDocument(jConfig).toJson();
+    return configs;
 }
 
 QString OpenVpnConfigurator::processConfigWithLocalSettings(const QPair<QString, QString> &dns, const bool isApiConfig,
@@ -179,26 +267,60 @@ QString OpenVpnConfigurator::processConfigWithExportSettings(const QPair<QString
     return QJsonDocument(json).toJson();
 }
 
-ErrorCode OpenVpnConfigurator::signCert(DockerContainer container, const ServerCredentials &credentials, QString clientId)
+ErrorCode OpenVpnConfigurator::signCerts(DockerContainer container, const ServerCredentials &credentials,
+                                         QList<ConnectionData> &connData)
 {
-    QString script_import = QString("sudo docker exec -i %1 bash -c \"cd /opt/amnezia/openvpn && "
-                                    "easyrsa import-req %2/%3.req %3\"")
-                                    .arg(ContainerProps::containerToString(container))
-                                    .arg(amnezia::protocols::openvpn::clientsDirPath)
-                                    .arg(clientId);
+    QByteArray requests;
+    for (const auto &data : connData) {
+        appendTarEntry(requests, data.clientId + ".req", data.request.toUtf8());
+    }
+    finishTarArchive(requests);
+
+    // requests are unpacked into the clients dir, imported and signed one by one, then the signed certificates
+    // are sent back together with the ca and tls-auth keys as a single hex encoded tar
+    QString script = QString("sudo docker exec -i $CONTAINER_NAME bash -c '"
+                             "cd /opt/amnezia/openvpn && export EASYRSA_BATCH=1 && certs=\"\" && "
+                             "for req in $(tar -xvf - -C %1); do id=${req%.req}; "
+                             "easyrsa import-req %1/$req $id > /dev/null 2>&1 && easyrsa sign-req client $id > /dev/null 2>&1 "
+                             "|| { echo \"Failed to sign $id\" >&2; exit 1; }; "
+                             "certs=\"$certs pki/issued/$id.crt\"; done; "
+                             "tar -cf - pki/ca.crt ta.key $certs | xxd -p'")
+                             .arg(amnezia::protocols::openvpn::clientsDirPath);
+    script = m_serverController->replaceVars(script, m_serverController->genVarsForScript(credentials, container));
+
+    QString stdOut;
+    auto cbReadStdOut = [&](const QString &data, libssh::Client &) {
+        stdOut += data;
+        return ErrorCode::NoError;
+    };
+    auto cbReadStdErr = [&](const QString &data, libssh::Client &) {
+        qDebug().noquote() << "OpenVpnConfigurator::signCerts" << data;
+        return ErrorCode::NoError;
+    };
+
+    ErrorCode errorCode = m_serverController->runCommandWithInput(credentials, script, requests, cbReadStdOut, cbReadStdErr);
+    if (errorCode != ErrorCode::NoError) {
+        return errorCode;
+    }
+
+    const QMap<QString, QByteArray> files = readTarArchive(QByteArray::fromHex(stdOut.toUtf8()));
+    const QString caCert = files.value("pki/ca.crt");
+    const QString taKey = files.value("ta.key");
 
-    QString script_sign = QString("sudo docker exec -i %1 bash -c \"export EASYRSA_BATCH=1; cd /opt/amnezia/openvpn && "
-                                  "easyrsa sign-req client %2\"")
-                                  .arg(ContainerProps::containerToString(container))
-                                  .arg(clientId);
+    for (auto &data : connData) {
+        data.caCert = caCert;
+        data.taKey = taKey;
+        data.clientCert = files.value(QString("pki/issued/%1.crt").arg(data.clientId));
 
-    QStringList scriptList { script_import, script_sign };
-    QString script = m_serverController->replaceVars(scriptList.join("\n"), m_serverController->genVarsForScript(credentials, container));
+        if (data.caCert.isEmpty() || data.clientCert.isEmpty() || data.taKey.isEmpty()) {
+            return ErrorCode::SshScpFailureError;
+        }
+    }
 
-    return m_serverController->runScript(credentials, script);
+    return ErrorCode::NoError;
 }
 
-OpenVpnConfigurator::ConnectionData OpenVpnConfigurator::createCertRequest()
+OpenVpnConfigurator::ConnectionData OpenVpnConfigurator::createCertRequest(KeyPool::KeyType keyType)
 {
     ConnectionData connData;
     connData.clientId = Utils::getRandomString(32);
@@ -208,11 +330,11 @@ OpenVpnConfigurator::ConnectionData OpenVpnConfigurator::createCertRequest()
 
     QByteArray clientIdUtf8 = connData.clientId.toUtf8();
 
-    EVP_PKEY *pKey = EVP_PKEY_new();
-    q_check_ptr(pKey);
-    RSA *rsa = RSA_generate_key(2048, RSA_F4, nullptr, nullptr);
-    q_check_ptr(rsa);
-    EVP_PKEY_assign_RSA(pKey, rsa);
+    EVP_PKEY *pKey = KeyPool::instance().takeKey(keyType);
+    if (!pKey) {
+        qWarning() << "Could not generate a private key!";
+        return connData;
+    }
 
     // 2. set version of x509 req
     X509_REQ *x509_req = X509_REQ_new();
@@ -283,7 +405,7 @@ OpenVpnConfigurator::ConnectionData OpenVpnConfigurator::createCertRequest()
     connData.request = QByteArray(bio_buf->data, bio_buf->length);
     BIO_free(bio_req);
 
-    EVP_PKEY_free(pKey); // this will also free the rsa key
+    EVP_PKEY_free(pKey);
 
     return connData;
 }
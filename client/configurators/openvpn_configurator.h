@@ -6,6 +6,7 @@
 
 #include "configurator_base.h"
 #include "core/defs.h"
+#include "core/keyPool.h"
 
 class OpenVpnConfigurator : public ConfiguratorBase
 {
@@ -26,18 +27,26 @@ public:
 
     QString createConfig(const ServerCredentials &credentials, DockerContainer container,
                          const QJsonObject &containerConfig, ErrorCode &errorCode);
+    // all certificate requests are signed by a single docker exec on the server
+    QStringList createConfigs(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &containerConfig,
+                              int count, ErrorCode &errorCode);
 
     QString processConfigWithLocalSettings(const QPair<QString, QString> &dns, const bool isApiConfig,
                                            QString &protocolConfigString);
     QString processConfigWithExportSettings(const QPair<QString, QString> &dns, const bool isApiConfig,
                                             QString &protocolConfigString);
 
-    static ConnectionData createCertRequest();
+    static ConnectionData createCertRequest(KeyPool::KeyType keyType = KeyPool::KeyType::Rsa2048);
+
+    // starts generating the keys of the type the settings ask for, called where client configs are about to be created
+    static void warmUpKeyPool(const Settings &settings);
 
 private:
-    ConnectionData prepareOpenVpnConfig(const ServerCredentials &credentials, DockerContainer container,
-                                        ErrorCode &errorCode);
-    ErrorCode signCert(DockerContainer container, const ServerCredentials &credentials, QString clientId);
+    static KeyPool::KeyType keyType(const Settings &settings);
+
+    QList<ConnectionData> prepareOpenVpnConfigs(const ServerCredentials &credentials, DockerContainer container, int count,
+                                                ErrorCode &errorCode);
+    ErrorCode signCerts(DockerContainer container, const ServerCredentials &credentials, QList<ConnectionData> &connData);
 };
 
 #endif // OPENVPN_CONFIGURATOR_H
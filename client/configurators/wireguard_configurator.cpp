@@ -3,6 +3,7 @@
 #include <QDebug>
 #include <QJsonDocument>
 #include <QProcess>
+#include <QtConcurrent>
 #include <QString>
 #include <QTemporaryDir>
 #include <QTemporaryFile>
@@ -26,6 +27,7 @@ WireguardConfigurator::WireguardConfigurator(std::shared_ptr<Settings> settings,
     m_serverConfigPath = m_isAwg ? amnezia::protocols::awg::serverConfigPath : amnezia::protocols::wireguard::serverConfigPath;
     m_serverPublicKeyPath = m_isAwg ? amnezia::protocols::awg::serverPublicKeyPath : amnezia::protocols::wireguard::serverPublicKeyPath;
     m_serverPskKeyPath = m_isAwg ? amnezia::protocols::awg::serverPskKeyPath : amnezia::protocols::wireguard::serverPskKeyPath;
+    m_ipPoolPath = m_isAwg ? amnezia::protocols::awg::ipPoolPath : amnezia::protocols::wireguard::ipPoolPath;
     m_configTemplate = m_isAwg ? ProtocolScriptType::awg_template : ProtocolScriptType::wireguard_template;
 
     m_protocolName = m_isAwg ? config_key::awg : config_key::wireguard;
@@ -44,9 +46,8 @@ WireguardConfigurator::ConnectionData WireguardConfigurator::genClientKeys()
     if (ret <= 0)
         return connData;
 
-    EVP_PKEY *pKey = EVP_PKEY_new();
+    EVP_PKEY *pKey = EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, NULL, &buff[0], EDDSA_KEY_LENGTH);
     q_check_ptr(pKey);
-    pKey = EVP_PKEY_new_raw_private_key(EVP_PKEY_X25519, NULL, &buff[0], EDDSA_KEY_LENGTH);
 
     size_t keySize = EDDSA_KEY_LENGTH;
 
@@ -60,105 +61,94 @@ WireguardConfigurator::ConnectionData WireguardConfigurator::genClientKeys()
     EVP_PKEY_get_raw_public_key(pKey, pub, &keySize);
     connData.clientPubKey = QByteArray::fromRawData((char *)pub, keySize).toBase64();
 
+    EVP_PKEY_free(pKey);
     return connData;
 }
 
-WireguardConfigurator::ConnectionData WireguardConfigurator::prepareWireguardConfig(const ServerCredentials &credentials,
-                                                                                    DockerContainer container,
-                                                                                    const QJsonObject &containerConfig, ErrorCode &errorCode)
+QList<WireguardConfigurator::ConnectionData> WireguardConfigurator::genClientKeys(int count)
 {
-    WireguardConfigurator::ConnectionData connData = WireguardConfigurator::genClientKeys();
-    connData.host = credentials.hostName;
-    connData.port = containerConfig.value(m_protocolName).toObject().value(config_key::port).toString(m_defaultPort);
-
-    if (connData.clientPrivKey.isEmpty() || connData.clientPubKey.isEmpty()) {
-        errorCode = ErrorCode::InternalError;
-        return connData;
-    }
-
-    // Get list of already created clients (only IP addresses)
-    QString nextIpNumber;
-    {
-        QString script = QString("cat %1 | grep AllowedIPs").arg(m_serverConfigPath);
-        QString stdOut;
-        auto cbReadStdOut = [&](const QString &data, libssh::Client &) {
-            stdOut += data + "\n";
-            return ErrorCode::NoError;
-        };
-
-        errorCode = m_serverController->runContainerScript(credentials, container, script, cbReadStdOut);
-        if (errorCode != ErrorCode::NoError) {
-            return connData;
-        }
+    QList<ConnectionData> keys(count);
+    QtConcurrent::blockingMap(keys, [](ConnectionData &connData) { connData = genClientKeys(); });
+    return keys;
+}
 
-        stdOut.replace("AllowedIPs = ", "");
-        stdOut.replace("/32", "");
-        QStringList ips = stdOut.split("\n", Qt::SkipEmptyParts);
-
-        // remove extra IPs from each line for case when user manually edited the wg0.conf
-        // and added there more IPs for route his itnernal networks, like:
-        //     ...
-        //     AllowedIPs = 10.8.1.6/32, 192.168.1.0/24, 192.168.2.0/24, ...
-        //     ...
-        // without this code - next IP would be 1 if last item in 'ips' has format above
-        QStringList vpnIps;
-        for (const auto &ip : ips) {
-          vpnIps.append(ip.split(",", Qt::SkipEmptyParts).first().trimmed());
-        }
-        ips = vpnIps;
-
-        // Calc next IP address
-        if (ips.isEmpty()) {
-            nextIpNumber = "2";
-        } else {
-            int next = ips.last().split(".").last().toInt() + 1;
-            if (next > 254) {
-                errorCode = ErrorCode::AddressPoolError;
-                return connData;
-            }
-            nextIpNumber = QString::number(next);
+QList<WireguardConfigurator::ConnectionData> WireguardConfigurator::prepareWireguardConfigs(const ServerCredentials &credentials,
+                                                                                           DockerContainer container,
+                                                                                           const QJsonObject &containerConfig, int count,
+                                                                                           ErrorCode &errorCode)
+{
+    QList<ConnectionData> clients = WireguardConfigurator::genClientKeys(count);
+    const QString port = containerConfig.value(m_protocolName).toObject().value(config_key::port).toString(m_defaultPort);
+    for (auto &connData : clients) {
+        if (connData.clientPrivKey.isEmpty() || connData.clientPubKey.isEmpty()) {
+            errorCode = ErrorCode::InternalError;
+            return {};
         }
+        connData.host = credentials.hostName;
+        connData.port = port;
     }
 
-    QString subnetIp = containerConfig.value(config_key::subnet_address).toString(protocols::wireguard::defaultSubnetAddress);
-    {
-        QStringList l = subnetIp.split(".", Qt::SkipEmptyParts);
-        if (l.isEmpty()) {
-            errorCode = ErrorCode::AddressPoolError;
-            return connData;
-        }
-        l.removeLast();
-        l.append(nextIpNumber);
+    IpAllocator allocator = createIpAllocator(containerConfig);
+    if (!allocator.isValid()) {
+        errorCode = ErrorCode::AddressPoolError;
+        return {};
+    }
 
-        connData.clientIP = l.join(".");
+    errorCode = loadIpPool(credentials, container, allocator);
+    if (errorCode != ErrorCode::NoError) {
+        return {};
     }
 
     // Get keys
-    connData.serverPubKey = m_serverController->getTextFileFromContainer(container, credentials, m_serverPublicKeyPath, errorCode);
-    connData.serverPubKey.replace("\n", "");
+    QString serverPubKey = m_serverController->getTextFileFromContainer(container, credentials, m_serverPublicKeyPath, errorCode);
+    serverPubKey.replace("\n", "");
     if (errorCode != ErrorCode::NoError) {
-        return connData;
+        return {};
     }
 
-    connData.pskKey = m_serverController->getTextFileFromContainer(container, credentials, m_serverPskKeyPath, errorCode);
-    connData.pskKey.replace("\n", "");
-
+    QString pskKey = m_serverController->getTextFileFromContainer(container, credentials, m_serverPskKeyPath, errorCode);
+    pskKey.replace("\n", "");
     if (errorCode != ErrorCode::NoError) {
-        return connData;
+        return {};
     }
 
-    // Add client to config
-    QString configPart = QString("[Peer]\n"
-                                 "PublicKey = %1\n"
-                                 "PresharedKey = %2\n"
-                                 "AllowedIPs = %3/32\n\n")
-                                 .arg(connData.clientPubKey, connData.pskKey, connData.clientIP);
+    for (auto &connData : clients) {
+        connData.serverPubKey = serverPubKey;
+        connData.pskKey = pskKey;
+    }
 
-    errorCode = m_serverController->uploadTextFileToContainer(container, credentials, configPart, m_serverConfigPath,
-                                                              libssh::ScpOverwriteMode::ScpAppendToExisting);
+    // Another admin may take the same addresses between loading the pool and appending the peers,
+    // in that case the pool is reloaded and the next free addresses are tried
+    constexpr int maxAllocationAttempts = 3;
+    for (int attempt = 0;; attempt++) {
+        if (allocator.capacity() - allocator.allocatedCount() < count) {
+            errorCode = ErrorCode::AddressPoolError;
+            return {};
+        }
+        for (auto &connData : clients) {
+            connData.clientIP = allocator.allocate().toString();
+        }
 
-    if (errorCode != ErrorCode::NoError) {
-        return connData;
+        bool isConflict = false;
+        errorCode = appendPeers(credentials, container, clients, isConflict);
+        if (errorCode != ErrorCode::NoError) {
+            return {};
+        }
+        if (!isConflict) {
+            break;
+        }
+
+        if (attempt + 1 == maxAllocationAttempts) {
+            errorCode = ErrorCode::AddressPoolError;
+            return {};
+        }
+        qDebug() << "WireguardConfigurator: client ips were taken concurrently, retrying";
+
+        allocator = createIpAllocator(containerConfig);
+        errorCode = loadIpPool(credentials, container, allocator);
+        if (errorCode != ErrorCode::NoError) {
+            return {};
+        }
     }
 
     QString script = QString("sudo docker exec -i $CONTAINER_NAME bash -c 'wg syncconf wg0 <(wg-quick strip %1)'").arg(m_serverConfigPath);
@@ -166,21 +156,117 @@ WireguardConfigurator::ConnectionData WireguardConfigurator::prepareWireguardCon
     errorCode = m_serverController->runScript(
             credentials, m_serverController->replaceVars(script, m_serverController->genVarsForScript(credentials, container)));
 
-    return connData;
+    return clients;
+}
+
+IpAllocator WireguardConfigurator::createIpAllocator(const QJsonObject &containerConfig) const
+{
+    const QJsonObject protocolConfig = containerConfig.value(m_protocolName).toObject();
+    const QString subnetAddress = protocolConfig.value(config_key::subnet_address)
+                                          .toString(containerConfig.value(config_key::subnet_address)
+                                                            .toString(protocols::wireguard::defaultSubnetAddress));
+    const QString subnetCidr = protocolConfig.value(config_key::subnet_cidr)
+                                       .toString(containerConfig.value(config_key::subnet_cidr).toString(protocols::wireguard::defaultSubnetCidr));
+
+    return IpAllocator(subnetAddress, subnetCidr.toInt());
+}
+
+ErrorCode WireguardConfigurator::loadIpPool(const ServerCredentials &credentials, DockerContainer container, IpAllocator &allocator)
+{
+    // the pool file holds addresses handed out by the allocator, wg0.conf covers peers added before it existed or by hand
+    const QString script = QString("cat %1 2>/dev/null; grep AllowedIPs %2").arg(m_ipPoolPath, m_serverConfigPath);
+
+    QString stdOut;
+    auto cbReadStdOut = [&](const QString &data, libssh::Client &) {
+        stdOut += data + "\n";
+        return ErrorCode::NoError;
+    };
+
+    ErrorCode errorCode = m_serverController->runContainerScript(credentials, container, script, cbReadStdOut);
+    if (errorCode != ErrorCode::NoError) {
+        return errorCode;
+    }
+
+    for (QString line : stdOut.split("\n", Qt::SkipEmptyParts)) {
+        line.remove("AllowedIPs = ");
+
+        // only the first address of a peer belongs to the vpn subnet, the rest are routed networks
+        // added by hand, like AllowedIPs = 10.8.1.6/32, 192.168.1.0/24
+        const QString ip = line.split(",", Qt::SkipEmptyParts).value(0).split("/").first().trimmed();
+        allocator.markAllocated(QHostAddress(ip));
+    }
+
+    return ErrorCode::NoError;
+}
+
+ErrorCode WireguardConfigurator::appendPeers(const ServerCredentials &credentials, DockerContainer container,
+                                             const QList<ConnectionData> &peers, bool &isConflict)
+{
+    QStringList clientIps;
+    QString configPart;
+    for (const auto &peer : peers) {
+        clientIps.append(peer.clientIP);
+        configPart += QString("[Peer]\n"
+                              "PublicKey = %1\n"
+                              "PresharedKey = %2\n"
+                              "AllowedIPs = %3/32\n\n")
+                              .arg(peer.clientPubKey, peer.pskKey, peer.clientIP);
+    }
+
+    // checking that the addresses are still free and appending the peers happen under one lock on the server
+    const QString script = QString("exec 9>%1.lock\n"
+                                   "flock -x 9\n"
+                                   "for ip in %3; do\n"
+                                   "  if grep -qsxF \"$ip\" %1 || grep -qsF \"AllowedIPs = $ip/32\" %2; then\n"
+                                   "    echo \"IP_POOL_CONFLICT $ip\"\n"
+                                   "    exit 0\n"
+                                   "  fi\n"
+                                   "done\n"
+                                   "cat >> %2 <<'AMNEZIA_PEERS_EOF'\n"
+                                   "%4"
+                                   "AMNEZIA_PEERS_EOF\n"
+                                   "printf '%s\\n' %3 >> %1\n")
+                                   .arg(m_ipPoolPath, m_serverConfigPath, clientIps.join(" "), configPart);
+
+    QString stdOut;
+    auto cbReadStdOut = [&](const QString &data, libssh::Client &) {
+        stdOut += data + "\n";
+        return ErrorCode::NoError;
+    };
+
+    ErrorCode errorCode = m_serverController->runContainerScript(credentials, container, script, cbReadStdOut);
+    isConflict = stdOut.contains("IP_POOL_CONFLICT");
+    return errorCode;
 }
 
 QString WireguardConfigurator::createConfig(const ServerCredentials &credentials, DockerContainer container,
                                             const QJsonObject &containerConfig, ErrorCode &errorCode)
+{
+    return createConfigs(credentials, container, containerConfig, 1, errorCode).value(0);
+}
+
+QStringList WireguardConfigurator::createConfigs(const ServerCredentials &credentials, DockerContainer container,
+                                                 const QJsonObject &containerConfig, int count, ErrorCode &errorCode)
 {
     QString scriptData = amnezia::scriptData(m_configTemplate, container);
-    QString config =
+    QString configTemplate =
             m_serverController->replaceVars(scriptData, m_serverController->genVarsForScript(credentials, container, containerConfig));
 
-    ConnectionData connData = prepareWireguardConfig(credentials, container, containerConfig, errorCode);
+    const QList<ConnectionData> clients = prepareWireguardConfigs(credentials, container, containerConfig, count, errorCode);
     if (errorCode != ErrorCode::NoError) {
-        return "";
+        return {};
     }
 
+    QStringList configs;
+    configs.reserve(clients.size());
+    for (const auto &connData : clients) {
+        configs.append(buildClientConfig(configTemplate, connData, containerConfig));
+    }
+    return configs;
+}
+
+QString WireguardConfigurator::buildClientConfig(QString config, const ConnectionData &connData, const QJsonObject &containerConfig)
+{
     config.replace("$WIREGUARD_CLIENT_PRIVATE_KEY", connData.clientPrivKey);
     config.replace("$WIREGUARD_CLIENT_IP", connData.clientIP);
     config.replace("$WIREGUARD_SERVER_PUBLIC_KEY", connData.serverPubKey);
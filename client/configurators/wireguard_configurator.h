@@ -6,6 +6,7 @@
 
 #include "configurator_base.h"
 #include "core/defs.h"
+#include "core/ipAllocator.h"
 #include "core/scripts_registry.h"
 
 class WireguardConfigurator : public ConfiguratorBase
@@ -29,19 +30,32 @@ public:
     QString createConfig(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &containerConfig,
                          ErrorCode &errorCode);
 
+    // Creates count clients at once: keys are generated locally in parallel, all peers are appended to the server
+    // config in one upload and applied with a single wg syncconf
+    virtual QStringList createConfigs(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &containerConfig,
+                                      int count, ErrorCode &errorCode);
+
     QString processConfigWithLocalSettings(const QPair<QString, QString> &dns, const bool isApiConfig, QString &protocolConfigString);
     QString processConfigWithExportSettings(const QPair<QString, QString> &dns, const bool isApiConfig, QString &protocolConfigString);
 
     static ConnectionData genClientKeys();
+    static QList<ConnectionData> genClientKeys(int count);
 
 private:
-    ConnectionData prepareWireguardConfig(const ServerCredentials &credentials, DockerContainer container,
-                                          const QJsonObject &containerConfig, ErrorCode &errorCode);
+    QList<ConnectionData> prepareWireguardConfigs(const ServerCredentials &credentials, DockerContainer container,
+                                                  const QJsonObject &containerConfig, int count, ErrorCode &errorCode);
+    QString buildClientConfig(QString config, const ConnectionData &connData, const QJsonObject &containerConfig);
+
+    ErrorCode loadIpPool(const ServerCredentials &credentials, DockerContainer container, IpAllocator &allocator);
+    ErrorCode appendPeers(const ServerCredentials &credentials, DockerContainer container, const QList<ConnectionData> &peers,
+                          bool &isConflict);
+    IpAllocator createIpAllocator(const QJsonObject &containerConfig) const;
 
     bool m_isAwg;
     QString m_serverConfigPath;
     QString m_serverPublicKeyPath;
     QString m_serverPskKeyPath;
+    QString m_ipPoolPath;
     amnezia::ProtocolScriptType m_configTemplate;
     QString m_protocolName;
     QString m_defaultPort;
@@ -12,6 +12,13 @@
 
 namespace {
 Logger logger("XrayConfigurator");
+
+constexpr char apiSuccessMarker[] = "XRAY_API_OK";
+
+QString runtimeApiServer()
+{
+    return QString("%1:%2").arg(amnezia::protocols::xray::apiAddress).arg(amnezia::protocols::xray::apiPort);
+}
 }
 
 XrayConfigurator::XrayConfigurator(std::shared_ptr<Settings> settings, const QSharedPointer<ServerController> &serverController, QObject *parent)
@@ -72,23 +79,29 @@ QString XrayConfigurator::prepareServerConfig(const ServerCredentials &credentia
         return "";
     }
 
-    QJsonArray clients = settings["clients"].toArray();
-    
     // Create configuration for new client
     QJsonObject clientConfig {
         {"id", clientId},
-        {"flow", "xtls-rprx-vision"}
+        {"flow", "xtls-rprx-vision"},
+        {"email", clientId}
     };
-    
+
+    // Servers installed before the runtime api was used need one restart to start serving it
+    const bool isRestartRequired = enableRuntimeApi(serverConfig);
+
+    inbounds = serverConfig["inbounds"].toArray();
+    inbound = inbounds[0].toObject();
+    settings = inbound["settings"].toObject();
+    QJsonArray clients = settings["clients"].toArray();
     clients.append(clientConfig);
-    
+
     // Update config
     settings["clients"] = clients;
     inbound["settings"] = settings;
     inbounds[0] = inbound;
     serverConfig["inbounds"] = inbounds;
-    
-    // Save updated config to server
+
+    // Save updated config to server, the running xray only reads it again after a restart
     QString updatedConfig = QJsonDocument(serverConfig).toJson();
     errorCode = m_serverController->uploadTextFileToContainer(
         container, 
@@ -102,6 +115,21 @@ QString XrayConfigurator::prepareServerConfig(const ServerCredentials &credentia
         return "";
     }
 
+    if (!isRestartRequired) {
+        bool isApplied = false;
+        errorCode = addUserAtRuntime(m_serverController, credentials, container, inbound, clientConfig, isApplied);
+        if (errorCode != ErrorCode::NoError) {
+            logger.error() << "Failed to add the client through the xray api";
+            return "";
+        }
+        if (isApplied) {
+            return clientId;
+        }
+        // containers built from an image before the v24.12.31 bump have no adu/rmu commands and keep restarting
+        // on every client change, as before the api was used, until the container is reinstalled
+        logger.warning() << "The xray api is not available, restarting the container";
+    }
+
     // Restart container
     QString restartScript = QString("sudo docker restart $CONTAINER_NAME");
     errorCode = m_serverController->runScript(
@@ -117,6 +145,140 @@ QString XrayConfigurator::prepareServerConfig(const ServerCredentials &credentia
     return clientId;
 }
 
+bool XrayConfigurator::enableRuntimeApi(QJsonObject &serverConfig)
+{
+    bool isChanged = false;
+
+    QJsonArray inbounds = serverConfig["inbounds"].toArray();
+    bool hasApiInbound = false;
+    for (int i = 0; i < inbounds.size(); i++) {
+        QJsonObject inbound = inbounds[i].toObject();
+        if (inbound["tag"].toString() == amnezia::protocols::xray::apiTag) {
+            hasApiInbound = true;
+            continue;
+        }
+        if (i != 0) {
+            continue;
+        }
+
+        if (inbound["tag"].toString().isEmpty()) {
+            inbound["tag"] = amnezia::protocols::xray::inboundTag;
+            isChanged = true;
+        }
+
+        QJsonObject settings = inbound["settings"].toObject();
+        QJsonArray clients = settings["clients"].toArray();
+        for (int j = 0; j < clients.size(); j++) {
+            QJsonObject client = clients[j].toObject();
+            if (!client.contains("email")) {
+                client["email"] = client["id"].toString();
+                clients[j] = client;
+                isChanged = true;
+            }
+        }
+        settings["clients"] = clients;
+        inbound["settings"] = settings;
+        inbounds[i] = inbound;
+    }
+
+    // the api inbound goes last, the vless inbound is expected to be the first one
+    if (!hasApiInbound) {
+        inbounds.append(QJsonObject { { "tag", amnezia::protocols::xray::apiTag },
+                                      { "listen", amnezia::protocols::xray::apiAddress },
+                                      { "port", amnezia::protocols::xray::apiPort },
+                                      { "protocol", "dokodemo-door" },
+                                      { "settings", QJsonObject { { "address", amnezia::protocols::xray::apiAddress } } } });
+        isChanged = true;
+    }
+    serverConfig["inbounds"] = inbounds;
+
+    if (!serverConfig.contains("api")) {
+        serverConfig["api"] = QJsonObject { { "tag", amnezia::protocols::xray::apiTag },
+                                            { "services", QJsonArray { "HandlerService" } } };
+        isChanged = true;
+    }
+
+    QJsonObject routing = serverConfig["routing"].toObject();
+    QJsonArray rules = routing["rules"].toArray();
+    bool hasApiRule = false;
+    for (const auto &rule : std::as_const(rules)) {
+        if (rule.toObject()["outboundTag"].toString() == amnezia::protocols::xray::apiTag) {
+            hasApiRule = true;
+            break;
+        }
+    }
+    if (!hasApiRule) {
+        rules.prepend(QJsonObject { { "type", "field" },
+                                    { "inboundTag", QJsonArray { amnezia::protocols::xray::apiTag } },
+                                    { "outboundTag", amnezia::protocols::xray::apiTag } });
+        routing["rules"] = rules;
+        serverConfig["routing"] = routing;
+        isChanged = true;
+    }
+
+    return isChanged;
+}
+
+ErrorCode XrayConfigurator::addUserAtRuntime(const QSharedPointer<ServerController> &serverController,
+                                             const ServerCredentials &credentials, DockerContainer container,
+                                             const QJsonObject &inbound, const QJsonObject &client, bool &isApplied)
+{
+    isApplied = false;
+
+    // `xray api adu` adds the users of the given inbounds to the running inbounds with the same tags
+    QJsonObject userInbound {
+        { "tag", inbound["tag"].toString(amnezia::protocols::xray::inboundTag) },
+        { "protocol", inbound["protocol"].toString("vless") },
+        { "port", inbound["port"] },
+        { "settings", QJsonObject { { "clients", QJsonArray { client } }, { "decryption", "none" } } }
+    };
+    const QString userConfig = QJsonDocument(QJsonObject { { "inbounds", QJsonArray { userInbound } } }).toJson(QJsonDocument::Compact);
+    // unique per call, so concurrent client changes on the same server don't pick up each other's users
+    const QString userConfigPath =
+            QString("/opt/amnezia/xray/api_add_user_%1.json").arg(QUuid::createUuid().toString(QUuid::WithoutBraces));
+
+    ErrorCode errorCode = serverController->uploadTextFileToContainer(container, credentials, userConfig, userConfigPath);
+    if (errorCode != ErrorCode::NoError) {
+        return errorCode;
+    }
+
+    QString stdOut;
+    auto cbReadStdOut = [&](const QString &data, libssh::Client &) {
+        stdOut += data + "\n";
+        return ErrorCode::NoError;
+    };
+
+    const QString script = QString("sudo docker exec -i $CONTAINER_NAME sh -c 'xray api adu --server=%1 %2 && echo %3; rm -f %2'")
+                                   .arg(runtimeApiServer(), userConfigPath, apiSuccessMarker);
+    errorCode = serverController->runScript(
+            credentials, serverController->replaceVars(script, serverController->genVarsForScript(credentials, container)), cbReadStdOut);
+
+    isApplied = stdOut.contains(apiSuccessMarker);
+    return errorCode;
+}
+
+ErrorCode XrayConfigurator::removeUserAtRuntime(const QSharedPointer<ServerController> &serverController,
+                                                const ServerCredentials &credentials, DockerContainer container,
+                                                const QJsonObject &inbound, const QString &email, bool &isApplied)
+{
+    isApplied = false;
+
+    QString stdOut;
+    auto cbReadStdOut = [&](const QString &data, libssh::Client &) {
+        stdOut += data + "\n";
+        return ErrorCode::NoError;
+    };
+
+    const QString script = QString("sudo docker exec -i $CONTAINER_NAME sh -c 'xray api rmu --server=%1 -tag=%2 %3 && echo %4'")
+                                   .arg(runtimeApiServer(), inbound["tag"].toString(amnezia::protocols::xray::inboundTag), email,
+                                        apiSuccessMarker);
+    ErrorCode errorCode = serverController->runScript(
+            credentials, serverController->replaceVars(script, serverController->genVarsForScript(credentials, container)), cbReadStdOut);
+
+    isApplied = stdOut.contains(apiSuccessMarker);
+    return errorCode;
+}
+
 QString XrayConfigurator::createConfig(const ServerCredentials &credentials, DockerContainer container,
                                        const QJsonObject &containerConfig, ErrorCode &errorCode)
 {
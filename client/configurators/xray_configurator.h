@@ -15,6 +15,17 @@ public:
     QString createConfig(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &containerConfig,
                          ErrorCode &errorCode);
 
+    // Adds the HandlerService api inbound and routing to the server config and gives every client an email,
+    // which the api uses as the user key. Returns true if the config had to be changed
+    static bool enableRuntimeApi(QJsonObject &serverConfig);
+
+    // Change users of the running xray through its api, isApplied is false if the api isn't available
+    // and the container has to be restarted to pick up the config from disk
+    static ErrorCode addUserAtRuntime(const QSharedPointer<ServerController> &serverController, const ServerCredentials &credentials,
+                                      DockerContainer container, const QJsonObject &inbound, const QJsonObject &client, bool &isApplied);
+    static ErrorCode removeUserAtRuntime(const QSharedPointer<ServerController> &serverController, const ServerCredentials &credentials,
+                                         DockerContainer container, const QJsonObject &inbound, const QString &email, bool &isApplied);
+
 private:
     QString prepareServerConfig(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &containerConfig,
                                 ErrorCode &errorCode);
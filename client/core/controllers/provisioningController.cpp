@@ -0,0 +1,222 @@
+#include "provisioningController.h"
+
+#include <QElapsedTimer>
+#include <QThread>
+#include <QtConcurrent>
+
+#include "logger.h"
+#include "settings.h"
+
+namespace
+{
+    Logger logger("ProvisioningController");
+}
+
+ProvisioningController::ProvisioningController(const std::shared_ptr<Settings> &settings, QObject *parent)
+    : QObject(parent), m_settings(settings)
+{
+    qRegisterMetaType<ProvisioningResult>();
+    qRegisterMetaType<QList<ProvisioningResult>>();
+
+    m_threadPool.setMaxThreadCount(4);
+}
+
+ProvisioningController::~ProvisioningController()
+{
+    cancel();
+    m_threadPool.waitForDone();
+}
+
+void ProvisioningController::setMaxConcurrentHosts(int count)
+{
+    m_threadPool.setMaxThreadCount(qMax(1, count));
+}
+
+void ProvisioningController::setMaxRetries(int count)
+{
+    m_maxRetries = qMax(0, count);
+}
+
+void ProvisioningController::setRetryDelay(int msecs)
+{
+    m_retryDelay = qMax(0, msecs);
+}
+
+bool ProvisioningController::isRunning() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pendingHosts > 0;
+}
+
+void ProvisioningController::provision(const QList<ProvisioningJob> &jobs)
+{
+    if (isRunning()) {
+        logger.warning() << "Provisioning is already running";
+        return;
+    }
+
+    // group jobs by host, so containers of one server are installed sequentially
+    QList<QString> hosts;
+    QHash<QString, QList<ProvisioningJob>> jobsPerHost;
+    for (const ProvisioningJob &job : jobs) {
+        const QString hostKey = QString("%1:%2").arg(job.credentials.hostName).arg(job.credentials.port);
+        if (!jobsPerHost.contains(hostKey)) {
+            hosts.append(hostKey);
+        }
+        jobsPerHost[hostKey].append(job);
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_report.clear();
+        m_totalJobs = jobs.size();
+        m_pendingHosts = hosts.size();
+    }
+    m_isCancelled = false;
+    m_hostTasks.clear();
+    m_settingsSnapshot = ServerController::settingsSnapshot(*m_settings);
+
+    if (hosts.isEmpty()) {
+        emit provisioningFinished({});
+        return;
+    }
+
+    logger.info() << "Provisioning" << jobs.size() << "containers on" << hosts.size() << "servers";
+    emit progressChanged(0, m_totalJobs);
+
+    for (const QString &host : hosts) {
+        const QList<ProvisioningJob> hostJobs = jobsPerHost.value(host);
+        m_hostTasks.append(QtConcurrent::run(&m_threadPool, [this, hostJobs]() { provisionHost(hostJobs); }));
+    }
+}
+
+void ProvisioningController::cancel()
+{
+    m_isCancelled = true;
+
+    QMutexLocker locker(&m_mutex);
+    for (ServerController *serverController : std::as_const(m_activeControllers)) {
+        serverController->cancelInstallation();
+    }
+}
+
+void ProvisioningController::provisionHost(const QList<ProvisioningJob> &jobs)
+{
+    for (const ProvisioningJob &job : jobs) {
+        ProvisioningResult result = provisionJob(job);
+
+        int finishedJobs = 0;
+        {
+            QMutexLocker locker(&m_mutex);
+            m_report.append(result);
+            finishedJobs = m_report.size();
+        }
+
+        emit jobFinished(result);
+        emit progressChanged(finishedJobs, m_totalJobs);
+    }
+
+    bool isLastHost = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        isLastHost = --m_pendingHosts == 0;
+    }
+
+    if (isLastHost) {
+        QMetaObject::invokeMethod(
+                this,
+                [this]() {
+                    QList<ProvisioningResult> report;
+                    {
+                        QMutexLocker locker(&m_mutex);
+                        report = m_report;
+                    }
+
+                    int failedJobs = 0;
+                    for (const ProvisioningResult &result : report) {
+                        if (result.errorCode != ErrorCode::NoError) {
+                            failedJobs++;
+                        }
+                    }
+                    logger.info() << "Provisioning finished," << report.size() - failedJobs << "succeeded," << failedJobs << "failed";
+
+                    emit provisioningFinished(report);
+                },
+                Qt::QueuedConnection);
+    }
+}
+
+ProvisioningResult ProvisioningController::provisionJob(const ProvisioningJob &job)
+{
+    ProvisioningResult result;
+    result.credentials = job.credentials;
+    result.container = job.container;
+    result.config = job.config;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const QString &hostName = job.credentials.hostName;
+
+    // the controller lives in the worker thread, its ssh client runs nested event loops there
+    QScopedPointer<ServerController> serverController(new ServerController(m_settings));
+    serverController->setSettingsSnapshot(m_settingsSnapshot);
+    connect(serverController.get(), &ServerController::serverIsBusy, this,
+            [this, hostName](const bool isBusy) { emit hostBusy(hostName, isBusy); }, Qt::DirectConnection);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_activeControllers.insert(serverController.get());
+    }
+
+    for (ServerController::SetupStage stage : ServerController::setupStages()) {
+        emit hostStageStarted(hostName, job.container, stage);
+
+        for (int retry = 0;; retry++) {
+            if (m_isCancelled) {
+                result.errorCode = ErrorCode::ServerCancelInstallation;
+                break;
+            }
+
+            result.errorCode = serverController->runSetupStage(stage, job.credentials, job.container, result.config);
+            if (result.errorCode == ErrorCode::NoError || !isRetryable(result.errorCode) || retry >= m_maxRetries) {
+                break;
+            }
+
+            result.retries++;
+            logger.warning() << hostName << ContainerProps::containerToString(job.container) << stage << "failed with" << result.errorCode
+                             << ", retrying";
+            emit hostStageRetrying(hostName, job.container, stage, retry + 1, result.errorCode);
+            QThread::msleep(static_cast<unsigned long>(m_retryDelay) * (retry + 1));
+
+            // drop the possibly broken ssh session before the next attempt
+            serverController->disconnectFromHost();
+        }
+
+        if (result.errorCode != ErrorCode::NoError) {
+            result.failedStage = stage;
+            logger.error() << hostName << ContainerProps::containerToString(job.container) << "failed at" << stage << "with"
+                           << result.errorCode;
+            break;
+        }
+    }
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_activeControllers.remove(serverController.get());
+    }
+
+    result.elapsedMs = timer.elapsed();
+    return result;
+}
+
+bool ProvisioningController::isRetryable(ErrorCode errorCode)
+{
+    switch (errorCode) {
+    case ErrorCode::SshTimeoutError:
+    case ErrorCode::SshInterruptedError:
+    case ErrorCode::SshInternalError:
+    case ErrorCode::SshScpFailureError: return true;
+    default: return false;
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef PROVISIONINGCONTROLLER_H
+#define PROVISIONINGCONTROLLER_H
+
+#include <QFuture>
+#include <QJsonObject>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+
+#include "containers/containers_defs.h"
+#include "core/controllers/serverController.h"
+#include "core/defs.h"
+
+class Settings;
+
+using namespace amnezia;
+
+struct ProvisioningJob
+{
+    ServerCredentials credentials;
+    DockerContainer container = DockerContainer::None;
+    QJsonObject config;
+};
+
+struct ProvisioningResult
+{
+    ServerCredentials credentials;
+    DockerContainer container = DockerContainer::None;
+    QJsonObject config;
+    ErrorCode errorCode = ErrorCode::NoError;
+    ServerController::SetupStage failedStage = ServerController::SetupStage::CheckUserInSudo;
+    int retries = 0;
+    qint64 elapsedMs = 0;
+};
+
+Q_DECLARE_METATYPE(ProvisioningResult)
+
+// Installs containers on many servers at once. Jobs for the same host are executed one after another
+// (they share the package manager and docker daemon), different hosts run in parallel on a bounded pool.
+// Every job goes through the ServerController::setupContainer stages, transient ssh failures are retried per stage.
+// provision() must be called on the thread the controller lives in, the settings the jobs need are read there.
+class ProvisioningController : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ProvisioningController(const std::shared_ptr<Settings> &settings, QObject *parent = nullptr);
+    ~ProvisioningController();
+
+    void setMaxConcurrentHosts(int count);
+    void setMaxRetries(int count);
+    void setRetryDelay(int msecs);
+
+    bool isRunning() const;
+
+public slots:
+    void provision(const QList<ProvisioningJob> &jobs);
+    void cancel();
+
+signals:
+    void hostStageStarted(const QString &hostName, amnezia::DockerContainer container, ServerController::SetupStage stage);
+    void hostStageRetrying(const QString &hostName, amnezia::DockerContainer container, ServerController::SetupStage stage, int retry,
+                           amnezia::ErrorCode errorCode);
+    void hostBusy(const QString &hostName, bool isBusy);
+    void jobFinished(const ProvisioningResult &result);
+    void progressChanged(int finishedJobs, int totalJobs);
+    void provisioningFinished(const QList<ProvisioningResult> &report);
+
+private:
+    void provisionHost(const QList<ProvisioningJob> &jobs);
+    ProvisioningResult provisionJob(const ProvisioningJob &job);
+    static bool isRetryable(ErrorCode errorCode);
+
+    std::shared_ptr<Settings> m_settings;
+    // read in provision(), the workers never touch Settings
+    ServerController::SettingsSnapshot m_settingsSnapshot;
+
+    QThreadPool m_threadPool;
+    QList<QFuture<void>> m_hostTasks;
+
+    mutable QMutex m_mutex;
+    QList<ProvisioningResult> m_report;
+    QSet<ServerController *> m_activeControllers;
+    int m_totalJobs = 0;
+    int m_pendingHosts = 0;
+
+    std::atomic_bool m_isCancelled = false;
+    int m_maxRetries = 2;
+    int m_retryDelay = 5000;
+};
+
+#endif // PROVISIONINGCONTROLLER_H
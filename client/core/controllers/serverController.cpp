@@ -9,7 +9,6 @@
 #include <QJsonObject>
 #include <QLoggingCategory>
 #include <QPointer>
-#include <QTemporaryFile>
 #include <QThread>
 #include <QTimer>
 #include <QtConcurrent>
@@ -26,6 +25,7 @@
 #include "core/networkUtilities.h"
 #include "core/scripts_registry.h"
 #include "core/server_defs.h"
+#include "core/sshsessionpool.h"
 #include "logger.h"
 #include "settings.h"
 #include "utilities.h"
@@ -47,7 +47,8 @@ ServerController::~ServerController()
 
 ErrorCode ServerController::runScript(const ServerCredentials &credentials, QString script,
                                       const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdOut,
-                                      const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdErr)
+                                      const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdErr,
+                                      ScriptMode mode)
 {
 
     auto error = m_sshClient.connectToHost(credentials);
@@ -59,6 +60,7 @@ ErrorCode ServerController::runScript(const ServerCredentials &credentials, QStr
 
     qDebug() << "ServerController::Run script";
 
+    QStringList commands;
     QString totalLine;
     const QStringList &lines = script.split("\n", Qt::SkipEmptyParts);
     for (int i = 0; i < lines.count(); i++) {
@@ -84,10 +86,31 @@ ErrorCode ServerController::runScript(const ServerCredentials &credentials, QStr
 
         qDebug().noquote() << lineToExec;
 
-        error = m_sshClient.executeCommand(lineToExec, cbReadStdOut, cbReadStdErr);
+        if (mode == ScriptMode::PerCommand) {
+            error = m_sshClient.executeCommand(lineToExec, cbReadStdOut, cbReadStdErr);
+            if (error != ErrorCode::NoError) {
+                return error;
+            }
+        } else {
+            commands.append(lineToExec);
+        }
+    }
+
+    if (!commands.isEmpty()) {
+        QList<int> exitStatuses;
+        error = m_sshClient.executeScript(commands, cbReadStdOut, cbReadStdErr, exitStatuses);
         if (error != ErrorCode::NoError) {
             return error;
         }
+
+        for (int i = 0; i < exitStatuses.size(); i++) {
+            if (exitStatuses.at(i) != 0) {
+                qDebug().noquote() << QString("ServerController::runScript command %1 exited with status %2").arg(i).arg(exitStatuses.at(i));
+            }
+        }
+        if (exitStatuses.size() != commands.size()) {
+            qDebug() << "ServerController::runScript shell exited after" << exitStatuses.size() << "of" << commands.size() << "commands";
+        }
     }
 
     qDebug().noquote() << "ServerController::runScript finished\n";
@@ -114,12 +137,29 @@ ErrorCode ServerController::runContainerScript(const ServerCredentials &credenti
     return e;
 }
 
+ErrorCode ServerController::runCommandWithInput(const ServerCredentials &credentials, const QString &command, const QByteArray &input,
+                                                const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdOut,
+                                                const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdErr)
+{
+    auto error = m_sshClient.connectToHost(credentials);
+    if (error != ErrorCode::NoError) {
+        return error;
+    }
+
+    return m_sshClient.executeCommand(command, input, cbReadStdOut, cbReadStdErr);
+}
+
 ErrorCode ServerController::uploadTextFileToContainer(DockerContainer container, const ServerCredentials &credentials, const QString &file,
                                                       const QString &path, libssh::ScpOverwriteMode overwriteMode)
 {
-    ErrorCode e = ErrorCode::NoError;
-    QString tmpFileName = QString("/tmp/%1.tmp").arg(Utils::getRandomString(16));
-    e = uploadFileToHost(credentials, file.toUtf8(), tmpFileName);
+    QString teeArgs;
+    if (overwriteMode == libssh::ScpOverwriteMode::ScpAppendToExisting) {
+        teeArgs = "-a ";
+    } else if (overwriteMode != libssh::ScpOverwriteMode::ScpOverwriteExisting) {
+        return ErrorCode::NotImplementedError;
+    }
+
+    auto e = m_sshClient.connectToHost(credentials);
     if (e)
         return e;
 
@@ -129,45 +169,18 @@ ErrorCode ServerController::uploadTextFileToContainer(DockerContainer container,
         return ErrorCode::NoError;
     };
 
-    // mkdir
-    QString mkdir = QString("sudo docker exec -i $CONTAINER_NAME mkdir -p  \"$(dirname %1)\"").arg(path);
+    // the file content goes straight into the container through stdin of a single docker exec
+    QString script = QString("sudo docker exec -i $CONTAINER_NAME sh -c 'mkdir -p \"$(dirname %1)\" && tee %2%1 > /dev/null'")
+                             .arg(path, teeArgs);
 
-    e = runScript(credentials, replaceVars(mkdir, genVarsForScript(credentials, container)));
+    e = m_sshClient.executeCommand(replaceVars(script, genVarsForScript(credentials, container)), file.toUtf8(), cbReadStd, cbReadStd);
     if (e)
         return e;
 
-    if (overwriteMode == libssh::ScpOverwriteMode::ScpOverwriteExisting) {
-        e = runScript(credentials,
-                      replaceVars(QString("sudo docker cp %1 $CONTAINER_NAME:/%2").arg(tmpFileName).arg(path),
-                                  genVarsForScript(credentials, container)),
-                      cbReadStd, cbReadStd);
-
-        if (e)
-            return e;
-    } else if (overwriteMode == libssh::ScpOverwriteMode::ScpAppendToExisting) {
-        e = runScript(credentials,
-                      replaceVars(QString("sudo docker cp %1 $CONTAINER_NAME:/%2").arg(tmpFileName).arg(tmpFileName),
-                                  genVarsForScript(credentials, container)),
-                      cbReadStd, cbReadStd);
-
-        if (e)
-            return e;
-
-        e = runScript(credentials,
-                      replaceVars(QString("sudo docker exec -i $CONTAINER_NAME sh -c \"cat %1 >> %2\"").arg(tmpFileName).arg(path),
-                                  genVarsForScript(credentials, container)),
-                      cbReadStd, cbReadStd);
-
-        if (e)
-            return e;
-    } else
-        return ErrorCode::NotImplementedError;
-
     if (stdOut.contains("Error") && stdOut.contains("No such container")) {
         return ErrorCode::ServerContainerMissingError;
     }
 
-    runScript(credentials, replaceVars(QString("sudo shred -u %1").arg(tmpFileName), genVarsForScript(credentials, container)));
     return e;
 }
 
@@ -197,17 +210,18 @@ ErrorCode ServerController::uploadFileToHost(const ServerCredentials &credential
         return error;
     }
 
-    QTemporaryFile localFile;
-    localFile.open();
-    localFile.write(data);
-    localFile.close();
-
-    error = m_sshClient.scpFileCopy(overwriteMode, localFile.fileName(), remotePath, "non_desc");
+    return m_sshClient.scpCopy(overwriteMode, data, remotePath);
+}
 
+ErrorCode ServerController::uploadFileToHost(const ServerCredentials &credentials, QIODevice &source, const QString &remotePath,
+                                             libssh::ScpOverwriteMode overwriteMode)
+{
+    auto error = m_sshClient.connectToHost(credentials);
     if (error != ErrorCode::NoError) {
         return error;
     }
-    return ErrorCode::NoError;
+
+    return m_sshClient.scpCopy(overwriteMode, source, remotePath);
 }
 
 ErrorCode ServerController::rebootServer(const ServerCredentials &credentials)
@@ -225,7 +239,13 @@ ErrorCode ServerController::rebootServer(const ServerCredentials &credentials)
         return ErrorCode::NoError;
     };
 
-    return runScript(credentials, script, cbReadStdOut, cbReadStdErr);
+    ErrorCode errorCode = runScript(credentials, script, cbReadStdOut, cbReadStdErr);
+
+    // sessions to a rebooting server are dead, don't keep them in the pool
+    m_sshClient.disconnectFromHost();
+    libssh::SessionPool::instance().removeSessions(credentials);
+
+    return errorCode;
 }
 
 ErrorCode ServerController::removeAllContainers(const ServerCredentials &credentials)
@@ -239,64 +259,53 @@ ErrorCode ServerController::removeContainer(const ServerCredentials &credentials
                      replaceVars(amnezia::scriptData(SharedScriptType::remove_container), genVarsForScript(credentials, container)));
 }
 
-ErrorCode ServerController::setupContainer(const ServerCredentials &credentials, DockerContainer container, QJsonObject &config, bool isUpdate)
+QList<ServerController::SetupStage> ServerController::setupStages(bool isUpdate)
 {
-    qDebug().noquote() << "ServerController::setupContainer" << ContainerProps::containerToString(container);
-    ErrorCode e = ErrorCode::NoError;
-
-    e = isUserInSudo(credentials, container);
-    if (e)
-        return e;
-
-    e = isServerDpkgBusy(credentials, container);
-    if (e)
-        return e;
-
-    e = installDockerWorker(credentials, container);
-    if (e)
-        return e;
-    qDebug().noquote() << "ServerController::setupContainer installDockerWorker finished";
-
+    QList<SetupStage> stages = { SetupStage::CheckUserInSudo, SetupStage::WaitForPackageManager, SetupStage::InstallDocker };
     if (!isUpdate) {
-        e = isServerPortBusy(credentials, container, config);
-        if (e)
-            return e;
+        stages.append(SetupStage::CheckServerPort);
     }
+    stages.append({ SetupStage::PrepareHost, SetupStage::RemoveOldContainer, SetupStage::BuildContainer, SetupStage::RunContainer,
+                    SetupStage::ConfigureContainer, SetupStage::SetupFirewall, SetupStage::StartupContainer });
+    return stages;
+}
 
-    if (!isUpdate) {
-        e = isServerPortBusy(credentials, container, config);
+ErrorCode ServerController::setupContainer(const ServerCredentials &credentials, DockerContainer container, QJsonObject &config, bool isUpdate)
+{
+    qDebug().noquote() << "ServerController::setupContainer" << ContainerProps::containerToString(container);
+
+    for (SetupStage stage : setupStages(isUpdate)) {
+        ErrorCode e = runSetupStage(stage, credentials, container, config);
         if (e)
             return e;
+        qDebug().noquote() << "ServerController::setupContainer" << stage << "finished";
     }
 
-    e = prepareHostWorker(credentials, container, config);
-    if (e)
-        return e;
-    qDebug().noquote() << "ServerController::setupContainer prepareHostWorker finished";
-
-    removeContainer(credentials, container);
-    qDebug().noquote() << "ServerController::setupContainer removeContainer finished";
-
-    qDebug().noquote() << "buildContainerWorker start";
-    e = buildContainerWorker(credentials, container, config);
-    if (e)
-        return e;
-    qDebug().noquote() << "ServerController::setupContainer buildContainerWorker finished";
-
-    e = runContainerWorker(credentials, container, config);
-    if (e)
-        return e;
-    qDebug().noquote() << "ServerController::setupContainer runContainerWorker finished";
-
-    e = configureContainerWorker(credentials, container, config);
-    if (e)
-        return e;
-    qDebug().noquote() << "ServerController::setupContainer configureContainerWorker finished";
-
-    setupServerFirewall(credentials);
-    qDebug().noquote() << "ServerController::setupContainer setupServerFirewall finished";
+    return ErrorCode::NoError;
+}
 
-    return startupContainerWorker(credentials, container, config);
+ErrorCode ServerController::runSetupStage(SetupStage stage, const ServerCredentials &credentials, DockerContainer container,
+                                          QJsonObject &config)
+{
+    switch (stage) {
+    case SetupStage::CheckUserInSudo: return isUserInSudo(credentials, container);
+    case SetupStage::WaitForPackageManager: return isServerDpkgBusy(credentials, container);
+    case SetupStage::InstallDocker: return installDockerWorker(credentials, container);
+    case SetupStage::CheckServerPort: return isServerPortBusy(credentials, container, config);
+    case SetupStage::PrepareHost: return prepareHostWorker(credentials, container, config);
+    case SetupStage::RemoveOldContainer:
+        // the container may not exist yet
+        removeContainer(credentials, container);
+        return ErrorCode::NoError;
+    case SetupStage::BuildContainer: return buildContainerWorker(credentials, container, config);
+    case SetupStage::RunContainer: return runContainerWorker(credentials, container, config);
+    case SetupStage::ConfigureContainer: return configureContainerWorker(credentials, container, config);
+    case SetupStage::SetupFirewall:
+        setupServerFirewall(credentials);
+        return ErrorCode::NoError;
+    case SetupStage::StartupContainer: return startupContainerWorker(credentials, container, config);
+    }
+    return ErrorCode::NotImplementedError;
 }
 
 ErrorCode ServerController::updateContainer(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &oldConfig,
@@ -398,9 +407,10 @@ ErrorCode ServerController::installDockerWorker(const ServerCredentials &credent
         return ErrorCode::NoError;
     };
 
+    // the docker installer may ask questions on stdin, which are answered from cbReadStdOut
     ErrorCode error =
             runScript(credentials, replaceVars(amnezia::scriptData(SharedScriptType::install_docker), genVarsForScript(credentials)),
-                      cbReadStdOut, cbReadStdErr);
+                      cbReadStdOut, cbReadStdErr, ScriptMode::PerCommand);
 
     qDebug().noquote() << "ServerController::installDockerWorker" << stdOut;
     if (stdOut.contains("lock"))
@@ -598,8 +608,9 @@ ServerController::Vars ServerController::genVarsForScript(const ServerCredential
 
     vars.append({ { "$IPSEC_VPN_C2C_TRAFFIC", "no" } });
 
-    vars.append({ { "$PRIMARY_SERVER_DNS", m_settings->primaryDns() } });
-    vars.append({ { "$SECONDARY_SERVER_DNS", m_settings->secondaryDns() } });
+    const SettingsSnapshot settings = m_settingsSnapshot ? *m_settingsSnapshot : settingsSnapshot(*m_settings);
+    vars.append({ { "$PRIMARY_SERVER_DNS", settings.primaryDns } });
+    vars.append({ { "$SECONDARY_SERVER_DNS", settings.secondaryDns } });
 
     // Sftp vars
     vars.append({ { "$SFTP_PORT", sftpConfig.value(config_key::port).toString(QString::number(ProtocolProps::defaultPort(Proto::Sftp))) } });
@@ -656,11 +667,26 @@ QString ServerController::checkSshConnection(const ServerCredentials &credential
     return stdOut;
 }
 
+ServerController::SettingsSnapshot ServerController::settingsSnapshot(const Settings &settings)
+{
+    return SettingsSnapshot { settings.primaryDns(), settings.secondaryDns() };
+}
+
+void ServerController::setSettingsSnapshot(const SettingsSnapshot &snapshot)
+{
+    m_settingsSnapshot = snapshot;
+}
+
 void ServerController::cancelInstallation()
 {
     m_cancelInstallation = true;
 }
 
+void ServerController::disconnectFromHost()
+{
+    m_sshClient.disconnectFromHost();
+}
+
 ErrorCode ServerController::setupServerFirewall(const ServerCredentials &credentials)
 {
     return runScript(credentials, replaceVars(amnezia::scriptData(SharedScriptType::setup_host_firewall), genVarsForScript(credentials)));
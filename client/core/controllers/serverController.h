@@ -4,6 +4,9 @@
 #include <QJsonObject>
 #include <QObject>
 
+#include <atomic>
+#include <optional>
+
 #include "containers/containers_defs.h"
 #include "core/defs.h"
 #include "core/sshclient.h"
@@ -22,10 +25,47 @@ public:
 
     typedef QList<QPair<QString, QString>> Vars;
 
+    // steps of setupContainer(), in the order they are executed
+    enum class SetupStage {
+        CheckUserInSudo,
+        WaitForPackageManager,
+        InstallDocker,
+        CheckServerPort,
+        PrepareHost,
+        RemoveOldContainer,
+        BuildContainer,
+        RunContainer,
+        ConfigureContainer,
+        SetupFirewall,
+        StartupContainer
+    };
+    Q_ENUM(SetupStage)
+
+    static QList<SetupStage> setupStages(bool isUpdate = false);
+
+    // the settings genVarsForScript() uses. Settings blocks on the main thread when it is read from another one,
+    // so controllers running on worker threads get them read up front
+    struct SettingsSnapshot
+    {
+        QString primaryDns;
+        QString secondaryDns;
+    };
+
+    static SettingsSnapshot settingsSnapshot(const Settings &settings);
+    void setSettingsSnapshot(const SettingsSnapshot &snapshot);
+
+    enum class ScriptMode {
+        // every logical line gets its own ssh channel, stdin stays attached so callbacks can answer prompts
+        PerCommand,
+        // all logical lines are streamed into one shell channel and split back by sentinels
+        Pipelined
+    };
+
     ErrorCode rebootServer(const ServerCredentials &credentials);
     ErrorCode removeAllContainers(const ServerCredentials &credentials);
     ErrorCode removeContainer(const ServerCredentials &credentials, DockerContainer container);
     ErrorCode setupContainer(const ServerCredentials &credentials, DockerContainer container, QJsonObject &config, bool isUpdate = false);
+    ErrorCode runSetupStage(SetupStage stage, const ServerCredentials &credentials, DockerContainer container, QJsonObject &config);
     ErrorCode updateContainer(const ServerCredentials &credentials, DockerContainer container, const QJsonObject &oldConfig,
                               QJsonObject &newConfig);
 
@@ -35,6 +75,10 @@ public:
     ErrorCode uploadTextFileToContainer(DockerContainer container, const ServerCredentials &credentials, const QString &file,
                                         const QString &path,
                                         libssh::ScpOverwriteMode overwriteMode = libssh::ScpOverwriteMode::ScpOverwriteExisting);
+    ErrorCode uploadFileToHost(const ServerCredentials &credentials, const QByteArray &data, const QString &remotePath,
+                               libssh::ScpOverwriteMode overwriteMode = libssh::ScpOverwriteMode::ScpOverwriteExisting);
+    ErrorCode uploadFileToHost(const ServerCredentials &credentials, QIODevice &source, const QString &remotePath,
+                               libssh::ScpOverwriteMode overwriteMode = libssh::ScpOverwriteMode::ScpOverwriteExisting);
     QByteArray getTextFileFromContainer(DockerContainer container, const ServerCredentials &credentials, const QString &path,
                                         ErrorCode &errorCode);
 
@@ -44,15 +88,22 @@ public:
 
     ErrorCode runScript(const ServerCredentials &credentials, QString script,
                         const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdOut = nullptr,
-                        const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdErr = nullptr);
+                        const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdErr = nullptr,
+                        ScriptMode mode = ScriptMode::Pipelined);
 
     ErrorCode runContainerScript(const ServerCredentials &credentials, DockerContainer container, QString script,
                                  const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdOut = nullptr,
                                  const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdErr = nullptr);
 
+    // runs a single command with the input streamed into its stdin, nothing is staged on the host
+    ErrorCode runCommandWithInput(const ServerCredentials &credentials, const QString &command, const QByteArray &input,
+                                  const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdOut = nullptr,
+                                  const std::function<ErrorCode(const QString &, libssh::Client &)> &cbReadStdErr = nullptr);
+
     QString checkSshConnection(const ServerCredentials &credentials, ErrorCode &errorCode);
 
     void cancelInstallation();
+    void disconnectFromHost();
 
     ErrorCode getDecryptedPrivateKey(const ServerCredentials &credentials, QString &decryptedPrivateKey,
                                      const std::function<QString()> &callback);
@@ -70,15 +121,14 @@ private:
     ErrorCode isUserInSudo(const ServerCredentials &credentials, DockerContainer container);
     ErrorCode isServerDpkgBusy(const ServerCredentials &credentials, DockerContainer container);
 
-    ErrorCode uploadFileToHost(const ServerCredentials &credentials, const QByteArray &data, const QString &remotePath,
-                               libssh::ScpOverwriteMode overwriteMode = libssh::ScpOverwriteMode::ScpOverwriteExisting);
-
     ErrorCode setupServerFirewall(const ServerCredentials &credentials);
 
     std::shared_ptr<Settings> m_settings;
+    std::optional<SettingsSnapshot> m_settingsSnapshot;
     std::shared_ptr<VpnConfigurator> m_configurator;
 
-    bool m_cancelInstallation = false;
+    // set by cancelInstallation() from the gui thread while the installation runs on a worker thread
+    std::atomic_bool m_cancelInstallation = false;
     libssh::Client m_sshClient;
 signals:
     void serverIsBusy(const bool isBusy);
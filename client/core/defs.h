@@ -56,6 +56,7 @@ namespace amnezia
         ServerCancelInstallation = 204,
         ServerUserNotInSudo = 205,
         ServerPacketManagerError = 206,
+        ServerInstallationInProgress = 207,
 
         // Ssh connection errors
         SshRequestDeniedError = 300,
@@ -0,0 +1,118 @@
+#include "ipAllocator.h"
+
+#include <QtAlgorithms>
+
+namespace
+{
+    // keeps the bitmap of a /8 at 2 MiB
+    constexpr int minPrefixLength = 8;
+    constexpr int maxPrefixLength = 30;
+}
+
+IpAllocator::IpAllocator(const QString &subnetAddress, int prefixLength)
+{
+    const QHostAddress address(subnetAddress);
+    if (address.protocol() != QAbstractSocket::IPv4Protocol || prefixLength < minPrefixLength || prefixLength > maxPrefixLength) {
+        return;
+    }
+
+    m_size = 1u << (32 - prefixLength);
+    m_network = address.toIPv4Address() & ~(m_size - 1);
+    m_bitmap.assign((m_size + wordBits - 1) / wordBits, 0);
+
+    set(0);
+    set(1);
+    set(m_size - 1);
+    m_reservedCount = 3;
+}
+
+bool IpAllocator::isValid() const
+{
+    return m_size != 0;
+}
+
+int IpAllocator::capacity() const
+{
+    return static_cast<int>(m_size) - m_reservedCount;
+}
+
+int IpAllocator::allocatedCount() const
+{
+    return m_allocatedCount;
+}
+
+bool IpAllocator::contains(const QHostAddress &address) const
+{
+    return isValid() && address.protocol() == QAbstractSocket::IPv4Protocol && address.toIPv4Address() - m_network < m_size;
+}
+
+bool IpAllocator::isAllocated(const QHostAddress &address) const
+{
+    return contains(address) && isSet(address.toIPv4Address() - m_network);
+}
+
+bool IpAllocator::markAllocated(const QHostAddress &address)
+{
+    if (!contains(address)) {
+        return false;
+    }
+
+    const quint32 offset = address.toIPv4Address() - m_network;
+    if (!isSet(offset)) {
+        set(offset);
+        m_allocatedCount++;
+    }
+    return true;
+}
+
+void IpAllocator::release(const QHostAddress &address)
+{
+    if (!contains(address)) {
+        return;
+    }
+
+    const quint32 offset = address.toIPv4Address() - m_network;
+    if (offset == 0 || offset == 1 || offset == m_size - 1 || !isSet(offset)) {
+        return;
+    }
+
+    reset(offset);
+    m_allocatedCount--;
+    m_firstFreeWord = qMin(m_firstFreeWord, static_cast<size_t>(offset / wordBits));
+}
+
+QHostAddress IpAllocator::allocate()
+{
+    for (; m_firstFreeWord < m_bitmap.size(); m_firstFreeWord++) {
+        const quint64 freeBits = ~m_bitmap[m_firstFreeWord];
+        if (freeBits == 0) {
+            continue;
+        }
+
+        const quint32 offset = static_cast<quint32>(m_firstFreeWord * wordBits) + qCountTrailingZeroBits(freeBits);
+        if (offset >= m_size) {
+            break;
+        }
+
+        set(offset);
+        m_allocatedCount++;
+        return QHostAddress(m_network + offset);
+    }
+
+    return QHostAddress();
+}
+
+bool IpAllocator::isSet(quint32 offset) const
+{
+    return m_bitmap[offset / wordBits] & (quint64(1) << (offset % wordBits));
+}
+
+void IpAllocator::set(quint32 offset)
+{
+    m_bitmap[offset / wordBits] |= quint64(1) << (offset % wordBits);
+}
+
+void IpAllocator::reset(quint32 offset)
+{
+    m_bitmap[offset / wordBits] &= ~(quint64(1) << (offset % wordBits));
+}
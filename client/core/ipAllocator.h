@@ -0,0 +1,47 @@
+#ifndef IPALLOCATOR_H
+#define IPALLOCATOR_H
+
+#include <QHostAddress>
+#include <QString>
+
+#include <vector>
+
+// Bitmap of the host addresses of an IPv4 subnet. The network address, the first host (taken by the server)
+// and the broadcast address are never handed out.
+class IpAllocator
+{
+public:
+    IpAllocator(const QString &subnetAddress, int prefixLength);
+
+    bool isValid() const;
+    int capacity() const;
+    int allocatedCount() const;
+
+    bool contains(const QHostAddress &address) const;
+    bool isAllocated(const QHostAddress &address) const;
+
+    // returns false if the address doesn't belong to the subnet
+    bool markAllocated(const QHostAddress &address);
+    void release(const QHostAddress &address);
+
+    // first free address of the subnet, null address if the subnet is exhausted
+    QHostAddress allocate();
+
+private:
+    static constexpr int wordBits = 64;
+
+    bool isSet(quint32 offset) const;
+    void set(quint32 offset);
+    void reset(quint32 offset);
+
+    quint32 m_network = 0;
+    quint32 m_size = 0;
+    int m_allocatedCount = 0;
+    int m_reservedCount = 0;
+
+    std::vector<quint64> m_bitmap;
+    // no free bits before this word
+    size_t m_firstFreeWord = 0;
+};
+
+#endif // IPALLOCATOR_H
@@ -0,0 +1,129 @@
+#include "keyPool.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+
+#include <openssl/ec.h>
+#include <openssl/rsa.h>
+
+KeyPool &KeyPool::instance()
+{
+    static KeyPool pool;
+    return pool;
+}
+
+KeyPool::KeyPool()
+{
+    // one background thread is enough to stay ahead of config creation and leaves the other cores alone
+    m_threadPool.setMaxThreadCount(1);
+}
+
+KeyPool::~KeyPool()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_isShuttingDown = true;
+    }
+    m_threadPool.waitForDone();
+
+    for (auto &keys : m_keys) {
+        while (!keys.isEmpty()) {
+            EVP_PKEY_free(keys.dequeue());
+        }
+    }
+}
+
+EVP_PKEY *KeyPool::takeKey(KeyType type)
+{
+    EVP_PKEY *key = nullptr;
+    {
+        QMutexLocker locker(&m_mutex);
+        QQueue<EVP_PKEY *> &keys = m_keys[type];
+        if (!keys.isEmpty()) {
+            key = keys.dequeue();
+        }
+        scheduleRefill(type);
+    }
+
+    if (!key) {
+        key = generateKey(type);
+    }
+    return key;
+}
+
+void KeyPool::warmUp(KeyType type)
+{
+    QMutexLocker locker(&m_mutex);
+    scheduleRefill(type);
+}
+
+void KeyPool::setWatermark(int count)
+{
+    QMutexLocker locker(&m_mutex);
+    m_watermark = qMax(0, count);
+
+    // keys above the new watermark are not needed anymore
+    for (auto &keys : m_keys) {
+        while (keys.size() > m_watermark) {
+            EVP_PKEY_free(keys.dequeue());
+        }
+    }
+}
+
+EVP_PKEY *KeyPool::generateKey(KeyType type)
+{
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(type == KeyType::EcP256 ? EVP_PKEY_EC : EVP_PKEY_RSA, nullptr);
+    if (!ctx) {
+        return nullptr;
+    }
+
+    EVP_PKEY *key = nullptr;
+    bool isInitialized = EVP_PKEY_keygen_init(ctx) == 1;
+    if (isInitialized) {
+        if (type == KeyType::EcP256) {
+            isInitialized = EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1) == 1;
+        } else {
+            isInitialized = EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048) == 1;
+        }
+    }
+
+    if (!isInitialized || EVP_PKEY_keygen(ctx, &key) != 1) {
+        qWarning() << "KeyPool: failed to generate a private key";
+        key = nullptr;
+    }
+
+    EVP_PKEY_CTX_free(ctx);
+    return key;
+}
+
+void KeyPool::scheduleRefill(KeyType type)
+{
+    if (m_isShuttingDown || m_isRefilling.value(type) || m_keys.value(type).size() >= m_watermark) {
+        return;
+    }
+
+    m_isRefilling[type] = true;
+    m_threadPool.start([this, type]() { refill(type); });
+}
+
+void KeyPool::refill(KeyType type)
+{
+    forever {
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_isShuttingDown || m_keys.value(type).size() >= m_watermark) {
+                m_isRefilling[type] = false;
+                return;
+            }
+        }
+
+        EVP_PKEY *key = generateKey(type);
+
+        QMutexLocker locker(&m_mutex);
+        if (!key) {
+            m_isRefilling[type] = false;
+            return;
+        }
+        m_keys[type].enqueue(key);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef KEYPOOL_H
+#define KEYPOOL_H
+
+#include <QMap>
+#include <QMutex>
+#include <QQueue>
+#include <QThreadPool>
+
+#include <openssl/evp.h>
+
+// Process-wide pool of pre-generated private keys for certificate requests.
+// Keys are generated on a background thread up to the watermark and refilled after every take,
+// so creating a client config doesn't wait for RSA key generation.
+class KeyPool
+{
+public:
+    enum class KeyType {
+        Rsa2048,
+        EcP256
+    };
+
+    static KeyPool &instance();
+
+    // The caller owns the returned key and frees it with EVP_PKEY_free().
+    // Falls back to generating the key in the calling thread if the pool is empty.
+    EVP_PKEY *takeKey(KeyType type);
+
+    // Starts filling the pool for the key type without taking a key
+    void warmUp(KeyType type);
+
+    // Keys kept ready per key type, the keys live in memory until they are taken or the app quits
+    static constexpr int defaultWatermark = 8;
+    void setWatermark(int count);
+
+    static EVP_PKEY *generateKey(KeyType type);
+
+private:
+    KeyPool();
+    ~KeyPool();
+    KeyPool(const KeyPool &) = delete;
+    KeyPool &operator=(const KeyPool &) = delete;
+
+    void scheduleRefill(KeyType type);
+    void refill(KeyType type);
+
+    QMutex m_mutex;
+    QMap<KeyType, QQueue<EVP_PKEY *>> m_keys;
+    QMap<KeyType, bool> m_isRefilling;
+    bool m_isShuttingDown = false;
+
+    int m_watermark = defaultWatermark;
+
+    QThreadPool m_threadPool;
+};
+
+#endif // KEYPOOL_H
@@ -34,6 +34,8 @@
 #include <QHostAddress>
 #include <QHostInfo>
 
+#include <algorithm>
+
 QRegularExpression NetworkUtilities::ipAddressRegExp()
 {
     return QRegularExpression("^((25[0-5]|(2[0-4]|1[0-9]|[1-9]|)[0-9])(\\.(?!$)|$)){4}$");
@@ -90,21 +92,123 @@ QString NetworkUtilities::ipAddressFromIpWithSubnet(const QString ip)
     return ip.split("/").first();
 }
 
-QStringList NetworkUtilities::summarizeRoutes(const QStringList &ips, const QString cidr)
+namespace
+{
+    // inclusive range of IPv4 addresses, 64 bit so that the end of 255.255.255.255 doesn't overflow
+    struct Ipv4Range
+    {
+        quint64 first;
+        quint64 last;
+    };
+
+    bool parseIpv4Range(const QString &ip, Ipv4Range &range)
+    {
+        const int slash = ip.indexOf('/');
+        int prefixLength = 32;
+        if (slash >= 0) {
+            bool ok;
+            prefixLength = QStringView(ip).mid(slash + 1).toInt(&ok);
+            if (!ok || prefixLength < 0 || prefixLength > 32) {
+                return false;
+            }
+        }
+
+        const QHostAddress address(slash >= 0 ? ip.left(slash) : ip);
+        if (address.protocol() != QAbstractSocket::IPv4Protocol) {
+            return false;
+        }
+
+        const quint64 size = quint64(1) << (32 - prefixLength);
+        range.first = address.toIPv4Address() & ~(size - 1);
+        range.last = range.first + size - 1;
+        return true;
+    }
+
+    // addresses of the sorted disjoint ranges within [first, last], prefix sums make it O(log n)
+    quint64 coveredAddresses(const QVector<Ipv4Range> &ranges, const QVector<quint64> &sizesBefore, quint64 first, quint64 last)
+    {
+        const auto begin = std::lower_bound(ranges.cbegin(), ranges.cend(), first,
+                                            [](const Ipv4Range &range, quint64 value) { return range.last < value; });
+        const auto end = std::upper_bound(begin, ranges.cend(), last,
+                                          [](quint64 value, const Ipv4Range &range) { return value < range.first; });
+        if (begin == end) {
+            return 0;
+        }
+
+        quint64 covered = sizesBefore.at(end - ranges.cbegin()) - sizesBefore.at(begin - ranges.cbegin());
+        // only the outermost ranges can stick out of the prefix
+        if (begin->first < first) {
+            covered -= first - begin->first;
+        }
+        if ((end - 1)->last > last) {
+            covered -= (end - 1)->last - last;
+        }
+        return covered;
+    }
+
+    void appendPrefixes(const QVector<Ipv4Range> &ranges, const QVector<quint64> &sizesBefore, quint64 first, int prefixLength,
+                        quint64 maxOverCoverage, QStringList &result)
+    {
+        const quint64 size = quint64(1) << (32 - prefixLength);
+        const quint64 covered = coveredAddresses(ranges, sizesBefore, first, first + size - 1);
+        if (covered == 0) {
+            return;
+        }
+
+        if (size - covered <= maxOverCoverage) {
+            const QString address = QHostAddress(static_cast<quint32>(first)).toString();
+            result.append(prefixLength == 32 ? address : QString("%1/%2").arg(address).arg(prefixLength));
+            return;
+        }
+
+        appendPrefixes(ranges, sizesBefore, first, prefixLength + 1, maxOverCoverage, result);
+        appendPrefixes(ranges, sizesBefore, first + size / 2, prefixLength + 1, maxOverCoverage, result);
+    }
+}
+
+QStringList NetworkUtilities::summarizeRoutes(const QStringList &ips, quint64 maxOverCoverage)
 {
-    //    QMap<int, int>
-    //    QHostAddress
+    QVector<Ipv4Range> ranges;
+    ranges.reserve(ips.size());
+    QStringList result;
+
+    for (const QString &ip : ips) {
+        Ipv4Range range;
+        if (parseIpv4Range(ip.trimmed(), range)) {
+            ranges.append(range);
+        } else if (!ip.trimmed().isEmpty() && !result.contains(ip.trimmed())) {
+            // IPv6 and anything else is passed through as is
+            result.append(ip.trimmed());
+        }
+    }
+    if (ranges.isEmpty()) {
+        return result;
+    }
 
-           //    QMap<QString, QStringList> subnets; // <"a.b", <list subnets>>
+    std::sort(ranges.begin(), ranges.end(), [](const Ipv4Range &a, const Ipv4Range &b) { return a.first < b.first; });
 
-           //    for (const QString &ip : ips) {
-           //        if (ip.count(".") != 3) continue;
+    // merge overlapping and adjacent ranges
+    QVector<Ipv4Range> merged;
+    merged.reserve(ranges.size());
+    for (const Ipv4Range &range : ranges) {
+        if (!merged.isEmpty() && range.first <= merged.last().last + 1) {
+            merged.last().last = std::max(merged.last().last, range.last);
+        } else {
+            merged.append(range);
+        }
+    }
 
-           //        const QStringList &parts = ip.split(".");
-           //        subnets[parts.at(0) + "." + parts.at(1)].append(ip);
-           //    }
+    QVector<quint64> sizesBefore(merged.size() + 1, 0);
+    for (int i = 0; i < merged.size(); ++i) {
+        sizesBefore[i + 1] = sizesBefore.at(i) + merged.at(i).last - merged.at(i).first + 1;
+    }
 
-    return QStringList();
+    // Every prefix that is covered completely, or misses at most maxOverCoverage addresses, is taken as is,
+    // the rest is split into the two halves. Only the prefixes along the range boundaries are split,
+    // so it takes O(n * 32 * log n) and yields the smallest list of prefixes for the ranges.
+    QStringList prefixes;
+    appendPrefixes(merged, sizesBefore, 0, 0, maxOverCoverage, prefixes);
+    return prefixes + result;
 }
 
 QString NetworkUtilities::getIPAddress(const QString &host)
@@ -29,7 +29,10 @@ public:
     static QString netMaskFromIpWithSubnet(const QString ip);
     static QString ipAddressFromIpWithSubnet(const QString ip);
 
-    static QStringList summarizeRoutes(const QStringList &ips, const QString cidr);
+    // Aggregates IPv4 addresses and subnets into the smallest list of prefixes covering them: sorts, merges
+    // overlapping and adjacent ranges and collapses sibling prefixes into supernets. A prefix may cover up to
+    // maxOverCoverage addresses that are not in the list. Other entries, e.g. IPv6, are returned as is.
+    static QStringList summarizeRoutes(const QStringList &ips, quint64 maxOverCoverage = 0);
 
 };
 
@@ -0,0 +1,430 @@
+#include "prefixSet.h"
+
+namespace
+{
+    constexpr int ipv4Family = 0;
+    constexpr int ipv6Family = 1;
+
+    int maxPrefixLength(int family)
+    {
+        return family == ipv4Family ? 32 : 128;
+    }
+}
+
+PrefixSet::PrefixSet()
+{
+    clear();
+}
+
+PrefixSet::PrefixSet(const QStringList &prefixes)
+{
+    clear();
+    for (const QString &prefix : prefixes) {
+        insert(prefix);
+    }
+}
+
+bool PrefixSet::parsePrefix(const QString &prefix, QHostAddress &address, int &prefixLength)
+{
+    const QString trimmed = prefix.trimmed();
+    const int slash = trimmed.indexOf('/');
+
+    address = QHostAddress(slash < 0 ? trimmed : trimmed.left(slash));
+    if (address.protocol() != QAbstractSocket::IPv4Protocol && address.protocol() != QAbstractSocket::IPv6Protocol) {
+        return false;
+    }
+
+    const int maxLength = address.protocol() == QAbstractSocket::IPv4Protocol ? 32 : 128;
+    if (slash < 0) {
+        prefixLength = maxLength;
+        return true;
+    }
+
+    bool ok = false;
+    prefixLength = trimmed.mid(slash + 1).toInt(&ok);
+    return ok && prefixLength >= 0 && prefixLength <= maxLength;
+}
+
+bool PrefixSet::insert(const QString &prefix)
+{
+    QHostAddress address;
+    int prefixLength = 0;
+    return parsePrefix(prefix, address, prefixLength) && insert(address, prefixLength);
+}
+
+bool PrefixSet::insert(const QHostAddress &address, int prefixLength)
+{
+    Key key;
+    int family = 0;
+    if (!makeKey(address, prefixLength, key, family)) {
+        return false;
+    }
+
+    qint32 parent = m_roots[family];
+    if (prefixLength == 0) {
+        if (m_nodes[parent].isTerminal) {
+            return false;
+        }
+        m_nodes[parent].isTerminal = true;
+        m_size++;
+        return true;
+    }
+
+    // allocateNode() may reallocate m_nodes, don't hold references across it
+    while (true) {
+        const int bit = bitAt(key, m_nodes[parent].prefixLength);
+        const qint32 child = m_nodes[parent].children[bit];
+        if (child < 0) {
+            const qint32 leaf = allocateNode(key, prefixLength, true);
+            m_nodes[parent].children[bit] = leaf;
+            break;
+        }
+
+        const Key childKey = m_nodes[child].key;
+        const int childLength = m_nodes[child].prefixLength;
+        const int common = commonPrefixLength(key, childKey, qMin(prefixLength, childLength));
+
+        if (common == childLength) {
+            if (childLength < prefixLength) {
+                parent = child;
+                continue;
+            }
+            if (m_nodes[child].isTerminal) {
+                return false;
+            }
+            m_nodes[child].isTerminal = true;
+            break;
+        }
+
+        if (common == prefixLength) {
+            // the new prefix is a supernet of the child and goes between it and the parent
+            const qint32 node = allocateNode(key, prefixLength, true);
+            m_nodes[node].children[bitAt(childKey, prefixLength)] = child;
+            m_nodes[parent].children[bit] = node;
+            break;
+        }
+
+        // the paths part before either prefix ends, branch at the first differing bit
+        Key splitKey = key;
+        clearHostBits(splitKey, common);
+        const qint32 split = allocateNode(splitKey, common, false);
+        const qint32 leaf = allocateNode(key, prefixLength, true);
+        m_nodes[split].children[bitAt(key, common)] = leaf;
+        m_nodes[split].children[bitAt(childKey, common)] = child;
+        m_nodes[parent].children[bit] = split;
+        break;
+    }
+
+    m_size++;
+    return true;
+}
+
+bool PrefixSet::remove(const QString &prefix)
+{
+    QHostAddress address;
+    int prefixLength = 0;
+    Key key;
+    int family = 0;
+    if (!parsePrefix(prefix, address, prefixLength) || !makeKey(address, prefixLength, key, family)) {
+        return false;
+    }
+
+    qint32 parent = -1;
+    int parentBit = 0;
+    const qint32 node = findNode(key, prefixLength, family, &parent, &parentBit);
+    if (node < 0 || !m_nodes[node].isTerminal) {
+        return false;
+    }
+    m_nodes[node].isTerminal = false;
+    m_size--;
+
+    // roots are kept even when empty
+    if (parent < 0) {
+        return true;
+    }
+
+    const bool isLeaf = m_nodes[node].children[0] < 0 && m_nodes[node].children[1] < 0;
+    compactNode(node, parent, parentBit);
+
+    // without the leaf its parent may be left as a branch point with a single branch
+    if (isLeaf && !m_nodes[parent].isTerminal) {
+        qint32 grandParent = -1;
+        int grandParentBit = 0;
+        findNode(m_nodes[parent].key, m_nodes[parent].prefixLength, family, &grandParent, &grandParentBit);
+        if (grandParent >= 0) {
+            compactNode(parent, grandParent, grandParentBit);
+        }
+    }
+    return true;
+}
+
+void PrefixSet::clear()
+{
+    m_nodes.clear();
+    m_freeNodes.clear();
+    m_size = 0;
+    m_roots[ipv4Family] = allocateNode(Key {}, 0, false);
+    m_roots[ipv6Family] = allocateNode(Key {}, 0, false);
+}
+
+int PrefixSet::size() const
+{
+    return m_size;
+}
+
+bool PrefixSet::isEmpty() const
+{
+    return m_size == 0;
+}
+
+bool PrefixSet::contains(const QString &prefix) const
+{
+    QHostAddress address;
+    int prefixLength = 0;
+    Key key;
+    int family = 0;
+    if (!parsePrefix(prefix, address, prefixLength) || !makeKey(address, prefixLength, key, family)) {
+        return false;
+    }
+
+    const qint32 node = findNode(key, prefixLength, family);
+    return node >= 0 && m_nodes[node].isTerminal;
+}
+
+bool PrefixSet::isCovered(const QString &prefix) const
+{
+    QHostAddress address;
+    int prefixLength = 0;
+    return parsePrefix(prefix, address, prefixLength) && isCovered(address, prefixLength);
+}
+
+bool PrefixSet::isCovered(const QHostAddress &address, int prefixLength) const
+{
+    Key key;
+    int family = 0;
+    if (!makeKey(address, prefixLength, key, family)) {
+        return false;
+    }
+
+    qint32 node = m_roots[family];
+    while (node >= 0) {
+        const Node &current = m_nodes[node];
+        if (current.prefixLength > prefixLength
+            || commonPrefixLength(key, current.key, current.prefixLength) < current.prefixLength) {
+            return false;
+        }
+        if (current.isTerminal) {
+            return true;
+        }
+        if (current.prefixLength == prefixLength) {
+            return false;
+        }
+        node = current.children[bitAt(key, current.prefixLength)];
+    }
+    return false;
+}
+
+QStringList PrefixSet::coveredBy(const QString &prefix) const
+{
+    QStringList result;
+
+    QHostAddress address;
+    int prefixLength = 0;
+    Key key;
+    int family = 0;
+    if (!parsePrefix(prefix, address, prefixLength) || !makeKey(address, prefixLength, key, family)) {
+        return result;
+    }
+
+    // the first node at or below the prefix length holds everything inside the prefix, if it lies on its path
+    qint32 node = m_roots[family];
+    while (node >= 0) {
+        const Node &current = m_nodes[node];
+        if (current.prefixLength >= prefixLength) {
+            if (commonPrefixLength(key, current.key, prefixLength) == prefixLength) {
+                collect(node, family, false, result);
+            }
+            break;
+        }
+        if (commonPrefixLength(key, current.key, current.prefixLength) < current.prefixLength) {
+            break;
+        }
+        node = current.children[bitAt(key, current.prefixLength)];
+    }
+    return result;
+}
+
+QStringList PrefixSet::prefixes() const
+{
+    QStringList result;
+    result.reserve(m_size);
+
+    for (int family : { ipv4Family, ipv6Family }) {
+        collect(m_roots[family], family, true, result);
+    }
+    return result;
+}
+
+QString PrefixSet::normalized(const QString &prefix)
+{
+    QHostAddress address;
+    int prefixLength = 0;
+    Key key;
+    int family = 0;
+    if (!parsePrefix(prefix, address, prefixLength) || !makeKey(address, prefixLength, key, family)) {
+        return QString();
+    }
+    return prefixToString(key, prefixLength, family);
+}
+
+bool PrefixSet::makeKey(const QHostAddress &address, int prefixLength, Key &key, int &family)
+{
+    key.fill(0);
+
+    if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+        family = ipv4Family;
+        const quint32 ipv4 = address.toIPv4Address();
+        key[0] = static_cast<quint8>(ipv4 >> 24);
+        key[1] = static_cast<quint8>(ipv4 >> 16);
+        key[2] = static_cast<quint8>(ipv4 >> 8);
+        key[3] = static_cast<quint8>(ipv4);
+    } else if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+        family = ipv6Family;
+        const Q_IPV6ADDR ipv6 = address.toIPv6Address();
+        for (int i = 0; i < 16; i++) {
+            key[i] = ipv6[i];
+        }
+    } else {
+        return false;
+    }
+
+    if (prefixLength < 0 || prefixLength > maxPrefixLength(family)) {
+        return false;
+    }
+
+    clearHostBits(key, prefixLength);
+    return true;
+}
+
+void PrefixSet::clearHostBits(Key &key, int prefixLength)
+{
+    for (int i = prefixLength; i < static_cast<int>(key.size()) * 8; i++) {
+        key[i / 8] &= ~(0x80 >> (i % 8));
+    }
+}
+
+int PrefixSet::bitAt(const Key &key, int index)
+{
+    return (key[index / 8] >> (7 - index % 8)) & 1;
+}
+
+int PrefixSet::commonPrefixLength(const Key &first, const Key &second, int maxLength)
+{
+    for (int i = 0; i * 8 < maxLength; i++) {
+        const quint8 diff = first[i] ^ second[i];
+        if (!diff) {
+            continue;
+        }
+
+        int bit = 0;
+        while (!(diff & (0x80 >> bit))) {
+            bit++;
+        }
+        return qMin(maxLength, i * 8 + bit);
+    }
+    return maxLength;
+}
+
+QString PrefixSet::prefixToString(const Key &key, int prefixLength, int family)
+{
+    QHostAddress address;
+    if (family == ipv4Family) {
+        address.setAddress((quint32(key[0]) << 24) | (quint32(key[1]) << 16) | (quint32(key[2]) << 8) | quint32(key[3]));
+    } else {
+        Q_IPV6ADDR ipv6;
+        for (int i = 0; i < 16; i++) {
+            ipv6[i] = key[i];
+        }
+        address.setAddress(ipv6);
+    }
+
+    // host prefixes are written the way sites are stored in the settings, without the length
+    if (prefixLength == maxPrefixLength(family)) {
+        return address.toString();
+    }
+    return QString("%1/%2").arg(address.toString()).arg(prefixLength);
+}
+
+qint32 PrefixSet::allocateNode(const Key &key, int prefixLength, bool isTerminal)
+{
+    Node node;
+    node.key = key;
+    node.prefixLength = prefixLength;
+    node.isTerminal = isTerminal;
+
+    if (!m_freeNodes.empty()) {
+        const qint32 index = m_freeNodes.back();
+        m_freeNodes.pop_back();
+        m_nodes[index] = node;
+        return index;
+    }
+
+    m_nodes.push_back(node);
+    return static_cast<qint32>(m_nodes.size() - 1);
+}
+
+qint32 PrefixSet::findNode(const Key &key, int prefixLength, int family, qint32 *parent, int *parentBit) const
+{
+    qint32 parentNode = -1;
+    int bit = 0;
+    qint32 node = m_roots[family];
+    while (node >= 0) {
+        const Node &current = m_nodes[node];
+        if (current.prefixLength > prefixLength
+            || commonPrefixLength(key, current.key, current.prefixLength) < current.prefixLength) {
+            return -1;
+        }
+        if (current.prefixLength == prefixLength) {
+            if (parent) {
+                *parent = parentNode;
+            }
+            if (parentBit) {
+                *parentBit = bit;
+            }
+            return node;
+        }
+
+        parentNode = node;
+        bit = bitAt(key, current.prefixLength);
+        node = current.children[bit];
+    }
+    return -1;
+}
+
+void PrefixSet::compactNode(qint32 node, qint32 parent, int parentBit)
+{
+    const Node &current = m_nodes[node];
+    if (current.isTerminal || (current.children[0] >= 0 && current.children[1] >= 0)) {
+        return;
+    }
+
+    m_nodes[parent].children[parentBit] = current.children[0] >= 0 ? current.children[0] : current.children[1];
+    m_freeNodes.push_back(node);
+}
+
+void PrefixSet::collect(qint32 node, int family, bool stopAtTerminal, QStringList &result) const
+{
+    const Node &current = m_nodes[node];
+    if (current.isTerminal) {
+        result.append(prefixToString(current.key, current.prefixLength, family));
+        if (stopAtTerminal) {
+            return;
+        }
+    }
+
+    for (qint32 child : current.children) {
+        if (child >= 0) {
+            collect(child, family, stopAtTerminal, result);
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef PREFIXSET_H
+#define PREFIXSET_H
+
+#include <QHostAddress>
+#include <QString>
+#include <QStringList>
+
+#include <array>
+#include <vector>
+
+// Set of IPv4 and IPv6 prefixes kept in a path compressed binary trie: a node only exists where a prefix ends
+// or two branches split, so there are at most two nodes per prefix and insert, lookup and coverage queries walk
+// at most one node per stored supernet or branch point. Addresses without a prefix length are host prefixes,
+// host bits of a subnet are ignored, so "10.1.2.3/8" and "10.0.0.0/8" are the same entry.
+class PrefixSet
+{
+public:
+    PrefixSet();
+    explicit PrefixSet(const QStringList &prefixes);
+
+    // parses "address" or "address/length", returns false for anything else, e.g. domain names
+    static bool parsePrefix(const QString &prefix, QHostAddress &address, int &prefixLength);
+    // the prefix the way the set returns it, e.g. "10.0.0.0/8" for "10.1.2.3/8", empty if it's not valid
+    static QString normalized(const QString &prefix);
+
+    // returns false if the prefix is not valid or is already in the set
+    bool insert(const QString &prefix);
+    bool insert(const QHostAddress &address, int prefixLength);
+    bool remove(const QString &prefix);
+    void clear();
+
+    int size() const;
+    bool isEmpty() const;
+
+    // exactly this prefix is in the set
+    bool contains(const QString &prefix) const;
+    // this prefix or one of its supernets is in the set
+    bool isCovered(const QString &prefix) const;
+    bool isCovered(const QHostAddress &address, int prefixLength) const;
+    // prefixes of the set that lie inside the given one, the prefix itself included
+    QStringList coveredBy(const QString &prefix) const;
+
+    // prefixes of the set that are not covered by another prefix of the set, i.e. the routes to program
+    QStringList prefixes() const;
+
+private:
+    // network order bytes of the address, IPv4 addresses use the first 4 bytes
+    typedef std::array<quint8, 16> Key;
+
+    struct Node
+    {
+        // the whole prefix of the node, the bits skipped on the way from the parent included
+        Key key {};
+        int prefixLength = 0;
+        qint32 children[2] = { -1, -1 };
+        bool isTerminal = false;
+    };
+
+    static bool makeKey(const QHostAddress &address, int prefixLength, Key &key, int &family);
+    static void clearHostBits(Key &key, int prefixLength);
+    static int bitAt(const Key &key, int index);
+    // number of leading bits the keys have in common, at most maxLength
+    static int commonPrefixLength(const Key &first, const Key &second, int maxLength);
+    static QString prefixToString(const Key &key, int prefixLength, int family);
+
+    qint32 allocateNode(const Key &key, int prefixLength, bool isTerminal);
+    // the node of the exact prefix, -1 if there is none, parent and parentBit tell where it hangs
+    qint32 findNode(const Key &key, int prefixLength, int family, qint32 *parent = nullptr, int *parentBit = nullptr) const;
+    // drops a node that is neither a prefix nor a branch point, its only child takes its place
+    void compactNode(qint32 node, qint32 parent, int parentBit);
+    void collect(qint32 node, int family, bool stopAtTerminal, QStringList &result) const;
+
+    std::vector<Node> m_nodes;
+    std::vector<qint32> m_freeNodes;
+    // roots of the IPv4 and IPv6 tries
+    qint32 m_roots[2];
+    int m_size = 0;
+};
+
+#endif // PREFIXSET_H
@@ -0,0 +1,548 @@
+#include "sitesImporter.h"
+
+#include <QFileInfo>
+#include <QHostAddress>
+
+#include "prefixSet.h"
+
+namespace
+{
+    constexpr qint64 maxLineLength = 4096;
+    constexpr qint64 jsonBlockSize = 64 * 1024;
+    constexpr int maxJsonStringLength = 4096;
+    constexpr int maxJsonDepth = 64;
+
+    const QByteArray utf8Bom("\xEF\xBB\xBF");
+
+    bool isDigit(char16_t c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    }
+
+    // dotted quad with an optional /0-32 suffix, each octet is 1-3 digits up to 255
+    bool isIpv4(QStringView site, bool &hasPrefix)
+    {
+        enum class State { OctetStart, Octet, PrefixStart, Prefix };
+
+        State state = State::OctetStart;
+        int octetCount = 1;
+        int digitCount = 0;
+        int value = 0;
+
+        for (const QChar ch : site) {
+            const char16_t c = ch.unicode();
+
+            switch (state) {
+            case State::OctetStart:
+            case State::PrefixStart:
+                if (!isDigit(c)) {
+                    return false;
+                }
+                value = c - '0';
+                digitCount = 1;
+                state = state == State::OctetStart ? State::Octet : State::Prefix;
+                break;
+            case State::Octet:
+                if (isDigit(c)) {
+                    value = value * 10 + (c - '0');
+                    if (++digitCount > 3 || value > 255) {
+                        return false;
+                    }
+                } else if (c == '.' && octetCount < 4) {
+                    octetCount++;
+                    state = State::OctetStart;
+                } else if (c == '/' && octetCount == 4) {
+                    state = State::PrefixStart;
+                } else {
+                    return false;
+                }
+                break;
+            case State::Prefix:
+                if (!isDigit(c)) {
+                    return false;
+                }
+                value = value * 10 + (c - '0');
+                if (++digitCount > 2 || value > 32) {
+                    return false;
+                }
+                break;
+            }
+        }
+
+        hasPrefix = state == State::Prefix;
+        return (state == State::Octet && octetCount == 4) || state == State::Prefix;
+    }
+
+    // at least two labels of letters, digits, '_' and inner '-', up to 63 characters each, the top level label
+    // is not numeric
+    bool isDomain(QStringView site)
+    {
+        enum class State { LabelStart, Label, Hyphen };
+
+        if (site.size() > 253) {
+            return false;
+        }
+
+        State state = State::LabelStart;
+        int labelCount = 1;
+        int labelLength = 0;
+        bool isLabelNumeric = true;
+
+        for (const QChar ch : site) {
+            const char16_t c = ch.unicode();
+
+            if (c == '.') {
+                if (state != State::Label) {
+                    return false;
+                }
+                labelCount++;
+                labelLength = 0;
+                isLabelNumeric = true;
+                state = State::LabelStart;
+                continue;
+            }
+
+            if (++labelLength > 63) {
+                return false;
+            }
+
+            if (c == '-') {
+                if (state == State::LabelStart) {
+                    return false;
+                }
+                isLabelNumeric = false;
+                state = State::Hyphen;
+            } else if (isDigit(c)) {
+                state = State::Label;
+            } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (c > 0x7f && ch.isLetterOrNumber())) {
+                isLabelNumeric = false;
+                state = State::Label;
+            } else {
+                return false;
+            }
+        }
+
+        return state == State::Label && labelCount >= 2 && !isLabelNumeric;
+    }
+
+    // addresses hosts files point blocked or local names to, they are never routed
+    bool isSinkAddress(const QString &address)
+    {
+        const QHostAddress hostAddress(address);
+        return hostAddress.isLoopback() || hostAddress.isBroadcast() || hostAddress == QHostAddress::AnyIPv4
+                || hostAddress == QHostAddress::AnyIPv6;
+    }
+}
+
+SitesImporter::SitesImporter(int chunkSize, const ChunkHandler &onChunk) : m_chunkSize(qMax(1, chunkSize)), m_onChunk(onChunk)
+{
+}
+
+SitesImporter::Format SitesImporter::detectFormat(const QString &fileName, QIODevice &device)
+{
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == "json") {
+        return Format::Json;
+    } else if (suffix == "csv") {
+        return Format::Csv;
+    } else if (suffix == "txt" || suffix == "list" || suffix == "hosts") {
+        return Format::Text;
+    }
+
+    const QByteArray head = device.peek(256);
+    for (const char c : head) {
+        // whitespace and the BOM
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || static_cast<uchar>(c) >= 0x80) {
+            continue;
+        }
+        return c == '[' || c == '{' ? Format::Json : Format::Text;
+    }
+    return Format::Text;
+}
+
+SitesImporter::SiteType SitesImporter::siteType(QStringView site)
+{
+    bool hasPrefix = false;
+    if (isIpv4(site, hasPrefix)) {
+        return hasPrefix ? SiteType::IpSubnet : SiteType::IpAddress;
+    }
+
+    if (site.contains(':')) {
+        QHostAddress address;
+        int prefixLength = 0;
+        if (!PrefixSet::parsePrefix(site.toString(), address, prefixLength)) {
+            return SiteType::Invalid;
+        }
+        return site.contains('/') ? SiteType::IpSubnet : SiteType::IpAddress;
+    }
+
+    return isDomain(site) ? SiteType::Domain : SiteType::Invalid;
+}
+
+QString SitesImporter::normalizeSite(const QString &site)
+{
+    QString normalized = site.trimmed();
+
+    const int schemeEnd = normalized.indexOf("://");
+    if (schemeEnd >= 0) {
+        normalized.remove(0, schemeEnd + 3);
+    }
+
+    if (siteType(normalized) == SiteType::IpSubnet) {
+        return normalized;
+    }
+
+    for (int i = 0; i < normalized.size(); i++) {
+        const QChar ch = normalized.at(i);
+        if (ch == '/' || ch == '?' || ch == '#') {
+            normalized.truncate(i);
+            break;
+        }
+    }
+
+    // a port, IPv6 addresses have more than one colon
+    if (normalized.count(':') == 1) {
+        normalized.truncate(normalized.indexOf(':'));
+    }
+    if (normalized.endsWith('.')) {
+        normalized.chop(1);
+    }
+    return normalized.toLower();
+}
+
+SitesImporter::Error SitesImporter::import(QIODevice &device, Format format)
+{
+    const Error error = format == Format::Json ? importJson(device) : importLines(device, format);
+    if (error != Error::NoError) {
+        return error;
+    }
+    return flushChunk(device.pos()) ? Error::NoError : Error::Cancelled;
+}
+
+qint64 SitesImporter::acceptedCount() const
+{
+    return m_acceptedCount;
+}
+
+qint64 SitesImporter::duplicateCount() const
+{
+    return m_duplicateCount;
+}
+
+qint64 SitesImporter::rejectedCount() const
+{
+    return m_rejectedCount;
+}
+
+SitesImporter::Error SitesImporter::importLines(QIODevice &device, Format format)
+{
+    bool isFirstLine = true;
+
+    while (!device.atEnd()) {
+        QByteArray line = device.readLine(maxLineLength);
+        if (line.isEmpty()) {
+            return Error::ReadError;
+        }
+
+        // the rest of an overlong line is skipped, it can't be a site
+        if (!line.endsWith('\n') && line.size() == maxLineLength - 1) {
+            while (!device.atEnd() && !device.readLine(maxLineLength).endsWith('\n')) {
+            }
+            m_rejectedCount++;
+            continue;
+        }
+
+        if (isFirstLine && line.startsWith(utf8Bom)) {
+            line.remove(0, utf8Bom.size());
+        }
+        isFirstLine = false;
+
+        parseLine(line, format);
+
+        if (m_isTooManySites) {
+            return Error::TooManySitesError;
+        }
+        if (m_chunk.size() >= m_chunkSize && !flushChunk(device.pos())) {
+            return Error::Cancelled;
+        }
+    }
+    return Error::NoError;
+}
+
+SitesImporter::Error SitesImporter::importJson(QIODevice &device)
+{
+    // open containers, '[' and '{', a site object is "[{" and a plain hostname is a string in "["
+    QByteArray containers;
+    bool isStarted = false;
+    bool isFinished = false;
+
+    bool isInString = false;
+    bool isEscaped = false;
+    int unicodeDigitCount = -1;
+    char16_t unicodeValue = 0;
+    // characters outside the BMP are escaped as two \u code units, the first one waits here for the second
+    char16_t highSurrogate = 0;
+    QByteArray string;
+
+    bool isKeyExpected = false;
+    QString key;
+    QString hostname;
+    QString ip;
+
+    bool isFirstBlock = true;
+    while (!device.atEnd()) {
+        QByteArray block = device.read(jsonBlockSize);
+        if (block.isEmpty()) {
+            return Error::ReadError;
+        }
+        if (isFirstBlock && block.startsWith(utf8Bom)) {
+            block.remove(0, utf8Bom.size());
+        }
+        isFirstBlock = false;
+
+        for (const char c : std::as_const(block)) {
+            if (isInString) {
+                if (unicodeDigitCount >= 0) {
+                    const int digit = hexValue(c);
+                    if (digit < 0) {
+                        return Error::JsonParseError;
+                    }
+                    unicodeValue = unicodeValue * 16 + digit;
+                    if (++unicodeDigitCount == 4) {
+                        unicodeDigitCount = -1;
+                        if (QChar::isHighSurrogate(unicodeValue)) {
+                            highSurrogate = unicodeValue;
+                            continue;
+                        }
+
+                        if (highSurrogate && QChar::isLowSurrogate(unicodeValue)) {
+                            const QChar pair[] = { QChar(highSurrogate), QChar(unicodeValue) };
+                            string.append(QString(pair, 2).toUtf8());
+                        } else {
+                            string.append(QString(QChar(unicodeValue)).toUtf8());
+                        }
+                        highSurrogate = 0;
+                    }
+                    continue;
+                }
+
+                // a high surrogate is kept only for the \u escape right after it, a lone one is dropped
+                if (isEscaped ? c != 'u' : c != '\\') {
+                    highSurrogate = 0;
+                }
+
+                if (isEscaped) {
+                    isEscaped = false;
+                    switch (c) {
+                    case '"':
+                    case '\\':
+                    case '/': string.append(c); break;
+                    case 'b': string.append('\b'); break;
+                    case 'f': string.append('\f'); break;
+                    case 'n': string.append('\n'); break;
+                    case 'r': string.append('\r'); break;
+                    case 't': string.append('\t'); break;
+                    case 'u':
+                        unicodeDigitCount = 0;
+                        unicodeValue = 0;
+                        break;
+                    default: return Error::JsonParseError;
+                    }
+                } else if (c == '\\') {
+                    isEscaped = true;
+                } else if (c == '"') {
+                    isInString = false;
+                    const QString value = QString::fromUtf8(string);
+                    string.clear();
+
+                    if (containers == "[") {
+                        addSite(value, QString());
+                    } else if (containers == "[{") {
+                        if (isKeyExpected) {
+                            key = value;
+                            isKeyExpected = false;
+                        } else if (key == "hostname") {
+                            hostname = value;
+                        } else if (key == "ip") {
+                            ip = value;
+                        }
+                    }
+                } else if (string.size() < maxJsonStringLength) {
+                    string.append(c);
+                }
+                continue;
+            }
+
+            switch (c) {
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n': break;
+            case '"':
+                if (!isStarted || isFinished) {
+                    return isStarted ? Error::JsonParseError : Error::JsonNotArrayError;
+                }
+                isInString = true;
+                break;
+            case '[':
+            case '{':
+                if (isFinished || containers.size() >= maxJsonDepth) {
+                    return Error::JsonParseError;
+                }
+                if (!isStarted) {
+                    if (c != '[') {
+                        return Error::JsonNotArrayError;
+                    }
+                    isStarted = true;
+                }
+                containers.append(c);
+                if (containers == "[{") {
+                    isKeyExpected = true;
+                    key.clear();
+                    hostname.clear();
+                    ip.clear();
+                }
+                break;
+            case ']':
+            case '}':
+                if (containers.isEmpty() || containers.back() != (c == ']' ? '[' : '{')) {
+                    return Error::JsonParseError;
+                }
+                if (containers == "[{") {
+                    addSite(hostname, ip);
+                }
+                containers.chop(1);
+                isFinished = containers.isEmpty();
+                break;
+            case ',':
+                if (containers == "[{") {
+                    isKeyExpected = true;
+                }
+                break;
+            default:
+                // ':', numbers, true, false and null
+                if (!isStarted) {
+                    return Error::JsonNotArrayError;
+                }
+                if (isFinished) {
+                    return Error::JsonParseError;
+                }
+                break;
+            }
+
+            if (m_isTooManySites) {
+                return Error::TooManySitesError;
+            }
+            if (m_chunk.size() >= m_chunkSize && !flushChunk(device.pos())) {
+                return Error::Cancelled;
+            }
+        }
+    }
+
+    if (!isFinished) {
+        return Error::JsonParseError;
+    }
+    return Error::NoError;
+}
+
+void SitesImporter::parseLine(const QByteArray &line, Format format)
+{
+    QString text = QString::fromUtf8(line);
+    const int commentStart = text.indexOf('#');
+    if (commentStart >= 0) {
+        text.truncate(commentStart);
+    }
+
+    QStringList fields;
+    if (format == Format::Csv) {
+        const QLatin1Char separator(text.contains(';') && !text.contains(',') ? ';' : ',');
+        for (QString field : text.split(separator)) {
+            field = field.trimmed();
+            if (field.size() >= 2 && field.startsWith('"') && field.endsWith('"')) {
+                field = field.mid(1, field.size() - 2).trimmed();
+            }
+            fields.append(field);
+        }
+    } else {
+        fields = text.simplified().split(' ', Qt::SkipEmptyParts);
+    }
+
+    if (fields.isEmpty() || fields.first().isEmpty()) {
+        return;
+    }
+
+    // header row
+    if (format == Format::Csv && fields.first().compare("hostname", Qt::CaseInsensitive) == 0) {
+        return;
+    }
+
+    if (format == Format::Text && siteType(fields.first()) == SiteType::IpAddress) {
+        if (fields.size() == 1) {
+            addSite(fields.first(), QString());
+            return;
+        }
+
+        // hosts file, "address hostname...", only the domain names are sites, "localhost" and the like are skipped
+        const QString address = isSinkAddress(fields.first()) ? QString() : fields.first();
+        for (int i = 1; i < fields.size(); i++) {
+            if (siteType(normalizeSite(fields.at(i))) == SiteType::Domain) {
+                addSite(fields.at(i), address);
+            } else {
+                m_rejectedCount++;
+            }
+        }
+        return;
+    }
+
+    addSite(fields.first(), fields.value(1));
+}
+
+void SitesImporter::addSite(const QString &site, const QString &ip)
+{
+    const QString normalized = normalizeSite(site);
+    const SiteType type = siteType(normalized);
+    if (type == SiteType::Invalid || (type == SiteType::IpAddress && isSinkAddress(normalized))) {
+        m_rejectedCount++;
+        return;
+    }
+
+    QString address = ip.trimmed();
+    if (!address.isEmpty() && siteType(address) != SiteType::IpAddress) {
+        address.clear();
+    }
+
+    if (m_seenSites.contains(normalized)) {
+        m_duplicateCount++;
+        return;
+    }
+    if (m_acceptedCount >= maxSiteCount) {
+        m_isTooManySites = true;
+        return;
+    }
+    m_seenSites.insert(normalized);
+    m_chunk.insert(normalized, address);
+    m_acceptedCount++;
+}
+
+bool SitesImporter::flushChunk(qint64 bytesRead)
+{
+    if (m_chunk.isEmpty()) {
+        return !m_isCancelled;
+    }
+
+    m_isCancelled = !m_onChunk(m_chunk, bytesRead);
+    m_chunk.clear();
+    return !m_isCancelled;
+}
@@ -0,0 +1,83 @@
+#ifndef SITESIMPORTER_H
+#define SITESIMPORTER_H
+
+#include <QIODevice>
+#include <QMap>
+#include <QSet>
+#include <QString>
+
+#include <functional>
+
+// Reads split tunneling site lists without loading them into memory: a JSON array of {"hostname", "ip"} objects
+// as written by the export or of plain hostnames, CSV with hostname,ip rows, or text with one site per line,
+// hosts file lines included. Sites are validated, normalized and deduplicated and handed out in chunks.
+class SitesImporter
+{
+public:
+    enum class Format {
+        Json,
+        Csv,
+        Text
+    };
+
+    enum class Error {
+        NoError,
+        ReadError,
+        JsonParseError,
+        JsonNotArrayError,
+        TooManySitesError,
+        Cancelled
+    };
+
+    enum class SiteType {
+        Invalid,
+        Domain,
+        IpAddress,
+        IpSubnet
+    };
+
+    // gets at most chunkSize new sites as <site, ip> and the number of bytes read so far, the import stops
+    // if it returns false
+    typedef std::function<bool(const QMap<QString, QString> &sites, qint64 bytesRead)> ChunkHandler;
+
+    // the importer keeps every accepted site for deduplication and the caller stages them until the file is read,
+    // so larger lists are refused to keep the memory bounded
+    static constexpr qint64 maxSiteCount = 1000000;
+
+    SitesImporter(int chunkSize, const ChunkHandler &onChunk);
+
+    // by the file extension, otherwise by the first character of the file
+    static Format detectFormat(const QString &fileName, QIODevice &device);
+
+    static SiteType siteType(QStringView site);
+    // strips the scheme and the path of urls and lowercases domain names
+    static QString normalizeSite(const QString &site);
+
+    Error import(QIODevice &device, Format format);
+
+    qint64 acceptedCount() const;
+    qint64 duplicateCount() const;
+    qint64 rejectedCount() const;
+
+private:
+    Error importLines(QIODevice &device, Format format);
+    Error importJson(QIODevice &device);
+
+    void parseLine(const QByteArray &line, Format format);
+    void addSite(const QString &site, const QString &ip);
+    bool flushChunk(qint64 bytesRead);
+
+    int m_chunkSize;
+    ChunkHandler m_onChunk;
+
+    QMap<QString, QString> m_chunk;
+    QSet<QString> m_seenSites;
+    bool m_isCancelled = false;
+    bool m_isTooManySites = false;
+
+    qint64 m_acceptedCount = 0;
+    qint64 m_duplicateCount = 0;
+    qint64 m_rejectedCount = 0;
+};
+
+#endif // SITESIMPORTER_H
@@ -0,0 +1,240 @@
+#include "sitesResolver.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QHostAddress>
+
+#include <limits>
+#include <utility>
+
+namespace
+{
+    // bounds for the record TTL, so short TTLs don't turn into a lookup storm and long ones still get refreshed
+    constexpr qint64 minTtlSecs = 60;
+    constexpr qint64 maxTtlSecs = 24 * 60 * 60;
+    constexpr qint64 failureRetrySecs = 5 * 60;
+    // entries expiring this soon are refreshed together with the due ones
+    constexpr qint64 refreshSlackMsecs = 5 * 1000;
+
+    const char addressesKey[] = "addresses";
+    const char expiresAtKey[] = "expiresAt";
+}
+
+SitesResolver::SitesResolver(QObject *parent) : QObject(parent), m_refreshTimer(new QTimer(this))
+{
+    m_refreshTimer->setSingleShot(true);
+    connect(m_refreshTimer, &QTimer::timeout, this, &SitesResolver::refresh);
+}
+
+void SitesResolver::loadCache(const QVariantMap &cache)
+{
+    for (auto i = cache.constBegin(); i != cache.constEnd(); ++i) {
+        const QVariantMap &value = i.value().toMap();
+
+        CacheEntry entry;
+        entry.addresses = value.value(addressesKey).toStringList();
+        entry.expiresAt = value.value(expiresAtKey).toLongLong();
+
+        // entries resolved during this run are newer than the persisted ones
+        if (!m_cache.contains(i.key())) {
+            m_cache.insert(i.key(), entry);
+        }
+    }
+}
+
+QVariantMap SitesResolver::cache() const
+{
+    QVariantMap cache;
+    for (const QString &hostname : m_watched) {
+        auto entry = m_cache.constFind(hostname);
+        if (entry == m_cache.constEnd() || entry->addresses.isEmpty()) {
+            continue;
+        }
+
+        QVariantMap value;
+        value.insert(addressesKey, entry->addresses);
+        value.insert(expiresAtKey, entry->expiresAt);
+        cache.insert(hostname, value);
+    }
+    return cache;
+}
+
+bool SitesResolver::isCacheChanged() const
+{
+    return m_isCacheChanged;
+}
+
+void SitesResolver::setCacheSaved()
+{
+    m_isCacheChanged = false;
+}
+
+void SitesResolver::watch(const QStringList &hostnames)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    for (const QString &hostname : hostnames) {
+        if (hostname.isEmpty()) {
+            continue;
+        }
+        m_watched.insert(hostname);
+
+        auto entry = m_cache.constFind(hostname);
+        if (entry != m_cache.constEnd() && entry->expiresAt > now && !entry->addresses.isEmpty()) {
+            m_waveAddresses.insert(hostname, entry->addresses);
+        } else {
+            enqueue(hostname);
+        }
+    }
+
+    startLookups();
+    finishWaveIfDone();
+}
+
+void SitesResolver::stop()
+{
+    m_refreshTimer->stop();
+    m_watched.clear();
+    m_queue.clear();
+    m_queuedHostnames.clear();
+    m_waveAddresses.clear();
+
+    for (QDnsLookup *lookup : std::as_const(m_lookups)) {
+        lookup->disconnect(this);
+        lookup->abort();
+        lookup->deleteLater();
+    }
+    m_lookups.clear();
+}
+
+bool SitesResolver::isWatching() const
+{
+    return !m_watched.isEmpty();
+}
+
+void SitesResolver::setMaxConcurrentLookups(int count)
+{
+    m_maxConcurrentLookups = qMax(1, count);
+}
+
+void SitesResolver::enqueue(const QString &hostname)
+{
+    if (m_queuedHostnames.contains(hostname)) {
+        return;
+    }
+    m_queuedHostnames.insert(hostname);
+    m_queue.append(hostname);
+}
+
+void SitesResolver::startLookups()
+{
+    while (m_lookups.size() < m_maxConcurrentLookups && !m_queue.isEmpty()) {
+        auto lookup = new QDnsLookup(QDnsLookup::A, m_queue.takeFirst(), this);
+        connect(lookup, &QDnsLookup::finished, this, [this, lookup]() { onLookupFinished(lookup); });
+        m_lookups.append(lookup);
+        lookup->lookup();
+    }
+}
+
+void SitesResolver::onLookupFinished(QDnsLookup *lookup)
+{
+    m_lookups.removeOne(lookup);
+    lookup->deleteLater();
+
+    const QString hostname = lookup->name();
+    m_queuedHostnames.remove(hostname);
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    CacheEntry &entry = m_cache[hostname];
+
+    QStringList addresses;
+    qint64 ttl = maxTtlSecs;
+    if (lookup->error() == QDnsLookup::NoError) {
+        // the answer holds the whole chain, the addresses expire together with the shortest lived record
+        for (const QDnsDomainNameRecord &record : lookup->canonicalNameRecords()) {
+            ttl = qMin<qint64>(ttl, record.timeToLive());
+        }
+        for (const QDnsHostAddressRecord &record : lookup->hostAddressRecords()) {
+            if (record.value().protocol() == QAbstractSocket::IPv4Protocol) {
+                addresses.append(record.value().toString());
+                ttl = qMin<qint64>(ttl, record.timeToLive());
+            }
+        }
+    }
+
+    if (addresses.isEmpty()) {
+        // the cached addresses, if any, are still the best guess
+        qDebug() << "SitesResolver: failed to resolve" << hostname << lookup->errorString();
+        entry.expiresAt = now + failureRetrySecs * 1000;
+    } else {
+        addresses.removeDuplicates();
+        if (entry.addresses != addresses) {
+            entry.addresses = addresses;
+            m_isCacheChanged = true;
+        }
+        entry.expiresAt = now + qBound(minTtlSecs, ttl, maxTtlSecs) * 1000;
+        m_waveAddresses.insert(hostname, addresses);
+    }
+
+    startLookups();
+    finishWaveIfDone();
+}
+
+void SitesResolver::finishWaveIfDone()
+{
+    if (!m_lookups.isEmpty() || !m_queue.isEmpty() || m_isWaveFinishScheduled) {
+        return;
+    }
+
+    // queued, so a wave answered from the cache is reported after watch() returns as well
+    m_isWaveFinishScheduled = true;
+    QMetaObject::invokeMethod(
+            this,
+            [this]() {
+                m_isWaveFinishScheduled = false;
+                if (!m_lookups.isEmpty() || !m_queue.isEmpty()) {
+                    return;
+                }
+
+                const QMap<QString, QStringList> addresses = std::exchange(m_waveAddresses, {});
+                scheduleRefresh();
+                if (!addresses.isEmpty()) {
+                    emit resolved(addresses);
+                }
+            },
+            Qt::QueuedConnection);
+}
+
+void SitesResolver::refresh()
+{
+    const qint64 dueAt = QDateTime::currentMSecsSinceEpoch() + refreshSlackMsecs;
+    for (const QString &hostname : std::as_const(m_watched)) {
+        auto entry = m_cache.constFind(hostname);
+        if (entry == m_cache.constEnd() || entry->expiresAt <= dueAt) {
+            enqueue(hostname);
+        }
+    }
+
+    if (m_queue.isEmpty()) {
+        scheduleRefresh();
+        return;
+    }
+    startLookups();
+}
+
+void SitesResolver::scheduleRefresh()
+{
+    if (m_watched.isEmpty()) {
+        m_refreshTimer->stop();
+        return;
+    }
+
+    qint64 nextExpiry = std::numeric_limits<qint64>::max();
+    for (const QString &hostname : std::as_const(m_watched)) {
+        auto entry = m_cache.constFind(hostname);
+        nextExpiry = qMin(nextExpiry, entry == m_cache.constEnd() ? 0 : entry->expiresAt);
+    }
+
+    const qint64 delay = qBound<qint64>(refreshSlackMsecs, nextExpiry - QDateTime::currentMSecsSinceEpoch(), maxTtlSecs * 1000);
+    m_refreshTimer->start(static_cast<int>(delay));
+}
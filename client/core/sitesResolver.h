@@ -0,0 +1,72 @@
+#ifndef SITESRESOLVER_H
+#define SITESRESOLVER_H
+
+#include <QDnsLookup>
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+#include <QVariantMap>
+
+// Resolves the domains of split tunneling sites to IPv4 addresses and keeps them fresh. Lookups run with bounded
+// concurrency and their answers are cached for the TTL of the record chain, CNAMEs included. The results are
+// reported in waves: one resolved() signal when all lookups queued together have finished.
+class SitesResolver : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SitesResolver(QObject *parent = nullptr);
+
+    // cache entries are stored as hostname -> { "addresses": [...], "expiresAt": msecs since epoch }
+    void loadCache(const QVariantMap &cache);
+    // entries of the watched hostnames
+    QVariantMap cache() const;
+    // the addresses of an entry changed since setCacheSaved(), refreshed expiry times don't count
+    bool isCacheChanged() const;
+    void setCacheSaved();
+
+    // resolves the hostnames, unexpired cache entries are reported without a lookup, and looks them up
+    // again every time their records expire
+    void watch(const QStringList &hostnames);
+    // forgets the watched hostnames and cancels the lookups in flight, the cache is kept
+    void stop();
+    bool isWatching() const;
+
+    void setMaxConcurrentLookups(int count);
+
+signals:
+    void resolved(const QMap<QString, QStringList> &addresses);
+
+private:
+    struct CacheEntry
+    {
+        QStringList addresses;
+        qint64 expiresAt = 0;
+    };
+
+    void enqueue(const QString &hostname);
+    void startLookups();
+    void onLookupFinished(QDnsLookup *lookup);
+    void finishWaveIfDone();
+    void refresh();
+    void scheduleRefresh();
+
+    QHash<QString, CacheEntry> m_cache;
+    QSet<QString> m_watched;
+
+    QStringList m_queue;
+    // queued or being looked up
+    QSet<QString> m_queuedHostnames;
+    QList<QDnsLookup *> m_lookups;
+    QMap<QString, QStringList> m_waveAddresses;
+    bool m_isWaveFinishScheduled = false;
+    bool m_isCacheChanged = false;
+
+    QTimer *m_refreshTimer;
+    int m_maxConcurrentLookups = 16;
+};
+
+#endif // SITESRESOLVER_H
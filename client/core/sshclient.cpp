@@ -1,6 +1,9 @@
 #include "sshclient.h"
+#include "sshsessionpool.h"
 
+#include <QBuffer>
 #include <QEventLoop>
+#include <QUuid>
 #include <QtConcurrent>
 
 #include <fstream>
@@ -21,19 +24,35 @@ namespace libssh {
         return 0;
     }
 
+    Client::~Client()
+    {
+        disconnectFromHost();
+    }
+
     ErrorCode Client::connectToHost(const ServerCredentials &credentials)
     {
         if (m_session != nullptr) {
             if (!ssh_is_connected(m_session)) {
-                ssh_free(m_session);
+                SessionPool::instance().discard(m_credentials, m_session);
                 m_session = nullptr;
+            } else if (m_credentials.hostName != credentials.hostName || m_credentials.port != credentials.port
+                       || m_credentials.userName != credentials.userName || m_credentials.secretData != credentials.secretData) {
+                disconnectFromHost();
             }
         }
 
         if (m_session == nullptr) {
+            m_credentials = credentials;
+            m_session = SessionPool::instance().acquire(credentials);
+            m_isReusedSession = m_session != nullptr;
+            if (m_isReusedSession) {
+                return ErrorCode::NoError;
+            }
+
             m_session = ssh_new();
 
             if (m_session == nullptr) {
+                SessionPool::instance().discard(credentials, nullptr);
                 qDebug() << "Failed to create ssh session";
                 return ErrorCode::InternalError;
             }
@@ -95,12 +114,18 @@ namespace libssh {
                     if (errorCode == ErrorCode::NoError) {
                         errorCode = ErrorCode::SshPrivateKeyFormatError;
                     }
+                    // never let a connected but unauthenticated session get into the pool
+                    SessionPool::instance().discard(credentials, m_session);
+                    m_session = nullptr;
                     return errorCode;
                 }
             } else {
                 authResult = ssh_userauth_password(m_session, authUsername.c_str(), credentials.secretData.toStdString().c_str());
                 if (authResult != SSH_OK) {
-                    return fromLibsshErrorCode();
+                    ErrorCode errorCode = fromLibsshErrorCode();
+                    SessionPool::instance().discard(credentials, m_session);
+                    m_session = nullptr;
+                    return errorCode;
                 }
             }
         }
@@ -110,10 +135,7 @@ namespace libssh {
     void Client::disconnectFromHost()
     {
         if (m_session != nullptr) {
-            if (ssh_is_connected(m_session)) {
-                ssh_disconnect(m_session);
-            }
-            ssh_free(m_session);
+            SessionPool::instance().release(m_credentials, m_session);
             m_session = nullptr;
         }
     }
@@ -122,30 +144,35 @@ namespace libssh {
                                         const std::function<ErrorCode (const QString &, Client &)> &cbReadStdOut,
                                         const std::function<ErrorCode (const QString &, Client &)> &cbReadStdErr)
     {
-        m_channel = ssh_channel_new(m_session);
-
-        if (m_channel == nullptr) {
-            return closeChannel();
-        }
-
-        int result = ssh_channel_open_session(m_channel);
+        return executeCommand(data, QByteArray(), cbReadStdOut, cbReadStdErr);
+    }
 
-        if (result == SSH_OK && ssh_channel_is_open(m_channel)) {
-            qDebug() << "SSH chanel opened";
-        } else {
-            return closeChannel();
+    ErrorCode Client::executeCommand(const QString &data, const QByteArray &input,
+                                        const std::function<ErrorCode (const QString &, Client &)> &cbReadStdOut,
+                                        const std::function<ErrorCode (const QString &, Client &)> &cbReadStdErr)
+    {
+        auto errorCode = openChannel();
+        if (errorCode != ErrorCode::NoError) {
+            return errorCode;
         }
 
         QFutureWatcher<ErrorCode> watcher;
         connect(&watcher, &QFutureWatcher<ErrorCode>::finished, this, &Client::writeToChannelFinished);
 
-        QFuture<ErrorCode> future = QtConcurrent::run([this, &data, &cbReadStdOut, &cbReadStdErr]() {
+        QFuture<ErrorCode> future = QtConcurrent::run([this, &data, &input, &cbReadStdOut, &cbReadStdErr]() {
             const size_t bufferSize = 2048;
 
             int bytesRead = 0;
             char buffer[bufferSize];
 
             int result = ssh_channel_request_exec(m_channel, data.toUtf8());
+            if (result == SSH_OK && !input.isNull()) {
+                // stream the input into the command's stdin, without input stdin stays open for writeResponse()
+                if (ssh_channel_write(m_channel, input.constData(), input.size()) != input.size()) {
+                    return closeChannel();
+                }
+                ssh_channel_send_eof(m_channel);
+            }
             if (result == SSH_OK) {
                 std::string output;
                 auto readOutput = [&](bool isStdErr) {
@@ -194,6 +221,151 @@ namespace libssh {
         return watcher.result();
     }
 
+    ErrorCode Client::executeScript(const QStringList &commands,
+                                    const std::function<ErrorCode (const QString &, Client &)> &cbReadStdOut,
+                                    const std::function<ErrorCode (const QString &, Client &)> &cbReadStdErr,
+                                    QList<int> &exitStatuses)
+    {
+        exitStatuses.clear();
+
+        auto errorCode = openChannel();
+        if (errorCode != ErrorCode::NoError) {
+            return errorCode;
+        }
+
+        QFutureWatcher<ErrorCode> watcher;
+        connect(&watcher, &QFutureWatcher<ErrorCode>::finished, this, &Client::writeToChannelFinished);
+
+        QFuture<ErrorCode> future = QtConcurrent::run([this, &commands, &cbReadStdOut, &cbReadStdErr, &exitStatuses]() {
+            const size_t bufferSize = 2048;
+            char buffer[bufferSize];
+
+            // Every command runs in its own subshell with stdin detached from the channel, so `cd`, variables and `exit`
+            // behave as if the command had its own channel. After each command a sentinel line is printed to stdout
+            // (followed by the exit status) and to stderr, which lets us split both streams back into per-command output.
+            // The very first sentinel separates the output of the login shell profile from the script output.
+            const QByteArray sentinel = "__amnezia_" + QUuid::createUuid().toString(QUuid::Id128).toUtf8() + "__";
+            const QByteArray frameEnd = "echo \"" + sentinel + " $?\"; echo \"" + sentinel + "\" >&2\n";
+
+            QByteArray payload = "true\n" + frameEnd;
+            for (const QString &command : commands) {
+                payload += "(\n" + command.toUtf8() + "\n) </dev/null\n" + frameEnd;
+            }
+
+            if (ssh_channel_request_shell(m_channel) != SSH_OK) {
+                return closeChannel();
+            }
+
+            if (ssh_channel_write(m_channel, payload.constData(), payload.size()) != payload.size()) {
+                return closeChannel();
+            }
+            ssh_channel_send_eof(m_channel);
+
+            struct StreamState
+            {
+                QByteArray buffer;
+                int framesDone = 0;
+            };
+            StreamState streams[2];
+            const int framesCount = commands.size() + 1;
+
+            auto deliver = [&](bool isStdErr, const QByteArray &data) {
+                // output that arrives before the first sentinel belongs to the shell startup and is dropped
+                if (data.isEmpty() || streams[isStdErr].framesDone == 0) {
+                    return ErrorCode::NoError;
+                }
+                if (cbReadStdOut && !isStdErr) {
+                    return cbReadStdOut(QString::fromUtf8(data), *this);
+                }
+                if (cbReadStdErr && isStdErr) {
+                    return cbReadStdErr(QString::fromUtf8(data), *this);
+                }
+                return ErrorCode::NoError;
+            };
+
+            auto processOutput = [&](bool isStdErr, const QByteArray &data) {
+                StreamState &stream = streams[isStdErr];
+                stream.buffer += data;
+
+                while (true) {
+                    const int sentinelPos = stream.buffer.indexOf(sentinel);
+                    const int lineEnd = sentinelPos < 0 ? -1 : stream.buffer.indexOf('\n', sentinelPos);
+                    if (lineEnd < 0) {
+                        // keep the output of a single command in one piece unless it grows too large,
+                        // then flush it up to the last complete line that can't contain the sentinel
+                        if (stream.buffer.size() > static_cast<int>(bufferSize)) {
+                            const int safeEnd = sentinelPos < 0 ? stream.buffer.size() - sentinel.size() : sentinelPos;
+                            const int flushSize = stream.buffer.lastIndexOf('\n', safeEnd) + 1;
+                            if (flushSize > 0) {
+                                auto error = deliver(isStdErr, stream.buffer.left(flushSize));
+                                stream.buffer.remove(0, flushSize);
+                                if (error != ErrorCode::NoError) {
+                                    return error;
+                                }
+                            }
+                        }
+                        return ErrorCode::NoError;
+                    }
+
+                    auto error = deliver(isStdErr, stream.buffer.left(sentinelPos));
+                    if (error != ErrorCode::NoError) {
+                        return error;
+                    }
+
+                    if (!isStdErr && stream.framesDone > 0) {
+                        const int statusPos = sentinelPos + sentinel.size();
+                        exitStatuses.append(stream.buffer.mid(statusPos, lineEnd - statusPos).trimmed().toInt());
+                    }
+                    stream.framesDone++;
+                    stream.buffer.remove(0, lineEnd + 1);
+                }
+            };
+
+            while (streams[0].framesDone < framesCount || streams[1].framesDone < framesCount) {
+                bool hasData = false;
+                for (bool isStdErr : { false, true }) {
+                    int bytesRead = ssh_channel_read_nonblocking(m_channel, buffer, sizeof(buffer), isStdErr);
+                    if (bytesRead == SSH_ERROR) {
+                        return closeChannel();
+                    }
+                    if (bytesRead > 0) {
+                        hasData = true;
+                        auto error = processOutput(isStdErr, QByteArray(buffer, bytesRead));
+                        if (error != ErrorCode::NoError) {
+                            closeChannel();
+                            return error;
+                        }
+                    }
+                }
+
+                if (!hasData) {
+                    if (ssh_channel_is_eof(m_channel)) {
+                        break;
+                    }
+                    ssh_channel_poll_timeout(m_channel, 100, 0);
+                }
+            }
+
+            // the shell exited before all sentinels were printed, pass through whatever is left
+            for (bool isStdErr : { false, true }) {
+                auto error = deliver(isStdErr, streams[isStdErr].buffer);
+                if (error != ErrorCode::NoError) {
+                    closeChannel();
+                    return error;
+                }
+            }
+
+            return closeChannel();
+        });
+        watcher.setFuture(future);
+
+        QEventLoop wait;
+        QObject::connect(this, &Client::writeToChannelFinished, &wait, &QEventLoop::quit);
+        wait.exec();
+
+        return watcher.result();
+    }
+
     ErrorCode Client::writeResponse(const QString &data)
     {
         if (m_channel == nullptr) {
@@ -208,6 +380,42 @@ namespace libssh {
         return fromLibsshErrorCode();
     }
 
+    ErrorCode Client::openChannel()
+    {
+        m_channel = ssh_channel_new(m_session);
+
+        if (m_channel != nullptr && ssh_channel_open_session(m_channel) == SSH_OK && ssh_channel_is_open(m_channel)) {
+            qDebug() << "SSH chanel opened";
+            return ErrorCode::NoError;
+        }
+
+        if (m_isReusedSession) {
+            if (m_channel != nullptr) {
+                ssh_channel_free(m_channel);
+                m_channel = nullptr;
+            }
+
+            auto errorCode = reconnectStaleSession();
+            if (errorCode != ErrorCode::NoError) {
+                return errorCode;
+            }
+            return openChannel();
+        }
+
+        auto errorCode = closeChannel();
+        return errorCode == ErrorCode::NoError ? ErrorCode::SshInternalError : errorCode;
+    }
+
+    ErrorCode Client::reconnectStaleSession()
+    {
+        qDebug() << "Pooled ssh session is stale, reconnecting";
+        SessionPool::instance().discard(m_credentials, m_session);
+        m_session = nullptr;
+
+        const ServerCredentials credentials = m_credentials;
+        return connectToHost(credentials);
+    }
+
     ErrorCode Client::closeChannel()
     {
         if (m_channel != nullptr) {
@@ -225,57 +433,75 @@ namespace libssh {
 
     ErrorCode Client::scpFileCopy(const ScpOverwriteMode overwriteMode, const QString& localPath, const QString& remotePath, const QString &fileDesc)
     {
-        m_scpSession = ssh_scp_new(m_session, SSH_SCP_WRITE, remotePath.toStdString().c_str());
+        QFile fin(localPath);
+        if (!fin.open(QIODevice::ReadOnly)) {
+            return fromFileErrorCode(fin.error());
+        }
 
-        if (m_scpSession == nullptr) {
-            return fromLibsshErrorCode();
+        return scpCopy(overwriteMode, fin, remotePath);
+    }
+
+    ErrorCode Client::scpCopy(const ScpOverwriteMode overwriteMode, const QByteArray &data, const QString &remotePath)
+    {
+        QBuffer buffer;
+        buffer.setData(data);
+        buffer.open(QIODevice::ReadOnly);
+
+        return scpCopy(overwriteMode, buffer, remotePath);
+    }
+
+    ErrorCode Client::scpCopy(const ScpOverwriteMode overwriteMode, QIODevice &source, const QString &remotePath)
+    {
+        if (!source.isOpen() || source.isSequential()) {
+            qCritical() << "scp source must be an open random-access device";
+            return ErrorCode::InternalError;
         }
 
-        if (ssh_scp_init(m_scpSession) != SSH_OK) {
+        m_scpSession = ssh_scp_new(m_session, SSH_SCP_WRITE, remotePath.toStdString().c_str());
+
+        if (m_scpSession == nullptr || ssh_scp_init(m_scpSession) != SSH_OK) {
             auto errorCode = fromLibsshErrorCode();
             closeScpSession();
-            return errorCode;
+
+            // nothing was read from the source yet, so the copy can start over on a fresh session
+            if (m_isReusedSession) {
+                errorCode = reconnectStaleSession();
+                if (errorCode != ErrorCode::NoError) {
+                    return errorCode;
+                }
+                return scpCopy(overwriteMode, source, remotePath);
+            }
+            return errorCode == ErrorCode::NoError ? ErrorCode::SshInternalError : errorCode;
         }
 
         QFutureWatcher<ErrorCode> watcher;
         connect(&watcher, &QFutureWatcher<ErrorCode>::finished, this, &Client::scpFileCopyFinished);
-        QFuture<ErrorCode> future = QtConcurrent::run([this, overwriteMode, &localPath, &remotePath, &fileDesc]() {
+        QFuture<ErrorCode> future = QtConcurrent::run([this, overwriteMode, &source, &remotePath]() {
             const int accessType = O_WRONLY | O_CREAT | overwriteMode;
-            const int localFileSize = QFileInfo(localPath).size();
+            const qint64 sourceSize = source.size() - source.pos();
 
-            int result = ssh_scp_push_file(m_scpSession, remotePath.toStdString().c_str(), localFileSize, accessType);
+            int result = ssh_scp_push_file64(m_scpSession, remotePath.toStdString().c_str(), sourceSize, accessType);
             if (result != SSH_OK) {
                 return fromLibsshErrorCode();
             }
 
-            QFile fin(localPath);
-
-            if (fin.open(QIODevice::ReadOnly)) {
-                constexpr size_t bufferSize = 16384;
-                int transferred = 0;
-                int currentChunkSize = bufferSize;
-
-                while (transferred < localFileSize) {
-
-                    // Last Chunk
-                    if ((localFileSize - transferred) < bufferSize) {
-                        currentChunkSize = localFileSize % bufferSize;
-                    }
-
-                    QByteArray chunk = fin.read(currentChunkSize);
-                    if (chunk.size() != currentChunkSize) {
-                        return fromFileErrorCode(fin.error());
-                    }
+            constexpr qint64 bufferSize = 16384;
+            char buffer[bufferSize];
+            qint64 transferred = 0;
 
-                    result = ssh_scp_write(m_scpSession, chunk.data(), chunk.size());
-                    if (result != SSH_OK) {
-                        return fromLibsshErrorCode();
-                    }
+            while (transferred < sourceSize) {
+                const qint64 chunkSize = source.read(buffer, qMin(bufferSize, sourceSize - transferred));
+                if (chunkSize <= 0) {
+                    auto file = qobject_cast<QFileDevice *>(&source);
+                    return file ? fromFileErrorCode(file->error()) : ErrorCode::ReadError;
+                }
 
-                    transferred += currentChunkSize;
+                result = ssh_scp_write(m_scpSession, buffer, chunkSize);
+                if (result != SSH_OK) {
+                    return fromLibsshErrorCode();
                 }
-            } else {
-                return fromFileErrorCode(fin.error());
+
+                transferred += chunkSize;
             }
 
             return ErrorCode::NoError;
@@ -24,27 +24,41 @@ namespace libssh {
         Q_OBJECT
     public:
         Client() = default;
-        ~Client() = default;
+        ~Client();
 
         ErrorCode connectToHost(const ServerCredentials &credentials);
         void disconnectFromHost();
         ErrorCode executeCommand(const QString &data,
                                  const std::function<ErrorCode (const QString &, Client &)> &cbReadStdOut,
                                  const std::function<ErrorCode (const QString &, Client &)> &cbReadStdErr);
+        ErrorCode executeCommand(const QString &data, const QByteArray &input,
+                                 const std::function<ErrorCode (const QString &, Client &)> &cbReadStdOut,
+                                 const std::function<ErrorCode (const QString &, Client &)> &cbReadStdErr);
+        ErrorCode executeScript(const QStringList &commands,
+                                const std::function<ErrorCode (const QString &, Client &)> &cbReadStdOut,
+                                const std::function<ErrorCode (const QString &, Client &)> &cbReadStdErr,
+                                QList<int> &exitStatuses);
         ErrorCode writeResponse(const QString &data);
         ErrorCode scpFileCopy(const ScpOverwriteMode overwriteMode,
                                const QString &localPath,
                                const QString &remotePath,
                                const QString &fileDesc);
+        ErrorCode scpCopy(const ScpOverwriteMode overwriteMode, const QByteArray &data, const QString &remotePath);
+        ErrorCode scpCopy(const ScpOverwriteMode overwriteMode, QIODevice &source, const QString &remotePath);
         ErrorCode getDecryptedPrivateKey(const ServerCredentials &credentials, QString &decryptedPrivateKey, const std::function<QString()> &passphraseCallback);
     private:
+        ErrorCode openChannel();
         ErrorCode closeChannel();
+        // the server may have dropped a pooled session while it was idle, replaces it with a fresh connection
+        ErrorCode reconnectStaleSession();
         void closeScpSession();
         ErrorCode fromLibsshErrorCode();
         ErrorCode fromFileErrorCode(QFileDevice::FileError fileError);
         static int callback(const char *prompt, char *buf, size_t len, int echo, int verify, void *userdata);
 
         ssh_session m_session = nullptr;
+        ServerCredentials m_credentials;
+        bool m_isReusedSession = false;
         ssh_channel m_channel = nullptr;
         ssh_scp m_scpSession = nullptr;
 
@@ -0,0 +1,263 @@
+#include "sshsessionpool.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QMutexLocker>
+
+namespace
+{
+    // a client that still holds a lease of the same host on this thread would wait forever
+    constexpr int maxLeaseWaitMsecs = 30 * 1000;
+}
+
+namespace libssh {
+    SessionPool::SessionPool()
+    {
+        if (QCoreApplication::instance()) {
+            m_sweepTimer.moveToThread(QCoreApplication::instance()->thread());
+        }
+        QObject::connect(&m_sweepTimer, &QTimer::timeout, &m_sweepTimer, [this]() {
+            QMutexLocker locker(&m_mutex);
+            evictExpiredSessions();
+            if (m_idleSessions.isEmpty()) {
+                m_sweepTimer.stop();
+            }
+        });
+    }
+
+    SessionPool &SessionPool::instance()
+    {
+        static SessionPool pool;
+        return pool;
+    }
+
+    SessionPool::~SessionPool()
+    {
+        clear();
+    }
+
+    ssh_session SessionPool::acquire(const ServerCredentials &credentials)
+    {
+        QMutexLocker locker(&m_mutex);
+        evictExpiredSessions();
+
+        const QString key = sessionKey(credentials);
+        const QString host = hostKey(credentials);
+
+        QElapsedTimer waitTimer;
+        waitTimer.start();
+        while (m_leasedSessions.value(host) >= m_maxSessionsPerHost) {
+            const qint64 remaining = maxLeaseWaitMsecs - waitTimer.elapsed();
+            if (remaining <= 0 || !m_sessionReleased.wait(&m_mutex, remaining)) {
+                qWarning() << "SessionPool: no ssh session of" << credentials.hostName << "was released in time, opening one more";
+                break;
+            }
+        }
+
+        ssh_session session = nullptr;
+        QList<IdleSession> &idleSessions = m_idleSessions[key];
+        while (!idleSessions.isEmpty()) {
+            IdleSession idleSession = idleSessions.takeLast();
+            if (ssh_is_connected(idleSession.session)) {
+                session = idleSession.session;
+                break;
+            }
+            closeSession(idleSession.session);
+        }
+        if (idleSessions.isEmpty()) {
+            m_idleSessions.remove(key);
+        }
+
+        // make room for a new session by dropping idle sessions of the same host opened with other credentials
+        if (session == nullptr) {
+            while (sessionsPerHost(host) >= m_maxSessionsPerHost && evictOldestSession(host)) {
+            }
+        }
+
+        m_leasedSessions[host]++;
+
+        if (session != nullptr) {
+            qDebug() << "SessionPool: reusing ssh session for" << credentials.hostName;
+        }
+        return session;
+    }
+
+    void SessionPool::release(const ServerCredentials &credentials, ssh_session session)
+    {
+        QMutexLocker locker(&m_mutex);
+
+        const QString host = hostKey(credentials);
+        if (m_leasedSessions.value(host) > 0 && --m_leasedSessions[host] == 0) {
+            m_leasedSessions.remove(host);
+        }
+        m_sessionReleased.wakeAll();
+
+        if (session == nullptr) {
+            return;
+        }
+
+        if (!ssh_is_connected(session) || sessionsPerHost(host) >= m_maxSessionsPerHost) {
+            closeSession(session);
+            return;
+        }
+
+        IdleSession idleSession;
+        idleSession.hostKey = host;
+        idleSession.session = session;
+        idleSession.idleTimer.start();
+        m_idleSessions[sessionKey(credentials)].append(idleSession);
+
+        evictExpiredSessions();
+        scheduleSweep();
+    }
+
+    void SessionPool::discard(const ServerCredentials &credentials, ssh_session session)
+    {
+        QMutexLocker locker(&m_mutex);
+
+        const QString host = hostKey(credentials);
+        if (m_leasedSessions.value(host) > 0 && --m_leasedSessions[host] == 0) {
+            m_leasedSessions.remove(host);
+        }
+        m_sessionReleased.wakeAll();
+
+        if (session != nullptr) {
+            closeSession(session);
+        }
+    }
+
+    void SessionPool::removeSessions(const ServerCredentials &credentials)
+    {
+        QMutexLocker locker(&m_mutex);
+
+        const QString host = hostKey(credentials);
+        for (auto it = m_idleSessions.begin(); it != m_idleSessions.end();) {
+            if (!it->isEmpty() && it->first().hostKey == host) {
+                for (const IdleSession &idleSession : *it) {
+                    closeSession(idleSession.session);
+                }
+                it = m_idleSessions.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void SessionPool::clear()
+    {
+        QMutexLocker locker(&m_mutex);
+
+        for (const QList<IdleSession> &idleSessions : std::as_const(m_idleSessions)) {
+            for (const IdleSession &idleSession : idleSessions) {
+                closeSession(idleSession.session);
+            }
+        }
+        m_idleSessions.clear();
+    }
+
+    void SessionPool::setIdleTimeout(int msecs)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_idleTimeout = msecs;
+        if (!m_idleSessions.isEmpty()) {
+            scheduleSweep();
+        }
+    }
+
+    void SessionPool::setMaxSessionsPerHost(int count)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_maxSessionsPerHost = qMax(1, count);
+        m_sessionReleased.wakeAll();
+    }
+
+    void SessionPool::scheduleSweep()
+    {
+        // the timer lives in the main thread, this is a direct call there and a queued one elsewhere
+        QMetaObject::invokeMethod(&m_sweepTimer, [this, interval = qMax(1000, m_idleTimeout / 2)]() {
+            if (!m_sweepTimer.isActive() || m_sweepTimer.interval() != interval) {
+                m_sweepTimer.start(interval);
+            }
+        });
+    }
+
+    QString SessionPool::sessionKey(const ServerCredentials &credentials)
+    {
+        // the secret is part of the key, so changed credentials never get a session authenticated with the old ones
+        const QByteArray secretHash = QCryptographicHash::hash(credentials.secretData.toUtf8(), QCryptographicHash::Sha256).toHex();
+        return QString("%1@%2#%3").arg(credentials.userName, hostKey(credentials), QString::fromLatin1(secretHash));
+    }
+
+    QString SessionPool::hostKey(const ServerCredentials &credentials)
+    {
+        return QString("%1:%2").arg(credentials.hostName).arg(credentials.port);
+    }
+
+    void SessionPool::closeSession(ssh_session session)
+    {
+        if (ssh_is_connected(session)) {
+            ssh_disconnect(session);
+        }
+        ssh_free(session);
+    }
+
+    void SessionPool::evictExpiredSessions()
+    {
+        for (auto it = m_idleSessions.begin(); it != m_idleSessions.end();) {
+            QList<IdleSession> &idleSessions = *it;
+            for (int i = idleSessions.size() - 1; i >= 0; i--) {
+                if (idleSessions.at(i).idleTimer.hasExpired(m_idleTimeout)) {
+                    closeSession(idleSessions.at(i).session);
+                    idleSessions.removeAt(i);
+                }
+            }
+
+            if (idleSessions.isEmpty()) {
+                it = m_idleSessions.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    bool SessionPool::evictOldestSession(const QString &hostKey)
+    {
+        QString oldestKey;
+        int oldestIndex = -1;
+        qint64 oldestElapsed = -1;
+
+        for (auto it = m_idleSessions.cbegin(); it != m_idleSessions.cend(); ++it) {
+            for (int i = 0; i < it->size(); i++) {
+                const IdleSession &idleSession = it->at(i);
+                if (idleSession.hostKey == hostKey && idleSession.idleTimer.elapsed() > oldestElapsed) {
+                    oldestKey = it.key();
+                    oldestIndex = i;
+                    oldestElapsed = idleSession.idleTimer.elapsed();
+                }
+            }
+        }
+
+        if (oldestIndex < 0) {
+            return false;
+        }
+
+        QList<IdleSession> &idleSessions = m_idleSessions[oldestKey];
+        closeSession(idleSessions.takeAt(oldestIndex).session);
+        if (idleSessions.isEmpty()) {
+            m_idleSessions.remove(oldestKey);
+        }
+        return true;
+    }
+
+    int SessionPool::sessionsPerHost(const QString &hostKey) const
+    {
+        int count = m_leasedSessions.value(hostKey);
+        for (const QList<IdleSession> &idleSessions : m_idleSessions) {
+            if (!idleSessions.isEmpty() && idleSessions.first().hostKey == hostKey) {
+                count += idleSessions.size();
+            }
+        }
+        return count;
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef SSHSESSIONPOOL_H
+#define SSHSESSIONPOOL_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QTimer>
+#include <QWaitCondition>
+
+#include <libssh/libssh.h>
+
+#include "defs.h"
+
+using namespace amnezia;
+
+namespace libssh {
+    // Process-wide pool of authenticated ssh sessions shared by every libssh::Client.
+    // A session is leased exclusively to one client at a time and returned to the pool
+    // on disconnect, so the next client with the same credentials skips the handshake.
+    // At most maxSessionsPerHost sessions are leased per host at a time, further clients wait for one of them.
+    class SessionPool
+    {
+    public:
+        static SessionPool &instance();
+
+        // Returns a healthy idle session for the credentials or nullptr if a new one has to be created.
+        // Blocks while the host has all its sessions leased. Every call must be paired with release() or discard().
+        ssh_session acquire(const ServerCredentials &credentials);
+        void release(const ServerCredentials &credentials, ssh_session session);
+        void discard(const ServerCredentials &credentials, ssh_session session);
+
+        void removeSessions(const ServerCredentials &credentials);
+        void clear();
+
+        void setIdleTimeout(int msecs);
+        void setMaxSessionsPerHost(int count);
+
+    private:
+        SessionPool();
+        ~SessionPool();
+        SessionPool(const SessionPool &) = delete;
+        SessionPool &operator=(const SessionPool &) = delete;
+
+        struct IdleSession
+        {
+            QString hostKey;
+            ssh_session session = nullptr;
+            QElapsedTimer idleTimer;
+        };
+
+        static QString sessionKey(const ServerCredentials &credentials);
+        static QString hostKey(const ServerCredentials &credentials);
+        static void closeSession(ssh_session session);
+
+        void evictExpiredSessions();
+        void scheduleSweep();
+        bool evictOldestSession(const QString &hostKey);
+        int sessionsPerHost(const QString &hostKey) const;
+
+        QMutex m_mutex;
+        QWaitCondition m_sessionReleased;
+        // closes expired idle sessions even if nobody uses the pool anymore, lives in the main thread
+        QTimer m_sweepTimer;
+        QHash<QString, QList<IdleSession>> m_idleSessions;
+        QHash<QString, int> m_leasedSessions;
+
+        int m_idleTimeout = 5 * 60 * 1000;
+        int m_maxSessionsPerHost = 4;
+    };
+}
+
+#endif // SSHSESSIONPOOL_H
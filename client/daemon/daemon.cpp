@@ -546,7 +546,7 @@ QJsonObject Daemon::getStatus() {
 void Daemon::checkHandshake() {
   Q_ASSERT(wgutils() != nullptr);
 
-  logger.debug() << "Checking for handshake...";
+  LOG_DEBUG(logger) << "Checking for handshake...";
 
   int pendingHandshakes = 0;
   QList<WireguardUtils::PeerStatus> peers = wgutils()->getPeerStatus();
@@ -555,7 +555,7 @@ void Daemon::checkHandshake() {
     if (connection.m_date.isValid()) {
       continue;
     }
-    logger.debug() << "awaiting" << config.m_serverPublicKey;
+    LOG_DEBUG(logger).kv("awaiting", config.m_serverPublicKey);
 
     // Check if the handshake has completed.
     for (const WireguardUtils::PeerStatus& status : peers) {
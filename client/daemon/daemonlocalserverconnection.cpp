@@ -46,7 +46,7 @@ DaemonLocalServerConnection::~DaemonLocalServerConnection() {
 }
 
 void DaemonLocalServerConnection::readData() {
-  logger.debug() << "Read Data";
+  LOG_DEBUG(logger) << "Read Data";
 
   Q_ASSERT(m_socket);
 
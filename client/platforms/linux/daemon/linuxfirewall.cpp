@@ -31,8 +31,12 @@
 // along with this file. If not, see <https://www.gnu.org/licenses/>.
 
 #include "linuxfirewall.h"
+#include "nftablesfirewall.h"
 #include "logger.h"
 #include <QProcess>
+#include <QMap>
+#include <QSet>
+#include <QStandardPaths>
 
 #define BRAND_CODE "amn"
 
@@ -66,6 +70,157 @@ static QString getCommand(LinuxFirewall::IPVersion ip)
     return ip == LinuxFirewall::IPv6 ? QStringLiteral("ip6tables") : QStringLiteral("iptables");
 }
 
+static QString getRestoreCommand(LinuxFirewall::IPVersion ip)
+{
+    return ip == LinuxFirewall::IPv6 ? QStringLiteral("ip6tables-restore") : QStringLiteral("iptables-restore");
+}
+
+namespace
+{
+// Our chains are not programmed rule by rule. The desired state of every chain is kept here,
+// changed chains are rendered into one iptables-restore payload per IP version and the kernel
+// swaps each table atomically on COMMIT. Chains are only rewritten if they differ from the
+// last applied state, so e.g. updating the allowed networks touches a single chain.
+using ChainRules = QMap<QString, QStringList>;
+using Ruleset = QHash<QString, ChainRules>; // table name -> chain name -> rules
+
+Ruleset desiredRules[2];
+Ruleset appliedRules[2];
+// chains to delete even if they are unknown to appliedRules, e.g. left over from a previous run
+QHash<QString, QSet<QString>> removedChains[2];
+// commands for the built-in chains, they can only run once our chains exist
+QStringList deferredCommands;
+int transactionDepth = 0;
+
+bool isBuiltinChain(const QString &chain)
+{
+    static const QStringList builtinChains { QStringLiteral("INPUT"), QStringLiteral("OUTPUT"), QStringLiteral("FORWARD"),
+                                             QStringLiteral("PREROUTING"), QStringLiteral("POSTROUTING") };
+    return builtinChains.contains(chain);
+}
+
+QByteArray renderRestorePayload(const Ruleset &desired, const Ruleset &applied, const QHash<QString, QSet<QString>> &removed)
+{
+    QStringList tables = desired.keys() + applied.keys() + removed.keys();
+    tables.removeDuplicates();
+    tables.sort();
+
+    QByteArray payload;
+    for (const QString &table : tables)
+    {
+        const ChainRules desiredChains = desired.value(table);
+        const ChainRules appliedChains = applied.value(table);
+
+        // declaring a chain creates it or flushes it if it exists, even with --noflush
+        QStringList declarations;
+        QStringList rules;
+        for (auto it = desiredChains.cbegin(); it != desiredChains.cend(); ++it)
+        {
+            auto appliedChain = appliedChains.constFind(it.key());
+            if (appliedChain != appliedChains.cend() && appliedChain.value() == it.value())
+                continue;
+
+            declarations << QStringLiteral(":%1 - [0:0]").arg(it.key());
+            for (const QString &rule : it.value())
+                rules << QStringLiteral("-A %1 %2").arg(it.key(), rule);
+        }
+
+        QSet<QString> deletedChains = removed.value(table);
+        for (auto it = appliedChains.cbegin(); it != appliedChains.cend(); ++it)
+            deletedChains.insert(it.key());
+        QStringList deletedChainsList = deletedChains.values();
+        deletedChainsList.sort();
+        for (const QString &chain : deletedChainsList)
+        {
+            if (desiredChains.contains(chain))
+                continue;
+            // all the deleted chains are flushed by their declarations before any of them is deleted,
+            // so the jumps between them don't matter
+            declarations << QStringLiteral(":%1 - [0:0]").arg(chain);
+            rules << QStringLiteral("-X %1").arg(chain);
+        }
+
+        if (declarations.isEmpty())
+            continue;
+
+        payload += QStringLiteral("*%1\n%2\n").arg(table, declarations.join('\n')).toUtf8();
+        if (!rules.isEmpty())
+            payload += (rules.join('\n') + '\n').toUtf8();
+        payload += "COMMIT\n";
+    }
+    return payload;
+}
+}
+
+bool LinuxFirewall::isNfTablesBackend()
+{
+    // iptables stays the default, AMNEZIA_FIREWALL_BACKEND=nftables opts in to the nftables backend
+    static const bool isNfTables = [] {
+        if (qEnvironmentVariable("AMNEZIA_FIREWALL_BACKEND").toLower() != QStringLiteral("nftables"))
+            return false;
+        if (!NfTablesFirewall::isAvailable())
+        {
+            logger.warning() << "nftables is not available, using iptables";
+            return false;
+        }
+        return true;
+    }();
+    return isNfTables;
+}
+
+void LinuxFirewall::beginTransaction()
+{
+    if (isNfTablesBackend())
+        return NfTablesFirewall::beginTransaction();
+
+    transactionDepth++;
+}
+
+bool LinuxFirewall::commit()
+{
+    if (isNfTablesBackend())
+        return NfTablesFirewall::commit();
+
+    if (transactionDepth > 0 && --transactionDepth > 0)
+        return true;
+    return applyRules();
+}
+
+void LinuxFirewall::rulesChanged()
+{
+    if (transactionDepth == 0)
+        applyRules();
+}
+
+bool LinuxFirewall::applyRules()
+{
+    bool isApplied = true;
+    for (IPVersion ip : { IPv4, IPv6 })
+    {
+        const QByteArray payload = renderRestorePayload(desiredRules[ip], appliedRules[ip], removedChains[ip]);
+        if (payload.isEmpty())
+            continue;
+
+        if (executeRestore(ip, payload) == 0)
+        {
+            appliedRules[ip] = desiredRules[ip];
+            removedChains[ip].clear();
+        }
+        else
+        {
+            // the failed tables weren't touched, the next commit renders the same difference again
+            isApplied = false;
+        }
+    }
+
+    const QStringList commands = deferredCommands;
+    deferredCommands.clear();
+    for (const QString &command : commands)
+        execute(command);
+
+    return isApplied;
+}
+
 int LinuxFirewall::createChain(LinuxFirewall::IPVersion ip, const QString& chain, const QString& tableName)
 {
     if (ip == Both)
@@ -74,8 +229,10 @@ int LinuxFirewall::createChain(LinuxFirewall::IPVersion ip, const QString& chain
         int result6 = createChain(IPv6, chain, tableName);
         return result4 ? result4 : result6;
     }
-    const QString cmd = getCommand(ip);
-    return execute(QStringLiteral("%1 -N %2 -t %3 || %1 -F %2 -t %3").arg(cmd, chain, tableName));
+    desiredRules[ip][tableName][chain].clear();
+    removedChains[ip][tableName].remove(chain);
+    rulesChanged();
+    return 0;
 }
 
 int LinuxFirewall::deleteChain(LinuxFirewall::IPVersion ip, const QString& chain, const QString& tableName)
@@ -86,8 +243,10 @@ int LinuxFirewall::deleteChain(LinuxFirewall::IPVersion ip, const QString& chain
         int result6 = deleteChain(IPv6, chain, tableName);
         return result4 ? result4 : result6;
     }
-    const QString cmd = getCommand(ip);
-    return execute(QStringLiteral("if %1 -L %2 -n -t %3 > /dev/null 2> /dev/null ; then %1 -F %2 -t %3 && %1 -X %2 -t %3; fi").arg(cmd, chain, tableName));
+    desiredRules[ip][tableName].remove(chain);
+    removedChains[ip][tableName].insert(chain);
+    rulesChanged();
+    return 0;
 }
 
 int LinuxFirewall::linkChain(LinuxFirewall::IPVersion ip, const QString& chain, const QString& parent, bool mustBeFirst, const QString& tableName)
@@ -98,7 +257,28 @@ int LinuxFirewall::linkChain(LinuxFirewall::IPVersion ip, const QString& chain,
         int result6 = linkChain(IPv6, chain, parent, mustBeFirst, tableName);
         return result4 ? result4 : result6;
     }
+
+    if (!isBuiltinChain(parent))
+    {
+        QStringList &rules = desiredRules[ip][tableName][parent];
+        const QString jump = QStringLiteral("-j %1").arg(chain);
+        if (mustBeFirst)
+        {
+            rules.removeAll(jump);
+            rules.prepend(jump);
+        }
+        else if (!rules.contains(jump))
+        {
+            rules.append(jump);
+        }
+        rulesChanged();
+        return 0;
+    }
+
+    // Built-in chains are shared with other software, so they are never flushed by us
+    // and the jumps to our root chains are managed in place.
     const QString cmd = getCommand(ip);
+    QString command;
     if (mustBeFirst)
     {
         // This monster shell script does the following:
@@ -108,10 +288,18 @@ int LinuxFirewall::linkChain(LinuxFirewall::IPVersion ip, const QString& chain,
         //    (we can't safely delete all rules at once since rule numbers change)
         // TODO: occasionally this script results in warnings in logs "Bad rule (does a matching rule exist in the chain?)" - this happens when
         // the e.g OUTPUT chain is empty but this script attempts to delete things from it anyway. It doesn't cause any problems, but we should still fix at some point..
-        return execute(QStringLiteral("if ! %1 -L %2 -n --line-numbers -t %4 2> /dev/null | awk 'int($1) == 1 && $2 == \"%3\" { found=1 } END { if(found==1) { exit 0 } else { exit 1 } }' ; then %1 -I %2 -j %3 -t %4 && %1 -L %2 -n --line-numbers -t %4 2> /dev/null | awk 'int($1) > 1 && $2 == \"%3\" { print $1; exit }' | xargs %1 -t %4 -D %2 ; fi").arg(cmd, parent, chain, tableName));
+        command = QStringLiteral("if ! %1 -L %2 -n --line-numbers -t %4 2> /dev/null | awk 'int($1) == 1 && $2 == \"%3\" { found=1 } END { if(found==1) { exit 0 } else { exit 1 } }' ; then %1 -I %2 -j %3 -t %4 && %1 -L %2 -n --line-numbers -t %4 2> /dev/null | awk 'int($1) > 1 && $2 == \"%3\" { print $1; exit }' | xargs %1 -t %4 -D %2 ; fi").arg(cmd, parent, chain, tableName);
     }
     else
-        return execute(QStringLiteral("if ! %1 -C %2 -j %3 -t %4 2> /dev/null ; then %1 -A %2 -j %3 -t %4; fi").arg(cmd, parent, chain, tableName));
+        command = QStringLiteral("if ! %1 -C %2 -j %3 -t %4 2> /dev/null ; then %1 -A %2 -j %3 -t %4; fi").arg(cmd, parent, chain, tableName);
+
+    // the jump target has to be created by the pending transaction first
+    if (transactionDepth > 0)
+    {
+        deferredCommands << command;
+        return 0;
+    }
+    return execute(command);
 }
 
 int LinuxFirewall::unlinkChain(LinuxFirewall::IPVersion ip, const QString& chain, const QString& parent, const QString& tableName)
@@ -122,12 +310,28 @@ int LinuxFirewall::unlinkChain(LinuxFirewall::IPVersion ip, const QString& chain
         int result6 = unlinkChain(IPv6, chain, parent, tableName);
         return result4 ? result4 : result6;
     }
+
+    if (!isBuiltinChain(parent))
+    {
+        if (desiredRules[ip][tableName].contains(parent))
+        {
+            desiredRules[ip][tableName][parent].removeAll(QStringLiteral("-j %1").arg(chain));
+            rulesChanged();
+        }
+        return 0;
+    }
+
+    // runs right away, the chain can only be deleted by the transaction once nothing jumps to it
     const QString cmd = getCommand(ip);
     return execute(QStringLiteral("if %1 -C %2 -j %3 -t %4 2> /dev/null ; then %1 -D %2 -j %3 -t %4; fi").arg(cmd, parent, chain, tableName));
 }
 
 void LinuxFirewall::ensureRootAnchorPriority(LinuxFirewall::IPVersion ip)
 {
+    // the nftables table has hooks of its own, there is nothing to reorder
+    if (isNfTablesBackend())
+        return;
+
     linkChain(ip, kRootChain, kOutputChain, true);
 }
 
@@ -141,10 +345,11 @@ void LinuxFirewall::installAnchor(LinuxFirewall::IPVersion ip, const QString& an
         return;
     }
 
-    const QString cmd = getCommand(ip);
     const QString anchorChain = QStringLiteral("%1.a.%2").arg(kAnchorName, anchor);
     const QString actualChain = QStringLiteral("%1.%2").arg(kAnchorName, anchor);
 
+    beginTransaction();
+
     // Start by defining a placeholder chain, which stays locked into place
     // in the root chain without being removed or recreated, ensuring the
     // intended precedence order.
@@ -165,8 +370,9 @@ void LinuxFirewall::installAnchor(LinuxFirewall::IPVersion ip, const QString& an
     // Create the actual rule chain, which we'll insert or remove from the
     // placeholder anchor when needed.
     createChain(ip, actualChain, tableName);
-    for (const QString& rule : rules)
-        execute(QStringLiteral("%1 -A %2 %3 -t %4").arg(cmd, actualChain, rule, tableName));
+    desiredRules[ip][tableName][actualChain] = rules;
+
+    commit();
 }
 
 void LinuxFirewall::uninstallAnchor(LinuxFirewall::IPVersion ip, const QString& anchor, const QString& tableName)
@@ -178,13 +384,35 @@ void LinuxFirewall::uninstallAnchor(LinuxFirewall::IPVersion ip, const QString&
         return;
     }
 
-    const QString cmd = getCommand(ip);
     const QString anchorChain = QStringLiteral("%1.a.%2").arg(kAnchorName, anchor);
     const QString actualChain = QStringLiteral("%1.%2").arg(kAnchorName, anchor);
 
+    // also used to remove the leftovers of iptables while nftables is the backend
+    transactionDepth++;
     unlinkChain(ip, anchorChain, kRootChain, tableName);
     deleteChain(ip, anchorChain, tableName);
     deleteChain(ip, actualChain, tableName);
+    if (--transactionDepth == 0)
+        applyRules();
+}
+
+void LinuxFirewall::setChainRules(IPVersion ip, const QString &chain, const QStringList &rules, const QString &tableName)
+{
+    if (ip == Both)
+    {
+        setChainRules(IPv4, chain, rules, tableName);
+        setChainRules(IPv6, chain, rules, tableName);
+        return;
+    }
+
+    ChainRules &chains = desiredRules[ip][tableName];
+    if (!chains.contains(chain))
+    {
+        logger.warning() << "Chain" << chain << "is not installed";
+        return;
+    }
+    chains[chain] = rules;
+    rulesChanged();
 }
 
 QStringList LinuxFirewall::getDNSRules(const QStringList& servers)
@@ -223,6 +451,24 @@ QStringList LinuxFirewall::getBlockRule(const QStringList& servers)
 
 void LinuxFirewall::install()
 {
+    if (isNfTablesBackend())
+    {
+        // the chains of a previous run with iptables would filter the traffic as well
+        if (!QStandardPaths::findExecutable(getRestoreCommand(IPv4)).isEmpty())
+            removeIptablesRules();
+        NfTablesFirewall::install();
+        anchorCallbacks[enabledKeyTemplate.arg(kMangleTable, QStringLiteral("100.tagPkts"))] = setupTrafficSplitting;
+        anchorCallbacks[disabledKeyTemplate.arg(kMangleTable, QStringLiteral("100.tagPkts"))] = teardownTrafficSplitting;
+        setupTrafficSplitting();
+        return;
+    }
+
+    // the same for the table of a previous run with nftables
+    NfTablesFirewall::removeTable();
+
+    // Everything below is applied with one iptables-restore per IP version
+    beginTransaction();
+
     // Clean up any existing rules if they exist.
     uninstall();
 
@@ -324,11 +570,31 @@ void LinuxFirewall::install()
     // Insert our Raw root chain at the top of the PREROUTING chain.
     linkChain(Both, kRootChain, kPreRoutingChain, true, kRawTable);
 
+    commit();
+
     setupTrafficSplitting();
 }
 
 void LinuxFirewall::uninstall()
 {
+    if (isNfTablesBackend())
+    {
+        NfTablesFirewall::uninstall();
+        teardownTrafficSplitting();
+        return;
+    }
+
+    removeIptablesRules();
+    teardownTrafficSplitting();
+
+    logger.debug() << "LinuxFirewall::uninstall() complete";
+}
+
+void LinuxFirewall::removeIptablesRules()
+{
+    // not beginTransaction(), it belongs to nftables if that is the backend
+    transactionDepth++;
+
     // Filter chain
     unlinkChain(Both, kRootChain, kOutputChain, kFilterTable);
     deleteChain(Both, kRootChain, kFilterTable);
@@ -367,61 +633,108 @@ void LinuxFirewall::uninstall()
     // Remove Raw anchors
     uninstallAnchor(Both, QStringLiteral("100.vpnTunOnly"), kRawTable);
 
-    teardownTrafficSplitting();
-
-    logger.debug() << "LinuxFirewall::uninstall() complete";
+    if (--transactionDepth == 0)
+        applyRules();
 }
 
 bool LinuxFirewall::isInstalled()
 {
+    if (isNfTablesBackend())
+        return NfTablesFirewall::isInstalled();
+
+    // a fresh daemon doesn't know the rules of a previous run and installs them again
+    if (!desiredRules[IPv4].value(kFilterTable).contains(kRootChain))
+        return false;
     return execute(QStringLiteral("iptables -C %1 -j %2 2> /dev/null").arg(kOutputChain, kRootChain)) == 0;
 }
 
 void LinuxFirewall::enableAnchor(LinuxFirewall::IPVersion ip, const QString &anchor, const QString& tableName)
 {
+    if (isNfTablesBackend())
+        return NfTablesFirewall::setAnchorEnabled(ip, anchor, true);
+
     if (ip == Both)
     {
         enableAnchor(IPv4, anchor, tableName);
         enableAnchor(IPv6, anchor, tableName);
         return;
     }
-    const QString cmd = getCommand(ip);
     const QString ipStr = ip == IPv6 ? QStringLiteral("(IPv6)") : QStringLiteral("(IPv4)");
+    const QString anchorChain = QStringLiteral("%1.a.%2").arg(kAnchorName, anchor);
+    const QStringList rules { QStringLiteral("-j %1.%2").arg(kAnchorName, anchor) };
+
+    ChainRules &chains = desiredRules[ip][tableName];
+    if (!chains.contains(anchorChain))
+        return;
+    if (chains.value(anchorChain) == rules)
+    {
+        logger.debug() << anchor + ipStr + ": ON";
+        return;
+    }
 
-    execute(QStringLiteral("if %1 -C %5.a.%2 -j %5.%2 -t %4 2> /dev/null ; then echo '%2%3: ON' ; else echo '%2%3: OFF -> ON' ; %1 -A %5.a.%2 -j %5.%2 -t %4; fi").arg(cmd, anchor, ipStr, tableName, kAnchorName));
+    logger.debug() << anchor + ipStr + ": OFF -> ON";
+    chains[anchorChain] = rules;
+    rulesChanged();
 }
 
 void LinuxFirewall::replaceAnchor(LinuxFirewall::IPVersion ip, const QString &anchor, const QString &newRule, const QString& tableName)
 {
+    if (isNfTablesBackend())
+        return NfTablesFirewall::replaceAnchor(ip, anchor, newRule);
+
     if (ip == Both)
     {
         replaceAnchor(IPv4, anchor, newRule, tableName);
         replaceAnchor(IPv6, anchor, newRule, tableName);
         return;
     }
-    const QString cmd = getCommand(ip);
     const QString ipStr = ip == IPv6 ? QStringLiteral("(IPv6)") : QStringLiteral("(IPv4)");
+    const QString actualChain = QStringLiteral("%1.%2").arg(kAnchorName, anchor);
 
-    execute(QStringLiteral("%1 -R %7.%2 1 %3 -t %4 ; echo 'Replaced rule %7.%2 %5 with %6'").arg(cmd, anchor, newRule, tableName, ipStr, newRule, kAnchorName));
+    QStringList rules = desiredRules[ip][tableName].value(actualChain);
+    if (rules.isEmpty())
+        rules.append(newRule);
+    else
+        rules[0] = newRule;
+    setChainRules(ip, actualChain, rules, tableName);
+    logger.debug() << "Replaced rule" << actualChain << ipStr << "with" << newRule;
 }
 
 void LinuxFirewall::disableAnchor(LinuxFirewall::IPVersion ip, const QString &anchor, const QString& tableName)
 {
+    if (isNfTablesBackend())
+        return NfTablesFirewall::setAnchorEnabled(ip, anchor, false);
+
     if (ip == Both)
     {
         disableAnchor(IPv4, anchor, tableName);
         disableAnchor(IPv6, anchor, tableName);
         return;
     }
-    const QString cmd = getCommand(ip);
     const QString ipStr = ip == IPv6 ? QStringLiteral("(IPv6)") : QStringLiteral("(IPv4)");
-    execute(QStringLiteral("if ! %1 -C %5.a.%2 -j %5.%2 -t %4 2> /dev/null ; then echo '%2%3: OFF' ; else echo '%2%3: ON -> OFF' ; %1 -F %5.a.%2 -t %4; fi").arg(cmd, anchor, ipStr, tableName, kAnchorName));
+    const QString anchorChain = QStringLiteral("%1.a.%2").arg(kAnchorName, anchor);
+
+    ChainRules &chains = desiredRules[ip][tableName];
+    if (!chains.contains(anchorChain))
+        return;
+    if (chains.value(anchorChain).isEmpty())
+    {
+        logger.debug() << anchor + ipStr + ": OFF";
+        return;
+    }
+
+    logger.debug() << anchor + ipStr + ": ON -> OFF";
+    chains[anchorChain].clear();
+    rulesChanged();
 }
 
 bool LinuxFirewall::isAnchorEnabled(LinuxFirewall::IPVersion ip, const QString &anchor, const QString& tableName)
 {
-    const QString cmd = getCommand(ip);
-    return execute(QStringLiteral("%1 -C %4.a.%2 -j %4.%2 -t %3 2> /dev/null").arg(cmd, anchor, tableName, kAnchorName)) == 0;
+    if (isNfTablesBackend())
+        return NfTablesFirewall::isAnchorEnabled(ip, anchor);
+
+    const QString anchorChain = QStringLiteral("%1.a.%2").arg(kAnchorName, anchor);
+    return !desiredRules[ip == IPv6 ? IPv6 : IPv4].value(tableName).value(anchorChain).isEmpty();
 }
 
 void LinuxFirewall::setAnchorEnabled(LinuxFirewall::IPVersion ip, const QString &anchor, bool enabled, const QString &tableName)
@@ -442,32 +755,26 @@ void LinuxFirewall::setAnchorEnabled(LinuxFirewall::IPVersion ip, const QString
 
 void LinuxFirewall::updateDNSServers(const QStringList& servers)
 {
-    static QStringList existingServers {};
+    if (isNfTablesBackend())
+        return NfTablesFirewall::updateDNSServers(servers);
 
-    existingServers = servers;
-    execute(QStringLiteral("iptables -F %1.320.allowDNS").arg(kAnchorName));
-    for (const QString& rule : getDNSRules(servers))
-        execute(QStringLiteral("iptables -A %1.320.allowDNS %2").arg(kAnchorName, rule));
+    setChainRules(IPv4, QStringLiteral("%1.320.allowDNS").arg(kAnchorName), getDNSRules(servers));
 }
 
 void LinuxFirewall::updateAllowNets(const QStringList& servers)
 {
-    static QStringList existingServers {};
+    if (isNfTablesBackend())
+        return NfTablesFirewall::updateAllowNets(servers);
 
-    existingServers = servers;
-    execute(QStringLiteral("iptables -F %1.110.allowNets").arg(kAnchorName));
-    for (const QString& rule : getAllowRule(servers))
-        execute(QStringLiteral("iptables -A %1.110.allowNets %2").arg(kAnchorName, rule));
+    setChainRules(IPv4, QStringLiteral("%1.110.allowNets").arg(kAnchorName), getAllowRule(servers));
 }
 
 void LinuxFirewall::updateBlockNets(const QStringList& servers)
 {
-    static QStringList existingServers {};
+    if (isNfTablesBackend())
+        return NfTablesFirewall::updateBlockNets(servers);
 
-    existingServers = servers;
-    execute(QStringLiteral("iptables -F %1.120.blockNets").arg(kAnchorName));
-    for (const QString& rule : getBlockRule(servers))
-        execute(QStringLiteral("iptables -A %1.120.blockNets %2").arg(kAnchorName, rule));
+    setChainRules(IPv4, QStringLiteral("%1.120.blockNets").arg(kAnchorName), getBlockRule(servers));
 }
 
 int waitForExitCode(QProcess& process)
@@ -500,6 +807,27 @@ int LinuxFirewall::execute(const QString &command, bool ignoreErrors)
     return exitCode;
 }
 
+int LinuxFirewall::executeRestore(IPVersion ip, const QByteArray &payload)
+{
+    const QString command = getRestoreCommand(ip);
+
+    QProcess p;
+    p.start(command, {QStringLiteral("--noflush")});
+    p.write(payload);
+    p.closeWriteChannel();
+
+    int exitCode = waitForExitCode(p);
+    auto out = p.readAllStandardOutput().trimmed();
+    auto err = p.readAllStandardError().trimmed();
+    if (exitCode != 0 || !err.isEmpty())
+        logger.warning() << "(" << exitCode << ") $ " << command << "--noflush <<" << payload;
+    if (!out.isEmpty())
+        logger.info() << out;
+    if (!err.isEmpty())
+        logger.warning() << err;
+    return exitCode;
+}
+
 void LinuxFirewall::setupTrafficSplitting()
 {
     auto cGroupDir = "/sys/fs/cgroup/net_cls/" BRAND_CODE "vpnexclusions/";
@@ -79,17 +79,29 @@ private:
     static int unlinkChain(IPVersion ip, const QString& chain, const QString& parent, const QString& tableName = kFilterTable);
     static void installAnchor(IPVersion ip, const QString& anchor, const QStringList& rules, const QString& tableName = kFilterTable, const FilterCallbackFunc& enableFunc = {}, const FilterCallbackFunc& disableFunc = {});
     static void uninstallAnchor(IPVersion ip, const QString& anchor, const QString& tableName = kFilterTable);
+    static void setChainRules(IPVersion ip, const QString& chain, const QStringList& rules, const QString& tableName = kFilterTable);
     static QStringList getDNSRules(const QStringList& servers);
     static QStringList getAllowRule(const QStringList& servers);
     static QStringList getBlockRule(const QStringList& servers);
     static void setupTrafficSplitting();
     static void teardownTrafficSplitting();
     static int execute(const QString& command, bool ignoreErrors = false);
+    static int executeRestore(IPVersion ip, const QByteArray& payload);
+    static bool isNfTablesBackend();
+    static void removeIptablesRules();
+    static void rulesChanged();
+    static bool applyRules();
 private:
     // Chain names
     static QString kOutputChain, kRootChain, kPostRoutingChain, kPreRoutingChain;
 
 public:
+    // Changes made until the matching commit() are applied together with one iptables-restore
+    // per IP version or one nft transaction, outside of a transaction every call is applied on its own.
+    // nftables is used if AMNEZIA_FIREWALL_BACKEND=nftables and the nft binary and the kernel support are available.
+    static void beginTransaction();
+    static bool commit();
+
     static void install();
     static void uninstall();
     static bool isInstalled();
@@ -0,0 +1,470 @@
+#include "nftablesfirewall.h"
+
+#include <QHash>
+#include <QHostAddress>
+#include <QProcess>
+#include <QSet>
+#include <QStandardPaths>
+
+#include "ipaddress.h"
+#include "logger.h"
+
+namespace
+{
+Logger logger("NfTablesFirewall");
+
+const QString kTableName = QStringLiteral("amnvpn");
+// the same values as the iptables rules use, the cgroup and the routing rules are shared
+const QString kPacketTag = QStringLiteral("0x3211");
+const QString kCGroupId = QStringLiteral("0x567");
+
+const QString kAllowNetsSet = QStringLiteral("allownets");
+const QString kBlockNetsSet = QStringLiteral("blocknets");
+const QString kDnsServersSet = QStringLiteral("dnsservers");
+// the IPv6 elements of a set live in a set of their own with this suffix
+const QString kIPv6SetSuffix = QStringLiteral("6");
+
+// the callers only know these anchors for IPv4, their IPv6 chain matches the IPv6 elements of the same set
+const QStringList kSetAnchors = { QStringLiteral("320.allowDNS"), QStringLiteral("120.blockNets"), QStringLiteral("110.allowNets") };
+
+enum class TableAction { None, Create, Delete };
+TableAction pendingTableAction = TableAction::None;
+bool isTableCreated = false;
+
+QSet<QString> desiredEnabledChains;
+// the rules of anchors changed by replaceAnchor()
+QHash<QString, QStringList> desiredAnchorRules;
+// the rules of every non-empty anchor chain in the kernel
+QHash<QString, QStringList> appliedChainRules;
+QHash<QString, QStringList> desiredElements;
+QHash<QString, QStringList> appliedElements;
+int transactionDepth = 0;
+
+int waitForExitCode(QProcess &process)
+{
+    if (!process.waitForFinished() || process.error() == QProcess::FailedToStart)
+        return -2;
+    else if (process.exitStatus() != QProcess::NormalExit)
+        return -1;
+    else
+        return process.exitCode();
+}
+
+QStringList setNames()
+{
+    QStringList names;
+    for (const QString &set : { kAllowNetsSet, kBlockNetsSet, kDnsServersSet })
+        names << set << set + kIPv6SetSuffix;
+    return names;
+}
+
+// Translates the iptables rules replaceAnchor() is used with, e.g. "-o eth0 -j MASQUERADE" or
+// "! -i amn0+ -d 10.8.0.2 -j DROP". Returns an empty string for anything else.
+QString translateRule(LinuxFirewall::IPVersion ip, const QString &rule)
+{
+    static const QHash<QString, QString> verdicts = { { QStringLiteral("ACCEPT"), QStringLiteral("accept") },
+                                                      { QStringLiteral("DROP"), QStringLiteral("drop") },
+                                                      { QStringLiteral("REJECT"), QStringLiteral("reject") },
+                                                      { QStringLiteral("MASQUERADE"), QStringLiteral("masquerade") } };
+
+    const QStringList args = rule.split(' ', Qt::SkipEmptyParts);
+    QStringList matches;
+    QString verdict;
+    bool isNegated = false;
+    for (int i = 0; i < args.size(); i++) {
+        if (args[i] == QStringLiteral("!")) {
+            isNegated = true;
+            continue;
+        }
+        if (i + 1 >= args.size() || !verdict.isEmpty())
+            return {};
+
+        const QString &option = args[i];
+        QString value = args[++i];
+        const QString op = isNegated ? QStringLiteral("!= ") : QString();
+        if (option == QStringLiteral("-o") || option == QStringLiteral("-i")) {
+            // iptables interface wildcards end with '+'
+            if (value.endsWith('+'))
+                value = value.chopped(1) + '*';
+            matches << QStringLiteral("%1 %2\"%3\"").arg(option == QStringLiteral("-o") ? QStringLiteral("oifname") : QStringLiteral("iifname"), op, value);
+        } else if (option == QStringLiteral("-d") || option == QStringLiteral("-s")) {
+            matches << QStringLiteral("%1 %2 %3%4").arg(ip == LinuxFirewall::IPv6 ? QStringLiteral("ip6") : QStringLiteral("ip"),
+                                                       option == QStringLiteral("-d") ? QStringLiteral("daddr") : QStringLiteral("saddr"), op, value);
+        } else if (option == QStringLiteral("-j") && !isNegated && verdicts.contains(value)) {
+            verdict = verdicts.value(value);
+        } else {
+            return {};
+        }
+        isNegated = false;
+    }
+
+    if (verdict.isEmpty())
+        return {};
+    matches << verdict;
+    return matches.join(' ');
+}
+}
+
+const QList<NfTablesFirewall::Anchor> &NfTablesFirewall::anchors()
+{
+    // In the order of evaluation, the first anchor with a verdict wins like with the iptables anchors
+    static const QList<Anchor> anchors = [] {
+        QList<Anchor> result;
+        auto add = [&result](LinuxFirewall::IPVersion ip, const QString &name, const QString &baseChain, const QStringList &rules) {
+            if (ip == LinuxFirewall::Both) {
+                result.append({ name, LinuxFirewall::IPv4, baseChain, rules });
+                result.append({ name, LinuxFirewall::IPv6, baseChain, rules });
+            } else {
+                result.append({ name, ip, baseChain, rules });
+            }
+        };
+
+        const QString output = QStringLiteral("output");
+        add(LinuxFirewall::Both, QStringLiteral("000.allowLoopback"), output, { QStringLiteral("oifname \"lo*\" accept") });
+        add(LinuxFirewall::IPv4, QStringLiteral("320.allowDNS"), output,
+            { QStringLiteral("oifname \"amn0*\" ip daddr @%1 meta l4proto { tcp, udp } th dport 53 accept").arg(kDnsServersSet),
+              QStringLiteral("oifname \"tun0*\" ip daddr @%1 meta l4proto { tcp, udp } th dport 53 accept").arg(kDnsServersSet) });
+        add(LinuxFirewall::IPv6, QStringLiteral("320.allowDNS"), output,
+            { QStringLiteral("oifname \"amn0*\" ip6 daddr @%1%2 meta l4proto { tcp, udp } th dport 53 accept").arg(kDnsServersSet, kIPv6SetSuffix),
+              QStringLiteral("oifname \"tun0*\" ip6 daddr @%1%2 meta l4proto { tcp, udp } th dport 53 accept").arg(kDnsServersSet, kIPv6SetSuffix) });
+        add(LinuxFirewall::Both, QStringLiteral("310.blockDNS"), output, { QStringLiteral("meta l4proto { tcp, udp } th dport 53 reject") });
+        add(LinuxFirewall::IPv4, QStringLiteral("300.allowLAN"), output,
+            { QStringLiteral("ip daddr { 10.0.0.0/8, 169.254.0.0/16, 172.16.0.0/12, 192.168.0.0/16, 224.0.0.0/4, 255.255.255.255 } accept") });
+        add(LinuxFirewall::IPv6, QStringLiteral("300.allowLAN"), output, { QStringLiteral("ip6 daddr { fc00::/7, fe80::/10, ff00::/8 } accept") });
+        add(LinuxFirewall::IPv4, QStringLiteral("290.allowDHCP"), output,
+            { QStringLiteral("ip daddr 255.255.255.255 udp sport 68 udp dport 67 accept") });
+        add(LinuxFirewall::IPv6, QStringLiteral("290.allowDHCP"), output,
+            { QStringLiteral("ip6 daddr ff00::/8 udp sport 546 udp dport 547 accept") });
+        add(LinuxFirewall::IPv6, QStringLiteral("250.blockIPv6"), output, { QStringLiteral("oifname != \"lo*\" reject") });
+        add(LinuxFirewall::Both, QStringLiteral("200.allowVPN"), output,
+            { QStringLiteral("oifname \"amn0*\" accept"), QStringLiteral("oifname \"tun0*\" accept") });
+        add(LinuxFirewall::IPv4, QStringLiteral("120.blockNets"), output, { QStringLiteral("ip daddr @%1 reject").arg(kBlockNetsSet) });
+        add(LinuxFirewall::IPv6, QStringLiteral("120.blockNets"), output,
+            { QStringLiteral("ip6 daddr @%1%2 reject").arg(kBlockNetsSet, kIPv6SetSuffix) });
+        add(LinuxFirewall::IPv4, QStringLiteral("110.allowNets"), output, { QStringLiteral("ip daddr @%1 accept").arg(kAllowNetsSet) });
+        add(LinuxFirewall::IPv6, QStringLiteral("110.allowNets"), output,
+            { QStringLiteral("ip6 daddr @%1%2 accept").arg(kAllowNetsSet, kIPv6SetSuffix) });
+        add(LinuxFirewall::Both, QStringLiteral("100.blockAll"), output, { QStringLiteral("reject") });
+
+        // the same stubs as the iptables anchors, replaceAnchor() sets the actual rules at runtime:
+        // "-o <interface> -j MASQUERADE" for transIp and for vpnTunOnly a rule dropping the packets addressed to
+        // the VPN address that weren't received on the VPN interface, the mitigation of CVE-2019-14899
+        add(LinuxFirewall::Both, QStringLiteral("100.transIp"), QStringLiteral("postrouting"), { QStringLiteral("masquerade") });
+        add(LinuxFirewall::Both, QStringLiteral("100.tagPkts"), QStringLiteral("mangle_output"),
+            { QStringLiteral("meta cgroup %1 meta mark set %2").arg(kCGroupId, kPacketTag) });
+        add(LinuxFirewall::Both, QStringLiteral("100.vpnTunOnly"), QStringLiteral("raw_prerouting"), { QStringLiteral("accept") });
+        return result;
+    }();
+    return anchors;
+}
+
+QString NfTablesFirewall::chainName(LinuxFirewall::IPVersion ip, const QString &anchor)
+{
+    return QStringLiteral("%1.%2").arg(ip == LinuxFirewall::IPv6 ? QStringLiteral("v6") : QStringLiteral("v4"), anchor);
+}
+
+bool NfTablesFirewall::isAvailable()
+{
+    if (QStandardPaths::findExecutable(QStringLiteral("nft")).isEmpty())
+        return false;
+
+    // the binary is useless without the kernel support
+    QProcess p;
+    p.start(QStringLiteral("nft"), { QStringLiteral("list"), QStringLiteral("tables") }, QProcess::ReadOnly);
+    return waitForExitCode(p) == 0;
+}
+
+void NfTablesFirewall::beginTransaction()
+{
+    transactionDepth++;
+}
+
+bool NfTablesFirewall::commit()
+{
+    if (transactionDepth > 0 && --transactionDepth > 0)
+        return true;
+    return apply();
+}
+
+void NfTablesFirewall::install()
+{
+    pendingTableAction = TableAction::Create;
+    desiredEnabledChains.clear();
+    desiredAnchorRules.clear();
+    appliedChainRules.clear();
+    desiredElements.clear();
+    appliedElements.clear();
+    changed();
+}
+
+void NfTablesFirewall::uninstall()
+{
+    pendingTableAction = TableAction::Delete;
+    desiredEnabledChains.clear();
+    desiredAnchorRules.clear();
+    desiredElements.clear();
+    changed();
+
+    logger.debug() << "NfTablesFirewall::uninstall() complete";
+}
+
+bool NfTablesFirewall::isInstalled()
+{
+    if (!isTableCreated)
+        return false;
+
+    // the table is gone if somebody flushed the whole ruleset
+    QProcess p;
+    p.start(QStringLiteral("nft"), { QStringLiteral("list"), QStringLiteral("table"), QStringLiteral("inet"), kTableName },
+            QProcess::ReadOnly);
+    return waitForExitCode(p) == 0;
+}
+
+void NfTablesFirewall::removeTable()
+{
+    if (QStandardPaths::findExecutable(QStringLiteral("nft")).isEmpty())
+        return;
+
+    QProcess p;
+    p.start(QStringLiteral("nft"), { QStringLiteral("delete"), QStringLiteral("table"), QStringLiteral("inet"), kTableName },
+            QProcess::ReadOnly);
+    if (waitForExitCode(p) == 0)
+        logger.info() << "Removed the nftables rules of a previous run";
+}
+
+void NfTablesFirewall::setAnchorEnabled(LinuxFirewall::IPVersion ip, const QString &anchor, bool enabled)
+{
+    if (ip == LinuxFirewall::IPv4 && kSetAnchors.contains(anchor))
+        ip = LinuxFirewall::Both;
+
+    bool isChanged = false;
+    for (const Anchor &a : anchors()) {
+        if (a.name != anchor || (ip != LinuxFirewall::Both && a.ip != ip))
+            continue;
+
+        const QString chain = chainName(a.ip, a.name);
+        if (desiredEnabledChains.contains(chain) == enabled)
+            continue;
+
+        logger.debug() << chain << (enabled ? ": OFF -> ON" : ": ON -> OFF");
+        if (enabled)
+            desiredEnabledChains.insert(chain);
+        else
+            desiredEnabledChains.remove(chain);
+        isChanged = true;
+    }
+
+    if (isChanged)
+        changed();
+}
+
+void NfTablesFirewall::replaceAnchor(LinuxFirewall::IPVersion ip, const QString &anchor, const QString &newRule)
+{
+    bool isChanged = false;
+    for (const Anchor &a : anchors()) {
+        if (a.name != anchor || (ip != LinuxFirewall::Both && a.ip != ip))
+            continue;
+
+        const QString rule = translateRule(a.ip, newRule);
+        if (rule.isEmpty()) {
+            logger.warning() << "Can't replace the rules of" << anchor << "with" << newRule;
+            return;
+        }
+
+        // like with iptables, the first rule of the anchor is replaced
+        const QString chain = chainName(a.ip, a.name);
+        QStringList rules = desiredAnchorRules.value(chain, a.rules);
+        if (rules.isEmpty())
+            rules.append(rule);
+        else
+            rules[0] = rule;
+        if (rules == desiredAnchorRules.value(chain, a.rules))
+            continue;
+
+        desiredAnchorRules.insert(chain, rules);
+        logger.debug() << "Replaced rule" << chain << "with" << rule;
+        isChanged = true;
+    }
+
+    if (isChanged)
+        changed();
+}
+
+bool NfTablesFirewall::isAnchorEnabled(LinuxFirewall::IPVersion ip, const QString &anchor)
+{
+    return desiredEnabledChains.contains(chainName(ip, anchor));
+}
+
+void NfTablesFirewall::updateDNSServers(const QStringList &servers)
+{
+    setElements(kDnsServersSet, servers);
+}
+
+void NfTablesFirewall::updateAllowNets(const QStringList &servers)
+{
+    setElements(kAllowNetsSet, servers);
+}
+
+void NfTablesFirewall::updateBlockNets(const QStringList &servers)
+{
+    setElements(kBlockNetsSet, servers);
+}
+
+void NfTablesFirewall::setElements(const QString &set, const QStringList &servers)
+{
+    // every set holds one address family, anything else would fail the whole transaction
+    QStringList elements;
+    QStringList ipv6Elements;
+    for (const QString &server : servers) {
+        const IPAddress ip(server.trimmed());
+        if (ip.type() == QAbstractSocket::IPv6Protocol) {
+            // parseSubnet() already cleared the host bits
+            const QString network = ip.address().toString();
+            ipv6Elements.append(ip.prefixLength() == 128 ? network : QStringLiteral("%1/%2").arg(network).arg(ip.prefixLength()));
+            continue;
+        }
+        if (ip.type() != QAbstractSocket::IPv4Protocol) {
+            if (!server.trimmed().isEmpty())
+                logger.warning() << "Skipping" << server << "for" << set;
+            continue;
+        }
+
+        const quint32 mask = ip.prefixLength() == 0 ? 0 : ~quint32(0) << (32 - ip.prefixLength());
+        const QHostAddress network(ip.address().toIPv4Address() & mask);
+        elements.append(ip.prefixLength() == 32 ? network.toString() : QStringLiteral("%1/%2").arg(network.toString()).arg(ip.prefixLength()));
+    }
+
+    bool isChanged = false;
+    for (auto [name, familyElements] : { qMakePair(set, elements), qMakePair(set + kIPv6SetSuffix, ipv6Elements) }) {
+        familyElements.sort();
+        familyElements.removeDuplicates();
+        if (desiredElements.value(name) == familyElements)
+            continue;
+        desiredElements.insert(name, familyElements);
+        isChanged = true;
+    }
+
+    if (isChanged)
+        changed();
+}
+
+QByteArray NfTablesFirewall::renderTable()
+{
+    QStringList lines;
+    // declaring the table first keeps the delete from failing if there is no table yet
+    lines << QStringLiteral("table inet %1").arg(kTableName);
+    lines << QStringLiteral("delete table inet %1").arg(kTableName);
+    lines << QStringLiteral("table inet %1 {").arg(kTableName);
+
+    for (const QString &set : setNames()) {
+        lines << QStringLiteral("    set %1 { type %2; flags interval; auto-merge; }")
+                         .arg(set, set.endsWith(kIPv6SetSuffix) ? QStringLiteral("ipv6_addr") : QStringLiteral("ipv4_addr"));
+    }
+
+    for (const Anchor &anchor : anchors())
+        lines << QStringLiteral("    chain %1 { }").arg(chainName(anchor.ip, anchor.name));
+
+    const QList<QPair<QString, QString>> baseChains = {
+        { QStringLiteral("output"), QStringLiteral("type filter hook output priority filter; policy accept;") },
+        { QStringLiteral("postrouting"), QStringLiteral("type nat hook postrouting priority srcnat; policy accept;") },
+        { QStringLiteral("mangle_output"), QStringLiteral("type route hook output priority mangle; policy accept;") },
+        { QStringLiteral("raw_prerouting"), QStringLiteral("type filter hook prerouting priority raw; policy accept;") },
+    };
+    for (const auto &baseChain : baseChains) {
+        lines << QStringLiteral("    chain %1 {").arg(baseChain.first);
+        lines << QStringLiteral("        %1").arg(baseChain.second);
+        // the jumps never change, disabled anchors are just empty chains
+        for (const Anchor &anchor : anchors()) {
+            if (anchor.baseChain == baseChain.first) {
+                lines << QStringLiteral("        meta nfproto %1 jump %2")
+                                 .arg(anchor.ip == LinuxFirewall::IPv6 ? QStringLiteral("ipv6") : QStringLiteral("ipv4"),
+                                      chainName(anchor.ip, anchor.name));
+            }
+        }
+        lines << QStringLiteral("    }");
+    }
+    lines << QStringLiteral("}");
+
+    return (lines.join('\n') + '\n').toUtf8();
+}
+
+void NfTablesFirewall::changed()
+{
+    if (transactionDepth == 0)
+        apply();
+}
+
+bool NfTablesFirewall::apply()
+{
+    QByteArray script;
+    QHash<QString, QStringList> chainRules;
+    if (pendingTableAction == TableAction::Delete) {
+        script = QStringLiteral("table inet %1\ndelete table inet %1\n").arg(kTableName).toUtf8();
+    } else {
+        if (pendingTableAction == TableAction::Create)
+            script = renderTable();
+        else if (!isTableCreated)
+            return true;
+
+        for (const Anchor &anchor : anchors()) {
+            const QString chain = chainName(anchor.ip, anchor.name);
+            const QStringList rules = desiredEnabledChains.contains(chain) ? desiredAnchorRules.value(chain, anchor.rules) : QStringList();
+            if (!rules.isEmpty())
+                chainRules.insert(chain, rules);
+            if (rules == appliedChainRules.value(chain))
+                continue;
+
+            script += QStringLiteral("flush chain inet %1 %2\n").arg(kTableName, chain).toUtf8();
+            for (const QString &rule : rules)
+                script += QStringLiteral("add rule inet %1 %2 %3\n").arg(kTableName, chain, rule).toUtf8();
+        }
+
+        // the set contents are replaced within the same transaction, lookups never see a partial set
+        for (const QString &set : setNames()) {
+            const QStringList elements = desiredElements.value(set);
+            if (elements == appliedElements.value(set))
+                continue;
+
+            script += QStringLiteral("flush set inet %1 %2\n").arg(kTableName, set).toUtf8();
+            if (!elements.isEmpty())
+                script += QStringLiteral("add element inet %1 %2 { %3 }\n").arg(kTableName, set, elements.join(", ")).toUtf8();
+        }
+    }
+
+    if (script.isEmpty())
+        return true;
+
+    if (execute(script) != 0)
+        return false;
+
+    if (pendingTableAction == TableAction::Delete) {
+        isTableCreated = false;
+        appliedChainRules.clear();
+        appliedElements.clear();
+    } else {
+        isTableCreated = true;
+        appliedChainRules = chainRules;
+        appliedElements = desiredElements;
+    }
+    pendingTableAction = TableAction::None;
+    return true;
+}
+
+int NfTablesFirewall::execute(const QByteArray &script)
+{
+    QProcess p;
+    p.start(QStringLiteral("nft"), { QStringLiteral("-f"), QStringLiteral("-") });
+    p.write(script);
+    p.closeWriteChannel();
+
+    int exitCode = waitForExitCode(p);
+    auto out = p.readAllStandardOutput().trimmed();
+    auto err = p.readAllStandardError().trimmed();
+    if (exitCode != 0 || !err.isEmpty())
+        logger.warning() << "(" << exitCode << ") $ nft -f - <<" << script;
+    if (!out.isEmpty())
+        logger.info() << out;
+    if (!err.isEmpty())
+        logger.warning() << err;
+    return exitCode;
+}
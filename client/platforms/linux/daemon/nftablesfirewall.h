@@ -0,0 +1,59 @@
+#ifndef NFTABLESFIREWALL_H
+#define NFTABLESFIREWALL_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+#include "linuxfirewall.h"
+
+// nftables implementation of the LinuxFirewall anchors.
+//
+// Everything lives in one inet table. Every anchor is a regular chain per IP version
+// that the base chains always jump to, an anchor is enabled by filling its chain.
+// The allowed and blocked networks and the DNS servers are interval sets per address family, so a packet
+// is matched against them with a single lookup and updating them doesn't touch the chains.
+// Changes are collected until commit() and applied with one "nft -f" transaction.
+class NfTablesFirewall
+{
+public:
+    static bool isAvailable();
+
+    static void beginTransaction();
+    static bool commit();
+
+    static void install();
+    static void uninstall();
+    static bool isInstalled();
+    // removes the table of a previous run that used this backend
+    static void removeTable();
+
+    static void setAnchorEnabled(LinuxFirewall::IPVersion ip, const QString &anchor, bool enabled);
+    static bool isAnchorEnabled(LinuxFirewall::IPVersion ip, const QString &anchor);
+    // takes the iptables rule of LinuxFirewall::replaceAnchor(), only interface, address and verdict options
+    static void replaceAnchor(LinuxFirewall::IPVersion ip, const QString &anchor, const QString &newRule);
+
+    static void updateDNSServers(const QStringList &servers);
+    static void updateAllowNets(const QStringList &servers);
+    static void updateBlockNets(const QStringList &servers);
+
+private:
+    struct Anchor
+    {
+        QString name;
+        LinuxFirewall::IPVersion ip;
+        QString baseChain;
+        QStringList rules;
+    };
+
+    static const QList<Anchor> &anchors();
+    static QString chainName(LinuxFirewall::IPVersion ip, const QString &anchor);
+
+    static QByteArray renderTable();
+    static void setElements(const QString &set, const QStringList &servers);
+    static void changed();
+    static bool apply();
+    static int execute(const QByteArray &script);
+};
+
+#endif // NFTABLESFIREWALL_H
@@ -300,6 +300,9 @@ QList<WireguardUtils::PeerStatus> WireguardUtilsLinux::getPeerStatus() {
 
 void WireguardUtilsLinux::applyFirewallRules(FirewallParams& params)
 {
+    // all the changes below are applied at once by commit()
+    LinuxFirewall::beginTransaction();
+
     // double-check + ensure our firewall is installed and enabled
     if (!LinuxFirewall::isInstalled()) LinuxFirewall::install();
 
@@ -320,6 +323,8 @@ void WireguardUtilsLinux::applyFirewallRules(FirewallParams& params)
     LinuxFirewall::updateDNSServers(params.dnsServers);
     LinuxFirewall::setAnchorEnabled(LinuxFirewall::IPv4, QStringLiteral("320.allowDNS"), true);
     LinuxFirewall::setAnchorEnabled(LinuxFirewall::Both, QStringLiteral("400.allowPIA"), true);
+
+    LinuxFirewall::commit();
 }
 
 bool WireguardUtilsLinux::updateRoutePrefix(const IPAddress& prefix) {
@@ -154,6 +154,12 @@ namespace amnezia
             constexpr char shortidPath[] = "/opt/amnezia/xray/xray_short_id.key";
             constexpr char defaultSite[] = "www.googletagmanager.com";
 
+            // Xray runtime api, reachable only from inside the container
+            constexpr char apiAddress[] = "127.0.0.1";
+            constexpr int apiPort = 10085;
+            constexpr char apiTag[] = "api";
+            constexpr char inboundTag[] = "vless-in";
+
             constexpr char defaultPort[] = "443";
             constexpr char defaultLocalProxyPort[] = "10808";
             constexpr char defaultLocalAddr[] = "10.33.0.2";
@@ -185,6 +191,7 @@ namespace amnezia
             constexpr char serverConfigPath[] = "/opt/amnezia/wireguard/wg0.conf";
             constexpr char serverPublicKeyPath[] = "/opt/amnezia/wireguard/wireguard_server_public_key.key";
             constexpr char serverPskKeyPath[] = "/opt/amnezia/wireguard/wireguard_psk.key";
+            constexpr char ipPoolPath[] = "/opt/amnezia/wireguard/ipPool";
 
         }
 
@@ -206,6 +213,7 @@ namespace amnezia
             constexpr char serverConfigPath[] = "/opt/amnezia/awg/wg0.conf";
             constexpr char serverPublicKeyPath[] = "/opt/amnezia/awg/wireguard_server_public_key.key";
             constexpr char serverPskKeyPath[] = "/opt/amnezia/awg/wireguard_psk.key";
+            constexpr char ipPoolPath[] = "/opt/amnezia/awg/ipPool";
 
             constexpr char defaultJunkPacketCount[] = "3";
             constexpr char defaultJunkPacketMinSize[] = "10";
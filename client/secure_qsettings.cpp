@@ -16,16 +16,28 @@
 using namespace QKeychain;
 
 SecureQSettings::SecureQSettings(const QString &organization, const QString &application, QObject *parent)
-    : QObject { parent }, m_settings(organization, application, parent), encryptedKeys({ "Servers/serversList" })
+    : QObject { parent }, m_settings(organization, application, parent), encryptedKeys({ "Servers/serversList" }),
+      encryptedKeyPrefixes({ "Servers/records/" })
 {
+}
+
+void SecureQSettings::migrateToEncrypted()
+{
+    if (encryptionRequired()) {
+        loadEncKeys();
+    }
+
+    // may run on a worker thread while the gui thread reads and writes settings
+    QMutexLocker locker(&mutex);
+
     bool encrypted = m_settings.value("Conf/encrypted").toBool();
 
     // convert settings to encrypted for if updated to >= 2.1.0
     if (encryptionRequired() && !encrypted) {
         for (const QString &key : m_settings.allKeys()) {
-            if (encryptedKeys.contains(key)) {
+            if (isEncryptedKey(key)) {
                 const QVariant &val = value(key);
-                setValue(key, val);
+                writeValue(key, val);
             }
         }
         m_settings.setValue("Conf/encrypted", true);
@@ -51,11 +63,22 @@ QVariant SecureQSettings::value(const QString &key, const QVariant &defaultValue
     if (retVal.isValid()) {
         if (retVal.userType() == QVariant::ByteArray && retVal.toByteArray().mid(0, magicString.size()) == magicString) {
 
-            if (getEncKey().isEmpty() || getEncIv().isEmpty()) {
+            // the keychain lookup doesn't hold the settings lock
+            locker.unlock();
+            const bool isKeyLoaded = loadEncKeys();
+            locker.relock();
+
+            if (!isKeyLoaded) {
                 qCritical() << "SecureQSettings::setValue Decryption requested, but key is empty";
                 return {};
             }
 
+            // the value could have been written while the lock was released
+            if (m_cache.contains(key)) {
+                return m_cache.value(key);
+            }
+            retVal = m_settings.value(key);
+
             QByteArray encryptedValue = retVal.toByteArray().mid(magicString.size());
 
             QByteArray decryptedValue = decryptText(encryptedValue);
@@ -79,9 +102,51 @@ QVariant SecureQSettings::value(const QString &key, const QVariant &defaultValue
 
 void SecureQSettings::setValue(const QString &key, const QVariant &value)
 {
+    if (encryptionRequired() && isEncryptedKey(key)) {
+        loadEncKeys();
+    }
+
     QMutexLocker locker(&mutex);
 
-    if (encryptionRequired() && encryptedKeys.contains(key)) {
+    writeValue(key, value);
+    sync();
+}
+
+void SecureQSettings::setValues(const QMap<QString, QVariant> &values, const QStringList &removedKeys)
+{
+    if (encryptionRequired()) {
+        loadEncKeys();
+    }
+
+    QMutexLocker locker(&mutex);
+
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        writeValue(it.key(), it.value());
+    }
+    for (const QString &key : removedKeys) {
+        m_settings.remove(key);
+        m_cache.remove(key);
+    }
+
+    sync();
+}
+
+bool SecureQSettings::isEncryptedKey(const QString &key) const
+{
+    if (encryptedKeys.contains(key)) {
+        return true;
+    }
+    for (const QString &prefix : encryptedKeyPrefixes) {
+        if (key.startsWith(prefix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SecureQSettings::writeValue(const QString &key, const QVariant &value)
+{
+    if (encryptionRequired() && isEncryptedKey(key)) {
         if (!getEncKey().isEmpty() && !getEncIv().isEmpty()) {
             QByteArray decryptedValue;
             {
@@ -101,7 +166,6 @@ void SecureQSettings::setValue(const QString &key, const QVariant &value)
     }
 
     m_cache.insert(key, value);
-    sync();
 }
 
 void SecureQSettings::remove(const QString &key)
@@ -206,6 +270,13 @@ bool SecureQSettings::encryptionRequired() const
 
 QByteArray SecureQSettings::getEncKey() const
 {
+    QMutexLocker locker(&keyMutex);
+
+    // every server record is decrypted separately, don't go to the keychain for each of them
+    if (!m_key.isEmpty()) {
+        return m_key;
+    }
+
     // load keys from system key storage
     m_key = getSecTag(settingsKeyTag);
 
@@ -232,6 +303,12 @@ QByteArray SecureQSettings::getEncKey() const
 
 QByteArray SecureQSettings::getEncIv() const
 {
+    QMutexLocker locker(&keyMutex);
+
+    if (!m_iv.isEmpty()) {
+        return m_iv;
+    }
+
     // load keys from system key storage
     m_iv = getSecTag(settingsIvTag);
 
@@ -255,6 +332,11 @@ QByteArray SecureQSettings::getEncIv() const
     return m_iv;
 }
 
+bool SecureQSettings::loadEncKeys() const
+{
+    return !getEncKey().isEmpty() && !getEncIv().isEmpty();
+}
+
 QByteArray SecureQSettings::getSecTag(const QString &tag)
 {
     auto job = QSharedPointer<ReadPasswordJob>(new ReadPasswordJob(keyChainName), &QObject::deleteLater);
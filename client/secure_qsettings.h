@@ -22,6 +22,8 @@ public:
 
     Q_INVOKABLE QVariant value(const QString &key, const QVariant &defaultValue = QVariant()) const;
     Q_INVOKABLE void setValue(const QString &key, const QVariant &value);
+    // writes and removes several keys with a single sync
+    void setValues(const QMap<QString, QVariant> &values, const QStringList &removedKeys = QStringList());
     void remove(const QString &key);
     void sync();
 
@@ -32,9 +34,13 @@ public:
     QByteArray decryptText(const QByteArray &ba) const;
 
     bool encryptionRequired() const;
+    // settings written before encryption was introduced are encrypted in place, needs the keychain
+    void migrateToEncrypted();
 
     QByteArray getEncKey() const;
     QByteArray getEncIv() const;
+    // fetches the key and iv from the keychain if they aren't cached yet, without holding the settings lock
+    bool loadEncKeys() const;
 
     static QByteArray getSecTag(const QString &tag);
     static void setSecTag(const QString &tag, const QByteArray &data);
@@ -42,11 +48,15 @@ public:
     void clearSettings();
 
 private:
+    bool isEncryptedKey(const QString &key) const;
+    void writeValue(const QString &key, const QVariant &value);
+
     QSettings m_settings;
 
     mutable QMap<QString, QVariant> m_cache;
 
     QStringList encryptedKeys; // encode only key listed here
+    QStringList encryptedKeyPrefixes; // and every key starting with one of these
     // only this fields need for backup
     QStringList m_fieldsToBackup = {
         "Conf/", "Servers/",
@@ -54,10 +64,14 @@ private:
 
     mutable QByteArray m_key;
     mutable QByteArray m_iv;
+    // the keychain runs a nested event loop, the key cache has its own lock so that reads of unrelated keys
+    // don't wait for it. Recursive because that event loop can ask for the key again
+    mutable QRecursiveMutex keyMutex;
 
     const QByteArray magicString { "EncData" }; // Magic keyword used for mark encrypted QByteArray
 
-    mutable QMutex mutex;
+    // recursive, migrateToEncrypted() holds it across value() calls
+    mutable QRecursiveMutex mutex;
 };
 
 #endif // SECUREQSETTINGS_H
@@ -27,15 +27,23 @@ cat > /opt/amnezia/xray/server.json <<EOF
     "log": {
         "loglevel": "error"
     },
+    "api": {
+        "tag": "api",
+        "services": [
+            "HandlerService"
+        ]
+    },
     "inbounds": [
         {
+            "tag": "vless-in",
             "port": $XRAY_SERVER_PORT,
             "protocol": "vless",
             "settings": {
                 "clients": [
                     {
                         "id": "$XRAY_CLIENT_ID",
-                        "flow": "xtls-rprx-vision"
+                        "flow": "xtls-rprx-vision",
+                        "email": "$XRAY_CLIENT_ID"
                     }
                 ],
                 "decryption": "none"
@@ -54,13 +62,33 @@ cat > /opt/amnezia/xray/server.json <<EOF
                     ]
                 }
             }
+        },
+        {
+            "tag": "api",
+            "listen": "127.0.0.1",
+            "port": 10085,
+            "protocol": "dokodemo-door",
+            "settings": {
+                "address": "127.0.0.1"
+            }
         }
     ],
     "outbounds": [
         {
             "protocol": "freedom"
         }
-    ]
+    ],
+    "routing": {
+        "rules": [
+            {
+                "type": "field",
+                "inboundTag": [
+                    "api"
+                ],
+                "outboundTag": "api"
+            }
+        ]
+    }
 }
 EOF
 
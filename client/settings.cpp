@@ -1,9 +1,13 @@
 #include "settings.h"
 
 #include "QCoreApplication"
+#include "QGuiApplication"
 #include "QThread"
+#include "QUuid"
 
+#include "core/keyPool.h"
 #include "core/networkUtilities.h"
+#include "core/prefixSet.h"
 #include "version.h"
 
 #include "containers/containers_defs.h"
@@ -15,10 +19,33 @@ namespace
     const char cloudFlareNs2[] = "1.0.0.1";
 
     constexpr char gatewayEndpoint[] = "http://gw.amnezia.org:80/";
+
+    constexpr int serversCommitDelayMs = 500;
+
+    constexpr char serversIndexKey[] = "Servers/serversIndex";
+    constexpr char serverRecordsPrefix[] = "Servers/records/";
+    constexpr char legacyServersListKey[] = "Servers/serversList";
 }
 
 Settings::Settings(QObject *parent) : QObject(parent), m_settings(ORGANIZATION_NAME, APPLICATION_NAME, this)
 {
+    m_commitTimer.setSingleShot(true);
+    m_commitTimer.setInterval(serversCommitDelayMs);
+    connect(&m_commitTimer, &QTimer::timeout, this, &Settings::flushServers);
+    if (QCoreApplication::instance()) {
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &Settings::flushServers);
+    }
+    // android and ios kill paused apps without aboutToQuit
+    if (auto guiApplication = qobject_cast<QGuiApplication *>(QCoreApplication::instance())) {
+        connect(guiApplication, &QGuiApplication::applicationStateChanged, this, [this](Qt::ApplicationState state) {
+            if (state == Qt::ApplicationSuspended || state == Qt::ApplicationInactive) {
+                flushServers();
+            }
+        });
+    }
+
+    loadServers();
+
     // Import old settings
     if (serversCount() == 0) {
         QString user = value("Server/userName").toString();
@@ -46,46 +73,278 @@ Settings::Settings(QObject *parent) : QObject(parent), m_settings(ORGANIZATION_N
     m_gatewayEndpoint = gatewayEndpoint;
 }
 
+Settings::~Settings()
+{
+    flushServers();
+}
+
+QJsonArray Settings::serversArray() const
+{
+    QMutexLocker locker(&m_serversMutex);
+
+    QJsonArray servers;
+    for (int i = 0; i < m_servers.size(); i++) {
+        servers.append(serverData(i));
+    }
+    return servers;
+}
+
+void Settings::setServersArray(const QJsonArray &servers)
+{
+    QMutexLocker locker(&m_serversMutex);
+
+    for (const ServerRecord &record : std::as_const(m_servers)) {
+        m_removedRecordIds.append(record.id);
+    }
+
+    m_servers.clear();
+    m_servers.reserve(servers.size());
+    for (const QJsonValue &server : servers) {
+        m_servers.append(newServerRecord(server.toObject()));
+    }
+    m_isServersListChanged = true;
+    scheduleServersCommit();
+}
+
+void Settings::beginTransaction()
+{
+    QMutexLocker locker(&m_serversMutex);
+    m_transactionDepth++;
+}
+
+void Settings::commit()
+{
+    {
+        QMutexLocker locker(&m_serversMutex);
+        if (m_transactionDepth == 0) {
+            qWarning() << "Settings::commit called without beginTransaction";
+        } else if (--m_transactionDepth > 0) {
+            return;
+        }
+    }
+
+    flushServers();
+}
+
+void Settings::preloadServers(const std::function<void(int serverIndex)> &onServerLoaded)
+{
+    m_settings.migrateToEncrypted();
+
+    const int defaultIndex = m_settings.value("Servers/defaultServerIndex", 0).toInt();
+
+    QStringList ids;
+    QList<int> loadedIndexes;
+    {
+        QMutexLocker locker(&m_serversMutex);
+        for (int i = 0; i < m_servers.size(); i++) {
+            if (m_servers.at(i).isLoaded) {
+                // accessed, added or migrated records need no decryption but the caller still waits for them
+                loadedIndexes.append(i);
+                continue;
+            }
+            if (i == defaultIndex) {
+                ids.prepend(m_servers.at(i).id);
+            } else {
+                ids.append(m_servers.at(i).id);
+            }
+        }
+    }
+
+    if (onServerLoaded) {
+        for (const int serverIndex : std::as_const(loadedIndexes)) {
+            onServerLoaded(serverIndex);
+        }
+    }
+
+    for (const QString &id : std::as_const(ids)) {
+        // decryption happens without m_serversMutex, the gui thread keeps working with the records meanwhile
+        const QJsonObject server = QJsonDocument::fromJson(m_settings.value(serverRecordKey(id)).toByteArray()).object();
+
+        int serverIndex = -1;
+        {
+            QMutexLocker locker(&m_serversMutex);
+            for (int i = 0; i < m_servers.size(); i++) {
+                ServerRecord &record = m_servers[i];
+                if (record.id == id) {
+                    // the record could have been edited while it was decrypted here
+                    if (!record.isLoaded) {
+                        record.data = server;
+                        record.isLoaded = true;
+                        serverIndex = i;
+                    }
+                    break;
+                }
+            }
+        }
+
+        if (serverIndex >= 0 && onServerLoaded) {
+            onServerLoaded(serverIndex);
+        }
+    }
+}
+
+QString Settings::serverRecordKey(const QString &id)
+{
+    return serverRecordsPrefix + id;
+}
+
+Settings::ServerRecord Settings::newServerRecord(const QJsonObject &server)
+{
+    ServerRecord record;
+    record.id = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    record.data = server;
+    record.isLoaded = true;
+    record.isDirty = true;
+    return record;
+}
+
+void Settings::loadServers()
+{
+    const QStringList ids = value(serversIndexKey).toStringList();
+    const QVariant legacyServers = value(legacyServersListKey);
+
+    QMutexLocker locker(&m_serversMutex);
+    m_servers.clear();
+    m_removedRecordIds.clear();
+    m_isServersListChanged = false;
+
+    if (!legacyServers.isValid()) {
+        // only the index is read here, every record is decrypted on first access
+        m_servers.reserve(ids.size());
+        for (const QString &id : ids) {
+            ServerRecord record;
+            record.id = id;
+            m_servers.append(record);
+        }
+        return;
+    }
+
+    // servers used to be stored as one encrypted list, split it into records once
+    const QJsonArray servers = QJsonDocument::fromJson(legacyServers.toByteArray()).array();
+    for (const QJsonValue &server : servers) {
+        m_servers.append(newServerRecord(server.toObject()));
+    }
+    m_removedRecordIds = ids;
+    m_isServersListChanged = true;
+    locker.unlock();
+
+    flushServers();
+    m_settings.remove(legacyServersListKey);
+}
+
+const QJsonObject &Settings::serverData(int index) const
+{
+    const ServerRecord &record = m_servers.at(index);
+    if (!record.isLoaded) {
+        // SecureQSettings is thread safe on its own, going through the main thread here could deadlock on m_serversMutex
+        record.data = QJsonDocument::fromJson(m_settings.value(serverRecordKey(record.id)).toByteArray()).object();
+        record.isLoaded = true;
+    }
+    return record.data;
+}
+
+void Settings::scheduleServersCommit()
+{
+    if (m_transactionDepth > 0) {
+        return;
+    }
+
+    // the timer lives in the main thread, this is a direct call there and a queued one elsewhere
+    QMetaObject::invokeMethod(&m_commitTimer, qOverload<>(&QTimer::start));
+}
+
+void Settings::flushServers()
+{
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, &Settings::flushServers, Qt::BlockingQueuedConnection);
+        return;
+    }
+
+    QMap<QString, QVariant> values;
+    QStringList removedKeys;
+    {
+        QMutexLocker locker(&m_serversMutex);
+
+        // only the records that were edited are encrypted again
+        for (ServerRecord &record : m_servers) {
+            if (record.isDirty) {
+                values.insert(serverRecordKey(record.id), QJsonDocument(record.data).toJson(QJsonDocument::Compact));
+                record.isDirty = false;
+            }
+        }
+
+        if (m_isServersListChanged) {
+            QStringList ids;
+            ids.reserve(m_servers.size());
+            for (const ServerRecord &record : std::as_const(m_servers)) {
+                ids.append(record.id);
+            }
+            values.insert(serversIndexKey, ids);
+            m_isServersListChanged = false;
+        }
+
+        for (const QString &id : std::as_const(m_removedRecordIds)) {
+            removedKeys.append(serverRecordKey(id));
+        }
+        m_removedRecordIds.clear();
+    }
+
+    m_commitTimer.stop();
+    if (!values.isEmpty() || !removedKeys.isEmpty()) {
+        m_settings.setValues(values, removedKeys);
+    }
+}
+
 int Settings::serversCount() const
 {
-    return serversArray().size();
+    QMutexLocker locker(&m_serversMutex);
+    return m_servers.size();
 }
 
 QJsonObject Settings::server(int index) const
 {
-    const QJsonArray &servers = serversArray();
-    if (index >= servers.size())
+    // a copy, another thread may change the servers list right after the lock is released
+    QMutexLocker locker(&m_serversMutex);
+    if (index < 0 || index >= m_servers.size())
         return QJsonObject();
 
-    return servers.at(index).toObject();
+    return serverData(index);
 }
 
 void Settings::addServer(const QJsonObject &server)
 {
-    QJsonArray servers = serversArray();
-    servers.append(server);
-    setServersArray(servers);
+    QMutexLocker locker(&m_serversMutex);
+    m_servers.append(newServerRecord(server));
+    m_isServersListChanged = true;
+    scheduleServersCommit();
 }
 
 void Settings::removeServer(int index)
 {
-    QJsonArray servers = serversArray();
-    if (index >= servers.size())
-        return;
+    {
+        QMutexLocker locker(&m_serversMutex);
+        if (index < 0 || index >= m_servers.size())
+            return;
 
-    servers.removeAt(index);
-    setServersArray(servers);
+        m_removedRecordIds.append(m_servers.at(index).id);
+        m_servers.removeAt(index);
+        m_isServersListChanged = true;
+        scheduleServersCommit();
+    }
     emit serverRemoved(index);
 }
 
 bool Settings::editServer(int index, const QJsonObject &server)
 {
-    QJsonArray servers = serversArray();
-    if (index >= servers.size())
+    QMutexLocker locker(&m_serversMutex);
+    if (index < 0 || index >= m_servers.size())
         return false;
 
-    servers.replace(index, server);
-    setServersArray(servers);
+    ServerRecord &record = m_servers[index];
+    record.data = server;
+    record.isLoaded = true;
+    record.isDirty = true;
+    scheduleServersCommit();
     return true;
 }
 
@@ -182,9 +441,11 @@ void Settings::clearLastConnectionConfig(int serverIndex, DockerContainer contai
 {
     // recursively remove
     if (proto == Proto::Any) {
+        beginTransaction();
         for (Proto p : ContainerProps::protocolsForContainer(container)) {
             clearLastConnectionConfig(serverIndex, container, p);
         }
+        commit();
         return;
     }
 
@@ -274,6 +535,26 @@ void Settings::setSitesSplitTunnelingEnabled(bool enabled)
     setValue("Conf/sitesSplitTunnelingEnabled", enabled);
 }
 
+bool Settings::isOpenVpnEcKeysEnabled() const
+{
+    return value("Conf/openVpnEcKeysEnabled", false).toBool();
+}
+
+void Settings::setOpenVpnEcKeysEnabled(bool enabled)
+{
+    setValue("Conf/openVpnEcKeysEnabled", enabled);
+}
+
+int Settings::openVpnKeyPoolSize() const
+{
+    return value("Conf/openVpnKeyPoolSize", KeyPool::defaultWatermark).toInt();
+}
+
+void Settings::setOpenVpnKeyPoolSize(int size)
+{
+    setValue("Conf/openVpnKeyPoolSize", size);
+}
+
 bool Settings::addVpnSite(RouteMode mode, const QString &site, const QString &ip)
 {
     QVariantMap sites = vpnSites(mode);
@@ -303,17 +584,17 @@ void Settings::addVpnSites(RouteMode mode, const QMap<QString, QString> &sites)
 
 QStringList Settings::getVpnIps(RouteMode mode) const
 {
-    QStringList ips;
+    PrefixSet ips;
     const QVariantMap &m = vpnSites(mode);
     for (auto i = m.constBegin(); i != m.constEnd(); ++i) {
         if (NetworkUtilities::checkIpSubnetFormat(i.key())) {
-            ips.append(i.key());
+            ips.insert(i.key());
         } else if (NetworkUtilities::checkIpSubnetFormat(i.value().toString())) {
-            ips.append(i.value().toString());
+            ips.insert(i.value().toString());
         }
     }
-    ips.removeDuplicates();
-    return ips;
+    // duplicates and addresses inside another site's subnet are dropped
+    return ips.prefixes();
 }
 
 void Settings::removeVpnSite(RouteMode mode, const QString &site)
@@ -357,6 +638,28 @@ void Settings::removeAllVpnSites(RouteMode mode)
     setVpnSites(mode, QVariantMap());
 }
 
+void Settings::setResolvedVpnSites(RouteMode mode, const QMap<QString, QString> &sites, const QVariantMap &dnsCache)
+{
+    QMap<QString, QVariant> values;
+    values.insert("Conf/sitesDnsCache", dnsCache);
+
+    QVariantMap allSites = vpnSites(mode);
+    bool isChanged = false;
+    for (auto i = sites.constBegin(); i != sites.constEnd(); ++i) {
+        // the site may have been removed while it was being resolved
+        auto site = allSites.find(i.key());
+        if (site != allSites.end() && site->toString() != i.value()) {
+            *site = i.value();
+            isChanged = true;
+        }
+    }
+    if (isChanged) {
+        values.insert("Conf/" + routeModeString(mode), allSites);
+    }
+
+    m_settings.setValues(values);
+}
+
 QString Settings::primaryDns() const
 {
     return value("Conf/primaryDns", cloudFlareNs1).toString();
@@ -367,10 +670,50 @@ QString Settings::secondaryDns() const
     return value("Conf/secondaryDns", cloudFlareNs2).toString();
 }
 
+QByteArray Settings::backupAppConfig()
+{
+    flushServers();
+
+    // backups keep the single servers list of older versions so that they can be restored after a downgrade,
+    // restoring one here splits the list into records again
+    QJsonObject cfg = QJsonDocument::fromJson(m_settings.backupAppConfig()).object();
+    for (const QString &key : cfg.keys()) {
+        if (key == serversIndexKey || key.startsWith(serverRecordsPrefix)) {
+            cfg.remove(key);
+        }
+    }
+    cfg.insert(legacyServersListKey, QString::fromUtf8(QJsonDocument(serversArray()).toJson()));
+
+    return QJsonDocument(cfg).toJson();
+}
+
+bool Settings::restoreAppConfig(const QByteArray &cfg)
+{
+    const QStringList oldIds = value(serversIndexKey).toStringList();
+
+    bool isRestored = m_settings.restoreAppConfig(cfg);
+    loadServers();
+
+    // records of the replaced servers list are not referenced by the restored index anymore
+    const QStringList ids = value(serversIndexKey).toStringList();
+    QStringList orphanKeys;
+    for (const QString &id : oldIds) {
+        if (!ids.contains(id)) {
+            orphanKeys.append(serverRecordKey(id));
+        }
+    }
+    if (!orphanKeys.isEmpty()) {
+        m_settings.setValues({}, orphanKeys);
+    }
+
+    return isRestored;
+}
+
 void Settings::clearSettings()
 {
     auto uuid = getInstallationUuid(false);
     m_settings.clearSettings();
+    loadServers();
     setInstallationUuid(uuid);
     emit settingsCleared();
 }
@@ -2,8 +2,12 @@
 #define SETTINGS_H
 
 #include <QObject>
+#include <QRecursiveMutex>
 #include <QSettings>
 #include <QString>
+#include <QTimer>
+
+#include <functional>
 
 #include <QJsonArray>
 #include <QJsonDocument>
@@ -23,18 +27,22 @@ class Settings : public QObject
 
 public:
     explicit Settings(QObject *parent = nullptr);
+    ~Settings();
 
     ServerCredentials defaultServerCredentials() const;
     ServerCredentials serverCredentials(int index) const;
 
-    QJsonArray serversArray() const
-    {
-        return QJsonDocument::fromJson(value("Servers/serversList").toByteArray()).array();
-    }
-    void setServersArray(const QJsonArray &servers)
-    {
-        setValue("Servers/serversList", QJsonDocument(servers).toJson());
-    }
+    QJsonArray serversArray() const;
+    void setServersArray(const QJsonArray &servers);
+
+    // Server edits are kept in memory and written out together, either by commit() of the outermost
+    // transaction or, outside of a transaction, by a short timer that coalesces bursts of edits
+    void beginTransaction();
+    void commit();
+
+    // Fetches the key material and decrypts the server records that were not accessed yet, the default server first.
+    // Meant to run on a worker thread at startup, onServerLoaded is called from that thread for every server, the already loaded ones included
+    void preloadServers(const std::function<void(int serverIndex)> &onServerLoaded = nullptr);
 
     // Servers section
     int serversCount() const;
@@ -118,6 +126,13 @@ public:
     bool isSitesSplitTunnelingEnabled() const;
     void setSitesSplitTunnelingEnabled(bool enabled);
 
+    // EC P-256 keys for OpenVPN client certificates are faster to generate and make configs smaller than RSA
+    bool isOpenVpnEcKeysEnabled() const;
+    void setOpenVpnEcKeysEnabled(bool enabled);
+    // number of OpenVPN client keys generated ahead of time, 0 turns the key pool off
+    int openVpnKeyPoolSize() const;
+    void setOpenVpnKeyPoolSize(int size);
+
     QVariantMap vpnSites(RouteMode mode) const
     {
         return value("Conf/" + routeModeString(mode)).toMap();
@@ -135,6 +150,17 @@ public:
     void addVpnIps(RouteMode mode, const QStringList &ip);
     void removeVpnSites(RouteMode mode, const QStringList &sites);
     void removeAllVpnSites(RouteMode mode);
+    // stores the resolved ips of the sites that still exist together with the DNS cache, with a single sync
+    void setResolvedVpnSites(RouteMode mode, const QMap<QString, QString> &sites, const QVariantMap &dnsCache);
+
+    QVariantMap sitesDnsCache() const
+    {
+        return value("Conf/sitesDnsCache").toMap();
+    }
+    void setSitesDnsCache(const QVariantMap &dnsCache)
+    {
+        setValue("Conf/sitesDnsCache", dnsCache);
+    }
 
     bool useAmneziaDns() const
     {
@@ -163,14 +189,8 @@ public:
     //    static constexpr char openNicNs5[] = "94.103.153.176";
     //    static constexpr char openNicNs13[] = "144.76.103.143";
 
-    QByteArray backupAppConfig() const
-    {
-        return m_settings.backupAppConfig();
-    }
-    bool restoreAppConfig(const QByteArray &cfg)
-    {
-        return m_settings.restoreAppConfig(cfg);
-    }
+    QByteArray backupAppConfig();
+    bool restoreAppConfig(const QByteArray &cfg);
 
     QLocale getAppLanguage()
     {
@@ -232,10 +252,35 @@ private:
     QVariant value(const QString &key, const QVariant &defaultValue = QVariant()) const;
     void setValue(const QString &key, const QVariant &value);
 
+    // every server is stored as its own encrypted record, Servers/serversIndex keeps their order
+    struct ServerRecord
+    {
+        QString id;
+        mutable QJsonObject data;
+        mutable bool isLoaded = false;
+        bool isDirty = false;
+    };
+
+    static QString serverRecordKey(const QString &id);
+    static ServerRecord newServerRecord(const QJsonObject &server);
+
+    void loadServers();
+    const QJsonObject &serverData(int index) const;
+    void scheduleServersCommit();
+    void flushServers();
+
     void setInstallationUuid(const QString &uuid);
 
     mutable SecureQSettings m_settings;
 
+    // guards the server records, never held while waiting for the main thread
+    mutable QRecursiveMutex m_serversMutex;
+    QVector<ServerRecord> m_servers;
+    QStringList m_removedRecordIds;
+    bool m_isServersListChanged = false; // servers were added or removed since the last flush
+    int m_transactionDepth = 0;
+    QTimer m_commitTimer;
+
     QString m_gatewayEndpoint;
     bool m_isDevGatewayEnv = false;
 };
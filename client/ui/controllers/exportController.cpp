@@ -3,11 +3,15 @@
 #include <QBuffer>
 #include <QDataStream>
 #include <QDesktopServices>
+#include <QDir>
 #include <QFile>
 #include <QFileInfo>
 #include <QImage>
 #include <QStandardPaths>
+#include <QtConcurrent>
 
+#include "configurators/awg_configurator.h"
+#include "configurators/openvpn_configurator.h"
 #include "core/controllers/vpnConfigurationController.h"
 #include "systemController.h"
 #include "qrcodegen.hpp"
@@ -264,6 +268,117 @@ void ExportController::generateXrayConfig(const QString &clientName)
     emit exportConfigChanged();
 }
 
+void ExportController::generateWireGuardConfigs(const QStringList &clientNames)
+{
+    clearBulkConfigs();
+
+    DockerContainer container = static_cast<DockerContainer>(m_containersModel->getProcessedContainerIndex());
+    if (container != DockerContainer::WireGuard && container != DockerContainer::Awg) {
+        emit exportErrorOccurred(ErrorCode::InternalError);
+        return;
+    }
+
+    int serverIndex = m_serversModel->getProcessedServerIndex();
+    ServerCredentials credentials = m_serversModel->getServerCredentials(serverIndex);
+
+    QJsonObject containerConfig = m_containersModel->getContainerConfig(container);
+    containerConfig.insert(config_key::container, ContainerProps::containerToString(container));
+
+    QSharedPointer<ServerController> serverController(new ServerController(m_settings));
+    QScopedPointer<WireguardConfigurator> configurator(container == DockerContainer::Awg
+                                                               ? new AwgConfigurator(m_settings, serverController)
+                                                               : new WireguardConfigurator(m_settings, serverController, false));
+
+    ErrorCode errorCode = ErrorCode::NoError;
+    QStringList protocolConfigs = configurator->createConfigs(credentials, container, containerConfig, clientNames.size(), errorCode);
+    if (errorCode) {
+        emit exportErrorOccurred(errorCode);
+        return;
+    }
+
+    errorCode = appendGeneratedConfigs(*configurator, protocolConfigs, clientNames, container, credentials, serverController);
+    if (errorCode) {
+        emit exportErrorOccurred(errorCode);
+        return;
+    }
+
+    m_bulkQrCodes = QtConcurrent::blockingMapped<QStringList>(m_bulkConfigs, [](const QString &config) {
+        qrcodegen::QrCode qr = qrcodegen::QrCode::encodeText(config.toUtf8(), qrcodegen::QrCode::Ecc::LOW);
+        return QString::fromStdString(toSvgString(qr, 1));
+    });
+    m_bulkConfigExtension = ".conf";
+
+    emit bulkConfigsChanged();
+}
+
+void ExportController::generateOpenVpnConfigs(const QStringList &clientNames)
+{
+    clearBulkConfigs();
+
+    DockerContainer container = static_cast<DockerContainer>(m_containersModel->getProcessedContainerIndex());
+    if (container != DockerContainer::OpenVpn && container != DockerContainer::Cloak && container != DockerContainer::ShadowSocks) {
+        emit exportErrorOccurred(ErrorCode::InternalError);
+        return;
+    }
+
+    int serverIndex = m_serversModel->getProcessedServerIndex();
+    ServerCredentials credentials = m_serversModel->getServerCredentials(serverIndex);
+
+    QJsonObject containerConfig = m_containersModel->getContainerConfig(container);
+    containerConfig.insert(config_key::container, ContainerProps::containerToString(container));
+
+    QSharedPointer<ServerController> serverController(new ServerController(m_settings));
+    OpenVpnConfigurator configurator(m_settings, serverController);
+
+    ErrorCode errorCode = ErrorCode::NoError;
+    QStringList protocolConfigs = configurator.createConfigs(credentials, container, containerConfig, clientNames.size(), errorCode);
+    if (errorCode) {
+        emit exportErrorOccurred(errorCode);
+        return;
+    }
+
+    errorCode = appendGeneratedConfigs(configurator, protocolConfigs, clientNames, container, credentials, serverController);
+    if (errorCode) {
+        emit exportErrorOccurred(errorCode);
+        return;
+    }
+
+    // openvpn configs are too big for a single qr code each, so bulk export only goes to files
+    m_bulkConfigExtension = ".ovpn";
+
+    emit bulkConfigsChanged();
+}
+
+void ExportController::warmUpKeyPool()
+{
+    DockerContainer container = static_cast<DockerContainer>(m_containersModel->getProcessedContainerIndex());
+    if (container == DockerContainer::OpenVpn || container == DockerContainer::Cloak || container == DockerContainer::ShadowSocks) {
+        OpenVpnConfigurator::warmUpKeyPool(*m_settings);
+    }
+}
+
+ErrorCode ExportController::appendGeneratedConfigs(ConfiguratorBase &configurator, QStringList &protocolConfigs,
+                                                   const QStringList &clientNames, const DockerContainer container,
+                                                   const ServerCredentials &credentials,
+                                                   const QSharedPointer<ServerController> &serverController)
+{
+    int serverIndex = m_serversModel->getProcessedServerIndex();
+    auto dns = m_serversModel->getDnsPair(serverIndex);
+    bool isApiConfig = qvariant_cast<bool>(m_serversModel->data(serverIndex, ServersModel::IsServerFromTelegramApiRole));
+
+    QList<QPair<QString, QString>> clients;
+    for (int i = 0; i < protocolConfigs.size(); i++) {
+        configurator.processConfigWithExportSettings(dns, isApiConfig, protocolConfigs[i]);
+        const QJsonObject nativeConfig = QJsonDocument::fromJson(protocolConfigs.at(i).toUtf8()).object();
+
+        clients.append({ nativeConfig.value(config_key::clientId).toString(), clientNames.at(i) });
+        m_bulkConfigs.append(nativeConfig.value(config_key::config).toString().replace("\r", ""));
+        m_bulkConfigNames.append(clientNames.at(i));
+    }
+
+    return m_clientManagementModel->appendClients(clients, container, credentials, serverController);
+}
+
 QString ExportController::getConfig()
 {
     return m_config;
@@ -284,6 +399,33 @@ void ExportController::exportConfig(const QString &fileName)
     SystemController::saveFile(fileName, m_config);
 }
 
+void ExportController::exportConfigs(const QUrl &folderUrl)
+{
+    // SystemController::saveFile() opens the folder for every file, so the files are written here
+    auto writeFile = [](const QString &filePath, const QString &data) {
+        QFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly)) {
+            qWarning() << "Failed to save the config to" << file.fileName();
+            return;
+        }
+        file.write(data.toUtf8());
+    };
+
+    QDir folder(folderUrl.isLocalFile() ? folderUrl.toLocalFile() : folderUrl.toString());
+    for (int i = 0; i < m_bulkConfigs.size(); i++) {
+        QString fileName = m_bulkConfigNames.at(i);
+        fileName.replace(QRegularExpression("[^\\w\\-. ]"), "_");
+        fileName = QString("%1_%2").arg(i + 1).arg(fileName);
+
+        writeFile(folder.filePath(fileName + m_bulkConfigExtension), m_bulkConfigs.at(i));
+        if (i < m_bulkQrCodes.size()) {
+            writeFile(folder.filePath(fileName + ".svg"), m_bulkQrCodes.at(i));
+        }
+    }
+
+    QDesktopServices::openUrl(QUrl::fromLocalFile(folder.absolutePath()));
+}
+
 void ExportController::updateClientManagementModel(const DockerContainer container, ServerCredentials credentials)
 {
     QSharedPointer<ServerController> serverController(new ServerController(m_settings));
@@ -343,6 +485,11 @@ int ExportController::getQrCodesCount()
     return m_qrCodes.size();
 }
 
+int ExportController::getBulkConfigsCount()
+{
+    return m_bulkConfigs.size();
+}
+
 void ExportController::clearPreviousConfig()
 {
     m_config.clear();
@@ -351,3 +498,13 @@ void ExportController::clearPreviousConfig()
 
     emit exportConfigChanged();
 }
+
+void ExportController::clearBulkConfigs()
+{
+    m_bulkConfigs.clear();
+    m_bulkConfigNames.clear();
+    m_bulkQrCodes.clear();
+    m_bulkConfigExtension.clear();
+
+    emit bulkConfigsChanged();
+}
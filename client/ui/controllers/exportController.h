@@ -2,7 +2,9 @@
 #define EXPORTCONTROLLER_H
 
 #include <QObject>
+#include <QUrl>
 
+#include "configurators/configurator_base.h"
 #include "ui/models/clientManagementModel.h"
 #include "ui/models/containers_model.h"
 #include "ui/models/servers_model.h"
@@ -19,6 +21,7 @@ public:
     Q_PROPERTY(int qrCodesCount READ getQrCodesCount NOTIFY exportConfigChanged)
     Q_PROPERTY(QString config READ getConfig NOTIFY exportConfigChanged)
     Q_PROPERTY(QString nativeConfigString READ getNativeConfigString NOTIFY exportConfigChanged)
+    Q_PROPERTY(int bulkConfigsCount READ getBulkConfigsCount NOTIFY bulkConfigsChanged)
 
 public slots:
     void generateFullAccessConfig();
@@ -29,12 +32,18 @@ public slots:
     void generateShadowSocksConfig();
     void generateCloakConfig();
     void generateXrayConfig(const QString &clientName);
+    void generateWireGuardConfigs(const QStringList &clientNames);
+    void generateOpenVpnConfigs(const QStringList &clientNames);
+
+    // starts generating OpenVPN client keys in the background when the processed container uses them
+    void warmUpKeyPool();
 
     QString getConfig();
     QString getNativeConfigString();
     QList<QString> getQrCodes();
 
     void exportConfig(const QString &fileName);
+    void exportConfigs(const QUrl &folderUrl);
 
     void updateClientManagementModel(const DockerContainer container, ServerCredentials credentials);
     void revokeConfig(const int row, const DockerContainer container, ServerCredentials credentials);
@@ -46,6 +55,7 @@ signals:
     void exportErrorOccurred(ErrorCode errorCode);
 
     void exportConfigChanged();
+    void bulkConfigsChanged();
 
     void saveFile(const QString &fileName, const QString &data);
 
@@ -54,11 +64,16 @@ private:
     QString svgToBase64(const QString &image);
 
     int getQrCodesCount();
+    int getBulkConfigsCount();
 
     void clearPreviousConfig();
+    void clearBulkConfigs();
 
     ErrorCode generateNativeConfig(const DockerContainer container, const QString &clientName, const Proto &protocol,
                                    QJsonObject &jsonNativeConfig);
+    ErrorCode appendGeneratedConfigs(ConfiguratorBase &configurator, QStringList &protocolConfigs, const QStringList &clientNames,
+                                     const DockerContainer container, const ServerCredentials &credentials,
+                                     const QSharedPointer<ServerController> &serverController);
 
     QSharedPointer<ServersModel> m_serversModel;
     QSharedPointer<ContainersModel> m_containersModel;
@@ -68,6 +83,14 @@ private:
     QString m_config;
     QString m_nativeConfigString;
     QList<QString> m_qrCodes;
+
+    // filled by generateWireGuardConfigs() and generateOpenVpnConfigs(), one entry per client,
+    // the single config members above are left alone
+    QStringList m_bulkConfigs;
+    QStringList m_bulkConfigNames;
+    // svg images, openvpn configs don't fit into one qr code and have none
+    QStringList m_bulkQrCodes;
+    QString m_bulkConfigExtension;
 };
 
 #endif // EXPORTCONTROLLER_H
@@ -5,8 +5,11 @@
 #include <QEventLoop>
 #include <QJsonObject>
 #include <QRandomGenerator>
+#include <QScopeGuard>
 #include <QStandardPaths>
 
+#include <utility>
+
 #include "core/controllers/apiController.h"
 #include "core/controllers/serverController.h"
 #include "core/controllers/vpnConfigurationController.h"
@@ -47,8 +50,13 @@ InstallController::InstallController(const QSharedPointer<ServersModel> &servers
       m_protocolModel(protocolsModel),
       m_clientManagementModel(clientManagementModel),
       m_apiServicesModel(apiServicesModel),
-      m_settings(settings)
+      m_settings(settings),
+      m_provisioningController(new ProvisioningController(settings, this))
 {
+    connect(m_provisioningController, &ProvisioningController::provisioningFinished, this, &InstallController::onContainerProvisioned);
+    connect(m_provisioningController, &ProvisioningController::hostBusy, this,
+            [this](const QString &, const bool isBusy) { emit serverIsBusy(isBusy); });
+    connect(this, &InstallController::cancelInstallation, m_provisioningController, &ProvisioningController::cancel);
 }
 
 InstallController::~InstallController()
@@ -144,26 +152,53 @@ void InstallController::install(DockerContainer container, int port, TransportPr
         return;
     }
 
-    QString finishMessage = "";
-
     if (!installedContainers.contains(container)) {
-        errorCode = serverController->setupContainer(serverCredentials, container, config);
-        if (errorCode) {
-            emit installationErrorOccurred(errorCode);
+        if (m_provisioningController->isRunning()) {
+            logger.warning() << "Another container is being installed";
+            emit installationErrorOccurred(ErrorCode::ServerInstallationInProgress);
             return;
         }
 
-        installedContainers.insert(container, config);
-        finishMessage = tr("%1 installed successfully. ").arg(ContainerProps::containerHumanNames().value(container));
-    } else {
-        finishMessage = tr("%1 is already installed on the server. ").arg(ContainerProps::containerHumanNames().value(container));
+        m_pendingInstallation = PendingInstallation { container, installedContainers, serverCredentials, serverController };
+
+        // the ssh session goes back to the pool for the provisioning worker
+        serverController->disconnectFromHost();
+        m_provisioningController->provision({ ProvisioningJob { serverCredentials, container, config } });
+        return;
     }
 
-    if (errorCode) {
-        emit installationErrorOccurred(errorCode);
+    QString finishMessage = tr("%1 is already installed on the server. ").arg(ContainerProps::containerHumanNames().value(container));
+    finishInstallation(container, installedContainers, serverCredentials, serverController, finishMessage);
+}
+
+void InstallController::onContainerProvisioned(const QList<ProvisioningResult> &report)
+{
+    PendingInstallation installation = std::exchange(m_pendingInstallation, PendingInstallation {});
+    if (installation.container == DockerContainer::None) {
         return;
     }
 
+    if (report.isEmpty()) {
+        emit installationErrorOccurred(ErrorCode::InternalError);
+        return;
+    }
+
+    const ProvisioningResult &result = report.first();
+    if (result.errorCode) {
+        emit installationErrorOccurred(result.errorCode);
+        return;
+    }
+
+    installation.installedContainers.insert(installation.container, result.config);
+    QString finishMessage = tr("%1 installed successfully. ").arg(ContainerProps::containerHumanNames().value(installation.container));
+    finishInstallation(installation.container, installation.installedContainers, installation.credentials, installation.serverController,
+                       finishMessage);
+}
+
+void InstallController::finishInstallation(const DockerContainer container, const QMap<DockerContainer, QJsonObject> &installedContainers,
+                                           const ServerCredentials &serverCredentials,
+                                           const QSharedPointer<ServerController> &serverController, QString &finishMessage)
+{
     if (m_shouldCreateServer) {
         installServer(container, installedContainers, serverCredentials, serverController, finishMessage);
     } else {
@@ -497,6 +532,10 @@ void InstallController::updateContainer(QJsonObject config)
     QJsonObject oldContainerConfig = m_containersModel->getContainerConfig(container);
     ErrorCode errorCode = ErrorCode::NoError;
 
+    // the cleared profile and the new container config are written out together
+    m_settings->beginTransaction();
+    auto commitSettings = qScopeGuard([this]() { m_settings->commit(); });
+
     if (isUpdateDockerContainerRequired(container, oldContainerConfig, config)) {
         QSharedPointer<ServerController> serverController(new ServerController(m_settings));
         connect(serverController.get(), &ServerController::serverIsBusy, this, &InstallController::serverIsBusy);
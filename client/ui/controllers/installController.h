@@ -5,6 +5,7 @@
 #include <QProcess>
 
 #include "containers/containers_defs.h"
+#include "core/controllers/provisioningController.h"
 #include "core/defs.h"
 #include "ui/models/clientManagementModel.h"
 #include "ui/models/containers_model.h"
@@ -98,6 +99,10 @@ private:
     void installContainer(const DockerContainer container, const QMap<DockerContainer, QJsonObject> &installedContainers,
                           const ServerCredentials &serverCredentials, const QSharedPointer<ServerController> &serverController,
                           QString &finishMessage);
+    void finishInstallation(const DockerContainer container, const QMap<DockerContainer, QJsonObject> &installedContainers,
+                            const ServerCredentials &serverCredentials, const QSharedPointer<ServerController> &serverController,
+                            QString &finishMessage);
+    void onContainerProvisioned(const QList<ProvisioningResult> &report);
     bool isServerAlreadyExists();
 
     ErrorCode getAlreadyInstalledContainers(const ServerCredentials &credentials, const QSharedPointer<ServerController> &serverController,
@@ -112,6 +117,18 @@ private:
 
     std::shared_ptr<Settings> m_settings;
 
+    // the container setup runs on its worker threads, install() continues in onContainerProvisioned()
+    ProvisioningController *m_provisioningController;
+
+    struct PendingInstallation
+    {
+        DockerContainer container = DockerContainer::None;
+        QMap<DockerContainer, QJsonObject> installedContainers;
+        ServerCredentials credentials;
+        QSharedPointer<ServerController> serverController;
+    };
+    PendingInstallation m_pendingInstallation;
+
     ServerCredentials m_processedServerCredentials;
 
     bool m_shouldCreateServer;
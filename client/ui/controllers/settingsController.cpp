@@ -2,6 +2,7 @@
 
 #include <QStandardPaths>
 
+#include "core/keyPool.h"
 #include "logger.h"
 #include "systemController.h"
 #include "ui/qautostart.h"
@@ -100,8 +101,10 @@ void SettingsController::exportLogsFile(const QString &fileName)
 {
 #ifdef Q_OS_ANDROID
     AndroidController::instance()->exportLogsFile(fileName);
-#else
+#elif defined(Q_OS_IOS)
     SystemController::saveFile(fileName, Logger::getLogFile());
+#else
+    SystemController::saveFile(fileName, [](QIODevice &device) { return Logger::exportLogs(device, false); });
 #endif
 }
 
@@ -109,8 +112,10 @@ void SettingsController::exportServiceLogsFile(const QString &fileName)
 {
 #ifdef Q_OS_ANDROID
     AndroidController::instance()->exportLogsFile(fileName);
-#else
+#elif defined(Q_OS_IOS)
     SystemController::saveFile(fileName, Logger::getServiceLogFile());
+#else
+    SystemController::saveFile(fileName, [](QIODevice &device) { return Logger::exportLogs(device, true); });
 #endif
 }
 
@@ -208,6 +213,27 @@ void SettingsController::toggleStartMinimized(bool enable)
     m_settings->setStartMinimized(enable);
 }
 
+bool SettingsController::isOpenVpnEcKeysEnabled()
+{
+    return m_settings->isOpenVpnEcKeysEnabled();
+}
+
+void SettingsController::toggleOpenVpnEcKeys(bool enable)
+{
+    m_settings->setOpenVpnEcKeysEnabled(enable);
+}
+
+int SettingsController::getOpenVpnKeyPoolSize()
+{
+    return m_settings->openVpnKeyPoolSize();
+}
+
+void SettingsController::setOpenVpnKeyPoolSize(int size)
+{
+    m_settings->setOpenVpnKeyPoolSize(size);
+    KeyPool::instance().setWatermark(size);
+}
+
 bool SettingsController::isScreenshotsEnabled()
 {
     return m_settings->isScreenshotsEnabled();
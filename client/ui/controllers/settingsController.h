@@ -65,6 +65,12 @@ public slots:
     bool isStartMinimizedEnabled();
     void toggleStartMinimized(bool enable);
 
+    bool isOpenVpnEcKeysEnabled();
+    void toggleOpenVpnEcKeys(bool enable);
+
+    int getOpenVpnKeyPoolSize();
+    void setOpenVpnKeyPoolSize(int size);
+
     bool isScreenshotsEnabled();
     void toggleScreenshotsEnabled(bool enable);
 
@@ -3,15 +3,29 @@
 #include <QFile>
 #include <QHostInfo>
 #include <QStandardPaths>
+#include <QtConcurrent>
 
 #include "systemController.h"
 #include "core/networkUtilities.h"
+#include "core/prefixSet.h"
+
+namespace
+{
+    constexpr int importChunkSize = 5000;
+}
 
 SitesController::SitesController(const std::shared_ptr<Settings> &settings,
                                  const QSharedPointer<VpnConnection> &vpnConnection,
                                  const QSharedPointer<SitesModel> &sitesModel, QObject *parent)
     : QObject(parent), m_settings(settings), m_vpnConnection(vpnConnection), m_sitesModel(sitesModel)
 {
+    connect(&m_importWatcher, &QFutureWatcher<ImportResult>::finished, this, &SitesController::onImportFinished);
+}
+
+SitesController::~SitesController()
+{
+    m_isImportCancelled = true;
+    m_importWatcher.waitForFinished();
 }
 
 void SitesController::addSite(QString hostname)
@@ -35,14 +49,20 @@ void SitesController::addSite(QString hostname)
     }
 
     const auto &processSite = [this](const QString &hostname, const QString &ip) {
-        m_sitesModel->addSite(hostname, ip);
-
+        QString route;
         if (!ip.isEmpty()) {
-            QMetaObject::invokeMethod(m_vpnConnection.get(), "addRoutes", Qt::QueuedConnection,
-                                      Q_ARG(QStringList, QStringList() << ip));
+            route = ip;
         } else if (NetworkUtilities::ipAddressWithSubnetRegExp().exactMatch(hostname)) {
+            route = hostname;
+        }
+        // a route for an enclosing subnet is already in place
+        const bool isRouteRequired = !route.isEmpty() && !m_sitesModel->isCovered(route);
+
+        m_sitesModel->addSite(hostname, ip);
+
+        if (isRouteRequired) {
             QMetaObject::invokeMethod(m_vpnConnection.get(), "addRoutes", Qt::QueuedConnection,
-                                      Q_ARG(QStringList, QStringList() << hostname));
+                                      Q_ARG(QStringList, QStringList() << route));
         }
         QMetaObject::invokeMethod(m_vpnConnection.get(), "flushDns", Qt::QueuedConnection);
     };
@@ -71,10 +91,22 @@ void SitesController::removeSite(int index)
 {
     auto modelIndex = m_sitesModel->index(index);
     auto hostname = m_sitesModel->data(modelIndex, SitesModel::Roles::UrlRole).toString();
+    auto ip = m_sitesModel->data(modelIndex, SitesModel::Roles::IpRole).toString();
     m_sitesModel->removeSite(modelIndex);
 
-    QMetaObject::invokeMethod(m_vpnConnection.get(), "deleteRoutes", Qt::QueuedConnection,
-                              Q_ARG(QStringList, QStringList() << hostname));
+    const QString route = ip.isEmpty() ? hostname : ip;
+    // the route stays while another site still needs it
+    if (!m_sitesModel->isCovered(route)) {
+        QMetaObject::invokeMethod(m_vpnConnection.get(), "deleteRoutes", Qt::QueuedConnection,
+                                  Q_ARG(QStringList, QStringList() << route));
+
+        // sites inside the removed subnet had no routes of their own
+        const QStringList uncoveredRoutes = m_sitesModel->coveredBy(route);
+        if (!uncoveredRoutes.isEmpty()) {
+            QMetaObject::invokeMethod(m_vpnConnection.get(), "addRoutes", Qt::QueuedConnection,
+                                      Q_ARG(QStringList, PrefixSet(uncoveredRoutes).prefixes()));
+        }
+    }
     QMetaObject::invokeMethod(m_vpnConnection.get(), "flushDns", Qt::QueuedConnection);
 
     emit finished(tr("Site removed: %1").arg(hostname));
@@ -82,53 +114,107 @@ void SitesController::removeSite(int index)
 
 void SitesController::importSites(const QString &fileName, bool replaceExisting)
 {
-    QFile file(fileName);
-
-    if (!file.open(QIODevice::ReadOnly)) {
-        emit errorOccurred(tr("Can't open file: %1").arg(fileName));
+    if (m_isImporting) {
+        emit errorOccurred(tr("Import is already in progress"));
         return;
     }
 
-    QByteArray jsonData = file.readAll();
-    QJsonDocument jsonDocument = QJsonDocument::fromJson(jsonData);
-    if (jsonDocument.isNull()) {
-        emit errorOccurred(tr("Failed to parse JSON data from file: %1").arg(fileName));
-        return;
-    }
+    m_isImporting = true;
+    m_isImportReplacing = replaceExisting;
+    m_isImportCancelled = false;
+    m_importFileName = fileName;
 
-    if (!jsonDocument.isArray()) {
-        emit errorOccurred(tr("The JSON data is not an array in file: %1").arg(fileName));
-        return;
-    }
+    // the file is parsed on a worker thread, the sites are committed here with a single settings write once it is
+    // read completely
+    m_importWatcher.setFuture(QtConcurrent::run([this, fileName]() {
+        ImportResult result;
 
-    auto jsonArray = jsonDocument.array();
-    QMap<QString, QString> sites;
-    QStringList ips;
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            result.error = SitesImporter::Error::ReadError;
+            return result;
+        }
 
-    for (auto jsonValue : jsonArray) {
-        auto jsonObject = jsonValue.toObject();
-        auto hostname = jsonObject.value("hostname").toString("");
-        auto ip = jsonObject.value("ip").toString("");
+        const qint64 fileSize = file.size();
+        int reportedProgress = -1;
+        SitesImporter importer(importChunkSize, [&](const QMap<QString, QString> &sites, qint64 bytesRead) {
+            result.sites.insert(sites);
 
-        if (!hostname.contains(".") && !NetworkUtilities::ipAddressWithSubnetRegExp().exactMatch(hostname)) {
-            qDebug() << hostname << " not look like ip adress or domain name";
-            continue;
+            const int progress = fileSize > 0 ? static_cast<int>(bytesRead * 100 / fileSize) : 100;
+            if (progress != reportedProgress) {
+                reportedProgress = progress;
+                QMetaObject::invokeMethod(this, [this, progress]() { emit importProgressChanged(progress); }, Qt::QueuedConnection);
+            }
+            return !m_isImportCancelled;
+        });
+
+        result.error = importer.import(file, SitesImporter::detectFormat(fileName, file));
+        qDebug() << "SitesController::importSites" << fileName << "accepted" << importer.acceptedCount() << "duplicates"
+                 << importer.duplicateCount() << "rejected" << importer.rejectedCount();
+        if (result.error != SitesImporter::Error::NoError) {
+            result.sites.clear();
         }
+        return result;
+    }));
+}
 
-        if (ip.isEmpty()) {
-            ips.append(hostname);
-        } else {
-            ips.append(ip);
+QStringList SitesController::routesToAdd(const QMap<QString, QString> &sites, bool replaceExisting,
+                                         QStringList &unresolvedSites) const
+{
+    PrefixSet routes;
+    for (auto i = sites.constBegin(); i != sites.constEnd(); ++i) {
+        const QString &route = i.value().isEmpty() ? i.key() : i.value();
+        if (!routes.insert(route) && !routes.contains(route)) {
+            unresolvedSites.append(route);
         }
-        sites.insert(hostname, ip);
     }
 
-    m_sitesModel->addSites(sites, replaceExisting);
+    // drop the routes that are duplicates or lie inside a subnet routed already, by the list itself or by
+    // the sites that are kept
+    QStringList ips;
+    for (const QString &route : routes.prefixes()) {
+        if (replaceExisting || !m_sitesModel->isCovered(route)) {
+            ips.append(route);
+        }
+    }
+    return ips;
+}
 
-    QMetaObject::invokeMethod(m_vpnConnection.get(), "addRoutes", Qt::QueuedConnection, Q_ARG(QStringList, ips));
-    QMetaObject::invokeMethod(m_vpnConnection.get(), "flushDns", Qt::QueuedConnection);
+void SitesController::onImportFinished()
+{
+    m_isImporting = false;
+
+    const ImportResult result = m_importWatcher.result();
+    switch (result.error) {
+    case SitesImporter::Error::NoError: {
+        QStringList unresolvedSites;
+        const QStringList ips = routesToAdd(result.sites, m_isImportReplacing, unresolvedSites);
+        // an empty list still replaces the existing sites
+        m_sitesModel->addSites(result.sites, m_isImportReplacing);
+
+        QMetaObject::invokeMethod(m_vpnConnection.get(), "addRoutes", Qt::QueuedConnection, Q_ARG(QStringList, ips));
+        // domains are routed once they are resolved
+        QMetaObject::invokeMethod(m_vpnConnection.get(), "watchSites", Qt::QueuedConnection,
+                                  Q_ARG(QStringList, unresolvedSites));
+        QMetaObject::invokeMethod(m_vpnConnection.get(), "flushDns", Qt::QueuedConnection);
 
-    emit finished(tr("Import completed"));
+        emit finished(tr("Import completed"));
+        break;
+    }
+    case SitesImporter::Error::ReadError:
+        emit errorOccurred(tr("Can't open file: %1").arg(m_importFileName));
+        break;
+    case SitesImporter::Error::JsonParseError:
+        emit errorOccurred(tr("Failed to parse JSON data from file: %1").arg(m_importFileName));
+        break;
+    case SitesImporter::Error::JsonNotArrayError:
+        emit errorOccurred(tr("The JSON data is not an array in file: %1").arg(m_importFileName));
+        break;
+    case SitesImporter::Error::TooManySitesError:
+        emit errorOccurred(tr("The file has more than %1 sites: %2").arg(SitesImporter::maxSiteCount).arg(m_importFileName));
+        break;
+    case SitesImporter::Error::Cancelled: break;
+    }
 }
 
 void SitesController::exportSites(const QString &fileName)
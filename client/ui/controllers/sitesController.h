@@ -1,8 +1,12 @@
 #ifndef SITESCONTROLLER_H
 #define SITESCONTROLLER_H
 
+#include <QFutureWatcher>
 #include <QObject>
 
+#include <atomic>
+
+#include "core/sitesImporter.h"
 #include "settings.h"
 #include "ui/models/sites_model.h"
 #include "vpnconnection.h"
@@ -14,6 +18,7 @@ public:
     explicit SitesController(const std::shared_ptr<Settings> &settings,
                              const QSharedPointer<VpnConnection> &vpnConnection,
                              const QSharedPointer<SitesModel> &sitesModel, QObject *parent = nullptr);
+    ~SitesController() override;
 
 public slots:
     void addSite(QString hostname);
@@ -28,11 +33,34 @@ signals:
 
     void saveFile(const QString &fileName, const QString &data);
 
+    // percent of the file read
+    void importProgressChanged(int progress);
+
 private:
+    // new routes for the sites, without duplicates and the ones inside routed subnets, domains without an address
+    // are returned in unresolvedSites
+    QStringList routesToAdd(const QMap<QString, QString> &sites, bool replaceExisting, QStringList &unresolvedSites) const;
+
+    void onImportFinished();
+
     std::shared_ptr<Settings> m_settings;
 
     QSharedPointer<VpnConnection> m_vpnConnection;
     QSharedPointer<SitesModel> m_sitesModel;
+
+    struct ImportResult
+    {
+        SitesImporter::Error error = SitesImporter::Error::NoError;
+        // staged until the whole file is read, so a broken file leaves the existing sites untouched, the importer
+        // stops at SitesImporter::maxSiteCount sites
+        QMap<QString, QString> sites;
+    };
+
+    QFutureWatcher<ImportResult> m_importWatcher;
+    QString m_importFileName;
+    bool m_isImporting = false;
+    bool m_isImportReplacing = false;
+    std::atomic<bool> m_isImportCancelled { false };
 };
 
 #endif // SITESCONTROLLER_H
@@ -1,5 +1,6 @@
 #include "systemController.h"
 
+#include <QBuffer>
 #include <QDesktopServices>
 #include <QDir>
 #include <QEventLoop>
@@ -31,6 +32,22 @@ void SystemController::saveFile(QString fileName, const QString &data)
     return;
 #endif
 
+    saveFile(fileName, [&data](QIODevice &device) {
+        const QByteArray content = data.toUtf8();
+        return device.write(content) == content.size();
+    });
+}
+
+void SystemController::saveFile(QString fileName, const std::function<bool(QIODevice &)> &writeData)
+{
+#if defined Q_OS_ANDROID
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    writeData(buffer);
+    AndroidController::instance()->saveFile(fileName, QString::fromUtf8(buffer.data()));
+    return;
+#endif
+
 #ifdef Q_OS_IOS
     QUrl fileUrl = QDir::tempPath() + "/" + fileName;
     QFile file(fileUrl.toString());
@@ -38,9 +55,9 @@ void SystemController::saveFile(QString fileName, const QString &data)
     QFile file(fileName);
 #endif
 
-    // todo check if save successful
-    file.open(QIODevice::WriteOnly);
-    file.write(data.toUtf8());
+    if (!file.open(QIODevice::WriteOnly) || !writeData(file)) {
+        qWarning() << "Cannot save file:" << file.fileName();
+    }
     file.close();
 
 #ifdef Q_OS_IOS
@@ -1,8 +1,11 @@
 #ifndef SYSTEMCONTROLLER_H
 #define SYSTEMCONTROLLER_H
 
+#include <QIODevice>
 #include <QObject>
 
+#include <functional>
+
 #include "settings.h"
 
 class SystemController : public QObject
@@ -12,6 +15,8 @@ public:
     explicit SystemController(const std::shared_ptr<Settings> &setting, QObject *parent = nullptr);
 
     static void saveFile(QString fileName, const QString &data);
+    // writeData streams the content into the file, nothing is kept in memory on desktop
+    static void saveFile(QString fileName, const std::function<bool(QIODevice &)> &writeData);
 
 public slots:
     QString getFileName(const QString &acceptLabel, const QString &nameFilter, const QString &selectedFile = "",
@@ -1,8 +1,15 @@
 #include "clientManagementModel.h"
 
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QRegularExpression>
 
+#include <charconv>
+#include <cstring>
+
+#include "configurators/xray_configurator.h"
 #include "core/controllers/serverController.h"
 #include "logger.h"
 
@@ -14,13 +21,77 @@ namespace
     {
         constexpr char clientId[] = "clientId";
         constexpr char clientName[] = "clientName";
-        constexpr char container[] = "container";
-        constexpr char userData[] = "userData";
-        constexpr char creationDate[] = "creationDate";
-        constexpr char latestHandshake[] = "latestHandshake";
-        constexpr char dataReceived[] = "dataReceived";
-        constexpr char dataSent[] = "dataSent";
-        constexpr char allowedIps[] = "allowedIps";
+    }
+
+    // The clients table is stored on the server as a json snapshot (clientsTable) plus an append-only journal
+    // (clientsTable.journal) with one compact json entry per line. Edits only append to the journal, reads only
+    // download what changed since the last time we saw the table.
+    // Every entry carries the sha256 of the snapshot it was appended to. Clients that don't know about the journal
+    // rewrite the snapshot without truncating it, the entries of such a stale journal are merged into the new snapshot
+    // by clientId (the snapshot wins for clients it already has) and the result is folded back into the snapshot.
+    namespace journalKey
+    {
+        constexpr char version[] = "v";
+        constexpr char base[] = "base";
+        constexpr char operation[] = "op";
+        constexpr char add[] = "add";
+        constexpr char update[] = "update";
+        constexpr char remove[] = "remove";
+    }
+
+    constexpr int journalVersion = 1;
+    // the journal is folded into the snapshot once it gets longer than this
+    constexpr int maxJournalEntries = 256;
+
+    struct ClientsTableCache
+    {
+        QByteArray tableHash;
+        // the journal as we know it, its hash tells whether someone else appended to it in between
+        QByteArray journal;
+        int journalEntries = 0;
+        ClientsRegistry clientsTable;
+    };
+
+    QHash<QString, ClientsTableCache> clientsTableCache;
+
+    // same output as the "latest handshake" line of `wg show`, with short units
+    QString formatLatestHandshake(const qint64 latestHandshake, const qint64 now)
+    {
+        qint64 seconds = qMax<qint64>(now - latestHandshake, 0);
+        if (seconds == 0) {
+            return QStringLiteral("Now");
+        }
+
+        const std::pair<qint64, char> units[] = { { 24 * 60 * 60, 'd' }, { 60 * 60, 'h' }, { 60, 'm' }, { 1, 's' } };
+
+        QStringList parts;
+        for (const auto &unit : units) {
+            if (seconds >= unit.first) {
+                parts.append(QString("%1%2").arg(seconds / unit.first).arg(unit.second));
+                seconds %= unit.first;
+            }
+        }
+        return parts.join(", ") + " ago";
+    }
+
+    // same output as the "transfer" line of `wg show`
+    QString formatBytes(const quint64 bytes)
+    {
+        const std::pair<double, const char *> units[] = {
+            { 1024.0 * 1024 * 1024 * 1024, "TiB" }, { 1024.0 * 1024 * 1024, "GiB" }, { 1024.0 * 1024, "MiB" }, { 1024.0, "KiB" }
+        };
+
+        for (const auto &unit : units) {
+            if (bytes >= unit.first) {
+                return QString("%1 %2").arg(bytes / unit.first, 0, 'f', 2).arg(unit.second);
+            }
+        }
+        return QString("%1 B").arg(bytes);
+    }
+
+    QString clientsTableCacheKey(const ServerCredentials &credentials, const QString &clientsTableFile)
+    {
+        return QString("%1:%2%3").arg(credentials.hostName).arg(credentials.port).arg(clientsTableFile);
     }
 }
 
@@ -32,25 +103,27 @@ ClientManagementModel::ClientManagementModel(std::shared_ptr<Settings> settings,
 int ClientManagementModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
-    return static_cast<int>(m_clientsTable.size());
+    return m_clients.size();
 }
 
 QVariant ClientManagementModel::data(const QModelIndex &index, int role) const
 {
-    if (!index.isValid() || index.row() < 0 || index.row() >= static_cast<int>(m_clientsTable.size())) {
+    if (!index.isValid() || index.row() < 0 || index.row() >= m_clients.size()) {
         return QVariant();
     }
 
-    auto client = m_clientsTable.at(index.row()).toObject();
-    auto userData = client.value(configKey::userData).toObject();
+    const ClientInfo &client = m_clients.at(index.row());
 
     switch (role) {
-    case ClientNameRole: return userData.value(configKey::clientName).toString();
-    case CreationDateRole: return userData.value(configKey::creationDate).toString();
-    case LatestHandshakeRole: return userData.value(configKey::latestHandshake).toString();
-    case DataReceivedRole: return userData.value(configKey::dataReceived).toString();
-    case DataSentRole: return userData.value(configKey::dataSent).toString();
-    case AllowedIpsRole: return userData.value(configKey::allowedIps).toString();
+    case ClientNameRole: return client.clientName;
+    case CreationDateRole: return client.creationDate;
+    case LatestHandshakeRole: return client.latestHandshake;
+    case DataReceivedRole: return client.dataReceived;
+    case DataSentRole: return client.dataSent;
+    case AllowedIpsRole: return client.allowedIps;
+    case LatestHandshakeTimestampRole: return client.latestHandshakeTimestamp;
+    case DataReceivedBytesRole: return client.dataReceivedBytes;
+    case DataSentBytesRole: return client.dataSentBytes;
     }
 
     return QVariant();
@@ -61,14 +134,258 @@ void ClientManagementModel::migration(const QByteArray &clientsTableString)
     QJsonObject clientsTable = QJsonDocument::fromJson(clientsTableString).object();
 
     for (auto &clientId : clientsTable.keys()) {
-        QJsonObject client;
-        client[configKey::clientId] = clientId;
+        appendMigratedClient(clientId, clientsTable.value(clientId).toObject().value(configKey::clientName).toString());
+    }
+}
 
-        QJsonObject userData;
-        userData[configKey::clientName] = clientsTable.value(clientId).toObject().value(configKey::clientName);
-        client[configKey::userData] = userData;
+void ClientManagementModel::appendMigratedClient(const QString &clientId, const QString &clientName)
+{
+    ClientInfo client;
+    client.clientId = clientId;
+    client.clientName = clientName;
+    m_clients.insert(client);
+}
 
-        m_clientsTable.push_back(client);
+QString ClientManagementModel::clientsTableFilePath(const DockerContainer container) const
+{
+    QString clientsTableFile = QString("/opt/amnezia/%1/clientsTable");
+    if (container == DockerContainer::OpenVpn || container == DockerContainer::ShadowSocks || container == DockerContainer::Cloak) {
+        return clientsTableFile.arg(ContainerProps::containerTypeToString(DockerContainer::OpenVpn));
+    }
+    return clientsTableFile.arg(ContainerProps::containerTypeToString(container));
+}
+
+ErrorCode ClientManagementModel::readClientsTable(const DockerContainer container, const ServerCredentials &credentials,
+                                                  const QSharedPointer<ServerController> &serverController, ClientsRegistry &clientsTable)
+{
+    const QString clientsTableFile = clientsTableFilePath(container);
+    const QString cacheKey = clientsTableCacheKey(credentials, clientsTableFile);
+
+    QString stdOut;
+    auto cbReadStdOut = [&](const QString &data, libssh::Client &) {
+        stdOut += data;
+        return ErrorCode::NoError;
+    };
+
+    auto cacheIt = clientsTableCache.find(cacheKey);
+    const qint64 knownJournalSize = cacheIt != clientsTableCache.end() ? cacheIt->journal.size() : 0;
+
+    // one round trip tells whether the snapshot or the journal changed since we've seen them
+    const QString getTableState = QString("sudo docker exec -i $CONTAINER_NAME sh -c '"
+                                          "echo table=$(sha256sum < %1 2>/dev/null | cut -d\\  -f1) "
+                                          "journal=$(cat %1.journal 2>/dev/null | wc -c) "
+                                          "known=$(head -c %2 %1.journal 2>/dev/null | sha256sum | cut -d\\  -f1)'")
+                                          .arg(clientsTableFile)
+                                          .arg(knownJournalSize);
+    ErrorCode error = serverController->runScript(
+            credentials, serverController->replaceVars(getTableState, serverController->genVarsForScript(credentials, container)),
+            cbReadStdOut);
+    if (error != ErrorCode::NoError) {
+        return error;
+    }
+
+    static const QRegularExpression tableStateRegExp("table=(\\S*)\\s+journal=\\s*(\\d+)\\s+known=(\\S*)");
+    const QRegularExpressionMatch tableStateMatch = tableStateRegExp.match(stdOut);
+    const QByteArray tableHash = tableStateMatch.captured(1).toLatin1();
+    const qint64 journalSize = tableStateMatch.captured(2).toLongLong();
+    const QByteArray knownJournalHash = tableStateMatch.captured(3).toLatin1();
+
+    if (tableStateMatch.hasMatch() && !tableHash.isEmpty() && cacheIt != clientsTableCache.end() && cacheIt->tableHash == tableHash
+        && knownJournalHash == QCryptographicHash::hash(cacheIt->journal, QCryptographicHash::Sha256).toHex()) {
+        if (knownJournalSize == journalSize) {
+            clientsTable = cacheIt->clientsTable;
+            return ErrorCode::NoError;
+        }
+
+        if (knownJournalSize < journalSize) {
+            stdOut.clear();
+            const QString getJournalTail = QString("sudo docker exec -i $CONTAINER_NAME sh -c 'tail -c +%2 %1.journal | xxd -p'")
+                                                   .arg(clientsTableFile)
+                                                   .arg(knownJournalSize + 1);
+            error = serverController->runScript(
+                    credentials, serverController->replaceVars(getJournalTail, serverController->genVarsForScript(credentials, container)),
+                    cbReadStdOut);
+            if (error != ErrorCode::NoError) {
+                return error;
+            }
+
+            const QByteArray journalTail = QByteArray::fromHex(stdOut.toUtf8());
+            ClientsRegistry updatedTable = cacheIt->clientsTable;
+            int entriesCount = cacheIt->journalEntries;
+            int staleEntries = 0;
+            if (journalTail.size() == journalSize - knownJournalSize
+                && applyClientsJournal(journalTail, cacheIt->tableHash, updatedTable, entriesCount, staleEntries)) {
+                cacheIt->journal += journalTail;
+                cacheIt->journalEntries = entriesCount;
+                cacheIt->clientsTable = updatedTable;
+                clientsTable = updatedTable;
+                return ErrorCode::NoError;
+            }
+            logger.warning() << "The clientsTable journal was rewritten on the server, reloading it";
+        }
+    }
+
+    const QByteArray clientsTableString = serverController->getTextFileFromContainer(container, credentials, clientsTableFile, error);
+    if (error != ErrorCode::NoError) {
+        return error;
+    }
+
+    const QByteArray journal = serverController->getTextFileFromContainer(container, credentials, clientsTableFile + ".journal", error);
+    if (error != ErrorCode::NoError) {
+        return error;
+    }
+
+    ClientsTableCache cache;
+    cache.tableHash = QCryptographicHash::hash(clientsTableString, QCryptographicHash::Sha256).toHex();
+    cache.clientsTable = ClientsRegistry::fromJson(QJsonDocument::fromJson(clientsTableString).array());
+    int staleEntries = 0;
+    if (!applyClientsJournal(journal, cache.tableHash, cache.clientsTable, cache.journalEntries, staleEntries)) {
+        logger.warning() << "The clientsTable journal contains malformed entries";
+    }
+    cache.journal = journal;
+
+    clientsTable = cache.clientsTable;
+    if (staleEntries > 0) {
+        // the snapshot was rewritten by a client that doesn't know about the journal, fold the merged table back
+        // so that it sees the clients added through the journal too
+        logger.warning() << "Merged" << staleEntries << "clientsTable journal entries written against another snapshot";
+        return writeClientsTable(container, credentials, serverController, clientsTable);
+    }
+
+    if (tableHash.isEmpty() || tableHash != cache.tableHash) {
+        // the snapshot doesn't exist yet or changed while we were reading it
+        clientsTableCache.remove(cacheKey);
+    } else {
+        clientsTableCache.insert(cacheKey, cache);
+    }
+
+    return ErrorCode::NoError;
+}
+
+ErrorCode ClientManagementModel::writeClientsTable(const DockerContainer container, const ServerCredentials &credentials,
+                                                   const QSharedPointer<ServerController> &serverController, const ClientsRegistry &clientsTable)
+{
+    const QString clientsTableFile = clientsTableFilePath(container);
+    const QString cacheKey = clientsTableCacheKey(credentials, clientsTableFile);
+    clientsTableCache.remove(cacheKey);
+
+    const QByteArray clientsTableString = QJsonDocument(clientsTable.toJson()).toJson();
+    ErrorCode error = serverController->uploadTextFileToContainer(container, credentials, clientsTableString, clientsTableFile);
+    if (error != ErrorCode::NoError) {
+        return error;
+    }
+
+    // the snapshot already contains everything from the journal
+    error = serverController->uploadTextFileToContainer(container, credentials, "", clientsTableFile + ".journal");
+    if (error != ErrorCode::NoError) {
+        return error;
+    }
+
+    ClientsTableCache cache;
+    cache.tableHash = QCryptographicHash::hash(clientsTableString, QCryptographicHash::Sha256).toHex();
+    cache.clientsTable = clientsTable;
+    clientsTableCache.insert(cacheKey, cache);
+
+    return ErrorCode::NoError;
+}
+
+ErrorCode ClientManagementModel::appendClientsJournal(const DockerContainer container, const ServerCredentials &credentials,
+                                                      const QSharedPointer<ServerController> &serverController, const QJsonObject &entry)
+{
+    return appendClientsJournal(container, credentials, serverController, QList<QJsonObject> { entry });
+}
+
+ErrorCode ClientManagementModel::appendClientsJournal(const DockerContainer container, const ServerCredentials &credentials,
+                                                      const QSharedPointer<ServerController> &serverController,
+                                                      const QList<QJsonObject> &entries)
+{
+    const QString clientsTableFile = clientsTableFilePath(container);
+    const QString cacheKey = clientsTableCacheKey(credentials, clientsTableFile);
+
+    // the entries are based on the snapshot we loaded last, if it was rewritten in between they are merged into the
+    // new one on the next read, and a journal that changed under us fails the hash check of the next read
+    auto cacheIt = clientsTableCache.find(cacheKey);
+    if (cacheIt == clientsTableCache.end() || cacheIt->journalEntries + entries.size() > maxJournalEntries) {
+        return writeClientsTable(container, credentials, serverController, m_clients);
+    }
+
+    QList<QJsonObject> versionedEntries;
+    QByteArray journalLines;
+    for (const auto &entry : entries) {
+        QJsonObject versionedEntry = entry;
+        versionedEntry[journalKey::version] = journalVersion;
+        versionedEntry[journalKey::base] = QString::fromLatin1(cacheIt->tableHash);
+        journalLines += QJsonDocument(versionedEntry).toJson(QJsonDocument::Compact) + "\n";
+        versionedEntries.append(versionedEntry);
+    }
+
+    ErrorCode error = serverController->uploadTextFileToContainer(container, credentials, journalLines, clientsTableFile + ".journal",
+                                                                  libssh::ScpOverwriteMode::ScpAppendToExisting);
+    if (error != ErrorCode::NoError) {
+        clientsTableCache.remove(cacheKey);
+        return error;
+    }
+
+    for (const auto &versionedEntry : versionedEntries) {
+        applyClientsJournalEntry(versionedEntry, cacheIt->clientsTable);
+    }
+    cacheIt->journal += journalLines;
+    cacheIt->journalEntries += versionedEntries.size();
+
+    return ErrorCode::NoError;
+}
+
+bool ClientManagementModel::applyClientsJournal(const QByteArray &journal, const QByteArray &tableHash, ClientsRegistry &clientsTable,
+                                                int &entriesCount, int &staleEntries)
+{
+    for (const QByteArray &line : journal.split('\n')) {
+        if (line.trimmed().isEmpty()) {
+            continue;
+        }
+
+        const QJsonDocument entry = QJsonDocument::fromJson(line);
+        if (!entry.isObject()) {
+            return false;
+        }
+
+        // the snapshot was rewritten by someone who didn't truncate the journal, the entry may already be in it
+        entriesCount++;
+        const bool isStale = entry.object().value(journalKey::base).toString().toLatin1() != tableHash;
+        if (isStale) {
+            staleEntries++;
+        }
+
+        applyClientsJournalEntry(entry.object(), clientsTable, isStale);
+    }
+
+    return true;
+}
+
+void ClientManagementModel::applyClientsJournalEntry(const QJsonObject &entry, ClientsRegistry &clientsTable, const bool isStale)
+{
+    if (entry.value(journalKey::version).toInt() > journalVersion) {
+        logger.warning() << "Skipping clientsTable journal entry of unsupported version";
+        return;
+    }
+
+    const QString operation = entry.value(journalKey::operation).toString();
+    const QString clientId = entry.value(configKey::clientId).toString();
+
+    // a stale entry only brings back clients the rewritten snapshot lost and renames the ones it still has,
+    // it doesn't overwrite newer records or resurrect clients removed since
+    if (operation == journalKey::add) {
+        if (!isStale || !clientsTable.contains(clientId)) {
+            clientsTable.insert(ClientInfo::fromJson(entry));
+        }
+    } else if (operation == journalKey::update) {
+        if (!isStale || clientsTable.contains(clientId)) {
+            clientsTable.insert(ClientInfo::fromJson(entry));
+        }
+    } else if (operation == journalKey::remove) {
+        const int row = clientsTable.indexOf(clientId);
+        if (row >= 0) {
+            clientsTable.removeAt(row);
+        }
     }
 }
 
@@ -76,28 +393,29 @@ ErrorCode ClientManagementModel::updateModel(const DockerContainer container, co
                                              const QSharedPointer<ServerController> &serverController)
 {
     beginResetModel();
-    m_clientsTable = QJsonArray();
+    m_clients.clear();
     endResetModel();
 
     ErrorCode error = ErrorCode::NoError;
 
-    QString clientsTableFile = QString("/opt/amnezia/%1/clientsTable");
-    if (container == DockerContainer::OpenVpn || container == DockerContainer::ShadowSocks || container == DockerContainer::Cloak) {
-        clientsTableFile = clientsTableFile.arg(ContainerProps::containerTypeToString(DockerContainer::OpenVpn));
-    } else {
-        clientsTableFile = clientsTableFile.arg(ContainerProps::containerTypeToString(container));
-    }
-
-    const QByteArray clientsTableString = serverController->getTextFileFromContainer(container, credentials, clientsTableFile, error);
+    ClientsRegistry clientsTable;
+    error = readClientsTable(container, credentials, serverController, clientsTable);
     if (error != ErrorCode::NoError) {
         logger.error() << "Failed to get the clientsTable file from the server";
         return error;
     }
 
     beginResetModel();
-    m_clientsTable = QJsonDocument::fromJson(clientsTableString).array();
+    m_clients = clientsTable;
 
-    if (m_clientsTable.isEmpty()) {
+    if (m_clients.isEmpty()) {
+        const QByteArray clientsTableString =
+                serverController->getTextFileFromContainer(container, credentials, clientsTableFilePath(container), error);
+        if (error != ErrorCode::NoError) {
+            endResetModel();
+            logger.error() << "Failed to get the clientsTable file from the server";
+            return error;
+        }
         migration(clientsTableString);
 
         int count = 0;
@@ -114,9 +432,9 @@ ErrorCode ClientManagementModel::updateModel(const DockerContainer container, co
             return error;
         }
 
-        const QByteArray newClientsTableString = QJsonDocument(m_clientsTable).toJson();
+        const QByteArray newClientsTableString = QJsonDocument(m_clients.toJson()).toJson();
         if (clientsTableString != newClientsTableString) {
-            error = serverController->uploadTextFileToContainer(container, credentials, newClientsTableString, clientsTableFile);
+            error = writeClientsTable(container, credentials, serverController, m_clients);
             if (error != ErrorCode::NoError) {
                 logger.error() << "Failed to upload the clientsTable file to the server";
             }
@@ -126,37 +444,30 @@ ErrorCode ClientManagementModel::updateModel(const DockerContainer container, co
     std::vector<WgShowData> data;
     wgShow(container, credentials, serverController, data);
 
-    for (const auto &client : data) {
-        int i = 0;
-        for (const auto &it : std::as_const(m_clientsTable)) {
-            if (it.isObject()) {
-                QJsonObject obj = it.toObject();
-                if (obj.contains(configKey::clientId) && obj[configKey::clientId].toString() == client.clientId) {
-                    QJsonObject userData = obj[configKey::userData].toObject();
-
-                    if (!client.latestHandshake.isEmpty()) {
-                        userData[configKey::latestHandshake] = client.latestHandshake;
-                    }
-
-                    if (!client.dataReceived.isEmpty()) {
-                        userData[configKey::dataReceived] = client.dataReceived;
-                    }
-
-                    if (!client.dataSent.isEmpty()) {
-                        userData[configKey::dataSent] = client.dataSent;
-                    }
-
-                    if (!client.allowedIps.isEmpty()) {
-                        userData[configKey::allowedIps] = client.allowedIps;
-                    }
-
-                    obj[configKey::userData] = userData;
-                    m_clientsTable.replace(i, obj);
-                    break;
-                }
-            }
-            ++i;
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+    for (const auto &peer : data) {
+        const int row = m_clients.indexOf(peer.clientId);
+        if (row < 0) {
+            continue;
+        }
+
+        ClientInfo client = m_clients.at(row);
+
+        if (peer.latestHandshake > 0) {
+            client.latestHandshake = formatLatestHandshake(peer.latestHandshake, now);
+            client.latestHandshakeTimestamp = peer.latestHandshake;
         }
+
+        client.dataReceived = formatBytes(peer.dataReceived);
+        client.dataReceivedBytes = peer.dataReceived;
+        client.dataSent = formatBytes(peer.dataSent);
+        client.dataSentBytes = peer.dataSent;
+
+        if (!peer.allowedIps.isEmpty()) {
+            client.allowedIps = peer.allowedIps;
+        }
+
+        m_clients.replace(row, client);
     }
 
     endResetModel();
@@ -188,14 +499,7 @@ ErrorCode ClientManagementModel::getOpenVpnClients(const DockerContainer contain
         for (auto &openvpnCertId : certsIds) {
             openvpnCertId.replace(".crt", "");
             if (!isClientExists(openvpnCertId)) {
-                QJsonObject client;
-                client[configKey::clientId] = openvpnCertId;
-
-                QJsonObject userData;
-                userData[configKey::clientName] = QString("Client %1").arg(count);
-                client[configKey::userData] = userData;
-
-                m_clientsTable.push_back(client);
+                appendMigratedClient(openvpnCertId, QString("Client %1").arg(count));
 
                 count++;
             }
@@ -227,14 +531,7 @@ ErrorCode ClientManagementModel::getWireGuardClients(const DockerContainer conta
 
     for (auto &wireguardKey : wireguardKeys) {
         if (!isClientExists(wireguardKey)) {
-            QJsonObject client;
-            client[configKey::clientId] = wireguardKey;
-
-            QJsonObject userData;
-            userData[configKey::clientName] = QString("Client %1").arg(count);
-            client[configKey::userData] = userData;
-
-            m_clientsTable.push_back(client);
+            appendMigratedClient(wireguardKey, QString("Client %1").arg(count));
 
             count++;
         }
@@ -289,14 +586,7 @@ ErrorCode ClientManagementModel::getXrayClients(const DockerContainer container,
         xrayDefaultUuid.replace("\n", "");
 
         if (!isClientExists(clientId) && clientId != xrayDefaultUuid) {
-            QJsonObject client;
-            client[configKey::clientId] = clientId;
-
-            QJsonObject userData;
-            userData[configKey::clientName] = QString("Client %1").arg(count);
-            client[configKey::userData] = userData;
-
-            m_clientsTable.push_back(client);
+            appendMigratedClient(clientId, QString("Client %1").arg(count));
             count++;
         }
     }
@@ -312,13 +602,13 @@ ErrorCode ClientManagementModel::wgShow(const DockerContainer container, const S
     }
 
     ErrorCode error = ErrorCode::NoError;
-    QString stdOut;
+    QByteArray stdOut;
     auto cbReadStdOut = [&](const QString &data, libssh::Client &) {
-        stdOut += data + "\n";
+        stdOut += data.toUtf8() + "\n";
         return ErrorCode::NoError;
     };
 
-    const QString command = QString("sudo docker exec -i $CONTAINER_NAME bash -c '%1'").arg("wg show all");
+    const QString command = QString("sudo docker exec -i $CONTAINER_NAME bash -c '%1'").arg("wg show all dump");
 
     QString script = serverController->replaceVars(command, serverController->genVarsForScript(credentials, container));
     error = serverController->runScript(credentials, script, cbReadStdOut);
@@ -327,62 +617,70 @@ ErrorCode ClientManagementModel::wgShow(const DockerContainer container, const S
         return error;
     }
 
-    if (stdOut.isEmpty()) {
-        return error;
-    }
-
-    const auto getStrValue = [](const auto str) { return str.mid(str.indexOf(":") + 1).trimmed(); };
-
-    const auto parts = stdOut.split('\n');
-    const auto peerList = parts.filter("peer:");
-    const auto latestHandshakeList = parts.filter("latest handshake:");
-    const auto transferredDataList = parts.filter("transfer:");
-    const auto allowedIpsList = parts.filter("allowed ips:");
+    parseWgShowDump(stdOut, data);
+    return error;
+}
 
-    if (allowedIpsList.isEmpty() || latestHandshakeList.isEmpty() || transferredDataList.isEmpty() || peerList.isEmpty()) {
-        return error;
-    }
+void ClientManagementModel::parseWgShowDump(const QByteArray &dump, std::vector<WgShowData> &data)
+{
+    // `wg show all dump` prints one tab separated line per interface and per peer, peer lines are:
+    // interface, public key, preshared key, endpoint, allowed ips, latest handshake, rx bytes, tx bytes, keepalive
+    enum PeerField { Interface, PublicKey, PresharedKey, Endpoint, AllowedIps, LatestHandshake, TransferRx, TransferTx, Keepalive, FieldsCount };
 
-    const auto changeHandshakeFormat = [](QString &latestHandshake) {
-        const std::vector<std::pair<QString, QString>> replaceMap = { { " days", "d" },    { " hours", "h" }, { " minutes", "m" },
-                                                                      { " seconds", "s" }, { " day", "d" },   { " hour", "h" },
-                                                                      { " minute", "m" },  { " second", "s" } };
+    const auto toNumber = [](const QByteArrayView field, auto &value) {
+        return std::from_chars(field.data(), field.data() + field.size(), value).ec == std::errc();
+    };
 
-        for (const auto &item : replaceMap) {
-            latestHandshake.replace(item.first, item.second);
+    const char *position = dump.constData();
+    const char *const end = position + dump.size();
+    while (position < end) {
+        const char *lineEnd = static_cast<const char *>(memchr(position, '\n', end - position));
+        if (!lineEnd) {
+            lineEnd = end;
         }
-    };
 
-    for (int i = 0; i < peerList.size() && i < transferredDataList.size() && i < latestHandshakeList.size() && i < allowedIpsList.size(); ++i) {
+        QByteArrayView fields[FieldsCount];
+        int fieldsCount = 0;
+        const char *fieldBegin = position;
+        while (fieldsCount < FieldsCount) {
+            const char *fieldEnd = static_cast<const char *>(memchr(fieldBegin, '\t', lineEnd - fieldBegin));
+            fields[fieldsCount++] = QByteArrayView(fieldBegin, (fieldEnd ? fieldEnd : lineEnd) - fieldBegin);
+            if (!fieldEnd) {
+                break;
+            }
+            fieldBegin = fieldEnd + 1;
+        }
+        position = lineEnd + 1;
 
-        const auto transferredData = getStrValue(transferredDataList[i]).split(",");
-        auto latestHandshake = getStrValue(latestHandshakeList[i]);
-        auto serverBytesReceived = transferredData.front().trimmed();
-        auto serverBytesSent = transferredData.back().trimmed();
-        auto allowedIps = getStrValue(allowedIpsList[i]);
+        // interface lines have fewer fields
+        if (fieldsCount != FieldsCount) {
+            continue;
+        }
 
-        changeHandshakeFormat(latestHandshake);
+        WgShowData peer;
+        quint64 transferRx = 0;
+        quint64 transferTx = 0;
+        if (!toNumber(fields[LatestHandshake], peer.latestHandshake) || !toNumber(fields[TransferRx], transferRx)
+            || !toNumber(fields[TransferTx], transferTx)) {
+            logger.warning() << "Skipping malformed wg show dump line";
+            continue;
+        }
 
-        serverBytesReceived.chop(QStringLiteral(" received").length());
-        serverBytesSent.chop(QStringLiteral(" sent").length());
+        peer.clientId = QString::fromLatin1(fields[PublicKey]);
+        // the server receives what the client sends and vice versa
+        peer.dataReceived = transferTx;
+        peer.dataSent = transferRx;
+        if (fields[AllowedIps] != QByteArrayView("(none)")) {
+            peer.allowedIps = QString::fromLatin1(fields[AllowedIps]).replace(',', ", ");
+        }
 
-        data.push_back({ getStrValue(peerList[i]), latestHandshake, serverBytesSent, serverBytesReceived, allowedIps });
+        data.push_back(peer);
     }
-
-    return error;
 }
 
-bool ClientManagementModel::isClientExists(const QString &clientId)
+bool ClientManagementModel::isClientExists(const QString &clientId) const
 {
-    for (const QJsonValue &value : std::as_const(m_clientsTable)) {
-        if (value.isObject()) {
-            QJsonObject obj = value.toObject();
-            if (obj.contains(configKey::clientId) && obj[configKey::clientId].toString() == clientId) {
-                return true;
-            }
-        }
-    }
-    return false;
+    return m_clients.contains(clientId);
 }
 
 ErrorCode ClientManagementModel::appendClient(const DockerContainer container, const ServerCredentials &credentials,
@@ -463,33 +761,88 @@ ErrorCode ClientManagementModel::appendClient(const QString &clientId, const QSt
         return error;
     }
 
-    for (int i = 0; i < m_clientsTable.size(); i++) {
-        if (m_clientsTable.at(i).toObject().value(configKey::clientId) == clientId) {
-            return renameClient(i, clientName, container, credentials, serverController, true);
-        }
+    const int existingRow = m_clients.indexOf(clientId);
+    if (existingRow >= 0) {
+        return renameClient(existingRow, clientName, container, credentials, serverController, true);
     }
 
-    beginInsertRows(QModelIndex(), rowCount(), rowCount() + 1);
-    QJsonObject client;
-    client[configKey::clientId] = clientId;
+    ClientInfo client;
+    client.clientId = clientId;
+    client.clientName = clientName;
+    client.creationDate = QDateTime::currentDateTime().toString();
 
-    QJsonObject userData;
-    userData[configKey::clientName] = clientName;
-    userData[configKey::creationDate] = QDateTime::currentDateTime().toString();
-    client[configKey::userData] = userData;
-    m_clientsTable.push_back(client);
+    beginInsertRows(QModelIndex(), rowCount(), rowCount());
+    m_clients.insert(client);
     endInsertRows();
 
-    const QByteArray clientsTableString = QJsonDocument(m_clientsTable).toJson();
+    QJsonObject entry = client.toJson();
+    entry[journalKey::operation] = journalKey::add;
+    error = appendClientsJournal(container, credentials, serverController, entry);
+    if (error != ErrorCode::NoError) {
+        logger.error() << "Failed to upload the clientsTable file to the server";
+    }
 
-    QString clientsTableFile = QString("/opt/amnezia/%1/clientsTable");
-    if (container == DockerContainer::OpenVpn || container == DockerContainer::ShadowSocks || container == DockerContainer::Cloak) {
-        clientsTableFile = clientsTableFile.arg(ContainerProps::containerTypeToString(DockerContainer::OpenVpn));
-    } else {
-        clientsTableFile = clientsTableFile.arg(ContainerProps::containerTypeToString(container));
+    return error;
+}
+
+ErrorCode ClientManagementModel::appendClients(const QList<QPair<QString, QString>> &clients, const DockerContainer container,
+                                               const ServerCredentials &credentials,
+                                               const QSharedPointer<ServerController> &serverController)
+{
+    ErrorCode error = updateModel(container, credentials, serverController);
+    if (error != ErrorCode::NoError) {
+        return error;
+    }
+
+    const QString creationDate = QDateTime::currentDateTime().toString();
+
+    QList<ClientInfo> newClients;
+    QList<QJsonObject> entries;
+    QSet<QString> processedIds;
+    for (const auto &[clientId, clientName] : clients) {
+        if (processedIds.contains(clientId)) {
+            continue;
+        }
+        processedIds.insert(clientId);
+
+        const int row = m_clients.indexOf(clientId);
+        if (row >= 0) {
+            ClientInfo client = m_clients.at(row);
+            client.clientName = clientName;
+            client.creationDate = creationDate;
+            m_clients.replace(row, client);
+            emit dataChanged(index(row, 0), index(row, 0));
+
+            QJsonObject entry = client.toJson();
+            entry[journalKey::operation] = journalKey::update;
+            entries.append(entry);
+            continue;
+        }
+
+        ClientInfo client;
+        client.clientId = clientId;
+        client.clientName = clientName;
+        client.creationDate = creationDate;
+        newClients.append(client);
+
+        QJsonObject entry = client.toJson();
+        entry[journalKey::operation] = journalKey::add;
+        entries.append(entry);
     }
 
-    error = serverController->uploadTextFileToContainer(container, credentials, clientsTableString, clientsTableFile);
+    if (!newClients.isEmpty()) {
+        beginInsertRows(QModelIndex(), rowCount(), rowCount() + newClients.size() - 1);
+        for (const auto &client : newClients) {
+            m_clients.insert(client);
+        }
+        endInsertRows();
+    }
+
+    if (entries.isEmpty()) {
+        return ErrorCode::NoError;
+    }
+
+    error = appendClientsJournal(container, credentials, serverController, entries);
     if (error != ErrorCode::NoError) {
         logger.error() << "Failed to upload the clientsTable file to the server";
     }
@@ -501,27 +854,18 @@ ErrorCode ClientManagementModel::renameClient(const int row, const QString &clie
                                               const ServerCredentials &credentials,
                                               const QSharedPointer<ServerController> &serverController, bool addTimeStamp)
 {
-    auto client = m_clientsTable.at(row).toObject();
-    auto userData = client[configKey::userData].toObject();
-    userData[configKey::clientName] = clientName;
+    ClientInfo client = m_clients.at(row);
+    client.clientName = clientName;
     if (addTimeStamp) {
-        userData[configKey::creationDate] = QDateTime::currentDateTime().toString();
+        client.creationDate = QDateTime::currentDateTime().toString();
     }
-    client[configKey::userData] = userData;
 
-    m_clientsTable.replace(row, client);
+    m_clients.replace(row, client);
     emit dataChanged(index(row, 0), index(row, 0));
 
-    const QByteArray clientsTableString = QJsonDocument(m_clientsTable).toJson();
-
-    QString clientsTableFile = QString("/opt/amnezia/%1/clientsTable");
-    if (container == DockerContainer::OpenVpn || container == DockerContainer::ShadowSocks || container == DockerContainer::Cloak) {
-        clientsTableFile = clientsTableFile.arg(ContainerProps::containerTypeToString(DockerContainer::OpenVpn));
-    } else {
-        clientsTableFile = clientsTableFile.arg(ContainerProps::containerTypeToString(container));
-    }
-
-    ErrorCode error = serverController->uploadTextFileToContainer(container, credentials, clientsTableString, clientsTableFile);
+    QJsonObject entry = client.toJson();
+    entry[journalKey::operation] = journalKey::update;
+    ErrorCode error = appendClientsJournal(container, credentials, serverController, entry);
     if (error != ErrorCode::NoError) {
         logger.error() << "Failed to upload the clientsTable file to the server";
     }
@@ -533,8 +877,7 @@ ErrorCode ClientManagementModel::revokeClient(const int row, const DockerContain
                                               const int serverIndex, const QSharedPointer<ServerController> &serverController)
 {
     ErrorCode errorCode = ErrorCode::NoError;
-    auto client = m_clientsTable.at(row).toObject();
-    QString clientId = client.value(configKey::clientId).toString();
+    const QString clientId = m_clients.at(row).clientId;
 
     switch(container)
     {
@@ -655,16 +998,8 @@ ErrorCode ClientManagementModel::revokeClient(const QJsonObject &containerConfig
         clientId = protocolConfig.value(config_key::clientId).toString();
     }
 
-    int row;
-    bool clientExists = false;
-    for (row = 0; row < rowCount(); row++) {
-        auto client = m_clientsTable.at(row).toObject();
-        if (clientId == client.value(configKey::clientId).toString()) {
-            clientExists = true;
-            break;
-        }
-    }
-    if (!clientExists) {
+    const int row = m_clients.indexOf(clientId);
+    if (row < 0) {
         return errorCode;
     }
 
@@ -696,8 +1031,7 @@ ErrorCode ClientManagementModel::revokeClient(const QJsonObject &containerConfig
 ErrorCode ClientManagementModel::revokeOpenVpn(const int row, const DockerContainer container, const ServerCredentials &credentials,
                                                const int serverIndex, const QSharedPointer<ServerController> &serverController)
 {
-    auto client = m_clientsTable.at(row).toObject();
-    QString clientId = client.value(configKey::clientId).toString();
+    const QString clientId = m_clients.at(row).clientId;
 
     const QString getOpenVpnCertData = QString("sudo docker exec -i $CONTAINER_NAME bash -c '"
                                                "cd /opt/amnezia/openvpn ;\\"
@@ -715,14 +1049,11 @@ ErrorCode ClientManagementModel::revokeOpenVpn(const int row, const DockerContai
     }
 
     beginRemoveRows(QModelIndex(), row, row);
-    m_clientsTable.removeAt(row);
+    m_clients.removeAt(row);
     endRemoveRows();
 
-    const QByteArray clientsTableString = QJsonDocument(m_clientsTable).toJson();
-
-    QString clientsTableFile = QString("/opt/amnezia/%1/clientsTable");
-    clientsTableFile = clientsTableFile.arg(ContainerProps::containerTypeToString(DockerContainer::OpenVpn));
-    error = serverController->uploadTextFileToContainer(container, credentials, clientsTableString, clientsTableFile);
+    error = appendClientsJournal(container, credentials, serverController,
+                                 QJsonObject { { journalKey::operation, journalKey::remove }, { configKey::clientId, clientId } });
     if (error != ErrorCode::NoError) {
         logger.error() << "Failed to upload the clientsTable file to the server";
         return error;
@@ -738,57 +1069,48 @@ ErrorCode ClientManagementModel::revokeWireGuard(const int row, const DockerCont
 
     const QString wireGuardConfigFile =
             QString("/opt/amnezia/%1/wg0.conf").arg(container == DockerContainer::WireGuard ? "wireguard" : "awg");
-    const QString wireguardConfigString = serverController->getTextFileFromContainer(container, credentials, wireGuardConfigFile, error);
-    if (error != ErrorCode::NoError) {
-        logger.error() << "Failed to get the wg conf file from the server";
-        return error;
-    }
-
-    auto client = m_clientsTable.at(row).toObject();
-    QString clientId = client.value(configKey::clientId).toString();
-
-    auto configSections = wireguardConfigString.split("[", Qt::SkipEmptyParts);
-    for (auto &section : configSections) {
-        if (section.contains(clientId)) {
-            configSections.removeOne(section);
-            break;
-        }
-    }
-    QString newWireGuardConfig = configSections.join("[");
-    newWireGuardConfig.insert(0, "[");
-    error = serverController->uploadTextFileToContainer(container, credentials, newWireGuardConfig, wireGuardConfigFile);
+    const QString ipPoolPath = container == DockerContainer::WireGuard ? amnezia::protocols::wireguard::ipPoolPath
+                                                                        : amnezia::protocols::awg::ipPoolPath;
+
+    const QString clientId = m_clients.at(row).clientId;
+
+    // removing the peer, giving its address back to the ip pool and applying the config happen under the lock
+    // WireguardConfigurator::appendPeers() takes, so a client added meanwhile is neither lost nor given this address
+    const QString script = QString("exec 9>%1.lock\n"
+                                   "flock -x 9\n"
+                                   "ip=$(awk -v key='%3' -v out=%2.tmp '\n"
+                                   "  function flush() {\n"
+                                   "    if (section != \"\" && index(section, key) == 0) { printf \"%s\", section > out }\n"
+                                   "    else if (match(section, /AllowedIPs *= *[0-9.]+/)) { ip = substr(section, RSTART, RLENGTH); sub(/.*= */, \"\", ip) }\n"
+                                   "    section = \"\"\n"
+                                   "  }\n"
+                                   "  /^\\[/ { flush() }\n"
+                                   "  { section = section $0 \"\\n\" }\n"
+                                   "  END { flush(); printf \"\" > out; print ip }' %2)\n"
+                                   "cat %2.tmp > %2 && rm -f %2.tmp\n"
+                                   "if [ -n \"$ip\" ]; then\n"
+                                   "  grep -vxF \"$ip\" %1 > %1.tmp\n"
+                                   "  cat %1.tmp > %1 && rm -f %1.tmp\n"
+                                   "fi\n"
+                                   "wg syncconf wg0 <(wg-quick strip %2)\n")
+                                   .arg(ipPoolPath, wireGuardConfigFile, clientId);
+    error = serverController->runContainerScript(credentials, container, script);
     if (error != ErrorCode::NoError) {
-        logger.error() << "Failed to upload the wg conf file to the server";
+        logger.error() << "Failed to remove the peer from the wg conf file on the server";
         return error;
     }
 
     beginRemoveRows(QModelIndex(), row, row);
-    m_clientsTable.removeAt(row);
+    m_clients.removeAt(row);
     endRemoveRows();
 
-    const QByteArray clientsTableString = QJsonDocument(m_clientsTable).toJson();
-
-    QString clientsTableFile = QString("/opt/amnezia/%1/clientsTable");
-    if (container == DockerContainer::OpenVpn || container == DockerContainer::ShadowSocks || container == DockerContainer::Cloak) {
-        clientsTableFile = clientsTableFile.arg(ContainerProps::containerTypeToString(DockerContainer::OpenVpn));
-    } else {
-        clientsTableFile = clientsTableFile.arg(ContainerProps::containerTypeToString(container));
-    }
-    error = serverController->uploadTextFileToContainer(container, credentials, clientsTableString, clientsTableFile);
+    error = appendClientsJournal(container, credentials, serverController,
+                                 QJsonObject { { journalKey::operation, journalKey::remove }, { configKey::clientId, clientId } });
     if (error != ErrorCode::NoError) {
         logger.error() << "Failed to upload the clientsTable file to the server";
         return error;
     }
 
-    const QString script = "sudo docker exec -i $CONTAINER_NAME bash -c 'wg syncconf wg0 <(wg-quick strip %1)'";
-    error = serverController->runScript(
-            credentials,
-            serverController->replaceVars(script.arg(wireGuardConfigFile), serverController->genVarsForScript(credentials, container)));
-    if (error != ErrorCode::NoError) {
-        logger.error() << "Failed to execute the command 'wg syncconf' on the server";
-        return error;
-    }
-
     return ErrorCode::NoError;
 }
 
@@ -814,8 +1136,7 @@ ErrorCode ClientManagementModel::revokeXray(const int row,
     }
 
     // Get client ID to remove
-    auto client = m_clientsTable.at(row).toObject();
-    QString clientId = client.value(configKey::clientId).toString();
+    const QString clientId = m_clients.at(row).clientId;
 
     // Remove client from server config
     QJsonObject configObj = serverConfig.object();
@@ -824,6 +1145,9 @@ ErrorCode ClientManagementModel::revokeXray(const int row,
         return ErrorCode::InternalError;
     }
 
+    // Servers installed before the runtime api was used need one restart to start serving it
+    const bool isRestartRequired = XrayConfigurator::enableRuntimeApi(configObj);
+
     QJsonArray inbounds = configObj["inbounds"].toArray();
     if (inbounds.isEmpty()) {
         logger.error() << "Empty inbounds array in xray config";
@@ -848,9 +1172,11 @@ ErrorCode ClientManagementModel::revokeXray(const int row,
         return ErrorCode::InternalError;
     }
 
+    QString clientEmail = clientId;
     for (int i = 0; i < clients.size(); ++i) {
         QJsonObject clientObj = clients[i].toObject();
         if (clientObj.contains("id") && clientObj["id"].toString() == clientId) {
+            clientEmail = clientObj["email"].toString(clientId);
             clients.removeAt(i);
             break;
         }
@@ -876,19 +1202,30 @@ ErrorCode ClientManagementModel::revokeXray(const int row,
 
     // Remove from local table
     beginRemoveRows(QModelIndex(), row, row);
-    m_clientsTable.removeAt(row);
+    m_clients.removeAt(row);
     endRemoveRows();
 
     // Update clients table file on server
-    const QByteArray clientsTableString = QJsonDocument(m_clientsTable).toJson();
-    QString clientsTableFile = QString("/opt/amnezia/%1/clientsTable")
-        .arg(ContainerProps::containerTypeToString(container));
-
-    error = serverController->uploadTextFileToContainer(container, credentials, clientsTableString, clientsTableFile);
+    error = appendClientsJournal(container, credentials, serverController,
+                                 QJsonObject { { journalKey::operation, journalKey::remove }, { configKey::clientId, clientId } });
     if (error != ErrorCode::NoError) {
         logger.error() << "Failed to upload the clientsTable file";
     }
 
+    if (!isRestartRequired) {
+        bool isApplied = false;
+        error = XrayConfigurator::removeUserAtRuntime(serverController, credentials, container, inbound, clientEmail, isApplied);
+        if (error != ErrorCode::NoError) {
+            logger.error() << "Failed to remove the client through the xray api";
+            return error;
+        }
+        if (isApplied) {
+            return error;
+        }
+        // always the case for an xray binary without rmu, i.e. a container built before the image moved to v24.12.31
+        logger.warning() << "The xray api is not available, restarting the container";
+    }
+
     // Restart container
     QString restartScript = QString("sudo docker restart $CONTAINER_NAME");
     error = serverController->runScript(
@@ -912,5 +1249,8 @@ QHash<int, QByteArray> ClientManagementModel::roleNames() const
     roles[DataReceivedRole] = "dataReceived";
     roles[DataSentRole] = "dataSent";
     roles[AllowedIpsRole] = "allowedIps";
+    roles[LatestHandshakeTimestampRole] = "latestHandshakeTimestamp";
+    roles[DataReceivedBytesRole] = "dataReceivedBytes";
+    roles[DataSentBytesRole] = "dataSentBytes";
     return roles;
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <QAbstractListModel>
 #include <QJsonArray>
 
+#include "clientsRegistry.h"
 #include "core/controllers/serverController.h"
 #include "settings.h"
 
@@ -18,18 +19,25 @@ public:
         LatestHandshakeRole,
         DataReceivedRole,
         DataSentRole,
-        AllowedIpsRole
+        AllowedIpsRole,
+        LatestHandshakeTimestampRole,
+        DataReceivedBytesRole,
+        DataSentBytesRole
     };
 
+    // peer statistics from `wg show all dump`, transfer counters are from the client's point of view
     struct WgShowData
     {
         QString clientId;
-        QString latestHandshake;
-        QString dataReceived;
-        QString dataSent;
+        // seconds since epoch, 0 if the peer has never completed a handshake
+        qint64 latestHandshake = 0;
+        quint64 dataReceived = 0;
+        quint64 dataSent = 0;
         QString allowedIps;
     };
 
+    static void parseWgShowDump(const QByteArray &dump, std::vector<WgShowData> &data);
+
     ClientManagementModel(std::shared_ptr<Settings> settings, QObject *parent = nullptr);
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
@@ -44,6 +52,9 @@ public slots:
                            const ServerCredentials &credentials, const QSharedPointer<ServerController> &serverController);
     ErrorCode appendClient(const QString &clientId, const QString &clientName, const DockerContainer container,
                            const ServerCredentials &credentials, const QSharedPointer<ServerController> &serverController);
+    // clients are pairs of client id and client name, the clients table is updated with a single upload
+    ErrorCode appendClients(const QList<QPair<QString, QString>> &clients, const DockerContainer container,
+                            const ServerCredentials &credentials, const QSharedPointer<ServerController> &serverController);
     ErrorCode renameClient(const int row, const QString &userName, const DockerContainer container, const ServerCredentials &credentials,
                            const QSharedPointer<ServerController> &serverController, bool addTimeStamp = false);
     ErrorCode revokeClient(const int index, const DockerContainer container, const ServerCredentials &credentials, const int serverIndex,
@@ -58,7 +69,22 @@ signals:
     void adminConfigRevoked(const DockerContainer container);
 
 private:
-    bool isClientExists(const QString &clientId);
+    bool isClientExists(const QString &clientId) const;
+    void appendMigratedClient(const QString &clientId, const QString &clientName);
+
+    QString clientsTableFilePath(const DockerContainer container) const;
+    ErrorCode readClientsTable(const DockerContainer container, const ServerCredentials &credentials,
+                               const QSharedPointer<ServerController> &serverController, ClientsRegistry &clientsTable);
+    ErrorCode writeClientsTable(const DockerContainer container, const ServerCredentials &credentials,
+                                const QSharedPointer<ServerController> &serverController, const ClientsRegistry &clientsTable);
+    ErrorCode appendClientsJournal(const DockerContainer container, const ServerCredentials &credentials,
+                                   const QSharedPointer<ServerController> &serverController, const QJsonObject &entry);
+    ErrorCode appendClientsJournal(const DockerContainer container, const ServerCredentials &credentials,
+                                   const QSharedPointer<ServerController> &serverController, const QList<QJsonObject> &entries);
+    // entriesCount counts every entry, staleEntries the ones written against another snapshot and merged into it
+    static bool applyClientsJournal(const QByteArray &journal, const QByteArray &tableHash, ClientsRegistry &clientsTable,
+                                    int &entriesCount, int &staleEntries);
+    static void applyClientsJournalEntry(const QJsonObject &entry, ClientsRegistry &clientsTable, const bool isStale = false);
 
     void migration(const QByteArray &clientsTableString);
 
@@ -79,7 +105,7 @@ private:
     ErrorCode wgShow(const DockerContainer container, const ServerCredentials &credentials,
                      const QSharedPointer<ServerController> &serverController, std::vector<WgShowData> &data);
 
-    QJsonArray m_clientsTable;
+    ClientsRegistry m_clients;
 
     std::shared_ptr<Settings> m_settings;
 };
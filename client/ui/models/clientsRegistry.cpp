@@ -0,0 +1,188 @@
+#include "clientsRegistry.h"
+
+namespace
+{
+    namespace configKey
+    {
+        constexpr char clientId[] = "clientId";
+        constexpr char clientName[] = "clientName";
+        constexpr char userData[] = "userData";
+        constexpr char creationDate[] = "creationDate";
+        constexpr char latestHandshake[] = "latestHandshake";
+        constexpr char dataReceived[] = "dataReceived";
+        constexpr char dataSent[] = "dataSent";
+        constexpr char allowedIps[] = "allowedIps";
+    }
+}
+
+ClientInfo ClientInfo::fromJson(const QJsonObject &client)
+{
+    ClientInfo info;
+    info.clientId = client.value(configKey::clientId).toString();
+
+    QJsonObject userData = client.value(configKey::userData).toObject();
+    info.clientName = userData.take(configKey::clientName).toString();
+    info.creationDate = userData.take(configKey::creationDate).toString();
+    info.latestHandshake = userData.take(configKey::latestHandshake).toString();
+    info.dataReceived = userData.take(configKey::dataReceived).toString();
+    info.dataSent = userData.take(configKey::dataSent).toString();
+    info.allowedIps = userData.take(configKey::allowedIps).toString();
+    info.extraUserData = userData;
+
+    return info;
+}
+
+QJsonObject ClientInfo::toJson() const
+{
+    QJsonObject client;
+    client[configKey::clientId] = clientId;
+    client[configKey::userData] = userDataToJson();
+    return client;
+}
+
+QJsonObject ClientInfo::userDataToJson() const
+{
+    QJsonObject userData = extraUserData;
+    userData[configKey::clientName] = clientName;
+
+    const auto insertIfSet = [&userData](const char *key, const QString &value) {
+        if (!value.isEmpty()) {
+            userData[key] = value;
+        }
+    };
+    insertIfSet(configKey::creationDate, creationDate);
+    insertIfSet(configKey::latestHandshake, latestHandshake);
+    insertIfSet(configKey::dataReceived, dataReceived);
+    insertIfSet(configKey::dataSent, dataSent);
+    insertIfSet(configKey::allowedIps, allowedIps);
+
+    return userData;
+}
+
+ClientsRegistry ClientsRegistry::fromJson(const QJsonArray &clientsTable)
+{
+    ClientsRegistry registry;
+    registry.m_clients.reserve(clientsTable.size());
+    for (const QJsonValue &client : clientsTable) {
+        if (client.isObject()) {
+            registry.insert(ClientInfo::fromJson(client.toObject()));
+        }
+    }
+    return registry;
+}
+
+QJsonArray ClientsRegistry::toJson() const
+{
+    QJsonArray clientsTable;
+    for (const ClientInfo &client : m_clients) {
+        clientsTable.push_back(client.toJson());
+    }
+    return clientsTable;
+}
+
+int ClientsRegistry::size() const
+{
+    return static_cast<int>(m_clients.size());
+}
+
+bool ClientsRegistry::isEmpty() const
+{
+    return m_clients.isEmpty();
+}
+
+const ClientInfo &ClientsRegistry::at(int row) const
+{
+    return m_clients.at(row);
+}
+
+int ClientsRegistry::indexOf(const QString &clientId) const
+{
+    return m_clientIdIndex.value(clientId, -1);
+}
+
+int ClientsRegistry::indexOfAllowedIp(const QString &allowedIp) const
+{
+    return m_allowedIpIndex.value(allowedIp, -1);
+}
+
+bool ClientsRegistry::contains(const QString &clientId) const
+{
+    return m_clientIdIndex.contains(clientId);
+}
+
+int ClientsRegistry::insert(const ClientInfo &client)
+{
+    const int row = indexOf(client.clientId);
+    if (row >= 0) {
+        replace(row, client);
+        return row;
+    }
+
+    m_clients.append(client);
+    addToIndexes(size() - 1);
+    return size() - 1;
+}
+
+void ClientsRegistry::replace(int row, const ClientInfo &client)
+{
+    removeFromIndexes(row);
+    m_clients[row] = client;
+    addToIndexes(row);
+}
+
+void ClientsRegistry::removeAt(int row)
+{
+    m_clients.removeAt(row);
+
+    // rows after the removed one shift by one
+    rebuildIndexes();
+}
+
+void ClientsRegistry::clear()
+{
+    m_clients.clear();
+    m_clientIdIndex.clear();
+    m_allowedIpIndex.clear();
+}
+
+void ClientsRegistry::addToIndexes(int row)
+{
+    const ClientInfo &client = m_clients.at(row);
+    m_clientIdIndex.insert(client.clientId, row);
+    for (const QString &allowedIp : splitAllowedIps(client.allowedIps)) {
+        m_allowedIpIndex.insert(allowedIp, row);
+    }
+}
+
+void ClientsRegistry::removeFromIndexes(int row)
+{
+    const ClientInfo &client = m_clients.at(row);
+    m_clientIdIndex.remove(client.clientId);
+    for (const QString &allowedIp : splitAllowedIps(client.allowedIps)) {
+        if (m_allowedIpIndex.value(allowedIp, -1) == row) {
+            m_allowedIpIndex.remove(allowedIp);
+        }
+    }
+}
+
+void ClientsRegistry::rebuildIndexes()
+{
+    m_clientIdIndex.clear();
+    m_allowedIpIndex.clear();
+    m_clientIdIndex.reserve(m_clients.size());
+    for (int row = 0; row < size(); row++) {
+        addToIndexes(row);
+    }
+}
+
+QStringList ClientsRegistry::splitAllowedIps(const QString &allowedIps)
+{
+    QStringList result;
+    for (const QString &allowedIp : allowedIps.split(',', Qt::SkipEmptyParts)) {
+        const QString trimmed = allowedIp.trimmed();
+        if (!trimmed.isEmpty() && trimmed != "(none)") {
+            result.append(trimmed);
+        }
+    }
+    return result;
+}
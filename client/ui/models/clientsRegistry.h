@@ -0,0 +1,68 @@
+#ifndef CLIENTSREGISTRY_H
+#define CLIENTSREGISTRY_H
+
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct ClientInfo
+{
+    // for WireGuard/AWG the client id is the peer public key
+    QString clientId;
+    QString clientName;
+    QString creationDate;
+    QString latestHandshake;
+    QString dataReceived;
+    QString dataSent;
+    QString allowedIps;
+
+    // raw peer statistics behind the strings above, not stored in the clients table
+    qint64 latestHandshakeTimestamp = 0;
+    quint64 dataReceivedBytes = 0;
+    quint64 dataSentBytes = 0;
+
+    // userData fields unknown to this version, kept so they survive a rewrite of the clients table
+    QJsonObject extraUserData;
+
+    static ClientInfo fromJson(const QJsonObject &client);
+    QJsonObject toJson() const;
+    QJsonObject userDataToJson() const;
+};
+
+// In-memory clients table with hash indexes by client id (public key for WireGuard/AWG) and by allowed ip
+class ClientsRegistry
+{
+public:
+    static ClientsRegistry fromJson(const QJsonArray &clientsTable);
+    QJsonArray toJson() const;
+
+    int size() const;
+    bool isEmpty() const;
+    const ClientInfo &at(int row) const;
+
+    int indexOf(const QString &clientId) const;
+    int indexOfAllowedIp(const QString &allowedIp) const;
+    bool contains(const QString &clientId) const;
+
+    // appends a new client or replaces the existing one with the same id, returns its row
+    int insert(const ClientInfo &client);
+    void replace(int row, const ClientInfo &client);
+    void removeAt(int row);
+    void clear();
+
+private:
+    void addToIndexes(int row);
+    void removeFromIndexes(int row);
+    void rebuildIndexes();
+
+    static QStringList splitAllowedIps(const QString &allowedIps);
+
+    QVector<ClientInfo> m_clients;
+    QHash<QString, int> m_clientIdIndex;
+    QHash<QString, int> m_allowedIpIndex;
+};
+
+#endif // CLIENTSREGISTRY_H
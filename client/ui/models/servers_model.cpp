@@ -1,5 +1,7 @@
 #include "servers_model.h"
 
+#include <QtConcurrent>
+
 #include "core/controllers/serverController.h"
 #include "core/enums/apiEnums.h"
 #include "core/networkUtilities.h"
@@ -31,10 +33,11 @@ ServersModel::ServersModel(std::shared_ptr<Settings> settings, QObject *parent)
     m_isAmneziaDnsEnabled = m_settings->useAmneziaDns();
 
     connect(this, &ServersModel::defaultServerIndexChanged, this, &ServersModel::defaultServerNameChanged);
+    connect(&m_serversLoadingWatcher, &QFutureWatcher<void>::finished, this, &ServersModel::serversLoaded);
 
     connect(this, &ServersModel::defaultServerIndexChanged, this, [this](const int serverIndex) {
         auto defaultContainer =
-                ContainerProps::containerFromString(m_servers.at(serverIndex).toObject().value(config_key::defaultContainer).toString());
+                ContainerProps::containerFromString(loadedServer(serverIndex).value(config_key::defaultContainer).toString());
         emit ServersModel::defaultServerDefaultContainerChanged(defaultContainer);
         emit ServersModel::defaultServerNameChanged();
         updateDefaultServerContainersModel();
@@ -44,6 +47,12 @@ ServersModel::ServersModel(std::shared_ptr<Settings> settings, QObject *parent)
     connect(this, &ServersModel::dataChanged, this, &ServersModel::processedServerChanged);
 }
 
+ServersModel::~ServersModel()
+{
+    // the worker reports decrypted servers to this model
+    m_serversLoadingWatcher.waitForFinished();
+}
+
 int ServersModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
@@ -56,7 +65,7 @@ bool ServersModel::setData(const QModelIndex &index, const QVariant &value, int
         return false;
     }
 
-    QJsonObject server = m_servers.at(index.row()).toObject();
+    QJsonObject server = loadedServer(index.row());
     const auto configVersion = server.value(config_key::configVersion).toInt();
 
     switch (role) {
@@ -68,6 +77,7 @@ bool ServersModel::setData(const QModelIndex &index, const QVariant &value, int
         }
         m_settings->editServer(index.row(), server);
         m_servers.replace(index.row(), server);
+        m_isServerLoaded[index.row()] = true;
         if (index.row() == m_defaultServerIndex) {
             emit defaultServerNameChanged();
         }
@@ -165,13 +175,61 @@ QVariant ServersModel::data(const int index, int role) const
 }
 
 void ServersModel::resetModel()
+{
+    // every record of a restored backup would be decrypted here, the worker does it instead
+    resetModelAsync();
+    emit defaultServerIndexChanged(m_defaultServerIndex);
+}
+
+void ServersModel::resetModelAsync()
 {
     beginResetModel();
-    m_servers = m_settings->serversArray();
+    // placeholders until the worker has decrypted the servers, see loadedServer()
+    m_servers = QJsonArray();
+    for (int i = 0; i < m_settings->serversCount(); i++) {
+        m_servers.append(QJsonObject());
+    }
+    m_isServerLoaded.fill(false, m_servers.size());
     m_defaultServerIndex = m_settings->defaultServerIndex();
     m_processedServerIndex = m_defaultServerIndex;
     endResetModel();
-    emit defaultServerIndexChanged(m_defaultServerIndex);
+
+    auto settings = m_settings;
+    m_serversLoadingWatcher.setFuture(QtConcurrent::run([this, settings]() {
+        settings->preloadServers([this](int serverIndex) {
+            QMetaObject::invokeMethod(this, "onServerLoaded", Qt::QueuedConnection, Q_ARG(int, serverIndex));
+        });
+    }));
+}
+
+void ServersModel::onServerLoaded(const int serverIndex)
+{
+    if (serverIndex >= m_servers.size() || m_isServerLoaded.at(serverIndex)) {
+        return;
+    }
+
+    m_servers.replace(serverIndex, m_settings->server(serverIndex));
+    m_isServerLoaded[serverIndex] = true;
+    emit dataChanged(index(serverIndex, 0), index(serverIndex, 0));
+
+    if (serverIndex == m_defaultServerIndex) {
+        emit defaultServerIndexChanged(m_defaultServerIndex);
+    }
+}
+
+QJsonObject ServersModel::loadedServer(const int serverIndex)
+{
+    if (serverIndex < 0 || serverIndex >= m_servers.size()) {
+        return QJsonObject();
+    }
+
+    // edits and connections must never start from a placeholder, Settings::server() decrypts the record right away
+    if (!m_isServerLoaded.at(serverIndex)) {
+        m_servers.replace(serverIndex, m_settings->server(serverIndex));
+        m_isServerLoaded[serverIndex] = true;
+        emit dataChanged(index(serverIndex, 0), index(serverIndex, 0));
+    }
+    return m_servers.at(serverIndex).toObject();
 }
 
 void ServersModel::setDefaultServerIndex(const int index)
@@ -216,7 +274,7 @@ QString ServersModel::getServerDescription(const QJsonObject &server, const int
 
 const QString ServersModel::getDefaultServerDescriptionCollapsed()
 {
-    const QJsonObject server = m_servers.at(m_defaultServerIndex).toObject();
+    const QJsonObject server = loadedServer(m_defaultServerIndex);
     const auto configVersion = server.value(config_key::configVersion).toInt();
     auto description = getServerDescription(server, m_defaultServerIndex);
     if (configVersion) {
@@ -230,7 +288,7 @@ const QString ServersModel::getDefaultServerDescriptionCollapsed()
 
 const QString ServersModel::getDefaultServerDescriptionExpanded()
 {
-    const QJsonObject server = m_servers.at(m_defaultServerIndex).toObject();
+    const QJsonObject server = loadedServer(m_defaultServerIndex);
     const auto configVersion = server.value(config_key::configVersion).toInt();
     auto description = getServerDescription(server, m_defaultServerIndex);
     if (configVersion) {
@@ -275,11 +333,13 @@ int ServersModel::getProcessedServerIndex()
 
 const ServerCredentials ServersModel::getProcessedServerCredentials()
 {
+    loadedServer(m_processedServerIndex);
     return serverCredentials(m_processedServerIndex);
 }
 
 const ServerCredentials ServersModel::getServerCredentials(const int index)
 {
+    loadedServer(index);
     return serverCredentials(index);
 }
 
@@ -308,14 +368,17 @@ void ServersModel::addServer(const QJsonObject &server)
 {
     beginResetModel();
     m_settings->addServer(server);
-    m_servers = m_settings->serversArray();
+    // the other rows stay as they are, placeholders included
+    m_servers.append(m_settings->server(m_settings->serversCount() - 1));
+    m_isServerLoaded.append(true);
     endResetModel();
 }
 
 void ServersModel::editServer(const QJsonObject &server, const int serverIndex)
 {
     m_settings->editServer(serverIndex, server);
-    m_servers.replace(serverIndex, m_settings->serversArray().at(serverIndex));
+    m_servers.replace(serverIndex, m_settings->server(serverIndex));
+    m_isServerLoaded[serverIndex] = true;
     emit dataChanged(index(serverIndex, 0), index(serverIndex, 0));
 
     if (serverIndex == m_defaultServerIndex) {
@@ -333,7 +396,8 @@ void ServersModel::removeServer()
 {
     beginResetModel();
     m_settings->removeServer(m_processedServerIndex);
-    m_servers = m_settings->serversArray();
+    m_servers.removeAt(m_processedServerIndex);
+    m_isServerLoaded.removeAt(m_processedServerIndex);
 
     if (m_settings->defaultServerIndex() == m_processedServerIndex) {
         setDefaultServerIndex(0);
@@ -382,6 +446,8 @@ QHash<int, QByteArray> ServersModel::roleNames() const
     return roles;
 }
 
+// backs the data() roles like isAmneziaDnsContainerInstalled() and serverHasInstalledContainers(), a placeholder row
+// is refreshed by onServerLoaded(), everything else calls loadedServer() first
 ServerCredentials ServersModel::serverCredentials(int index) const
 {
     const QJsonObject &s = m_servers.at(index).toObject();
@@ -397,24 +463,24 @@ ServerCredentials ServersModel::serverCredentials(int index) const
 
 void ServersModel::updateContainersModel()
 {
-    auto containers = m_servers.at(m_processedServerIndex).toObject().value(config_key::containers).toArray();
+    auto containers = loadedServer(m_processedServerIndex).value(config_key::containers).toArray();
     emit containersUpdated(containers);
 }
 
 void ServersModel::updateDefaultServerContainersModel()
 {
-    auto containers = m_servers.at(m_defaultServerIndex).toObject().value(config_key::containers).toArray();
+    auto containers = loadedServer(m_defaultServerIndex).value(config_key::containers).toArray();
     emit defaultServerContainersUpdated(containers);
 }
 
 QJsonObject ServersModel::getServerConfig(const int serverIndex)
 {
-    return m_servers.at(serverIndex).toObject();
+    return loadedServer(serverIndex);
 }
 
 void ServersModel::reloadDefaultServerContainerConfig()
 {
-    QJsonObject server = m_servers.at(m_defaultServerIndex).toObject();
+    QJsonObject server = loadedServer(m_defaultServerIndex);
     auto container = ContainerProps::containerFromString(server.value(config_key::defaultContainer).toString());
 
     auto containers = server.value(config_key::containers).toArray();
@@ -435,7 +501,7 @@ void ServersModel::reloadDefaultServerContainerConfig()
 void ServersModel::updateContainerConfig(const int containerIndex, const QJsonObject config)
 {
     auto container = static_cast<DockerContainer>(containerIndex);
-    QJsonObject server = m_servers.at(m_processedServerIndex).toObject();
+    QJsonObject server = loadedServer(m_processedServerIndex);
 
     auto containers = server.value(config_key::containers).toArray();
     for (auto i = 0; i < containers.size(); i++) {
@@ -447,13 +513,16 @@ void ServersModel::updateContainerConfig(const int containerIndex, const QJsonOb
     }
 
     server.insert(config_key::containers, containers);
+
+    m_settings->beginTransaction();
     editServer(server, m_processedServerIndex);
+    m_settings->commit();
 }
 
 void ServersModel::addContainerConfig(const int containerIndex, const QJsonObject config)
 {
     auto container = static_cast<DockerContainer>(containerIndex);
-    QJsonObject server = m_servers.at(m_processedServerIndex).toObject();
+    QJsonObject server = loadedServer(m_processedServerIndex);
 
     auto containers = server.value(config_key::containers).toArray();
     containers.push_back(config);
@@ -472,9 +541,12 @@ void ServersModel::addContainerConfig(const int containerIndex, const QJsonObjec
 void ServersModel::setDefaultContainer(const int serverIndex, const int containerIndex)
 {
     auto container = static_cast<DockerContainer>(containerIndex);
-    QJsonObject s = m_servers.at(serverIndex).toObject();
+    QJsonObject s = loadedServer(serverIndex);
     s.insert(config_key::defaultContainer, ContainerProps::containerToString(container));
+
+    m_settings->beginTransaction();
     editServer(s, serverIndex); // check
+    m_settings->commit();
 }
 
 const QString ServersModel::getDefaultServerDefaultContainerName()
@@ -489,7 +561,7 @@ ErrorCode ServersModel::removeAllContainers(const QSharedPointer<ServerControlle
     ErrorCode errorCode = serverController->removeAllContainers(m_settings->serverCredentials(m_processedServerIndex));
 
     if (errorCode == ErrorCode::NoError) {
-        QJsonObject s = m_servers.at(m_processedServerIndex).toObject();
+        QJsonObject s = loadedServer(m_processedServerIndex);
         s.insert(config_key::containers, {});
         s.insert(config_key::defaultContainer, ContainerProps::containerToString(DockerContainer::None));
 
@@ -516,7 +588,7 @@ ErrorCode ServersModel::removeContainer(const QSharedPointer<ServerController> &
     ErrorCode errorCode = serverController->removeContainer(credentials, dockerContainer);
 
     if (errorCode == ErrorCode::NoError) {
-        QJsonObject server = m_servers.at(m_processedServerIndex).toObject();
+        QJsonObject server = loadedServer(m_processedServerIndex);
 
         auto containers = server.value(config_key::containers).toArray();
         for (auto it = containers.begin(); it != containers.end(); it++) {
@@ -546,8 +618,13 @@ ErrorCode ServersModel::removeContainer(const QSharedPointer<ServerController> &
 
 void ServersModel::clearCachedProfile(const DockerContainer container)
 {
+    // a single write of the record, clearLastConnectionConfig() edits every protocol of the container
+    m_settings->beginTransaction();
     m_settings->clearLastConnectionConfig(m_processedServerIndex, container);
+    m_settings->commit();
+
     m_servers.replace(m_processedServerIndex, m_settings->server(m_processedServerIndex));
+    m_isServerLoaded[m_processedServerIndex] = true;
     if (m_processedServerIndex == m_defaultServerIndex) {
         updateDefaultServerContainersModel();
     }
@@ -570,7 +647,7 @@ QPair<QString, QString> ServersModel::getDnsPair(int serverIndex)
 {
     QPair<QString, QString> dns;
 
-    const QJsonObject &server = m_servers.at(m_processedServerIndex).toObject();
+    const QJsonObject server = loadedServer(m_processedServerIndex);
     const auto containers = server.value(config_key::containers).toArray();
     bool isDnsContainerInstalled = false;
     for (const QJsonValue &container : containers) {
@@ -599,7 +676,7 @@ QPair<QString, QString> ServersModel::getDnsPair(int serverIndex)
 QStringList ServersModel::getAllInstalledServicesName(const int serverIndex)
 {
     QStringList servicesName;
-    QJsonObject server = m_servers.at(serverIndex).toObject();
+    QJsonObject server = loadedServer(serverIndex);
     const auto containers = server.value(config_key::containers).toArray();
     for (auto it = containers.begin(); it != containers.end(); it++) {
         auto container = ContainerProps::containerFromString(it->toObject().value(config_key::container).toString());
@@ -627,8 +704,8 @@ void ServersModel::toggleAmneziaDns(bool enabled)
 
 bool ServersModel::isServerFromApiAlreadyExists(const quint16 crc)
 {
-    for (const auto &server : std::as_const(m_servers)) {
-        if (static_cast<quint16>(server.toObject().value(config_key::crc).toInt()) == crc) {
+    for (int i = 0; i < m_servers.size(); i++) {
+        if (static_cast<quint16>(loadedServer(i).value(config_key::crc).toInt()) == crc) {
             return true;
         }
     }
@@ -637,8 +714,8 @@ bool ServersModel::isServerFromApiAlreadyExists(const quint16 crc)
 
 bool ServersModel::isServerFromApiAlreadyExists(const QString &userCountryCode, const QString &serviceType, const QString &serviceProtocol)
 {
-    for (const auto &server : std::as_const(m_servers)) {
-        const auto apiConfig = server.toObject().value(configKey::apiConfig).toObject();
+    for (int i = 0; i < m_servers.size(); i++) {
+        const auto apiConfig = loadedServer(i).value(configKey::apiConfig).toObject();
         if (apiConfig.value(configKey::userCountryCode).toString() == userCountryCode
             && apiConfig.value(configKey::serviceType).toString() == serviceType
             && apiConfig.value(configKey::serviceProtocol).toString() == serviceProtocol) {
@@ -702,7 +779,7 @@ bool ServersModel::setProcessedServerData(const QString &roleString, const QVari
 
 bool ServersModel::isDefaultServerDefaultContainerHasSplitTunneling()
 {
-    auto server = m_servers.at(m_defaultServerIndex).toObject();
+    auto server = loadedServer(m_defaultServerIndex);
     auto defaultContainer = ContainerProps::containerFromString(server.value(config_key::defaultContainer).toString());
 
     auto containers = server.value(config_key::containers).toArray();
@@ -735,7 +812,7 @@ bool ServersModel::isServerFromApi(const int serverIndex)
 
 bool ServersModel::isApiKeyExpired(const int serverIndex)
 {
-    auto serverConfig = m_servers.at(serverIndex).toObject();
+    auto serverConfig = loadedServer(serverIndex);
     auto apiConfig = serverConfig.value(configKey::apiConfig).toObject();
 
     auto publicKeyInfo = apiConfig.value(configKey::publicKeyInfo).toObject();
@@ -785,7 +862,7 @@ void ServersModel::removeApiConfig(const int serverIndex)
 
 const QString ServersModel::getDefaultServerImagePathCollapsed()
 {
-    const auto server = m_servers.at(m_defaultServerIndex).toObject();
+    const auto server = loadedServer(m_defaultServerIndex);
     const auto apiConfig = server.value(configKey::apiConfig).toObject();
     const auto countryCode = apiConfig.value(configKey::serverCountryCode).toString();
 
@@ -2,6 +2,7 @@
 #define SERVERSMODEL_H
 
 #include <QAbstractListModel>
+#include <QFutureWatcher>
 
 #include "core/controllers/serverController.h"
 #include "settings.h"
@@ -42,6 +43,7 @@ public:
     };
 
     ServersModel(std::shared_ptr<Settings> settings, QObject *parent = nullptr);
+    ~ServersModel();
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
 
@@ -51,6 +53,8 @@ public:
     QVariant data(const int index, int role = Qt::DisplayRole) const;
 
     void resetModel();
+    // rows are created from the servers index right away and filled in while a worker decrypts the servers
+    void resetModelAsync();
 
     Q_PROPERTY(int defaultIndex READ getDefaultServerIndex WRITE setDefaultServerIndex NOTIFY defaultServerIndexChanged)
     Q_PROPERTY(QString defaultServerName READ getDefaultServerName NOTIFY defaultServerNameChanged)
@@ -143,8 +147,15 @@ signals:
     void updateApiLanguageModel();
     void updateApiServicesModel();
 
+    void serversLoaded();
+
+private slots:
+    void onServerLoaded(const int serverIndex);
+
 private:
     ServerCredentials serverCredentials(int index) const;
+    // the decrypted server, even if the row still holds a placeholder of resetModelAsync()
+    QJsonObject loadedServer(const int serverIndex);
 
     void updateContainersModel();
     void updateDefaultServerContainersModel();
@@ -156,6 +167,8 @@ private:
     bool serverHasInstalledContainers(const int serverIndex) const;
 
     QJsonArray m_servers;
+    QVector<bool> m_isServerLoaded;
+    QFutureWatcher<void> m_serversLoadingWatcher;
 
     std::shared_ptr<Settings> m_settings;
 
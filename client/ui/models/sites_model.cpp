@@ -1,5 +1,18 @@
 #include "sites_model.h"
 
+namespace
+{
+    QString siteRoute(const QString &hostname, const QString &ip)
+    {
+        QHostAddress address;
+        int prefixLength = 0;
+        if (PrefixSet::parsePrefix(hostname, address, prefixLength)) {
+            return hostname;
+        }
+        return ip;
+    }
+}
+
 SitesModel::SitesModel(std::shared_ptr<Settings> settings, QObject *parent)
     : QAbstractListModel(parent), m_settings(settings)
 {
@@ -47,7 +60,9 @@ bool SitesModel::addSite(const QString &hostname, const QString &ip)
     }
     for (int i = 0; i < m_sites.size(); i++) {
         if (m_sites[i].first == hostname && (m_sites[i].second.isEmpty() && !ip.isEmpty())) {
+            releasePrefix(siteRoute(hostname, m_sites[i].second));
             m_sites[i].second = ip;
+            addPrefix(siteRoute(hostname, ip));
             QModelIndex index = createIndex(i, i);
             emit dataChanged(index, index);
             return true;
@@ -57,6 +72,7 @@ bool SitesModel::addSite(const QString &hostname, const QString &ip)
     }
     beginInsertRows(QModelIndex(), rowCount(), rowCount());
     m_sites.append(qMakePair(hostname, ip));
+    addPrefix(siteRoute(hostname, ip));
     endInsertRows();
     return true;
 }
@@ -76,10 +92,11 @@ void SitesModel::addSites(const QMap<QString, QString> &sites, bool replaceExist
 
 void SitesModel::removeSite(QModelIndex index)
 {
-    auto hostname = m_sites.at(index.row()).first;
+    const auto site = m_sites.at(index.row());
     beginRemoveRows(QModelIndex(), index.row(), index.row());
-    m_settings->removeVpnSite(m_currentRouteMode, hostname);
+    m_settings->removeVpnSite(m_currentRouteMode, site.first);
     m_sites.removeAt(index.row());
+    releasePrefix(siteRoute(site.first, site.second));
     endRemoveRows();
 }
 
@@ -115,6 +132,16 @@ QVector<QPair<QString, QString> > SitesModel::getCurrentSites()
     return m_sites;
 }
 
+bool SitesModel::isCovered(const QString &prefix) const
+{
+    return m_prefixes.isCovered(prefix);
+}
+
+QStringList SitesModel::coveredBy(const QString &prefix) const
+{
+    return m_prefixes.coveredBy(prefix);
+}
+
 QHash<int, QByteArray> SitesModel::roleNames() const
 {
     QHash<int, QByteArray> roles;
@@ -132,4 +159,33 @@ void SitesModel::fillSites()
         m_sites.append(qMakePair(i.key(), i.value().toString()));
         ++i;
     }
+    fillPrefixes();
+}
+
+void SitesModel::fillPrefixes()
+{
+    m_prefixes.clear();
+    m_prefixRefs.clear();
+    for (const auto &site : std::as_const(m_sites)) {
+        addPrefix(siteRoute(site.first, site.second));
+    }
+}
+
+void SitesModel::addPrefix(const QString &route)
+{
+    const QString prefix = PrefixSet::normalized(route);
+    if (!prefix.isEmpty() && m_prefixRefs[prefix]++ == 0) {
+        m_prefixes.insert(prefix);
+    }
+}
+
+void SitesModel::releasePrefix(const QString &route)
+{
+    const QString prefix = PrefixSet::normalized(route);
+    auto it = m_prefixRefs.find(prefix);
+    if (it == m_prefixRefs.end() || --it.value() > 0) {
+        return;
+    }
+    m_prefixRefs.erase(it);
+    m_prefixes.remove(prefix);
 }
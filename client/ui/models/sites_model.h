@@ -3,6 +3,7 @@
 
 #include <QAbstractListModel>
 
+#include "core/prefixSet.h"
 #include "settings.h"
 
 class SitesModel : public QAbstractListModel
@@ -37,6 +38,11 @@ public slots:
 
     QVector<QPair<QString, QString>> getCurrentSites();
 
+    // the address or subnet is routed by one of the current sites
+    bool isCovered(const QString &prefix) const;
+    // addresses and subnets of the current sites that lie inside the prefix
+    QStringList coveredBy(const QString &prefix) const;
+
 signals:
     void routeModeChanged();
     void splitTunnelingToggled();
@@ -46,6 +52,10 @@ protected:
 
 private:
     void fillSites();
+    void fillPrefixes();
+    // several sites may resolve to the same address, a prefix leaves the set with the last of them
+    void addPrefix(const QString &route);
+    void releasePrefix(const QString &route);
 
     std::shared_ptr<Settings> m_settings;
 
@@ -53,6 +63,10 @@ private:
     Settings::RouteMode m_currentRouteMode;
 
     QVector<QPair<QString, QString>> m_sites;
+    // routable addresses of m_sites, either the site itself or its resolved ip
+    PrefixSet m_prefixes;
+    // number of sites behind each prefix of m_prefixes
+    QHash<QString, int> m_prefixRefs;
 };
 
 #endif // SITESMODEL_H
@@ -167,7 +167,7 @@ PageType {
                 text: qsTr("Start minimized")
                 descriptionText: qsTr("Launch application minimized")
 
-                KeyNavigation.tab: labelWithButtonLanguage.rightButton
+                KeyNavigation.tab: switcherOpenVpnEcKeys
                 parentFlickable: fl
 
                 checked: SettingsController.isStartMinimizedEnabled()
@@ -182,6 +182,28 @@ PageType {
                 visible: !GC.isMobile()
             }
 
+            SwitcherType {
+                id: switcherOpenVpnEcKeys
+
+                Layout.fillWidth: true
+                Layout.margins: 16
+
+                text: qsTr("EC keys for OpenVPN")
+                descriptionText: qsTr("New OpenVPN connections use elliptic curve keys, they are created faster and make the configuration smaller")
+
+                KeyNavigation.tab: labelWithButtonLanguage.rightButton
+                parentFlickable: fl
+
+                checked: SettingsController.isOpenVpnEcKeysEnabled()
+                onCheckedChanged: {
+                    if (checked !== SettingsController.isOpenVpnEcKeysEnabled()) {
+                        SettingsController.toggleOpenVpnEcKeys(checked)
+                    }
+                }
+            }
+
+            DividerType {}
+
             LabelWithButtonType {
                 id: labelWithButtonLanguage
                 Layout.fillWidth: true
@@ -31,6 +31,7 @@ PageType {
     }
 
     property bool pageEnabled
+    property bool isImportInProgress: false
 
     Component.onCompleted: {
         if (ConnectionController.isConnected) {
@@ -48,12 +49,18 @@ PageType {
         target: SitesController
 
         function onFinished(message) {
+            root.isImportInProgress = false
             PageController.showNotificationMessage(message)
         }
 
         function onErrorOccurred(errorMessage) {
+            root.isImportInProgress = false
             PageController.showErrorMessage(errorMessage)
         }
+
+        function onImportProgressChanged(progress) {
+            importProgressBar.value = progress
+        }
     }
 
     QtObject {
@@ -186,6 +193,20 @@ PageType {
                             searchField.textField
             }
         }
+
+        ProgressBarType {
+            id: importProgressBar
+
+            Layout.fillWidth: true
+            Layout.topMargin: 16
+            Layout.leftMargin: 16
+            Layout.rightMargin: 16
+
+            visible: root.isImportInProgress
+
+            from: 0
+            to: 100
+        }
     }
 
     FlickableType {
@@ -520,7 +541,7 @@ PageType {
 
                         clickedFunction: function() {
                             var fileName = SystemController.getFileName(qsTr("Open sites file"),
-                                                                        qsTr("Sites files (*.json)"))
+                                                                        qsTr("Sites files (*.json *.txt *.csv)"))
                             if (fileName !== "") {
                                 importSitesDrawerContent.importSites(fileName, true)
                             }
@@ -537,7 +558,7 @@ PageType {
 
                         clickedFunction: function() {
                             var fileName = SystemController.getFileName(qsTr("Open sites file"),
-                                                                        qsTr("Sites files (*.json)"))
+                                                                        qsTr("Sites files (*.json *.txt *.csv)"))
                             if (fileName !== "") {
                                 importSitesDrawerContent.importSites(fileName, false)
                             }
@@ -545,9 +566,10 @@ PageType {
                     }
 
                     function importSites(fileName, replaceExistingSites) {
-                        PageController.showBusyIndicator(true)
+                        // the file is read in the background, the progress bar is hidden when the import finishes
+                        importProgressBar.value = 0
+                        root.isImportInProgress = true
                         SitesController.importSites(fileName, replaceExistingSites)
-                        PageController.showBusyIndicator(false)
                         importSitesDrawer.close()
                         moreActionsDrawer.close()
                     }
@@ -113,6 +113,39 @@ PageType {
     property bool isSearchBarVisible: false
     property bool showContent: false
     property bool shareButtonEnabled: true
+    // several native configs at once are saved to a folder, which the mobile platforms don't offer
+    property bool isBulkShareAvailable: {
+        if (GC.isMobile() || accessTypeSelector.currentIndex !== 0 || exportTypeSelector.currentIndex >= root.connectionTypesModel.length) {
+            return false
+        }
+
+        var type = root.connectionTypesModel[exportTypeSelector.currentIndex].type
+        return type === PageShare.ConfigType.OpenVpn || type === PageShare.ConfigType.WireGuard || type === PageShare.ConfigType.Awg
+    }
+
+    function generateBulkConfigs() {
+        var count = parseInt(bulkClientsCountTextField.textFieldText)
+        if (isNaN(count) || count < 1 || clientNameTextField.textFieldText === "") {
+            return
+        }
+
+        var clientNames = []
+        for (var i = 1; i <= count; i++) {
+            clientNames.push(clientNameTextField.textFieldText + " " + i)
+        }
+
+        PageController.showBusyIndicator(true)
+        if (root.connectionTypesModel[exportTypeSelector.currentIndex].type === PageShare.ConfigType.OpenVpn) {
+            ExportController.generateOpenVpnConfigs(clientNames)
+        } else {
+            ExportController.generateWireGuardConfigs(clientNames)
+        }
+        PageController.showBusyIndicator(false)
+
+        if (ExportController.bulkConfigsCount > 0) {
+            bulkExportFolderDialog.open()
+        }
+    }
     property list<QtObject> connectionTypesModel: [
         amneziaConnectionFormat
     ]
@@ -474,6 +507,7 @@ PageType {
                         protocolSelector.text = selectedText
 
                         ContainersModel.setProcessedContainerIndex(proxyContainersModel.mapToSource(currentIndex))
+                        ExportController.warmUpKeyPool()
 
                         fillConnectionTypeModel()
 
@@ -567,7 +601,7 @@ PageType {
 
                 Layout.fillWidth: true
                 Layout.topMargin: 40
-                Layout.bottomMargin: 32
+                Layout.bottomMargin: root.isBulkShareAvailable ? 0 : 32
 
                 enabled: shareButtonEnabled
                 visible: accessTypeSelector.currentIndex === 0
@@ -575,7 +609,8 @@ PageType {
                 text: qsTr("Share")
                 leftImageSource: "qrc:/images/controls/share-2.svg"
 
-                Keys.onTabPressed: lastItemTabClicked(focusItem)
+                Keys.onTabPressed: root.isBulkShareAvailable ? bulkClientsCountTextField.textField.forceActiveFocus()
+                                                             : lastItemTabClicked(focusItem)
 
                 parentFlickable: a
 
@@ -587,6 +622,51 @@ PageType {
 
             }
 
+            TextFieldWithHeaderType {
+                id: bulkClientsCountTextField
+                Layout.fillWidth: true
+                Layout.topMargin: 32
+
+                visible: root.isBulkShareAvailable
+
+                headerText: qsTr("Number of users")
+                textFieldText: "10"
+                textField.validator: IntValidator { bottom: 1; top: 1000 }
+
+                checkEmptyText: true
+
+                KeyNavigation.tab: bulkShareButton
+            }
+
+            BasicButtonType {
+                id: bulkShareButton
+
+                Layout.fillWidth: true
+                Layout.topMargin: 16
+                Layout.bottomMargin: 32
+
+                defaultColor: AmneziaStyle.color.transparent
+                hoveredColor: AmneziaStyle.color.translucentWhite
+                pressedColor: AmneziaStyle.color.sheerWhite
+                disabledColor: AmneziaStyle.color.mutedGray
+                textColor: AmneziaStyle.color.paleGray
+                borderWidth: 1
+
+                enabled: shareButtonEnabled
+                visible: root.isBulkShareAvailable
+
+                text: qsTr("Create configs for several users")
+                leftImageSource: "qrc:/images/controls/share-2.svg"
+
+                Keys.onTabPressed: lastItemTabClicked(focusItem)
+
+                parentFlickable: a
+
+                clickedFunc: function() {
+                    root.generateBulkConfigs()
+                }
+            }
+
             Header2Type {
                 id: usersHeader
                 Layout.fillWidth: true
@@ -987,6 +1067,16 @@ PageType {
         }
     }
 
+    FolderDialog {
+        id: bulkExportFolderDialog
+
+        title: qsTr("Save configs to folder")
+
+        onAccepted: {
+            ExportController.exportConfigs(selectedFolder)
+        }
+    }
+
     ShareConnectionDrawer {
         id: shareConnectionDrawer
 
@@ -3,8 +3,8 @@
 #include <QDebug>
 #include <QEventLoop>
 #include <QFile>
-#include <QHostInfo>
 #include <QJsonObject>
+#include <QSet>
 
 #include "core/controllers/serverController.h"
 #include <configurators/cloak_configurator.h>
@@ -27,12 +27,14 @@
 #endif
 
 #include "core/networkUtilities.h"
+#include "core/sitesResolver.h"
 #include "vpnconnection.h"
 
 VpnConnection::VpnConnection(std::shared_ptr<Settings> settings, QObject *parent)
-    : QObject(parent), m_settings(settings), m_checkTimer(new QTimer(this))
+    : QObject(parent), m_settings(settings), m_checkTimer(new QTimer(this)), m_sitesResolver(new SitesResolver(this))
 {
     m_checkTimer.setInterval(1000);
+    connect(m_sitesResolver, &SitesResolver::resolved, this, &VpnConnection::onSitesResolved);
 #ifdef Q_OS_IOS
     connect(IosController::Instance(), &IosController::connectionStateChanged, this, &VpnConnection::onConnectionStateChanged);
     connect(IosController::Instance(), &IosController::bytesChanged, this, &VpnConnection::onBytesChanged);
@@ -54,6 +56,17 @@ void VpnConnection::onBytesChanged(quint64 receivedBytes, quint64 sentBytes)
 
 void VpnConnection::onConnectionStateChanged(Vpn::ConnectionState state)
 {
+    // the sites are watched again by addSitesRoutes() once the connection is up
+    if (state != Vpn::ConnectionState::Connected && m_sitesResolver->isWatching()) {
+        // the expiry times are saved once per connection, the waves only save changed addresses
+        m_settings->setSitesDnsCache(m_sitesResolver->cache());
+        m_sitesResolver->stop();
+    }
+    if (state != Vpn::ConnectionState::Connected) {
+        // the site routes are tracked again by addSitesRoutes()
+        m_sitesGateway.clear();
+        m_installedStaticRoutes.clear();
+    }
 
 #ifdef AMNEZIA_DESKTOP
     auto container = m_settings->defaultContainer(m_settings->defaultServerIndex());
@@ -119,43 +132,162 @@ const QString &VpnConnection::remoteAddress() const
 void VpnConnection::addSitesRoutes(const QString &gw, Settings::RouteMode mode)
 {
 #ifdef AMNEZIA_DESKTOP
-    QStringList ips;
+    m_staticSiteRoutes.clear();
+    m_installedStaticRoutes.clear();
+    m_siteAddresses.clear();
+    m_siteAddressRefs.clear();
+
     QStringList sites;
+    QStringList addressRoutes;
+    QStringList removedRoutes;
     const QVariantMap &m = m_settings->vpnSites(mode);
     for (auto i = m.constBegin(); i != m.constEnd(); ++i) {
         if (NetworkUtilities::checkIpSubnetFormat(i.key())) {
-            ips.append(i.key());
+            m_staticSiteRoutes.insert(i.key());
         } else {
-            if (NetworkUtilities::checkIpSubnetFormat(i.value().toString())) {
-                ips.append(i.value().toString());
-            }
             sites.append(i.key());
         }
     }
-    ips.removeDuplicates();
-
-    // add all IPs immediately
-    IpcClient::Interface()->routeAddList(gw, ips);
-
-    // re-resolve domains
-    for (const QString &site : sites) {
-        const auto &cbResolv = [this, site, gw, mode, ips](const QHostInfo &hostInfo) {
-            const QList<QHostAddress> &addresses = hostInfo.addresses();
-            QString ipv4Addr;
-            for (const QHostAddress &addr : hostInfo.addresses()) {
-                if (addr.protocol() == QAbstractSocket::NetworkLayerProtocol::IPv4Protocol) {
-                    const QString &ip = addr.toString();
-                    // qDebug() << "VpnConnection::addSitesRoutes updating site" << site << ip;
-                    if (!ips.contains(ip)) {
-                        IpcClient::Interface()->routeAddList(gw, QStringList() << ip);
-                        m_settings->addVpnSite(mode, site, ip);
-                    }
-                    flushDns();
-                    break;
-                }
+    for (const QString &site : std::as_const(sites)) {
+        const QString &ip = m.value(site).toString();
+        if (NetworkUtilities::checkIpSubnetFormat(ip)) {
+            updateSiteAddresses(site, QStringList() << ip, addressRoutes, removedRoutes);
+        }
+    }
+
+    // add all IPs immediately, the ip and subnet sites aggregated into as few routes as possible. The addresses of
+    // domains are routed one by one, so the route of an address the domain no longer resolves to can be removed
+    m_installedStaticRoutes = NetworkUtilities::summarizeRoutes(m_staticSiteRoutes.prefixes());
+    IpcClient::Interface()->routeAddList(gw, m_installedStaticRoutes + addressRoutes);
+
+    // re-resolve domains, the changed addresses are routed by onSitesResolved()
+    m_sitesGateway = gw;
+    m_sitesRouteMode = mode;
+    m_sitesResolver->loadCache(m_settings->sitesDnsCache());
+    m_sitesResolver->watch(sites);
+#endif
+}
+
+void VpnConnection::updateStaticSiteRoutes(const QStringList &addedPrefixes, const QStringList &removedPrefixes)
+{
+#ifdef AMNEZIA_DESKTOP
+    // the addresses of domains are routed on their own only while no ip or subnet site covers them
+    QSet<QString> coveredAddresses;
+    for (auto i = m_siteAddressRefs.constBegin(); i != m_siteAddressRefs.constEnd(); ++i) {
+        if (m_staticSiteRoutes.isCovered(i.key())) {
+            coveredAddresses.insert(i.key());
+        }
+    }
+
+    for (const QString &prefix : removedPrefixes) {
+        m_staticSiteRoutes.remove(prefix);
+    }
+    for (const QString &prefix : addedPrefixes) {
+        m_staticSiteRoutes.insert(prefix);
+    }
+
+    // the aggregated routes are recomputed and only the difference goes to the kernel, a removed site may have
+    // been merged into a supernet together with its neighbours
+    const QStringList routes = NetworkUtilities::summarizeRoutes(m_staticSiteRoutes.prefixes());
+    const QSet<QString> installedRoutes(m_installedStaticRoutes.cbegin(), m_installedStaticRoutes.cend());
+    const QSet<QString> currentRoutes(routes.cbegin(), routes.cend());
+
+    QStringList removedRoutes;
+    QStringList addedRoutes;
+    for (const QString &route : std::as_const(m_installedStaticRoutes)) {
+        if (!currentRoutes.contains(route)) {
+            removedRoutes.append(route);
+        }
+    }
+    for (const QString &route : routes) {
+        if (!installedRoutes.contains(route)) {
+            addedRoutes.append(route);
+        }
+    }
+    for (auto i = m_siteAddressRefs.constBegin(); i != m_siteAddressRefs.constEnd(); ++i) {
+        const bool isCovered = m_staticSiteRoutes.isCovered(i.key());
+        if (isCovered && !coveredAddresses.contains(i.key())) {
+            removedRoutes.append(i.key());
+        } else if (!isCovered && coveredAddresses.contains(i.key())) {
+            addedRoutes.append(i.key());
+        }
+    }
+    m_installedStaticRoutes = routes;
+
+    // deleted first, an address route may be replaced by the same route of a site
+    if (!removedRoutes.isEmpty()) {
+        IpcClient::Interface()->routeDeleteList(m_sitesGateway, removedRoutes);
+    }
+    if (!addedRoutes.isEmpty()) {
+        IpcClient::Interface()->routeAddList(m_sitesGateway, addedRoutes);
+    }
+
+    // a removed site must not stay routed through a route that is still installed
+    const PrefixSet remainingRoutes(m_installedStaticRoutes);
+    for (const QString &prefix : removedPrefixes) {
+        if (!m_staticSiteRoutes.isCovered(prefix) && remainingRoutes.isCovered(prefix)) {
+            qWarning() << "VpnConnection: the route of the removed site" << prefix << "is still installed";
+        }
+    }
+#endif
+}
+
+void VpnConnection::updateSiteAddresses(const QString &site, const QStringList &addresses, QStringList &addedRoutes,
+                                        QStringList &removedRoutes)
+{
+    const QStringList previousAddresses = m_siteAddresses.value(site);
+
+    for (const QString &ip : addresses) {
+        // a route is needed when the first domain resolves to the address and no ip or subnet site covers it
+        if (!previousAddresses.contains(ip) && m_siteAddressRefs[ip]++ == 0 && !m_staticSiteRoutes.isCovered(ip)) {
+            addedRoutes.append(ip);
+        }
+    }
+    for (const QString &ip : previousAddresses) {
+        if (!addresses.contains(ip) && --m_siteAddressRefs[ip] == 0) {
+            m_siteAddressRefs.remove(ip);
+            if (!m_staticSiteRoutes.isCovered(ip)) {
+                removedRoutes.append(ip);
             }
-        };
-        QHostInfo::lookupHost(site, this, cbResolv);
+        }
+    }
+
+    m_siteAddresses.insert(site, addresses);
+}
+
+void VpnConnection::onSitesResolved(const QMap<QString, QStringList> &addresses)
+{
+#ifdef AMNEZIA_DESKTOP
+    if (connectionState() != Vpn::ConnectionState::Connected || !IpcClient::Interface()) {
+        return;
+    }
+
+    QStringList addedRoutes;
+    QStringList removedRoutes;
+    QMap<QString, QString> resolvedSites;
+    const QVariantMap &sites = m_settings->vpnSites(m_sitesRouteMode);
+    for (auto i = addresses.constBegin(); i != addresses.constEnd(); ++i) {
+        updateSiteAddresses(i.key(), i.value(), addedRoutes, removedRoutes);
+
+        // round-robin answers reorder the addresses, the stored one is kept while it is still among them
+        if (!i.value().contains(sites.value(i.key()).toString())) {
+            resolvedSites.insert(i.key(), i.value().first());
+        }
+    }
+
+    if (!removedRoutes.isEmpty()) {
+        IpcClient::Interface()->routeDeleteList(m_sitesGateway, removedRoutes);
+    }
+    if (!addedRoutes.isEmpty()) {
+        IpcClient::Interface()->routeAddList(m_sitesGateway, addedRoutes);
+    }
+    // waves that only refresh the expiry times are not written, the cache is saved when the connection ends
+    if (!resolvedSites.isEmpty() || m_sitesResolver->isCacheChanged()) {
+        m_settings->setResolvedVpnSites(m_sitesRouteMode, resolvedSites, m_sitesResolver->cache());
+        m_sitesResolver->setCacheSaved();
+    }
+    if (!addedRoutes.isEmpty() || !removedRoutes.isEmpty()) {
+        flushDns();
     }
 #endif
 }
@@ -169,7 +301,9 @@ void VpnConnection::addRoutes(const QStringList &ips)
 {
 #ifdef AMNEZIA_DESKTOP
     if (connectionState() == Vpn::ConnectionState::Connected && IpcClient::Interface()) {
-        if (m_settings->routeMode() == Settings::VpnOnlyForwardSites) {
+        if (!m_sitesGateway.isEmpty()) {
+            updateStaticSiteRoutes(ips, {});
+        } else if (m_settings->routeMode() == Settings::VpnOnlyForwardSites) {
             IpcClient::Interface()->routeAddList(m_vpnProtocol->vpnGateway(), ips);
         } else if (m_settings->routeMode() == Settings::VpnAllExceptSites) {
             IpcClient::Interface()->routeAddList(m_vpnProtocol->routeGateway(), ips);
@@ -182,7 +316,9 @@ void VpnConnection::deleteRoutes(const QStringList &ips)
 {
 #ifdef AMNEZIA_DESKTOP
     if (connectionState() == Vpn::ConnectionState::Connected && IpcClient::Interface()) {
-        if (m_settings->routeMode() == Settings::VpnOnlyForwardSites) {
+        if (!m_sitesGateway.isEmpty()) {
+            updateStaticSiteRoutes({}, ips);
+        } else if (m_settings->routeMode() == Settings::VpnOnlyForwardSites) {
             IpcClient::Interface()->routeDeleteList(vpnProtocol()->vpnGateway(), ips);
         } else if (m_settings->routeMode() == Settings::VpnAllExceptSites) {
             IpcClient::Interface()->routeDeleteList(m_vpnProtocol->routeGateway(), ips);
@@ -191,6 +327,15 @@ void VpnConnection::deleteRoutes(const QStringList &ips)
 #endif
 }
 
+void VpnConnection::watchSites(const QStringList &hostnames)
+{
+#ifdef AMNEZIA_DESKTOP
+    if (connectionState() == Vpn::ConnectionState::Connected && !m_sitesGateway.isEmpty() && !hostnames.isEmpty()) {
+        m_sitesResolver->watch(hostnames);
+    }
+#endif
+}
+
 void VpnConnection::flushDns()
 {
 #ifdef AMNEZIA_DESKTOP
@@ -348,14 +493,16 @@ void VpnConnection::appendSplitTunnelingConfig()
 
         if (allowSiteBasedSplitTunneling) {
             auto sites = m_settings->getVpnIps(routeMode);
-            for (const auto &site : sites) {
-                sitesJsonArray.append(site);
-            }
 
             // Allow traffic to Amnezia DNS
             if (routeMode == Settings::VpnOnlyForwardSites) {
-                sitesJsonArray.append(m_vpnConfiguration.value(config_key::dns1).toString());
-                sitesJsonArray.append(m_vpnConfiguration.value(config_key::dns2).toString());
+                sites.append(m_vpnConfiguration.value(config_key::dns1).toString());
+                sites.append(m_vpnConfiguration.value(config_key::dns2).toString());
+            }
+
+            // the sites become routes, firewall rules and WireGuard allowed IPs, fewer prefixes keep all of them small
+            for (const auto &site : NetworkUtilities::summarizeRoutes(sites)) {
+                sitesJsonArray.append(site);
             }
         }
     }
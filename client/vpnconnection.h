@@ -1,6 +1,7 @@
 #ifndef VPNCONNECTION_H
 #define VPNCONNECTION_H
 
+#include <QHash>
 #include <QObject>
 #include <QString>
 #include <QScopedPointer>
@@ -9,8 +10,11 @@
 
 #include "protocols/vpnprotocol.h"
 #include "core/defs.h"
+#include "core/prefixSet.h"
 #include "settings.h"
 
+class SitesResolver;
+
 #ifdef AMNEZIA_DESKTOP
 #include "core/ipcclient.h"
 #endif
@@ -55,6 +59,8 @@ public slots:
 
     void addRoutes(const QStringList &ips);
     void deleteRoutes(const QStringList &ips);
+    // resolves domain sites added while connected, their addresses are routed by onSitesResolved()
+    void watchSites(const QStringList &hostnames);
     void flushDns();
 
 signals:
@@ -67,6 +73,7 @@ signals:
 protected slots:
     void onBytesChanged(quint64 receivedBytes, quint64 sentBytes);
     void onConnectionStateChanged(Vpn::ConnectionState state);
+    void onSitesResolved(const QMap<QString, QStringList> &addresses);
 
 protected:
     QSharedPointer<VpnProtocol> m_vpnProtocol;
@@ -80,6 +87,17 @@ private:
     // Only for iOS for now, check counters
     QTimer m_checkTimer;
 
+    SitesResolver *m_sitesResolver;
+    // ip and subnet sites, routed for the whole connection
+    PrefixSet m_staticSiteRoutes;
+    // the aggregated routes of m_staticSiteRoutes that are installed now
+    QStringList m_installedStaticRoutes;
+    // addresses each domain resolves to, and for every address the number of domains that need its route
+    QHash<QString, QStringList> m_siteAddresses;
+    QHash<QString, int> m_siteAddressRefs;
+    QString m_sitesGateway;
+    Settings::RouteMode m_sitesRouteMode = Settings::VpnAllSites;
+
 #ifdef AMNEZIA_DESKTOP
     IpcClient *m_IpcClient {nullptr};
 #endif
@@ -94,6 +112,9 @@ private:
    void createProtocolConnections();
 
    void appendSplitTunnelingConfig();
+   void updateStaticSiteRoutes(const QStringList &addedPrefixes, const QStringList &removedPrefixes);
+   void updateSiteAddresses(const QString &site, const QStringList &addresses, QStringList &addedRoutes,
+                            QStringList &removedRoutes);
    void appendKillSwitchConfig();
 };
 
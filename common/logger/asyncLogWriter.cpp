@@ -0,0 +1,199 @@
+#include "asyncLogWriter.h"
+
+#include <QFileDevice>
+
+#include <iostream>
+
+AsyncLogWriter &AsyncLogWriter::instance()
+{
+    static AsyncLogWriter writer;
+    return writer;
+}
+
+AsyncLogWriter::AsyncLogWriter() : m_slots(new Slot[slotsCount])
+{
+    for (size_t i = 0; i < slotsCount; i++) {
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+AsyncLogWriter::~AsyncLogWriter()
+{
+    stop();
+}
+
+void AsyncLogWriter::start(QIODevice *device, const std::function<void()> &afterWrite)
+{
+    stop();
+
+    {
+        std::lock_guard<std::mutex> lock(m_drainMutex);
+        m_device = device;
+        m_afterWrite = afterWrite;
+    }
+
+    m_isStopping = false;
+    m_thread = std::thread(&AsyncLogWriter::run, this);
+}
+
+void AsyncLogWriter::stop()
+{
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_wakeMutex);
+            m_isStopping = true;
+        }
+        m_wakeCondition.notify_one();
+        m_thread.join();
+    }
+
+    drain();
+
+    std::lock_guard<std::mutex> lock(m_drainMutex);
+    m_device = nullptr;
+    m_afterWrite = nullptr;
+}
+
+bool AsyncLogWriter::push(QByteArray message)
+{
+    if (message.size() > maxMessageSize) {
+        message.truncate(maxMessageSize);
+    }
+
+    // bounded queue by Dmitry Vyukov: a producer claims a slot by moving the enqueue position forward
+    // and publishes the message by bumping the slot sequence
+    Slot *slot = nullptr;
+    size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    forever {
+        slot = &m_slots[pos & (slotsCount - 1)];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            m_droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->message = std::move(message);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    // don't wait for the flush interval when the buffer fills up
+    if (pos - m_dequeuePos.load(std::memory_order_relaxed) > slotsCount / 2 && !m_isWakeRequested.exchange(true)) {
+        m_wakeCondition.notify_one();
+    }
+    return true;
+}
+
+bool AsyncLogWriter::pop(QByteArray &message)
+{
+    const size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+    Slot &slot = m_slots[pos & (slotsCount - 1)];
+    const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1) < 0) {
+        return false;
+    }
+
+    message = std::move(slot.message);
+    slot.message = QByteArray();
+    slot.sequence.store(pos + slotsCount, std::memory_order_release);
+    m_dequeuePos.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+void AsyncLogWriter::flush()
+{
+    drain();
+}
+
+void AsyncLogWriter::setFlushInterval(int msecs)
+{
+    m_flushIntervalMsecs = qMax(1, msecs);
+}
+
+quint64 AsyncLogWriter::droppedCount() const
+{
+    return m_droppedCount.load(std::memory_order_relaxed);
+}
+
+void AsyncLogWriter::writeFatal(const QByteArray &message)
+{
+    // locking the mutex again from the thread that holds it would deadlock, waiting for another thread
+    // could block the fatal message forever
+    std::unique_lock<std::mutex> lock(m_drainMutex, std::defer_lock);
+    if (m_drainingThread.load() != std::this_thread::get_id() && lock.try_lock()) {
+        drainLocked();
+    }
+
+    // the process is about to abort, a write racing with the draining thread is better than a lost message
+    const QByteArray line = message + '\n';
+    if (m_device) {
+        m_device->write(line);
+        if (auto file = qobject_cast<QFileDevice *>(m_device)) {
+            file->flush();
+        }
+    }
+    std::cout.write(line.constData(), line.size());
+    std::cout.flush();
+}
+
+void AsyncLogWriter::drain()
+{
+    std::lock_guard<std::mutex> lock(m_drainMutex);
+    m_drainingThread = std::this_thread::get_id();
+    drainLocked();
+    m_drainingThread = std::thread::id();
+}
+
+void AsyncLogWriter::drainLocked()
+{
+    QByteArray batch;
+    QByteArray message;
+    while (pop(message)) {
+        batch.append(message);
+        batch.append('\n');
+    }
+
+    const quint64 droppedCount = m_droppedCount.load(std::memory_order_relaxed);
+    if (droppedCount != m_reportedDroppedCount) {
+        batch.append(QByteArray("Logger: %1 messages were dropped, the log buffer was full\n")
+                             .replace("%1", QByteArray::number(droppedCount - m_reportedDroppedCount)));
+        m_reportedDroppedCount = droppedCount;
+    }
+
+    if (batch.isEmpty()) {
+        return;
+    }
+
+    if (m_device) {
+        m_device->write(batch);
+        if (auto file = qobject_cast<QFileDevice *>(m_device)) {
+            file->flush();
+        }
+        if (m_afterWrite) {
+            m_afterWrite();
+        }
+    }
+
+    std::cout.write(batch.constData(), batch.size());
+    std::cout.flush();
+}
+
+void AsyncLogWriter::run()
+{
+    while (!m_isStopping) {
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wakeCondition.wait_for(lock, std::chrono::milliseconds(m_flushIntervalMsecs.load()),
+                                     [this]() { return m_isStopping || m_isWakeRequested; });
+        }
+        m_isWakeRequested = false;
+
+        drain();
+    }
+}
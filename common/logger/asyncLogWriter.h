@@ -0,0 +1,82 @@
+#ifndef ASYNCLOGWRITER_H
+#define ASYNCLOGWRITER_H
+
+#include <QByteArray>
+#include <QIODevice>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Moves log output off the logging threads.
+// Messages go into a fixed size lock-free MPSC ring buffer and a dedicated writer thread appends them
+// to the log device and stdout in batches. Memory is bounded by the slot count and the message size limit,
+// messages that don't fit are dropped and counted.
+class AsyncLogWriter
+{
+public:
+    static AsyncLogWriter &instance();
+
+    // afterWrite is called on the draining thread after every batch written to the device, e.g. to rotate the file
+    void start(QIODevice *device, const std::function<void()> &afterWrite = nullptr);
+    // writes out everything that is still buffered and stops the writer thread
+    void stop();
+
+    // never blocks, returns false if the buffer is full and the message was dropped
+    bool push(QByteArray message);
+    // writes out everything that is buffered at the moment of the call from the calling thread
+    void flush();
+    // writes the message right away, after the buffered ones if possible. Never waits for the drain mutex,
+    // a fatal message may come from the draining thread itself, e.g. from the afterWrite callback
+    void writeFatal(const QByteArray &message);
+
+    void setFlushInterval(int msecs);
+    quint64 droppedCount() const;
+
+private:
+    AsyncLogWriter();
+    ~AsyncLogWriter();
+    AsyncLogWriter(const AsyncLogWriter &) = delete;
+    AsyncLogWriter &operator=(const AsyncLogWriter &) = delete;
+
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        QByteArray message;
+    };
+
+    bool pop(QByteArray &message);
+    void drain();
+    // the caller holds m_drainMutex
+    void drainLocked();
+    void run();
+
+    static constexpr size_t slotsCount = 8192; // must be a power of two
+    static constexpr int maxMessageSize = 16 * 1024;
+
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(64) std::atomic<size_t> m_enqueuePos { 0 };
+    alignas(64) std::atomic<size_t> m_dequeuePos { 0 };
+
+    std::atomic<quint64> m_droppedCount { 0 };
+    quint64 m_reportedDroppedCount = 0;
+
+    // serializes consumers, the writer thread and flush() callers take turns draining the buffer
+    std::mutex m_drainMutex;
+    std::atomic<std::thread::id> m_drainingThread;
+    QIODevice *m_device = nullptr;
+    std::function<void()> m_afterWrite;
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wakeCondition;
+    std::atomic<bool> m_isWakeRequested { false };
+    std::atomic<bool> m_isStopping { false };
+    std::atomic<int> m_flushIntervalMsecs { 200 };
+
+    std::thread m_thread;
+};
+
+#endif // ASYNCLOGWRITER_H
@@ -0,0 +1,260 @@
+#include "logRotator.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThreadPool>
+
+#include <zlib.h>
+
+namespace
+{
+    QMutex policyMutex;
+    LogRotator::Policy rotationPolicy;
+
+    constexpr char compressedSuffix[] = ".gz";
+    constexpr char partialSuffix[] = ".part";
+    constexpr qint64 copyChunkSize = 64 * 1024;
+
+    // keeps the start time of the current segment, file times can't tell it: the birth time is not available
+    // on every file system and the modification time changes with every write
+    constexpr char startedAtSuffix[] = ".started";
+
+    // windowBits of deflateInit2() and inflateInit2() selecting a gzip wrapper around the deflate stream
+    constexpr int gzipWindowBits = 15 + 16;
+
+    void writeSegmentStartedAt(const QString &logFilePath, const QDateTime &startedAt)
+    {
+        QFile startedAtFile(logFilePath + startedAtSuffix);
+        if (startedAtFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            startedAtFile.write(QByteArray::number(startedAt.toMSecsSinceEpoch()));
+        }
+    }
+}
+
+void LogRotator::setPolicy(const Policy &policy)
+{
+    QMutexLocker locker(&policyMutex);
+    rotationPolicy = policy;
+}
+
+LogRotator::Policy LogRotator::policy()
+{
+    QMutexLocker locker(&policyMutex);
+    return rotationPolicy;
+}
+
+bool LogRotator::isRotationRequired(const QFile &file, const QDateTime &segmentStartedAt)
+{
+    const Policy current = policy();
+    if (file.size() >= current.maxFileSize) {
+        return true;
+    }
+    return file.size() > 0 && segmentStartedAt.isValid() && segmentStartedAt.secsTo(QDateTime::currentDateTime()) >= current.maxAgeSecs;
+}
+
+QDateTime LogRotator::segmentStartedAt(const QFile &file)
+{
+    const QString logFilePath = file.fileName();
+    QFile startedAtFile(logFilePath + startedAtSuffix);
+    if (file.size() > 0 && startedAtFile.open(QIODevice::ReadOnly)) {
+        bool ok = false;
+        const qint64 msecs = startedAtFile.readAll().trimmed().toLongLong(&ok);
+        if (ok) {
+            return QDateTime::fromMSecsSinceEpoch(msecs);
+        }
+    }
+
+    // an empty log starts a new segment, a log of an older version without the file starts its age now
+    const QDateTime now = QDateTime::currentDateTime();
+    writeSegmentStartedAt(logFilePath, now);
+    return now;
+}
+
+bool LogRotator::rotate(QFile &file)
+{
+    const QString logFilePath = file.fileName();
+    const QString segmentPath = logFilePath + "." + QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss-zzz");
+
+    file.close();
+    const bool isRenamed = QFile::rename(logFilePath, segmentPath);
+
+    // the log keeps going into the old file if it couldn't be moved, e.g. it is opened by another process on windows
+    if (!file.open(QIODevice::Append)) {
+        return false;
+    }
+    file.setTextModeEnabled(true);
+
+    if (!isRenamed) {
+        return false;
+    }
+    writeSegmentStartedAt(logFilePath, QDateTime::currentDateTime());
+
+    QThreadPool::globalInstance()->start([segmentPath, logFilePath]() {
+        compressSegment(segmentPath);
+        pruneSegments(logFilePath);
+    });
+    return true;
+}
+
+QStringList LogRotator::segments(const QString &logFilePath)
+{
+    const QFileInfo logFileInfo(logFilePath);
+    const QDir dir = logFileInfo.absoluteDir();
+
+    QStringList segmentPaths;
+    // timestamps in the names keep the segments in chronological order
+    const QStringList names = dir.entryList({ logFileInfo.fileName() + ".*" }, QDir::Files, QDir::Name);
+    for (const QString &name : names) {
+        if (!name.endsWith(partialSuffix) && !name.endsWith(startedAtSuffix)) {
+            segmentPaths.append(dir.filePath(name));
+        }
+    }
+    return segmentPaths;
+}
+
+void LogRotator::removeSegments(const QString &logFilePath)
+{
+    for (const QString &segmentPath : segments(logFilePath)) {
+        QFile::remove(segmentPath);
+    }
+}
+
+bool LogRotator::writeSegment(const QString &segmentPath, QIODevice &device)
+{
+    QFile segment(segmentPath);
+    if (!segment.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    if (segmentPath.endsWith(compressedSuffix)) {
+        return gzipUncompress(segment, device);
+    }
+
+    while (!segment.atEnd()) {
+        const QByteArray chunk = segment.read(copyChunkSize);
+        if (chunk.isEmpty() || device.write(chunk) != chunk.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LogRotator::compressSegment(const QString &segmentPath)
+{
+    QFile segment(segmentPath);
+    if (!segment.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    const QString compressedPath = segmentPath + compressedSuffix;
+    QFile partial(compressedPath + partialSuffix);
+    if (!partial.open(QIODevice::WriteOnly | QIODevice::Truncate) || !gzipCompress(segment, partial)) {
+        partial.remove();
+        return;
+    }
+    segment.close();
+    partial.close();
+
+    if (partial.rename(compressedPath)) {
+        QFile::remove(segmentPath);
+    } else {
+        partial.remove();
+    }
+}
+
+void LogRotator::pruneSegments(const QString &logFilePath)
+{
+    const Policy current = policy();
+    const QDateTime oldestAllowed = QDateTime::currentDateTime().addSecs(-current.maxAgeSecs);
+
+    QStringList segmentPaths = segments(logFilePath);
+    while (!segmentPaths.isEmpty()
+           && (segmentPaths.size() > current.generations || QFileInfo(segmentPaths.first()).lastModified() < oldestAllowed)) {
+        QFile::remove(segmentPaths.takeFirst());
+    }
+}
+
+bool LogRotator::gzipCompress(QIODevice &source, QIODevice &target)
+{
+    z_stream stream {};
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, gzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+
+    QByteArray output(copyChunkSize, Qt::Uninitialized);
+    int status = Z_OK;
+    while (status == Z_OK) {
+        const QByteArray input = source.read(copyChunkSize);
+        if (input.isEmpty() && !source.atEnd()) {
+            status = Z_ERRNO;
+            break;
+        }
+        const int flush = source.atEnd() ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.constData()));
+        stream.avail_in = static_cast<uInt>(input.size());
+
+        // drains the compressed output until the chunk is consumed, or the stream is finished for the last one
+        do {
+            stream.next_out = reinterpret_cast<Bytef *>(output.data());
+            stream.avail_out = static_cast<uInt>(copyChunkSize);
+            status = deflate(&stream, flush);
+            if (status == Z_BUF_ERROR) {
+                // nothing left to do for this chunk, not an error
+                status = Z_OK;
+            }
+
+            const qsizetype size = copyChunkSize - stream.avail_out;
+            if (status != Z_STREAM_ERROR && target.write(output.constData(), size) != size) {
+                status = Z_ERRNO;
+            }
+        } while (status == Z_OK && stream.avail_out == 0);
+    }
+
+    deflateEnd(&stream);
+    return status == Z_STREAM_END;
+}
+
+bool LogRotator::gzipUncompress(QIODevice &source, QIODevice &target)
+{
+    z_stream stream {};
+    if (inflateInit2(&stream, gzipWindowBits) != Z_OK) {
+        return false;
+    }
+
+    QByteArray output(copyChunkSize, Qt::Uninitialized);
+    int status = Z_OK;
+    while (status == Z_OK) {
+        // an empty read leaves a truncated stream unfinished
+        const QByteArray input = source.read(copyChunkSize);
+        if (input.isEmpty()) {
+            break;
+        }
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.constData()));
+        stream.avail_in = static_cast<uInt>(input.size());
+
+        do {
+            stream.next_out = reinterpret_cast<Bytef *>(output.data());
+            stream.avail_out = static_cast<uInt>(copyChunkSize);
+
+            // the trailer checksum is verified by inflate() itself
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (status == Z_BUF_ERROR) {
+                status = Z_OK;
+            }
+            if (status != Z_OK && status != Z_STREAM_END) {
+                break;
+            }
+
+            const qsizetype size = copyChunkSize - stream.avail_out;
+            if (target.write(output.constData(), size) != size) {
+                status = Z_ERRNO;
+            }
+        } while (status == Z_OK && stream.avail_out == 0);
+    }
+
+    inflateEnd(&stream);
+    return status == Z_STREAM_END;
+}
@@ -0,0 +1,48 @@
+#ifndef LOGROTATOR_H
+#define LOGROTATOR_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QIODevice>
+#include <QStringList>
+
+// Rotation of the user and service log files.
+// A log file that grows over the size limit or gets older than the age limit is moved aside as a segment
+// named <log file>.<timestamp>, the segment is gzip compressed on a background thread
+// and only the newest generations are kept.
+class LogRotator
+{
+public:
+    struct Policy
+    {
+        qint64 maxFileSize = 5 * 1024 * 1024;
+        qint64 maxAgeSecs = 7 * 24 * 60 * 60;
+        int generations = 5;
+    };
+
+    static void setPolicy(const Policy &policy);
+    static Policy policy();
+
+    // when the current segment of the log file was started, kept next to it as <log file>.started
+    static QDateTime segmentStartedAt(const QFile &file);
+    static bool isRotationRequired(const QFile &file, const QDateTime &segmentStartedAt);
+    // reopens the file empty, the caller makes sure nothing writes to it meanwhile
+    static bool rotate(QFile &file);
+
+    // oldest first, compressed and not yet compressed ones
+    static QStringList segments(const QString &logFilePath);
+    static void removeSegments(const QString &logFilePath);
+    // writes the uncompressed segment content into the device
+    static bool writeSegment(const QString &segmentPath, QIODevice &device);
+
+private:
+    static void compressSegment(const QString &segmentPath);
+    static void pruneSegments(const QString &logFilePath);
+
+    // both go through fixed size chunks, a segment is never held in memory as a whole
+    static bool gzipCompress(QIODevice &source, QIODevice &target);
+    static bool gzipUncompress(QIODevice &source, QIODevice &target);
+};
+
+#endif // LOGROTATOR_H
@@ -1,16 +1,18 @@
 #include "logger.h"
 
+#include <QBuffer>
 #include <QDateTime>
 #include <QDebug>
 #include <QDesktopServices>
 #include <QDir>
 #include <QJsonDocument>
 #include <QMetaEnum>
+#include <QReadWriteLock>
 #include <QStandardPaths>
 #include <QUrl>
 
-#include <iostream>
-
+#include "asyncLogWriter.h"
+#include "logRotator.h"
 #include "utilities.h"
 #include "version.h"
 
@@ -22,8 +24,30 @@
     #include <AmneziaVPN-Swift.h>
 #endif
 
+namespace
+{
+    QReadWriteLock logLevelsLock;
+    QHash<QString, LogLevel> logLevels;
+    LogLevel defaultLogLevel = Trace;
+    std::atomic<int> logLevelsGeneration { 0 };
+
+    bool logLevelFromString(const QString &name, LogLevel &level)
+    {
+        static const QHash<QString, LogLevel> levels = {
+            { "trace", Trace }, { "debug", Debug }, { "info", Info }, { "warning", Warning }, { "error", Error },
+        };
+
+        auto it = levels.constFind(name.trimmed().toLower());
+        if (it == levels.constEnd()) {
+            return false;
+        }
+        level = it.value();
+        return true;
+    }
+}
+
 QFile Logger::m_file;
-QTextStream Logger::m_textStream;
+QDateTime Logger::m_segmentStartedAt;
 QString Logger::m_logFileName = QString("%1.log").arg(APPLICATION_NAME);
 QString Logger::m_serviceLogFileName = QString("%1.log").arg(SERVICE_NAME);
 
@@ -43,9 +67,14 @@ void debugMessageHandler(QtMsgType type, const QMessageLogContext &context, cons
         return;
     }
 
-    Logger::m_textStream << qFormatLogMessage(type, context, msg) << Qt::endl << Qt::flush;
+    // fatal messages are written right away, the process aborts after the handler returns
+    if (type == QtFatalMsg) {
+        AsyncLogWriter::instance().writeFatal(qFormatLogMessage(type, context, msg).toUtf8());
+        return;
+    }
 
-    std::cout << qFormatLogMessage(type, context, msg).toStdString() << std::endl << std::flush;
+    // the writer thread puts the message into the log file and stdout, the logging thread only formats it
+    AsyncLogWriter::instance().push(qFormatLogMessage(type, context, msg).toUtf8());
 }
 
 Logger &Logger::Instance()
@@ -63,6 +92,9 @@ bool Logger::init(bool isServiceLogger)
         return false;
     }
 
+    // messages logged meanwhile stay in the buffer until the writer is started again
+    AsyncLogWriter::instance().stop();
+
     m_file.setFileName(appDir.filePath(logFileName));
     if (!m_file.open(QIODevice::Append)) {
         qWarning() << "Cannot open log file:" << logFileName;
@@ -70,7 +102,12 @@ bool Logger::init(bool isServiceLogger)
     }
 
     m_file.setTextModeEnabled(true);
-    m_textStream.setDevice(&m_file);
+    m_segmentStartedAt = LogRotator::segmentStartedAt(m_file);
+    AsyncLogWriter::instance().start(&m_file, &Logger::rotateIfRequired);
+
+    if (qEnvironmentVariableIsSet("AMNEZIA_LOG_LEVELS")) {
+        setLogLevels(qEnvironmentVariable("AMNEZIA_LOG_LEVELS"));
+    }
     qSetMessagePattern("%{time yyyy-MM-dd hh:mm:ss} %{type} %{message}");
 
 #if !defined(QT_DEBUG) || defined(Q_OS_IOS)
@@ -84,7 +121,7 @@ void Logger::deInit()
 {
     qInstallMessageHandler(nullptr);
     qSetMessagePattern("%{message}");
-    m_textStream.setDevice(nullptr);
+    AsyncLogWriter::instance().stop();
     m_file.close();
 }
 
@@ -144,11 +181,10 @@ QString Logger::serviceLogsFilePath()
 
 QString Logger::getLogFile()
 {
-    m_file.flush();
-    QFile file(userLogsFilePath());
-
-    file.open(QIODevice::ReadOnly);
-    QString qtLog = file.readAll();
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    exportLogs(buffer, false);
+    QString qtLog = QString::fromUtf8(buffer.data());
 
 #ifdef Q_OS_IOS
     return QString().fromStdString(AmneziaVPN::swiftUpdateLogData(qtLog.toStdString()));
@@ -159,11 +195,10 @@ QString Logger::getLogFile()
 
 QString Logger::getServiceLogFile()
 {
-    m_file.flush();
-    QFile file(serviceLogsFilePath());
-
-    file.open(QIODevice::ReadOnly);
-    QString qtLog = file.readAll();
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    exportLogs(buffer, true);
+    QString qtLog = QString::fromUtf8(buffer.data());
 
 #ifdef Q_OS_IOS
     return QString().fromStdString(AmneziaVPN::swiftUpdateLogData(qtLog.toStdString()));
@@ -172,6 +207,38 @@ QString Logger::getServiceLogFile()
 #endif
 }
 
+bool Logger::exportLogs(QIODevice &device, bool isServiceLogger)
+{
+    AsyncLogWriter::instance().flush();
+    const QString logFilePath = isServiceLogger ? serviceLogsFilePath() : userLogsFilePath();
+
+    for (const QString &segmentPath : LogRotator::segments(logFilePath)) {
+        // a segment can be compressed or pruned meanwhile, the rest of the logs is still worth exporting
+        if (!LogRotator::writeSegment(segmentPath, device)) {
+            qWarning() << "Cannot export log segment:" << segmentPath;
+        }
+    }
+
+    QFile file(logFilePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    while (!file.atEnd()) {
+        const QByteArray chunk = file.read(64 * 1024);
+        if (chunk.isEmpty() || device.write(chunk) != chunk.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Logger::rotateIfRequired()
+{
+    if (LogRotator::isRotationRequired(m_file, m_segmentStartedAt) && LogRotator::rotate(m_file)) {
+        m_segmentStartedAt = QDateTime::currentDateTime();
+    }
+}
+
 bool Logger::openLogsFolder(bool isServiceLogger)
 {
     QString path = isServiceLogger ? systemLogDir() : userLogsDir();
@@ -188,6 +255,7 @@ bool Logger::openLogsFolder(bool isServiceLogger)
 void Logger::clearLogs(bool isServiceLogger)
 {
     bool isLogActive = m_file.isOpen();
+    AsyncLogWriter::instance().stop();
     m_file.close();
 
     QFile file(isServiceLogger ? serviceLogsFilePath() : userLogsFilePath());
@@ -195,6 +263,7 @@ void Logger::clearLogs(bool isServiceLogger)
     file.open(QIODevice::WriteOnly | QIODevice::Truncate);
     file.resize(0);
     file.close();
+    LogRotator::removeSegments(file.fileName());
 
 #ifdef Q_OS_IOS
     AmneziaVPN::swiftDeleteLog();
@@ -234,16 +303,66 @@ void Logger::cleanUp()
     clearLogs(true);
 }
 
-Logger::Log::Log(Logger *logger, LogLevel logLevel) : m_logger(logger), m_logLevel(logLevel), m_data(new Data())
+void Logger::setLogLevel(const QString &category, LogLevel level)
+{
+    QWriteLocker locker(&logLevelsLock);
+    if (category.isEmpty() || category == "*") {
+        defaultLogLevel = level;
+    } else {
+        logLevels.insert(category, level);
+    }
+    logLevelsGeneration++;
+}
+
+void Logger::setLogLevels(const QString &spec)
+{
+    for (const QString &item : spec.split(',', Qt::SkipEmptyParts)) {
+        const QString category = item.section('=', 0, 0).trimmed();
+        LogLevel level;
+        if (!logLevelFromString(item.section('=', 1), level)) {
+            qWarning() << "Unknown log level in" << item;
+            continue;
+        }
+        setLogLevel(category, level);
+    }
+}
+
+LogLevel Logger::logLevel() const
+{
+    const int generation = logLevelsGeneration.load(std::memory_order_acquire);
+    if (m_cachedLogLevelGeneration.load(std::memory_order_acquire) != generation) {
+        QReadLocker locker(&logLevelsLock);
+        m_cachedLogLevel = logLevels.value(m_className, defaultLogLevel);
+        m_cachedLogLevelGeneration.store(generation, std::memory_order_release);
+    }
+    return static_cast<LogLevel>(m_cachedLogLevel.load(std::memory_order_relaxed));
+}
+
+Logger::Log::Log(Logger *logger, LogLevel logLevel)
+    : m_logger(logger), m_logLevel(logLevel), m_data(logger->isEnabled(logLevel) ? new Data() : nullptr)
 {
 }
 
 Logger::Log::~Log()
 {
-    qDebug() << "Amnezia" << m_logger->className() << m_data->m_buffer.trimmed();
+    if (!m_data) {
+        return;
+    }
+
+    const QString message = m_data->m_buffer.trimmed();
+    switch (m_logLevel) {
+    case Error: qCritical() << "Amnezia" << m_logger->className() << message; break;
+    case Warning: qWarning() << "Amnezia" << m_logger->className() << message; break;
+    case Info: qInfo() << "Amnezia" << m_logger->className() << message; break;
+    default: qDebug() << "Amnezia" << m_logger->className() << message; break;
+    }
     delete m_data;
 }
 
+Logger::Log Logger::trace()
+{
+    return Log(this, LogLevel::Trace);
+}
 Logger::Log Logger::error()
 {
     return Log(this, LogLevel::Error);
@@ -273,7 +392,9 @@ QString Logger::sensitive(const QString &input)
 #define CREATE_LOG_OP_REF(x)                                                                                                               \
     Logger::Log &Logger::Log::operator<<(x t)                                                                                              \
     {                                                                                                                                      \
-        m_data->m_ts << t << ' ';                                                                                                          \
+        if (m_data) {                                                                                                                      \
+            m_data->m_ts << t << ' ';                                                                                                      \
+        }                                                                                                                                  \
         return *this;                                                                                                                      \
     }
 
@@ -287,18 +408,27 @@ CREATE_LOG_OP_REF(const void *);
 
 Logger::Log &Logger::Log::operator<<(const QStringList &t)
 {
+    if (!m_data) {
+        return *this;
+    }
     m_data->m_ts << '[' << t.join(",") << ']' << ' ';
     return *this;
 }
 
 Logger::Log &Logger::Log::operator<<(const QJsonObject &t)
 {
+    if (!m_data) {
+        return *this;
+    }
     m_data->m_ts << QJsonDocument(t).toJson(QJsonDocument::Indented) << ' ';
     return *this;
 }
 
 Logger::Log &Logger::Log::operator<<(QTextStreamFunction t)
 {
+    if (!m_data) {
+        return *this;
+    }
     m_data->m_ts << t;
     return *this;
 }
@@ -1,14 +1,31 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
+#include <QDateTime>
 #include <QDebug>
 #include <QDir>
 #include <QFile>
 #include <QString>
 #include <QTextStream>
 
+#include <atomic>
+
 #include "mozilla/shared/loglevel.h"
 
+// Messages below this level are compiled out. Everything is kept by default, the levels are chosen at runtime
+// with Logger::setLogLevels() or AMNEZIA_LOG_LEVELS, builds can raise the floor with -DAMNEZIA_MIN_LOG_LEVEL=<level>
+#ifndef AMNEZIA_MIN_LOG_LEVEL
+    #define AMNEZIA_MIN_LOG_LEVEL 0
+#endif
+
+// Unlike logger.debug() << ..., the operands of the stream aren't evaluated at all if the level is disabled.
+// A loop like the one of qCDebug(), so an else after the macro can't bind to it
+#define AMNEZIA_LOG_IF_ENABLED(logger, level) \
+    for (bool amneziaLogEnabled = (logger).isEnabled(level); amneziaLogEnabled; amneziaLogEnabled = false)
+#define LOG_TRACE(logger) AMNEZIA_LOG_IF_ENABLED(logger, LogLevel::Trace) (logger).trace()
+#define LOG_DEBUG(logger) AMNEZIA_LOG_IF_ENABLED(logger, LogLevel::Debug) (logger).debug()
+#define LOG_INFO(logger) AMNEZIA_LOG_IF_ENABLED(logger, LogLevel::Info) (logger).info()
+
 class Logger : public QObject
 {
     Q_OBJECT
@@ -33,6 +50,24 @@ public:
 
     static QString getLogFile();
     static QString getServiceLogFile();
+    // writes the rotated segments, oldest first, and then the current log into the device without loading them all at once
+    static bool exportLogs(QIODevice &device, bool isServiceLogger);
+
+    static constexpr LogLevel compiledMinLogLevel = static_cast<LogLevel>(AMNEZIA_MIN_LOG_LEVEL);
+
+    // runtime threshold for the loggers with the given class name, "*" sets the level for all other loggers
+    static void setLogLevel(const QString &category, LogLevel level);
+    // comma separated category=level pairs, e.g. "Daemon=debug,*=warning"
+    static void setLogLevels(const QString &spec);
+
+    bool isEnabled(LogLevel level) const
+    {
+        // constant for the compiler, disabled levels don't even look up the threshold
+        if (level < compiledMinLogLevel) {
+            return false;
+        }
+        return level >= logLevel();
+    }
 
     // compat with Mozilla logger
     Logger(const QString &className)
@@ -59,9 +94,21 @@ public:
         Log &operator<<(QTextStreamFunction t);
         Log &operator<<(const void *t);
 
+        // structured logging: appends key=value without building intermediate strings
+        template<typename T> Log &kv(const char *key, const T &value)
+        {
+            if (m_data) {
+                m_data->m_ts << key << '=' << value << ' ';
+            }
+            return *this;
+        }
+
         // Q_ENUM
         template<typename T> typename std::enable_if<QtPrivate::IsQEnumHelper<T>::Value, Log &>::type operator<<(T t)
         {
+            if (!m_data) {
+                return *this;
+            }
             const QMetaObject *meta = qt_getEnumMetaObject(t);
             const char *name = qt_getEnumName(t);
             addMetaEnum(typename QFlags<T>::Int(t), meta, name);
@@ -84,9 +131,11 @@ public:
             QTextStream m_ts;
         };
 
+        // null if the level is disabled, every operator is a no-op then
         Data *m_data;
     };
 
+    Log trace();
     Log error();
     Log warning();
     Log info();
@@ -100,8 +149,12 @@ private:
 
     static QString userLogsDir();
 
+    LogLevel logLevel() const;
+
+    static void rotateIfRequired();
+
     static QFile m_file;
-    static QTextStream m_textStream;
+    static QDateTime m_segmentStartedAt;
     static QString m_logFileName;
     static QString m_serviceLogFileName;
 
@@ -109,6 +162,10 @@ private:
 
     // compat with Mozilla logger
     QString m_className;
+
+    // threshold for m_className, looked up again when the thresholds are changed
+    mutable std::atomic<int> m_cachedLogLevel { Trace };
+    mutable std::atomic<int> m_cachedLogLevelGeneration { -1 };
 };
 
 #endif // LOGGER_H
@@ -48,6 +48,9 @@ LocalServer::LocalServer(QObject *parent) : QObject(parent),
     }
 
 #ifdef Q_OS_LINUX
+    // routes and rules left behind by a crashed run
+    Router::clearSavedRoutes();
+
     // Signal handling for a proper shutdown.
     QObject::connect(qApp, &QCoreApplication::aboutToQuit,
                      []() { LinuxDaemon::instance()->deactivate(); });
@@ -20,7 +20,55 @@
 #include <unistd.h>
 #include <QFileInfo>
 
-#include <core/networkUtilities.h>
+#include "rtnetlink_linux.h"
+
+namespace
+{
+    // Routes of routeAddList() live in their own table, so clearing them is a single table flush.
+    // Only the host routes of the main table are looked up before it, the route to the VPN server has to win
+    // over the sites, while the site routes win over any more specific network route of the main table.
+    // Everything our table doesn't route falls through to the main table rule of the system.
+    constexpr quint32 routeTable = 0x414d;
+    constexpr quint32 mainRulePriority = 32000;
+    constexpr quint32 routeRulePriority = 32001;
+    // the rule of older versions let every route of the main table except the default ones win
+    constexpr int legacyMainRuleSuppressPrefixLength = 1;
+
+    int mainRuleSuppressPrefixLength(int family)
+    {
+        return family == AF_INET ? 31 : 127;
+    }
+
+    bool parseRoute(const QString &ipWithSubnet, QHostAddress &dst, int &prefixLength)
+    {
+        if (ipWithSubnet.contains('/')) {
+            const QPair<QHostAddress, int> subnet = QHostAddress::parseSubnet(ipWithSubnet);
+            dst = subnet.first;
+            prefixLength = subnet.second;
+        } else {
+            dst = QHostAddress(ipWithSubnet);
+            prefixLength = dst.protocol() == QAbstractSocket::IPv6Protocol ? 128 : 32;
+        }
+
+        if (dst.isNull() || prefixLength < 0) {
+            return false;
+        }
+
+        // the kernel rejects destinations with host bits set
+        if (dst.protocol() == QAbstractSocket::IPv4Protocol) {
+            const quint32 mask = prefixLength == 0 ? 0 : ~quint32(0) << (32 - prefixLength);
+            dst = QHostAddress(dst.toIPv4Address() & mask);
+        } else {
+            Q_IPV6ADDR ip = dst.toIPv6Address();
+            for (int i = 0; i < 16; i++) {
+                const int bits = qBound(0, prefixLength - i * 8, 8);
+                ip[i] &= bits == 0 ? 0 : static_cast<quint8>(0xFF << (8 - bits));
+            }
+            dst = QHostAddress(ip);
+        }
+        return true;
+    }
+}
 
 RouterLinux &RouterLinux::Instance()
 {
@@ -28,128 +76,109 @@ RouterLinux &RouterLinux::Instance()
     return s;
 }
 
-bool RouterLinux::routeAdd(const QString &ipWithSubnet, const QString &gw, const int &sock)
+bool RouterLinux::setRouteTableEnabled(bool enabled)
 {
-    QString ip = NetworkUtilities::ipAddressFromIpWithSubnet(ipWithSubnet);
-    QString mask = NetworkUtilities::netMaskFromIpWithSubnet(ipWithSubnet);
-
-    if (!NetworkUtilities::checkIPv4Format(ip) || !NetworkUtilities::checkIPv4Format(gw)) {
-        qCritical().noquote() << "Critical, trying to add invalid route: " << ip << gw;
+    // leftovers of a previous run are removed first, so stale routes are never used
+    RtNetlinkBatch flushBatch;
+    if (!flushBatch.isValid()) {
         return false;
     }
+    flushBatch.flushTable(routeTable);
+    const int flushedCount = flushBatch.finish();
 
-    struct rtentry route;
-    memset(&route, 0, sizeof( route ));
-
-    // set gateway
-    ((struct sockaddr_in *)&route.rt_gateway)->sin_family = AF_INET;
-    ((struct sockaddr_in *)&route.rt_gateway)->sin_addr.s_addr = inet_addr(gw.toStdString().c_str());
-    ((struct sockaddr_in *)&route.rt_gateway)->sin_port = 0;
-    // set host rejecting
-    ((struct sockaddr_in *)&route.rt_dst)->sin_family = AF_INET;
-    ((struct sockaddr_in *)&route.rt_dst)->sin_addr.s_addr = inet_addr(ip.toStdString().c_str());
-    ((struct sockaddr_in *)&route.rt_dst)->sin_port = 0;
-    // set mask
-    ((struct sockaddr_in *)&route.rt_genmask)->sin_family = AF_INET;
-    ((struct sockaddr_in *)&route.rt_genmask)->sin_addr.s_addr = inet_addr(mask.toStdString().c_str());
-    ((struct sockaddr_in *)&route.rt_genmask)->sin_port = 0;
-
-    route.rt_flags = RTF_UP | RTF_GATEWAY;
-    route.rt_metric = 0;
-
-    if (int err = ioctl(sock, SIOCADDRT, &route) < 0)
-    {
-        qDebug().noquote() << "route add error: gw "
-                           << ((struct sockaddr_in *)&route.rt_gateway)->sin_addr.s_addr
-                           << " ip " << ((struct sockaddr_in *)&route.rt_dst)->sin_addr.s_addr
-                           << " mask " << ((struct sockaddr_in *)&route.rt_genmask)->sin_addr.s_addr << " " << err;
+    // the rules are deleted in a batch of their own, deleting a rule that doesn't exist fails
+    RtNetlinkBatch batch;
+    if (!batch.isValid()) {
         return false;
     }
+    for (int family : { AF_INET, AF_INET6 }) {
+        batch.deleteRule(family, mainRulePriority, RT_TABLE_MAIN, legacyMainRuleSuppressPrefixLength);
+        batch.deleteRule(family, mainRulePriority, RT_TABLE_MAIN, mainRuleSuppressPrefixLength(family));
+        batch.deleteRule(family, routeRulePriority, routeTable);
+        if (enabled) {
+            batch.addRule(family, mainRulePriority, RT_TABLE_MAIN, mainRuleSuppressPrefixLength(family));
+            batch.addRule(family, routeRulePriority, routeTable);
+        }
+    }
+    batch.finish();
+    qDebug().noquote() << "RouterLinux::setRouteTableEnabled" << enabled << "flushed routes:" << flushedCount;
 
-    m_addedRoutes.append({ipWithSubnet, gw});
-    return true;
+    m_isRouteTableEnabled = enabled;
+    return !flushBatch.hasFailures();
 }
 
 int RouterLinux::routeAddList(const QString &gw, const QStringList &ips)
 {
-    int temp_sock = socket(AF_INET, SOCK_DGRAM,  IPPROTO_IP);
-    int cnt = 0;
-    for (const QString &ip: ips) {
-        if (routeAdd(ip, gw, temp_sock)) cnt++;
+    const QHostAddress gateway(gw);
+    if (gateway.isNull()) {
+        qCritical().noquote() << "Critical, trying to add routes with invalid gateway: " << gw;
+        return 0;
     }
-    close(temp_sock);
+
+    if (!m_isRouteTableEnabled && !setRouteTableEnabled(true)) {
+        return 0;
+    }
+
+    RtNetlinkBatch batch;
+    if (!batch.isValid()) {
+        return 0;
+    }
+
+    for (const QString &ip : ips) {
+        QHostAddress dst;
+        int prefixLength;
+        if (!parseRoute(ip, dst, prefixLength) || dst.protocol() != gateway.protocol()) {
+            qCritical().noquote() << "Critical, trying to add invalid route: " << ip << gw;
+            continue;
+        }
+        batch.addRoute(dst, prefixLength, gateway, routeTable);
+    }
+
+    const int cnt = batch.finish();
+    qDebug().noquote() << "RouterLinux::routeAddList finished, success:" << cnt << "/" << ips.size();
     return cnt;
 }
 
 bool RouterLinux::clearSavedRoutes()
 {
-    int temp_sock = socket(AF_INET, SOCK_DGRAM,  IPPROTO_IP);
-    int cnt = 0;
-    for (const Route &r: m_addedRoutes) {
-        if (routeDelete(r.dst, r.gw, temp_sock)) cnt++;
-    }
-    bool ret = (cnt == m_addedRoutes.count());
-    m_addedRoutes.clear();
-    close(temp_sock);
-    return ret;
+    // done even if this run added nothing, the table and the rules of a crashed run are removed this way
+    return setRouteTableEnabled(false);
 }
 
-bool RouterLinux::routeDelete(const QString &ipWithSubnet, const QString &gw, const int &sock)
+bool RouterLinux::routeDeleteList(const QString &gw, const QStringList &ips)
 {
-#ifdef MZ_DEBUG
-    qDebug().noquote() << "RouterLinux::routeDelete: " << ipWithSubnet << gw;
-#endif
-
-    QString ip = NetworkUtilities::ipAddressFromIpWithSubnet(ipWithSubnet);
-    QString mask = NetworkUtilities::netMaskFromIpWithSubnet(ipWithSubnet);
-
-    if (!NetworkUtilities::checkIPv4Format(ip) || !NetworkUtilities::checkIPv4Format(gw)) {
-        qCritical().noquote() << "Critical, trying to remove invalid route: " << ip << gw;
+    const QHostAddress gateway(gw);
+    if (gateway.isNull()) {
+        qCritical().noquote() << "Critical, trying to remove routes with invalid gateway: " << gw;
         return false;
     }
 
-    if (ipWithSubnet == "0.0.0.0/0") {
-        qDebug().noquote() << "Warning, trying to remove default route, skipping: " << ip << gw;
-        return true;
-    }
-
-    struct rtentry route;
-    memset(&route, 0, sizeof( route ));
-
-    // set gateway
-    ((struct sockaddr_in *)&route.rt_gateway)->sin_family = AF_INET;
-    ((struct sockaddr_in *)&route.rt_gateway)->sin_addr.s_addr = inet_addr(gw.toStdString().c_str());
-    ((struct sockaddr_in *)&route.rt_gateway)->sin_port = 0;
-    // set host rejecting
-    ((struct sockaddr_in *)&route.rt_dst)->sin_family = AF_INET;
-    ((struct sockaddr_in *)&route.rt_dst)->sin_addr.s_addr = inet_addr(ip.toStdString().c_str());
-    ((struct sockaddr_in *)&route.rt_dst)->sin_port = 0;
-    // set mask
-    ((struct sockaddr_in *)&route.rt_genmask)->sin_family = AF_INET;
-    ((struct sockaddr_in *)&route.rt_genmask)->sin_addr.s_addr = inet_addr(mask.toStdString().c_str());
-    ((struct sockaddr_in *)&route.rt_genmask)->sin_port = 0;
-
-    route.rt_flags = RTF_UP | RTF_GATEWAY;
-    route.rt_metric = 0;
-    //route.rt_dev = "ens33";
-
-    if (ioctl(sock, SIOCDELRT, &route) < 0)
-    {
-        qDebug().noquote() << "route delete error: gw " << gw << " ip " << ip << " mask " << mask;
+    RtNetlinkBatch batch;
+    if (!batch.isValid()) {
         return false;
     }
-    return true;
-}
 
-bool RouterLinux::routeDeleteList(const QString &gw, const QStringList &ips)
-{
-    int temp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
-    int cnt = 0;
-    for (const QString &ip: ips) {
-        if (routeDelete(ip, gw, temp_sock)) cnt++;
+    bool isValidList = true;
+    for (const QString &ip : ips) {
+        if (ip == "0.0.0.0/0") {
+            qDebug().noquote() << "Warning, trying to remove default route, skipping: " << ip << gw;
+            continue;
+        }
+
+        QHostAddress dst;
+        int prefixLength;
+        if (!parseRoute(ip, dst, prefixLength) || dst.protocol() != gateway.protocol()) {
+            qCritical().noquote() << "Critical, trying to remove invalid route: " << ip << gw;
+            isValidList = false;
+            continue;
+        }
+        batch.deleteRoute(dst, prefixLength, gateway, routeTable);
     }
-    close(temp_sock);
-    return cnt;
+
+    // succeeds only if every route of the list was removed
+    const int cnt = batch.finish();
+    qDebug().noquote() << "RouterLinux::routeDeleteList finished, success:" << cnt << "/" << ips.size();
+    return isValidList && !batch.hasFailures();
 }
 
 void RouterLinux::flushDns()
@@ -17,17 +17,12 @@ class RouterLinux : public QObject
 {
     Q_OBJECT
 public:
-    struct Route {
-        QString dst;
-        QString gw;
-    };
-
     static RouterLinux& Instance();
 
-    bool routeAdd(const QString &ip, const QString &gw, const int &sock);
+    // the routes are added to a dedicated routing table with a single netlink batch, IPv4 and IPv6
     int routeAddList(const QString &gw, const QStringList &ips);
+    // flushes the routing table of routeAddList()
     bool clearSavedRoutes();
-    bool routeDelete(const QString &ip, const QString &gw, const int &sock);
     bool routeDeleteList(const QString &gw, const QStringList &ips);
     QString getgatewayandiface();
     void flushDns();
@@ -43,7 +38,9 @@ private:
     RouterLinux(RouterLinux const &) = delete;
     RouterLinux& operator= (RouterLinux const&) = delete;
 
-    QList<Route> m_addedRoutes;
+    bool setRouteTableEnabled(bool enabled);
+
+    bool m_isRouteTableEnabled = false;
     DnsUtilsLinux *m_dnsUtil;
 };
 
@@ -0,0 +1,353 @@
+#include "rtnetlink_linux.h"
+
+#include <QDebug>
+#include <QtEndian>
+
+#include <errno.h>
+#include <linux/fib_rules.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef NETLINK_CAP_ACK
+#define NETLINK_CAP_ACK 10
+#endif
+
+namespace
+{
+    // enough for the ACKs of a few batches, ACKs that don't fit are lost and the requests are counted as failed
+    constexpr int socketBufferSize = 1024 * 1024;
+    constexpr int ackTimeoutMsecs = 1000;
+    constexpr int maxLoggedErrors = 10;
+
+    QByteArray newMessage(const void *payload, int size)
+    {
+        QByteArray message(NLMSG_HDRLEN, '\0');
+        message.append(static_cast<const char *>(payload), size);
+        message.append(NLMSG_ALIGN(size) - size, '\0');
+        return message;
+    }
+
+    void appendAttr(QByteArray &message, quint16 type, const void *data, int size)
+    {
+        rtattr attr;
+        attr.rta_type = type;
+        attr.rta_len = RTA_LENGTH(size);
+        message.append(reinterpret_cast<const char *>(&attr), sizeof(attr));
+        message.append(static_cast<const char *>(data), size);
+        message.append(RTA_ALIGN(attr.rta_len) - attr.rta_len, '\0');
+    }
+
+    void appendAttr(QByteArray &message, quint16 type, quint32 value)
+    {
+        appendAttr(message, type, &value, sizeof(value));
+    }
+
+    void appendAddressAttr(QByteArray &message, quint16 type, const QHostAddress &address)
+    {
+        if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+            const quint32 ip = qToBigEndian(address.toIPv4Address());
+            appendAttr(message, type, &ip, sizeof(ip));
+        } else {
+            const Q_IPV6ADDR ip = address.toIPv6Address();
+            appendAttr(message, type, ip.c, sizeof(ip.c));
+        }
+    }
+
+    void setHeader(QByteArray &message, quint16 type, quint16 flags, quint32 seq)
+    {
+        nlmsghdr *header = reinterpret_cast<nlmsghdr *>(message.data());
+        header->nlmsg_len = message.size();
+        header->nlmsg_type = type;
+        header->nlmsg_flags = flags;
+        header->nlmsg_seq = seq;
+        header->nlmsg_pid = 0;
+    }
+
+    bool sendToKernel(int socket, const QByteArray &data)
+    {
+        sockaddr_nl kernel;
+        memset(&kernel, 0, sizeof(kernel));
+        kernel.nl_family = AF_NETLINK;
+
+        iovec iov;
+        iov.iov_base = const_cast<char *>(data.constData());
+        iov.iov_len = data.size();
+
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &kernel;
+        msg.msg_namelen = sizeof(kernel);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        return sendmsg(socket, &msg, 0) >= 0;
+    }
+
+    bool waitForData(int socket)
+    {
+        pollfd pfd;
+        pfd.fd = socket;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        return poll(&pfd, 1, ackTimeoutMsecs) > 0;
+    }
+}
+
+RtNetlinkBatch::RtNetlinkBatch()
+{
+    m_socket = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (m_socket < 0) {
+        qCritical().noquote() << "RtNetlinkBatch: can't open rtnetlink socket:" << strerror(errno);
+        return;
+    }
+
+    int size = socketBufferSize;
+    if (setsockopt(m_socket, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0) {
+        setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    setsockopt(m_socket, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+    // ACKs carry only the header of the request instead of a copy of the whole request
+    int enabled = 1;
+    setsockopt(m_socket, SOL_NETLINK, NETLINK_CAP_ACK, &enabled, sizeof(enabled));
+
+    m_buffer.reserve(maxBatchMessages * 128);
+}
+
+RtNetlinkBatch::~RtNetlinkBatch()
+{
+    if (m_socket >= 0) {
+        close(m_socket);
+    }
+}
+
+bool RtNetlinkBatch::isValid() const
+{
+    return m_socket >= 0;
+}
+
+void RtNetlinkBatch::addRoute(const QHostAddress &dst, int prefixLength, const QHostAddress &gw, quint32 table)
+{
+    // replacing keeps repeated additions of the same route from failing
+    appendRoute(RTM_NEWROUTE, NLM_F_CREATE | NLM_F_REPLACE, dst, prefixLength, gw, table);
+}
+
+void RtNetlinkBatch::deleteRoute(const QHostAddress &dst, int prefixLength, const QHostAddress &gw, quint32 table)
+{
+    appendRoute(RTM_DELROUTE, 0, dst, prefixLength, gw, table);
+}
+
+void RtNetlinkBatch::addRule(int family, quint32 priority, quint32 table, int suppressPrefixLength)
+{
+    appendRule(RTM_NEWRULE, NLM_F_CREATE | NLM_F_EXCL, family, priority, table, suppressPrefixLength);
+}
+
+void RtNetlinkBatch::deleteRule(int family, quint32 priority, quint32 table, int suppressPrefixLength)
+{
+    appendRule(RTM_DELRULE, 0, family, priority, table, suppressPrefixLength);
+}
+
+void RtNetlinkBatch::flushTable(quint32 table)
+{
+    // the kernel has no request for this, the routes of the table are dumped and deleted in batches like "ip route flush table" does
+    for (QByteArray &route : dumpRoutes(table)) {
+        setHeader(route, RTM_DELROUTE, NLM_F_REQUEST | NLM_F_ACK, ++m_seq);
+        appendMessage(route);
+    }
+}
+
+int RtNetlinkBatch::finish()
+{
+    send();
+    readAcks(true);
+    return m_succeeded;
+}
+
+bool RtNetlinkBatch::hasFailures() const
+{
+    return m_failed > 0;
+}
+
+void RtNetlinkBatch::appendRoute(quint16 type, quint16 flags, const QHostAddress &dst, int prefixLength, const QHostAddress &gw,
+                                 quint32 table)
+{
+    rtmsg rtm;
+    memset(&rtm, 0, sizeof(rtm));
+    rtm.rtm_family = dst.protocol() == QAbstractSocket::IPv6Protocol ? AF_INET6 : AF_INET;
+    rtm.rtm_dst_len = prefixLength;
+    rtm.rtm_table = table < 256 ? table : RT_TABLE_UNSPEC;
+    rtm.rtm_protocol = RTPROT_STATIC;
+    rtm.rtm_scope = type == RTM_DELROUTE ? RT_SCOPE_NOWHERE : RT_SCOPE_UNIVERSE;
+    rtm.rtm_type = RTN_UNICAST;
+
+    QByteArray message = newMessage(&rtm, sizeof(rtm));
+    appendAttr(message, RTA_TABLE, table);
+    appendAddressAttr(message, RTA_DST, dst);
+    if (!gw.isNull()) {
+        appendAddressAttr(message, RTA_GATEWAY, gw);
+    }
+
+    setHeader(message, type, NLM_F_REQUEST | NLM_F_ACK | flags, ++m_seq);
+    appendMessage(message);
+}
+
+void RtNetlinkBatch::appendRule(quint16 type, quint16 flags, int family, quint32 priority, quint32 table, int suppressPrefixLength)
+{
+    fib_rule_hdr rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.family = family;
+    rule.table = table < 256 ? table : RT_TABLE_UNSPEC;
+    rule.action = FR_ACT_TO_TBL;
+
+    QByteArray message = newMessage(&rule, sizeof(rule));
+    appendAttr(message, FRA_PRIORITY, priority);
+    appendAttr(message, FRA_TABLE, table);
+    if (suppressPrefixLength >= 0) {
+        appendAttr(message, FRA_SUPPRESS_PREFIXLEN, static_cast<quint32>(suppressPrefixLength));
+    }
+
+    setHeader(message, type, NLM_F_REQUEST | NLM_F_ACK | flags, ++m_seq);
+    appendMessage(message);
+}
+
+void RtNetlinkBatch::appendMessage(const QByteArray &message)
+{
+    m_buffer.append(message);
+    m_bufferedMessages++;
+    m_pendingAcks++;
+
+    if (m_bufferedMessages >= maxBatchMessages) {
+        send();
+    }
+}
+
+void RtNetlinkBatch::send()
+{
+    if (m_buffer.isEmpty() || !isValid()) {
+        return;
+    }
+
+    // the kernel handles the whole datagram within sendmsg(), the ACKs are queued by the time it returns
+    if (!sendToKernel(m_socket, m_buffer)) {
+        qCritical().noquote() << "RtNetlinkBatch: sendmsg failed:" << strerror(errno);
+        m_failed += m_bufferedMessages;
+        m_pendingAcks -= m_bufferedMessages;
+    }
+    m_buffer.clear();
+    m_bufferedMessages = 0;
+
+    readAcks(false);
+}
+
+void RtNetlinkBatch::readAcks(bool wait)
+{
+    QByteArray buffer(64 * 1024, Qt::Uninitialized);
+    while (m_pendingAcks > 0) {
+        if (wait && !waitForData(m_socket)) {
+            qWarning().noquote() << "RtNetlinkBatch: no ACK for" << m_pendingAcks << "requests";
+            break;
+        }
+
+        const ssize_t size = recv(m_socket, buffer.data(), buffer.size(), MSG_DONTWAIT);
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (!wait) {
+                    return;
+                }
+                continue;
+            }
+            // ENOBUFS means that ACKs were dropped, there is no way to tell which requests they belonged to
+            qCritical().noquote() << "RtNetlinkBatch: recv failed:" << strerror(errno);
+            break;
+        }
+
+        int length = size;
+        for (auto header = reinterpret_cast<const nlmsghdr *>(buffer.constData()); NLMSG_OK(header, length);
+             header = NLMSG_NEXT(header, length)) {
+            if (header->nlmsg_type != NLMSG_ERROR) {
+                continue;
+            }
+
+            const auto error = static_cast<const nlmsgerr *>(NLMSG_DATA(header));
+            m_pendingAcks--;
+            if (error->error == 0) {
+                m_succeeded++;
+            } else if (m_failed++ < maxLoggedErrors) {
+                qDebug().noquote() << "RtNetlinkBatch: request" << header->nlmsg_seq << "failed:" << strerror(-error->error);
+            }
+        }
+    }
+
+    m_failed += m_pendingAcks;
+    m_pendingAcks = 0;
+}
+
+QList<QByteArray> RtNetlinkBatch::dumpRoutes(quint32 table)
+{
+    QList<QByteArray> routes;
+    if (!isValid()) {
+        return routes;
+    }
+
+    // the replies of the dump must not be mixed with ACKs of queued requests
+    send();
+    readAcks(true);
+
+    rtmsg rtm;
+    memset(&rtm, 0, sizeof(rtm));
+    rtm.rtm_family = AF_UNSPEC;
+    QByteArray request = newMessage(&rtm, sizeof(rtm));
+    const quint32 seq = ++m_seq;
+    setHeader(request, RTM_GETROUTE, NLM_F_REQUEST | NLM_F_DUMP, seq);
+    if (!sendToKernel(m_socket, request)) {
+        qCritical().noquote() << "RtNetlinkBatch: can't dump routes:" << strerror(errno);
+        return routes;
+    }
+
+    QByteArray buffer(64 * 1024, Qt::Uninitialized);
+    while (waitForData(m_socket)) {
+        const ssize_t size = recv(m_socket, buffer.data(), buffer.size(), 0);
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qCritical().noquote() << "RtNetlinkBatch: can't dump routes:" << strerror(errno);
+            return routes;
+        }
+
+        int length = size;
+        for (auto header = reinterpret_cast<const nlmsghdr *>(buffer.constData()); NLMSG_OK(header, length);
+             header = NLMSG_NEXT(header, length)) {
+            if (header->nlmsg_seq != seq) {
+                continue;
+            }
+            if (header->nlmsg_type == NLMSG_DONE || header->nlmsg_type == NLMSG_ERROR) {
+                return routes;
+            }
+            if (header->nlmsg_type != RTM_NEWROUTE) {
+                continue;
+            }
+
+            const auto route = static_cast<const rtmsg *>(NLMSG_DATA(header));
+            quint32 routeTable = route->rtm_table;
+            int attrsLength = RTM_PAYLOAD(header);
+            for (auto attr = RTM_RTA(route); RTA_OK(attr, attrsLength); attr = RTA_NEXT(attr, attrsLength)) {
+                if (attr->rta_type == RTA_TABLE) {
+                    routeTable = *static_cast<const quint32 *>(RTA_DATA(attr));
+                }
+            }
+
+            if (routeTable == table) {
+                routes.append(QByteArray(reinterpret_cast<const char *>(header), header->nlmsg_len));
+            }
+        }
+    }
+    return routes;
+}
@@ -0,0 +1,53 @@
+#ifndef RTNETLINK_LINUX_H
+#define RTNETLINK_LINUX_H
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QList>
+
+/**
+ * @brief The RtNetlinkBatch class - sends routing requests to the kernel in batches
+ *
+ * Requests are packed into one buffer and many of them go to the kernel with a single sendmsg().
+ * Every request asks for an ACK, the ACKs are collected after each send without waiting
+ * for the individual requests, finish() waits for the rest and returns the number of succeeded requests.
+ */
+class RtNetlinkBatch
+{
+public:
+    RtNetlinkBatch();
+    ~RtNetlinkBatch();
+
+    bool isValid() const;
+
+    void addRoute(const QHostAddress &dst, int prefixLength, const QHostAddress &gw, quint32 table);
+    void deleteRoute(const QHostAddress &dst, int prefixLength, const QHostAddress &gw, quint32 table);
+    // lookup of the table for the given family, optionally ignoring routes with prefixes not longer than suppressPrefixLength
+    void addRule(int family, quint32 priority, quint32 table, int suppressPrefixLength = -1);
+    void deleteRule(int family, quint32 priority, quint32 table, int suppressPrefixLength = -1);
+    // queues the deletion of all the routes of the table, both IPv4 and IPv6
+    void flushTable(quint32 table);
+
+    int finish();
+    bool hasFailures() const;
+
+private:
+    void appendRoute(quint16 type, quint16 flags, const QHostAddress &dst, int prefixLength, const QHostAddress &gw, quint32 table);
+    void appendRule(quint16 type, quint16 flags, int family, quint32 priority, quint32 table, int suppressPrefixLength);
+    void appendMessage(const QByteArray &message);
+    void send();
+    void readAcks(bool wait);
+    QList<QByteArray> dumpRoutes(quint32 table);
+
+    static constexpr int maxBatchMessages = 256;
+
+    int m_socket = -1;
+    quint32 m_seq = 0;
+    QByteArray m_buffer;
+    int m_bufferedMessages = 0;
+    int m_pendingAcks = 0;
+    int m_succeeded = 0;
+    int m_failed = 0;
+};
+
+#endif // RTNETLINK_LINUX_H